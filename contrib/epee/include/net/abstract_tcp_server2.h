@@ -61,7 +61,9 @@
 #undef ARQMA_DEFAULT_LOG_CATEGORY
 #define ARQMA_DEFAULT_LOG_CATEGORY "net"
 
-#define ABSTRACT_SERVER_SEND_QUE_MAX_COUNT 1000
+#define ABSTRACT_SERVER_SEND_QUE_MAX_BYTES (32 * 1024 * 1024) // per priority class
+#define ABSTRACT_SERVER_SEND_QUE_WAIT_MS 5000
+#define ABSTRACT_SERVER_SEND_CHUNK_SIZE (64 * 1024)
 
 namespace epee
 {
@@ -134,7 +136,8 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb); ///< (see do_send from i_service_endpoint)
-    virtual bool do_send_chunk(const void* ptr, size_t cb); ///< will send (or queue) a part of data
+    virtual bool do_send_shared(const void* head, size_t head_cb, const shared_buffer& body, send_priority priority = send_priority_block); ///< (see do_send_shared from i_service_endpoint)
+    virtual bool do_send_frames(std::vector<send_que_entry>&& frames, send_priority priority = send_priority_block); ///< (see do_send_frames from i_service_endpoint)
     virtual bool send_done();
     virtual bool close();
     virtual bool call_run_once_service_io();
@@ -152,6 +155,12 @@ namespace net_utils
     /// Handle completion of a read operation.
     void handle_read(const boost::system::error_code& e, std::size_t bytes_transferred);
 
+    /// Start writing the next part of the send queue, m_send_que_lock must be held.
+    void start_write();
+
+    /// Handle the end of a delay before a write, from the upload limit.
+    void handle_send_timer(const boost::system::error_code& e);
+
     /// Handle completion of a write operation.
     void handle_write(const boost::system::error_code& e, size_t cb);
 
@@ -176,7 +185,6 @@ namespace net_utils
     size_t m_reference_count = 0; // reference count managed through add_ref/release support
     boost::shared_ptr<connection<t_protocol_handler>> m_self_ref; // the reference to hold
     critical_section m_self_refs_lock;
-    critical_section m_chunking_lock; // held while we add small chunks of the big do_send() to small do_send_chunk()
     critical_section m_shutdown_lock; // held while shutting down
 
     t_connection_type m_connection_type;
@@ -188,6 +196,7 @@ namespace net_utils
     boost::mutex m_throttle_speed_out_mutex;
 
     boost::asio::deadline_timer m_timer;
+    boost::asio::deadline_timer m_send_timer; // delays writes over the upload limit
     bool m_local;
     bool m_ready_to_close;
     std::string m_host;
@@ -231,6 +240,14 @@ namespace net_utils
     // Run the server's io_service loop.
     bool run_server(size_t threads_count, bool wait = true, const boost::thread::attributes& attrs = boost::thread::attributes());
 
+    // Give each server thread its own io_service, must be called before run_server.
+    // Connections are spread round-robin over them, and each connection then
+    // only ever runs on its own thread. The acceptor, idle handlers and async
+    // calls stay on get_io_service(), which is run by the first thread.
+    void set_io_service_per_thread(bool per_thread) { m_io_service_per_thread = per_thread; }
+
+    bool is_io_service_per_thread() const noexcept { return m_io_service_per_thread; }
+
     // wait for service workers stop
     bool timed_wait_server_stop(uint64_t wait_mseconds);
 
@@ -332,8 +349,10 @@ namespace net_utils
     }
 
   private:
-    // Run the server's io_service loop.
-    bool worker_thread();
+    // Run the given io_service loop.
+    bool worker_thread(boost::asio::io_service& io_service);
+    // The io_service for the next new connection.
+    boost::asio::io_service& next_io_service();
     // Handle completion of an asynchronous accept operation.
     void handle_accept(const boost::system::error_code& e);
 
@@ -354,6 +373,12 @@ namespace net_utils
     std::unique_ptr<worker> m_io_service_local_instance;
     boost::asio::io_service& io_service_;
 
+    // Extra io_services in io_service per thread mode, one per thread but the first.
+    // Declared before the connections so their sockets are closed first.
+    bool m_io_service_per_thread;
+    std::vector<std::unique_ptr<worker>> m_thread_io_services;
+    std::atomic<size_t> m_next_io_service;
+
     // Acceptor used to listen for incoming connections.
     boost::asio::ip::tcp::acceptor acceptor_;
     epee::net_utils::network_address default_remote;
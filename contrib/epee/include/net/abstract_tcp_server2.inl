@@ -102,6 +102,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
                 m_throttle_speed_in("speed_in", "throttle_speed_in"),
                 m_throttle_speed_out("speed_out", "throttle_speed_out"),
                 m_timer(GET_IO_SERVICE(socket_)),
+                m_send_timer(GET_IO_SERVICE(socket_)),
                 m_local(false),
                 m_ready_to_close(false)
   {
@@ -492,91 +493,38 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     auto self = safe_shared_from_this();
     if(!self) return false;
     if(m_was_shutdown) return false;
-    // TODO avoid copy
 
-    const double factor = 32; // TODO config
-    typedef long long signed int t_safe; // my t_size to avoid any overunderflow in arithmetic
-    const t_safe chunksize_good = (t_safe)( 1024 * std::max(1.0,factor) );
-    const t_safe chunksize_max = chunksize_good * 2 ;
-    const bool allow_split = (m_connection_type == e_connection_type_RPC) ? false : true; // do not split RPC data
-
-    CHECK_AND_ASSERT_MES(!(chunksize_max < 0), false, "Negative chunksize_max" ); // make sure it is unsigned before removin sign with cast:
-    long long unsigned int chunksize_max_unsigned = static_cast<long long unsigned int>( chunksize_max ) ;
-
-    if(allow_split && (cb > chunksize_max_unsigned))
-    {
-      { // LOCK: chunking
-        epee::critical_region_t<decltype(m_chunking_lock)> send_guard(m_chunking_lock); // *** critical ***
-
-        MDEBUG("do_send() will SPLIT into small chunks, from packet= " << cb << " B for ptr= " << ptr);
-        t_safe all = cb; // all bytes to send
-        t_safe pos = 0; // current sending position
-        // 01234567890
-        // ^^^^        (pos=0, len=4)     ;   pos:=pos+len, pos=4
-        //     ^^^^    (pos=4, len=4)     ;   pos:=pos+len, pos=8
-        //         ^^^ (pos=8, len=4)    ;
-        // const size_t bufsize = chunksize_good; // TODO safecast
-        // char* buf = new char[ bufsize ];
-
-        bool all_ok = true;
-        while(pos < all)
-        {
-          t_safe lenall = all-pos; // length from here to end
-          t_safe len = std::min(chunksize_good, lenall); // take a smaller part
-          CHECK_AND_ASSERT_MES(len<=chunksize_good, false, "len too large");
-          // pos=8; len=4; all=10;	len=3;
-
-          CHECK_AND_ASSERT_MES(!(len < 0), false, "negative len"); // check before we cast away sign:
-          unsigned long long int len_unsigned = static_cast<long long int>( len );
-          CHECK_AND_ASSERT_MES(len > 0, false, "len not strictly positive"); // (redundant)
-          CHECK_AND_ASSERT_MES(len_unsigned < std::numeric_limits<size_t>::max(), false, "Invalid len_unsigned");   // yeap we want strong < then max size, to be sure
-
-          void *chunk_start = ((char*)ptr) + pos;
-          MDEBUG("chunk_start= " << chunk_start << " ptr= " << ptr << " pos= " << pos);
-          CHECK_AND_ASSERT_MES(chunk_start >= ptr, false, "Pointer wraparound"); // not wrapped around address?
-          //std::memcpy( (void*)buf, chunk_start, len);
-
-          MDEBUG("part of " << lenall << ": pos= " << pos << " len=" << len);
-
-          bool ok = do_send_chunk(chunk_start, len); // <====== ***
-
-          all_ok = all_ok && ok;
-          if(!all_ok)
-          {
-            MDEBUG("do_send() DONE ***FAILED*** from packet= " << cb << " B for ptr= " << ptr);
-            MDEBUG("do_send() SEND was aborted in middle of big package - this is mostly harmless " << " (e.g. peer closed connection) but if it causes trouble tell us. " << cb);
-            return false; // partial failure in sending
-          }
-          pos = pos+len;
-          CHECK_AND_ASSERT_MES(pos > 0, false, "pos <= 0");
-
-          // (in catch block, or uniq pointer) delete buf;
-        } // each chunk
-
-        MDEBUG("do_send() DONE SPLIT from packet= " << cb << " B for ptr= " << ptr);
-        MDEBUG("do_send() m_connection_type = " << m_connection_type);
-
-        return all_ok; // done - e.g. queued - all the chunks of current do_send call
-      } // LOCK: chunking
-    } // a big block (to be chunked) - all chunks
-    else { // small block
-      return do_send_chunk(ptr,cb); // just send as 1 big chunk
-    }
+    // copied once here, the chunks below all share it
+    return do_send_shared(nullptr, 0, shared_buffer(epee::span<const uint8_t>((const uint8_t*)ptr, cb)));
 
     CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
   } // do_send()
-
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool connection<t_protocol_handler>::do_send_chunk(const void* ptr, size_t cb)
+  bool connection<t_protocol_handler>::do_send_shared(const void* head, size_t head_cb, const shared_buffer& body, send_priority priority)
+  {
+    // the message is queued whole, start_write splits it into writes
+    std::vector<send_que_entry> frames(1);
+    frames.front().head.assign((const char*)head, head_cb);
+    frames.front().body = body;
+    return do_send_frames(std::move(frames), priority);
+  } // do_send_shared()
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send_frames(std::vector<send_que_entry>&& frames, send_priority priority)
   {
     TRY_ENTRY();
+
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
     auto self = safe_shared_from_this();
-    if(!self)
-      return false;
-    if(m_was_shutdown)
-      return false;
+    if(!self) return false;
+    if(m_was_shutdown) return false;
+    CHECK_AND_ASSERT_MES(priority < send_priority_count, false, "Invalid send priority " << priority);
+    size_t cb = 0;
+    for(const send_que_entry& frame: frames)
+      cb += frame.size();
+    if(!cb) return true;
+
     double current_speed_up;
     {
       CRITICAL_REGION_LOCAL(m_throttle_speed_out_mutex);
@@ -589,79 +537,105 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     //_info("[sock " << socket().native_handle() << "] SEND " << cb);
     context.m_last_send = time(NULL);
     context.m_send_cnt += cb;
-    //some data should be wrote to stream
-    //request complete
-
-    // No sleeping here; sleeping is done once and for all in "handle_write"
 
     m_send_que_lock.lock(); // *** critical ***
     epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){m_send_que_lock.unlock();});
 
-    long int retry = 0;
-    const long int retry_limit = (5 * 4);
-    while (m_send_que.size() > ABSTRACT_SERVER_SEND_QUE_MAX_COUNT)
+    // Producers wait for room in the class of their message. A message bigger than
+    // the bound still goes in once its class is empty. RPC response bodies are
+    // written off the strand (see http_protocol_handler), so they wait here too.
+    const auto no_room = [&]() -> bool
     {
-        retry++;
-
-        /* if ( ::cryptonote::core::get_is_stopping() ) { // TODO re-add fast stop
-            _fact("ABORT queue wait due to stopping");
-            return false; // aborted
-        }*/
-
-        long int ms = 250 + (rand()%50);
-        MDEBUG("Sleeping because QUEUE is FULL, in " << __FUNCTION__ << " for " << ms << " ms before packet_size= " << cb); // XXX debug sleep
-        m_send_que_lock.unlock();
-        boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
-        m_send_que_lock.lock();
-        _dbg1("sleep for queue: " << ms);
-
-        if(retry > retry_limit)
+      const size_t queued = m_send_que.bytes(priority);
+      return !m_was_shutdown && queued != 0 && queued + cb > ABSTRACT_SERVER_SEND_QUE_MAX_BYTES;
+    };
+    if(no_room())
+    {
+      // writes complete on this strand, waiting on it would never make room. In
+      // io_service per thread mode, neither would waiting on the only thread
+      // running it, eg when relaying from another connection on that thread
+      if(strand_.running_in_this_thread() || runs_on_this_thread_only())
+      {
+        MWARNING(context << "send queue is more than ABSTRACT_SERVER_SEND_QUE_MAX_BYTES(" << ABSTRACT_SERVER_SEND_QUE_MAX_BYTES << ") for priority " << priority << ", shutting down connection");
+        shutdown();
+        return false;
+      }
+      MDEBUG(context << "Waiting because QUEUE is FULL for priority " << priority << ", before packet_size= " << cb);
+      // the wait is bounded while the peer reads nothing, not while it reads slowly
+      auto deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(ABSTRACT_SERVER_SEND_QUE_WAIT_MS);
+      size_t queued = m_send_que.bytes(priority);
+      while(no_room())
+      {
+        const bool timed_out = m_send_que_cond.wait_until(m_send_que_lock, deadline) == boost::cv_status::timeout;
+        if(m_send_que.bytes(priority) < queued)
         {
-            MWARNING("send que size is more than ABSTRACT_SERVER_SEND_QUE_MAX_COUNT(" << ABSTRACT_SERVER_SEND_QUE_MAX_COUNT << "), shutting down connection");
-            shutdown();
-            return false;
+          queued = m_send_que.bytes(priority);
+          deadline = boost::chrono::steady_clock::now() + boost::chrono::milliseconds(ABSTRACT_SERVER_SEND_QUE_WAIT_MS);
         }
+        else if(timed_out && no_room())
+        {
+          MWARNING(context << "send queue is more than ABSTRACT_SERVER_SEND_QUE_MAX_BYTES(" << ABSTRACT_SERVER_SEND_QUE_MAX_BYTES << ") for priority " << priority << ", shutting down connection");
+          shutdown();
+          return false;
+        }
+      }
     }
+    if(m_was_shutdown)
+      return false;
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
+    // the frames go in together, so other messages of the class can not come between them
+    for(send_que_entry& frame: frames)
+      if(frame.size())
+        m_send_que.push(std::move(frame), priority);
 
-    if(m_send_que.size() > 1)
+    if(m_send_que.writing())
     { // active operation should be in progress, nothing to do, just wait last operation callback
-        auto size_now = cb;
-        MDEBUG("do_send_chunk() NOW just queues: packet=" << size_now << " B, is added to queue-size=" << m_send_que.size());
-        //do_send_handler_delayed( ptr , size_now ); // (((H))) // empty function
-
-      LOG_TRACE_CC(context, "[sock " << socket().native_handle() << "] Async send requested " << m_send_que.front().size());
+      MDEBUG("do_send_frames() NOW just queues: packet=" << cb << " B in " << frames.size() << " frames, priority=" << priority << ", is added to queue-size=" << m_send_que.size());
     }
     else
     { // no active operation
-
-        if(m_send_que.size() != 1)
-        {
-            _erro("Looks like no active operations, but send que size != 1!!");
-            return false;
-        }
-
-        auto size_now = m_send_que.front().size();
-        MDEBUG("do_send_chunk() NOW SENSD: packet=" << size_now <<" B");
-        if(rpc_speed_limit_is_enabled())
-        do_send_handler_write(ptr, size_now); // (((H)))
-
-        CHECK_AND_ASSERT_MES(size_now == m_send_que.front().size(), false, "Unexpected queue size");
-        reset_timer(get_default_timeout(), false);
-        async_write(boost::asio::buffer(m_send_que.front().data(), size_now), strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2)));
-        //_dbg3("(chunk): " << size_now);
-        //logger_handle_net_write(size_now);
-        //_info("[sock " << socket().native_handle() << "] Async send requested " << m_send_que.front().size());
+      start_write();
     }
 
-    //do_send_handler_stop( ptr , cb ); // empty function
-
     return true;
 
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send_chunk", false);
-  } // do_send_chunk
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send_frames", false);
+  } // do_send_frames()
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_write()
+  {
+    // messages go out in parts, so the timeout is reset, the upload limit applied
+    // and room made for waiting producers as a big message is written
+    const size_t size_now = boost::asio::buffer_size(m_send_que.start_write(ABSTRACT_SERVER_SEND_CHUNK_SIZE));
+    MDEBUG("start_write() NOW SENDS: packet=" << size_now << " B, from queue size=" << m_send_que.size());
+    reset_timer(get_default_timeout(), false);
+
+    if(rpc_speed_limit_is_enabled())
+    {
+      const double delay = get_send_delay(size_now);
+      if(delay > 0)
+      {
+        m_send_timer.expires_from_now(boost::posix_time::microseconds((int64_t)(delay * 1000000)));
+        m_send_timer.async_wait(strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_send_timer, connection<t_protocol_handler>::shared_from_this(), _1)));
+        return;
+      }
+    }
+
+    async_write(m_send_que.write_buffers(), strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)));
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::handle_send_timer(const boost::system::error_code& e)
+  {
+    TRY_ENTRY();
+    if(e || m_was_shutdown)
+      return;
+    CRITICAL_REGION_LOCAL(m_send_que_lock);
+    reset_timer(get_default_timeout(), false);
+    async_write(m_send_que.write_buffers(), strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)));
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_send_timer", void());
+  }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   boost::posix_time::milliseconds connection<t_protocol_handler>::get_default_timeout()
@@ -735,6 +709,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     m_was_shutdown = true;
     // Initiate graceful connection closure.
     m_timer.cancel();
+    m_send_timer.cancel();
     boost::system::error_code ignored_ec;
     if(m_ssl_support == epee::net_utils::ssl_support_t::e_ssl_support_enabled)
     {
@@ -749,6 +724,10 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       m_host = "";
     }
     CRITICAL_REGION_END();
+    // wake producers waiting for room in the send queue
+    CRITICAL_REGION_BEGIN(m_send_que_lock);
+    m_send_que_cond.notify_all();
+    CRITICAL_REGION_END();
     m_protocol_handler.release_protocol();
     return true;
   }
@@ -805,21 +784,16 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }
     logger_handle_net_write(cb);
 
-    // The single sleeping that is needed for correctly handling "out" speed throttling
-    if(rpc_speed_limit_is_enabled())
-    {
-      sleep_before_packet(cb, 1, 1);
-    }
-
     bool do_shutdown = false;
     CRITICAL_REGION_BEGIN(m_send_que_lock);
-    if(m_send_que.empty())
+    if(!m_send_que.writing())
     {
-      _erro("[sock " << socket().native_handle() << "] m_send_que.size() == 0 at handle_write!");
+      _erro("[sock " << socket().native_handle() << "] no write in progress at handle_write!");
       return;
     }
 
-    m_send_que.pop_front();
+    m_send_que.finish_write();
+    m_send_que_cond.notify_all();
     if(m_send_que.empty())
     {
       if(boost::interprocess::ipcdetail::atomic_read32(&m_want_close_connection))
@@ -829,15 +803,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     }
     else
     {
-    //have more data to send
-    reset_timer(get_default_timeout(), false);
-    auto size_now = m_send_que.front().size();
-    MDEBUG("handle_write() NOW SENDS: packet=" << size_now << " B" << ", from  queue size=" << m_send_que.size());
-    if (rpc_speed_limit_is_enabled())
-      do_send_handler_write_from_queue(e, m_send_que.front().size(), m_send_que.size()); // (((H)))
-    CHECK_AND_ASSERT_MES(size_now == m_send_que.front().size(), void(), "Unexpected queue size");
-    async_write(boost::asio::buffer(m_send_que.front().data(), size_now), strand_.wrap(boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2)));
-      //_dbg3("(normal)" << size_now);
+      //have more data to send
+      start_write();
     }
     CRITICAL_REGION_END();
 
@@ -883,6 +850,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     : m_state(boost::make_shared<typename connection<t_protocol_handler>::shared_state>()),
       m_io_service_local_instance(new worker()),
       io_service_(m_io_service_local_instance->io_service),
+      m_io_service_per_thread(false),
+      m_next_io_service(0),
       acceptor_(io_service_),
       default_remote(),
       m_stop_signal_sent(false),
@@ -900,6 +869,8 @@ PRAGMA_WARNING_DISABLE_VS(4355)
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server(boost::asio::io_service& extarnal_io_service, t_connection_type connection_type)
     : m_state(boost::make_shared<typename connection<t_protocol_handler>::shared_state>()),
       io_service_(extarnal_io_service),
+      m_io_service_per_thread(false),
+      m_next_io_service(0),
       acceptor_(io_service_),
       default_remote(),
       m_stop_signal_sent(false),
@@ -949,7 +920,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
     m_port = binded_endpoint.port();
     MDEBUG("start accept");
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, m_state->ssl_options().support));
+    new_connection_.reset(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, m_state->ssl_options().support));
     acceptor_.async_accept(new_connection_->socket(), boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this, boost::asio::placeholders::error));
 
     return true;
@@ -982,19 +953,20 @@ DISABLE_GCC_WARNING(maybe-uninitialized)
 POP_WARNINGS
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool boosted_tcp_server<t_protocol_handler>::worker_thread()
+  bool boosted_tcp_server<t_protocol_handler>::worker_thread(boost::asio::io_service& io_service)
   {
     TRY_ENTRY();
     uint32_t local_thr_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index);
     std::string thread_name = std::string("[") + m_thread_name_prefix;
     thread_name += boost::to_string(local_thr_index) + "]";
     MLOG_SET_THREAD_NAME(thread_name);
+    connection_basic::set_thread_io_service(m_io_service_per_thread ? &io_service : NULL);
     //   _fact("Thread name: " << m_thread_name_prefix);
     while(!m_stop_signal_sent)
     {
       try
       {
-        io_service_.run();
+        io_service.run();
         return true;
       }
       catch(const std::exception& ex)
@@ -1035,6 +1007,13 @@ POP_WARNINGS
     m_threads_count = threads_count;
     m_main_thread_id = boost::this_thread::get_id();
     MLOG_SET_THREAD_NAME("[SRV_MAIN]");
+    if(m_io_service_per_thread)
+    {
+      CRITICAL_REGION_LOCAL(m_threads_lock);
+      while(m_thread_io_services.size() + 1 < threads_count)
+        m_thread_io_services.emplace_back(new worker());
+      MINFO("Running " << m_thread_io_services.size() + 1 << " io_services, one per thread");
+    }
     while(!m_stop_signal_sent)
     {
 
@@ -1042,7 +1021,8 @@ POP_WARNINGS
       CRITICAL_REGION_BEGIN(m_threads_lock);
       for(std::size_t i = 0; i < threads_count; ++i)
       {
-        boost::shared_ptr<boost::thread> thread(new boost::thread(attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this)));
+        boost::asio::io_service& io_service = (i == 0 || i > m_thread_io_services.size()) ? io_service_ : m_thread_io_services[i - 1]->io_service;
+        boost::shared_ptr<boost::thread> thread(new boost::thread(attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this, boost::ref(io_service))));
         _note("Run server thread name: " << m_thread_name_prefix);
         m_threads.push_back(thread);
       }
@@ -1132,10 +1112,21 @@ POP_WARNINGS
     connections_.clear();
     connections_mutex.unlock();
     io_service_.stop();
+    for (auto &w: m_thread_io_services)
+      w->io_service.stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::next_io_service()
+  {
+    if(m_thread_io_services.empty())
+      return io_service_;
+    const size_t index = m_next_io_service++ % (m_thread_io_services.size() + 1);
+    return index == 0 ? io_service_ : m_thread_io_services[index - 1]->io_service;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   void boosted_tcp_server<t_protocol_handler>::handle_accept(const boost::system::error_code& e)
   {
     MDEBUG("handle_accept");
@@ -1156,7 +1147,7 @@ POP_WARNINGS
         new_connection_->setRpcStation(); // hopefully this is not needed actually
       }
       connection_ptr conn(std::move(new_connection_));
-      new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, conn->get_ssl_support()));
+      new_connection_.reset(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, conn->get_ssl_support()));
       acceptor_.async_accept(new_connection_->socket(), boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this, boost::asio::placeholders::error));
 
       boost::asio::socket_base::keep_alive opt(true);
@@ -1189,7 +1180,7 @@ POP_WARNINGS
     assert(m_state != nullptr); // always set in constructor
     _erro("Some problems at accept: " << e.message() << ", connections_count = " << m_state->sock_count);
     misc_utils::sleep_no_w(100);
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, new_connection_->get_ssl_support()));
+    new_connection_.reset(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, new_connection_->get_ssl_support()));
     acceptor_.async_accept(new_connection_->socket(), boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this, boost::asio::placeholders::error));
   }
   //---------------------------------------------------------------------------------
@@ -1316,7 +1307,7 @@ POP_WARNINGS
   {
     TRY_ENTRY();
 
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, ssl_support) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, ssl_support) );
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1379,7 +1370,7 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, const t_callback &cb, const std::string& bind_ip, ssl_support_t ssl_support)
   {
     TRY_ENTRY();
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_state, m_connection_type, ssl_support) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(next_io_service(), m_state, m_connection_type, ssl_support) );
     connections_mutex.lock();
     connections_.insert(new_connection_l);
     MDEBUG("connections_ size now " << connections_.size());
@@ -1415,7 +1406,7 @@ POP_WARNINGS
       }
     }
 
-    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service_));
+    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(GET_IO_SERVICE(sock_)));
     //start deadline
     sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
     sh_deadline->async_wait([=](const boost::system::error_code& error)
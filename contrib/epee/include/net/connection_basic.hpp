@@ -43,15 +43,19 @@
 #define INCLUDED_p2p_connection_basic_hpp
 
 
+#include <array>
+#include <deque>
 #include <string>
 #include <atomic>
 #include <memory>
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
+#include <boost/thread/condition_variable.hpp>
 
 #include "net/net_utils_base.h"
 #include "net/net_ssl.h"
+#include "shared_buffer.h"
 #include "syncobj.h"
 
 namespace epee
@@ -98,6 +102,69 @@ class connection_basic_pimpl; // PIMPL for this class
 
   std::string to_string(t_connection_type type);
 
+  /// Outgoing frames of a connection, in one FIFO per priority class.
+  /// A frame is written out whole before the next one is picked, so frames
+  /// never interleave; the next one is the oldest of the most urgent class.
+  /// A message the sender split into several frames (eg, a fragmented levin
+  /// notification) thus lets more urgent ones out between its frames.
+  /// Not thread safe, the connection guards it with m_send_que_lock.
+  class send_queue
+  {
+  public:
+    typedef std::array<boost::asio::const_buffer, 2> buffers_t;
+
+    send_queue();
+
+    void push(send_que_entry&& entry, send_priority priority);
+
+    //! \return true if there is nothing left to write
+    bool empty() const noexcept { return !m_have_current && m_count == 0; }
+    //! \return true while a write started by start_write is in progress
+    bool writing() const noexcept { return m_write_size != 0; }
+    //! \return number of frames not fully written yet
+    size_t size() const noexcept { return m_count + (m_have_current ? 1 : 0); }
+    //! \return bytes not written yet in a class, the partly written frame included
+    size_t bytes(send_priority priority) const noexcept { return m_bytes[priority]; }
+
+    //! Picks the next frame if none is partly written, and starts a write of at most `max_size` bytes of it
+    buffers_t start_write(size_t max_size);
+    //! \return the buffers of the write in progress
+    buffers_t write_buffers() const;
+    //! The write in progress is done
+    void finish_write();
+
+  private:
+    std::deque<send_que_entry> m_queues[send_priority_count];
+    size_t m_bytes[send_priority_count];
+    size_t m_count;
+    send_que_entry m_current;
+    send_priority m_current_priority;
+    bool m_have_current;
+    size_t m_offset;
+    size_t m_write_size;
+  };
+
+  /// Rate limiter: takes are paid from tokens coming in at `rate` bytes per second,
+  /// up to `burst` seconds worth are saved while idle. A take may run the bucket
+  /// into debt, later takes wait until it is paid back.
+  class token_bucket
+  {
+  public:
+    explicit token_bucket(double burst = 1.0);
+
+    void set_rate(double rate);
+    double get_rate() const noexcept { return m_rate; }
+
+    //! Takes `bytes` tokens at time `now` (in seconds). \return seconds to wait before sending them, 0 if they were there
+    double take(size_t bytes, double now);
+
+  private:
+    double m_rate;
+    double m_burst;
+    double m_tokens;
+    double m_last;
+  };
+
 class connection_basic { // not-templated base class for rapid developmet of some code parts
   // beware of removing const, net_utils::connection is sketchily doing a cast to prevent storing ptr twice
   const boost::shared_ptr<connection_basic_shared_state> m_state;
@@ -108,7 +175,9 @@ class connection_basic { // not-templated base class for rapid developmet of som
   volatile uint32_t m_want_close_connection;
   std::atomic<bool> m_was_shutdown;
   critical_section m_send_que_lock;
-  std::list<std::string> m_send_que;
+  boost::condition_variable_any m_send_que_cond; // signalled when the queue shrinks, for producers waiting for room
+  send_queue m_send_que;
+  token_bucket m_send_bucket; // this connection's share of the upload limit, guarded by m_send_que_lock
   volatile bool m_is_multithreaded;
   /// Strand to ensure the connection's handlers are not called concurrently.
   boost::asio::io_service::strand strand_;
@@ -181,12 +250,17 @@ class connection_basic { // not-templated base class for rapid developmet of som
       static void set_tos_flag(int tos); // ToS / QoS flag
       static int get_tos_flag();
 
-      // handlers and sleep
-      void sleep_before_packet(size_t packet_size, int phase, int q_len); // execute a sleep ; phase is not really used now(?)
+      // rate limiting
+      double get_send_delay(size_t packet_size); // takes packet_size bytes from this connection's share of the upload limit, returns the seconds to wait before writing them
       static void save_limit_to_file(int limit); ///< for dr-arqma
       static double get_sleep_time(size_t cb);
 
       static void set_save_graph(bool save_graph);
+
+      // io_service per thread mode: the io_service the calling thread alone runs, or NULL
+      static void set_thread_io_service(boost::asio::io_service* io_service);
+      //! \return true if the calling thread is the only one running this connection's handlers
+      bool runs_on_this_thread_only();
 };
 
 } // nameserver
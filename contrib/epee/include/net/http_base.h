@@ -30,9 +30,11 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 #include <boost/utility/string_ref.hpp>
+#include <functional>
 #include <string>
 #include <utility>
 
+#include "shared_buffer.h"
 #include "string_tools.h"
 
 #undef ARQMA_DEFAULT_LOG_CATEGORY
@@ -65,6 +67,11 @@ namespace net_utils
 
 		typedef std::list<std::pair<std::string, std::string> > fields_list;
 
+		//! takes the next piece of a response body, false if it can not be sent
+		typedef std::function<bool(shared_buffer&&)> body_chunk_sink;
+		//! writes a response body piece by piece, false on failure
+		typedef std::function<bool(const body_chunk_sink&)> body_writer;
+
 		inline
 		std::string get_value_from_fields_list(const std::string& param_name, const net_utils::http::fields_list& fields)
 		{
@@ -190,6 +197,7 @@ namespace net_utils
 			std::string			m_response_comment;
 			fields_list	        m_additional_fields;
 			std::string			m_body;
+			body_writer			m_body_writer; // if set, writes the body when the response is sent, instead of m_body
 			std::string			m_mime_tipe;
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
@@ -31,11 +31,14 @@
 #define _HTTP_SERVER_H_
 
 #include <boost/optional/optional.hpp>
+#include <atomic>
+#include <memory>
 #include <string>
 #include "net_utils_base.h"
 #include "to_nonconst_iterator.h"
 #include "http_auth.h"
 #include "http_base.h"
+#include "syncobj.h"
 
 #undef ARQMA_DEFAULT_LOG_CATEGORY
 #define ARQMA_DEFAULT_LOG_CATEGORY "net.http"
@@ -92,6 +95,8 @@ namespace net_utils
 			}
 			virtual bool handle_recv(const void* ptr, size_t cb);
 			virtual bool handle_request(const http::http_request_info& query_info, http_response_info& response);
+			//! picks up the requests read while a response body was written on its own thread
+			void handle_qued_callback();
 
 		private:
 			enum machine_state{
@@ -125,9 +130,15 @@ namespace net_utils
 			bool slash_to_back_slash(std::string& str);
 			std::string get_file_mime_tipe(const std::string& path);
 			std::string get_response_header(const http_response_info& response);
+			//! the header lines after the body length, some of which depend on the request
+			std::string get_response_fields(const http_response_info& response);
+			static std::string get_response_header(const http_response_info& response, const std::string& fields, size_t body_size);
 
 			//major function
 			inline bool handle_request_and_send_response(const http::http_request_info& query_info);
+			//! \return true if the response is being sent by a thread of its own, else the body is left in response.m_body
+			bool send_response_in_chunks(const http::http_request_info& query_info, http_response_info& response);
+			void write_response_body(const std::shared_ptr<http_response_info>& response, const std::string& fields);
 
 
 			std::string get_not_found_response_body(const std::string& URI);
@@ -142,6 +153,8 @@ namespace net_utils
 			config_type& m_config;
 			bool m_want_close;
 			size_t m_newlines;
+			std::atomic<bool> m_writing_body; // a response body is being written on its own thread
+			bool m_write_failed;
 		protected:
 			i_service_endpoint* m_psnd_hndlr;
 			t_connection_context& m_conn_context;
@@ -209,8 +222,6 @@ namespace net_utils
 			{
 				return m_config.m_phandler->deinit_server_thread();
 			}
-			void handle_qued_callback()
-			{}
 			bool after_init_connection()
 			{
 				return true;
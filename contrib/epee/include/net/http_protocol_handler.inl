@@ -27,6 +27,7 @@
 
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
 #include "http_protocol_handler.h"
 #include "reg_exp_definer.h"
 #include "string_tools.h"
@@ -40,6 +41,7 @@
 #define HTTP_MAX_URI_LEN		 9000
 #define HTTP_MAX_HEADER_LEN		 100000
 #define HTTP_MAX_STARTING_NEWLINES       8
+#define HTTP_MAX_PENDING_LEN		 (10 * HTTP_MAX_HEADER_LEN)
 
 namespace epee
 {
@@ -206,6 +208,8 @@ namespace net_utils
 		m_config(config),
 		m_want_close(false),
 		m_newlines(0),
+		m_writing_body(false),
+		m_write_failed(false),
 		m_psnd_hndlr(psnd_hndlr),
 		m_conn_context(conn_context)
 	{
@@ -232,11 +236,37 @@ namespace net_utils
 		//file_io_utils::save_string_to_file(string_tools::get_current_module_folder() + "/" + boost::lexical_cast<std::string>(ptr), std::string((const char*)ptr, cb));
 
 		bool res = handle_buff_in(buf);
+		if(m_writing_body)
+		{
+			// the connection is closed once the body is sent, if it has to be
+			if(m_cache.size() > HTTP_MAX_PENDING_LEN)
+			{
+				LOG_ERROR_CC(m_conn_context, "simple_http_connection_handler::handle_recv: Too much data sent ahead of the response");
+				return false;
+			}
+			return true;
+		}
 		if(m_want_close/*m_state == http_state_connection_close || m_state == http_state_error*/)
 			return false;
 		return res;
 	}
 	//--------------------------------------------------------------------------------------------
+  template<class t_connection_context>
+	void simple_http_connection_handler<t_connection_context>::handle_qued_callback()
+	{
+		if(m_writing_body)
+			return;
+		m_psnd_hndlr->send_done();
+		if(m_write_failed || m_want_close)
+		{
+			m_psnd_hndlr->close();
+			return;
+		}
+		std::string none;
+		if(!handle_buff_in(none) || (m_want_close && !m_writing_body))
+			m_psnd_hndlr->close();
+	}
+	//--------------------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_buff_in(std::string& buf)
 	{
@@ -248,8 +278,9 @@ namespace net_utils
 		else
 			m_cache.swap(buf);
 
+		// requests are answered in order, so the next waits for the body being written
 		m_is_stop_handling = false;
-		while(!m_is_stop_handling)
+		while(!m_is_stop_handling && !m_writing_body)
 		{
 			switch(m_state)
 			{
@@ -360,7 +391,7 @@ namespace net_utils
 		boost::smatch result;
 		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
 		{
-			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi))
+			if (!analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_lo))
 			{
 				m_state = http_state_error;
 				MERROR("Failed to analyze method");
@@ -584,18 +615,153 @@ namespace net_utils
 			response.m_response_comment = "OK";
 		}
 
+		if (response.m_body_writer && send_response_in_chunks(query_info, response))
+			return res;
+
 		std::string response_data = get_response_header(response);
 		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
 
     LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
 
-		m_psnd_hndlr->do_send((void*)response_data.data(), response_data.size());
-		if ((response.m_body.size() && (query_info.m_http_method != http::http_method_head)) || (query_info.m_http_method == http::http_method_options))
-			m_psnd_hndlr->do_send((void*)response.m_body.data(), response.m_body.size());
+		if (query_info.m_http_method == http::http_method_head)
+			response.m_body.clear();
+		m_psnd_hndlr->do_send_shared(response_data.data(), response_data.size(), shared_buffer(std::move(response.m_body)));
 		m_psnd_hndlr->send_done();
 		return res;
 	}
 	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_response_in_chunks(const http::http_request_info& query_info, http_response_info& response)
+	{
+		// HEAD and HTTP/1.0 requests get the whole body collected here
+		const bool can_chunk = query_info.m_http_method != http::http_method_head &&
+			(query_info.m_http_ver_hi > 1 || (query_info.m_http_ver_hi == 1 && query_info.m_http_ver_lo >= 1));
+		if (!can_chunk)
+		{
+			bool r = false;
+			try
+			{
+				r = response.m_body_writer([&response](shared_buffer&& chunk) -> bool
+				{
+					response.m_body.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+					return true;
+				});
+			}
+			catch (const std::exception& e)
+			{
+				LOG_ERROR_CC(m_conn_context, "Failed to write response body: " << e.what());
+				r = false;
+			}
+			if (!r)
+			{
+				response.m_response_code = 500;
+				response.m_response_comment = "Internal Server Error";
+				response.m_body.clear();
+			}
+			return false;
+		}
+
+		// Others are written on a thread of their own: the connection's send
+		// queue is bounded, and the writer waits there for room as the client
+		// reads, which it could not do on the connection's strand. Requests that
+		// come meanwhile are answered once the body is sent.
+		std::shared_ptr<http_response_info> body_response = std::make_shared<http_response_info>(std::move(response));
+		const std::string fields = get_response_fields(*body_response);
+		if (!m_psnd_hndlr->add_ref())
+			return true; // the connection is going away
+		m_write_failed = false;
+		m_writing_body = true;
+		try
+		{
+			boost::thread(&simple_http_connection_handler<t_connection_context>::write_response_body, this, body_response, fields).detach();
+		}
+		catch (const std::exception& e)
+		{
+			LOG_ERROR_CC(m_conn_context, "Failed to start a thread for the response body, writing it here: " << e.what());
+			write_response_body(body_response, fields);
+		}
+		return true;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	void simple_http_connection_handler<t_connection_context>::write_response_body(const std::shared_ptr<http_response_info>& response, const std::string& fields)
+	{
+		// The first piece is held back, so a body that fits in it goes out with
+		// a Content-Length as usual. Larger ones are sent with chunked transfer
+		// encoding while they are being written.
+		bool chunked = false;
+		shared_buffer first;
+		const auto send_chunk = [this, &chunked](std::string head, const shared_buffer& chunk) -> bool
+		{
+			if (chunked)
+				head += "\r\n"; // ends the previous chunk
+			chunked = true;
+			char chunk_size[32];
+			snprintf(chunk_size, sizeof(chunk_size), "%zx\r\n", chunk.size());
+			head += chunk_size;
+			return m_psnd_hndlr->do_send_shared(head.data(), head.size(), chunk);
+		};
+
+		bool r = false;
+		try
+		{
+			r = response->m_body_writer([&](shared_buffer&& chunk) -> bool
+			{
+				if (chunk.empty())
+					return true;
+				if (!chunked && first.empty())
+				{
+					first = std::move(chunk);
+					return true;
+				}
+				if (!chunked)
+				{
+					response->m_header_info.m_transfer_encoding = "chunked";
+					std::string response_data = get_response_header(*response, fields, 0);
+					LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
+					if (!send_chunk(std::move(response_data), first))
+						return false;
+					first = shared_buffer();
+				}
+				return send_chunk(std::string(), chunk);
+			});
+		}
+		catch (const std::exception& e)
+		{
+			LOG_ERROR_CC(m_conn_context, "Failed to write response body: " << e.what());
+			r = false;
+		}
+
+		if (!chunked)
+		{
+			if (!r)
+			{
+				response->m_response_code = 500;
+				response->m_response_comment = "Internal Server Error";
+				first = shared_buffer();
+			}
+			const std::string response_data = get_response_header(*response, fields, first.size());
+			LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
+			m_psnd_hndlr->do_send_shared(response_data.data(), response_data.size(), first);
+		}
+		else if (r)
+		{
+			static const char last_chunk[] = "\r\n0\r\n\r\n";
+			m_psnd_hndlr->do_send(last_chunk, sizeof(last_chunk) - 1);
+		}
+		else
+		{
+			// too late for an error status, the client sees the body cut short
+			LOG_ERROR_CC(m_conn_context, "Failed to send response body, closing connection");
+			m_write_failed = true;
+		}
+
+		// the rest happens on the connection's strand, and this may be gone after release()
+		m_writing_body = false;
+		m_psnd_hndlr->request_callback();
+		m_psnd_hndlr->release();
+	}
+	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_request(const http::http_request_info& query_info, http_response_info& response)
 	{
@@ -628,13 +794,28 @@ namespace net_utils
 	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
 	std::string simple_http_connection_handler<t_connection_context>::get_response_header(const http_response_info& response)
+	{
+		return get_response_header(response, get_response_fields(response), response.m_body.size());
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	std::string simple_http_connection_handler<t_connection_context>::get_response_header(const http_response_info& response, const std::string& fields, size_t body_size)
 	{
 		std::string buf = "HTTP/1.1 ";
 		buf += boost::lexical_cast<std::string>(response.m_response_code) + " " + response.m_response_comment + "\r\n" +
-			"Server: Epee-based\r\n"
-			"Content-Length: ";
-		buf += boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
-
+			"Server: Epee-based\r\n";
+		if(response.m_header_info.m_transfer_encoding.empty())
+			buf += "Content-Length: " + boost::lexical_cast<std::string>(body_size) + "\r\n";
+		else
+			buf += "Transfer-Encoding: " + response.m_header_info.m_transfer_encoding + "\r\n";
+		buf += fields;
+		return buf;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	std::string simple_http_connection_handler<t_connection_context>::get_response_fields(const http_response_info& response)
+	{
+		std::string buf;
 		if(!response.m_mime_tipe.empty())
 		{
 			buf += "Content-Type: ";
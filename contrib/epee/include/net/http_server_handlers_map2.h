@@ -26,6 +26,7 @@
 
 
 #pragma once
+#include <memory>
 #include "http_base.h"
 #include "jsonrpc_structs.h"
 #include "storages/portable_storage.h"
@@ -34,6 +35,37 @@
 #undef ARQMA_DEFAULT_LOG_CATEGORY
 #define ARQMA_DEFAULT_LOG_CATEGORY "net.http"
 
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  //! stores `resp` as JSON when the response is sent, handing it to the connection piece by piece
+  template<class t_struct>
+  body_writer json_body_writer(const std::shared_ptr<t_struct>& resp)
+  {
+    return [resp](const body_chunk_sink& sink)
+    {
+      serialization::chunked_output out(sink);
+      return serialization::store_t_to_json(*resp, out);
+    };
+  }
+
+  //! stores `resp` in the binary format when the response is sent, handing it to the connection piece by piece
+  template<class t_struct>
+  body_writer binary_body_writer(const std::shared_ptr<t_struct>& resp)
+  {
+    return [resp](const body_chunk_sink& sink)
+    {
+      serialization::chunked_output out(sink);
+      return serialization::store_t_to_binary(*resp, out);
+    };
+  }
+}
+}
+}
+
 
 #define CHAIN_HTTP_TO_MAP2(context_type) bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, \
               epee::net_utils::http::http_response_info& response, \
@@ -67,8 +99,8 @@
       bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
       CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse json: \r\n" << query_info.m_body); \
       uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
-      boost::value_initialized<command_type::response> resp;\
-      if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), &m_conn_context)) \
+      std::shared_ptr<command_type::response> resp = std::make_shared<command_type::response>(); \
+      if(!callback_f(static_cast<command_type::request&>(req), *resp, &m_conn_context)) \
       { \
         LOG_ERROR("Failed to " << #callback_f << "()"); \
         response_info.m_response_code = 500; \
@@ -76,11 +108,10 @@
         return true; \
       } \
       uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-      epee::serialization::store_t_to_json(static_cast<command_type::response&>(resp), response_info.m_body); \
-      uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
+      response_info.m_body_writer = epee::net_utils::http::json_body_writer(resp); \
       response_info.m_mime_tipe = "application/json"; \
       response_info.m_header_info.m_content_type = " application/json"; \
-      MDEBUG( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
+      MDEBUG( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms"); \
     }
 
 #define MAP_URI_AUTO_JON2(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, true)
@@ -94,8 +125,8 @@
       bool parse_res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), epee::strspan<uint8_t>(query_info.m_body)); \
       CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse bin body data, body size=" << query_info.m_body.size()); \
       uint64_t ticks1 = misc_utils::get_tick_count(); \
-      boost::value_initialized<command_type::response> resp;\
-      if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), &m_conn_context)) \
+      std::shared_ptr<command_type::response> resp = std::make_shared<command_type::response>(); \
+      if(!callback_f(static_cast<command_type::request&>(req), *resp, &m_conn_context)) \
       { \
         LOG_ERROR("Failed to " << #callback_f << "()"); \
         response_info.m_response_code = 500; \
@@ -103,11 +134,10 @@
         return true; \
       } \
       uint64_t ticks2 = misc_utils::get_tick_count(); \
-      epee::serialization::store_t_to_binary(static_cast<command_type::response&>(resp), response_info.m_body); \
-      uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
+      response_info.m_body_writer = epee::net_utils::http::binary_body_writer(resp); \
       response_info.m_mime_tipe = " application/octet-stream"; \
       response_info.m_header_info.m_content_type = " application/octet-stream"; \
-      MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms"); \
+      MDEBUG( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms"); \
     }
 
 #define CHAIN_URI_MAP2(callback) else {callback(query_info, response_info, m_conn_context);handled = true;}
@@ -159,18 +189,17 @@
     return true; \
   } \
   uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
-  boost::value_initialized<epee::json_rpc::response<command_type::response, epee::json_rpc::dummy_error> > resp_; \
-  epee::json_rpc::response<command_type::response, epee::json_rpc::dummy_error>& resp =  static_cast<epee::json_rpc::response<command_type::response, epee::json_rpc::dummy_error> &>(resp_); \
+  std::shared_ptr<epee::json_rpc::response<command_type::response, epee::json_rpc::dummy_error> > resp_ = std::make_shared<epee::json_rpc::response<command_type::response, epee::json_rpc::dummy_error> >(); \
+  epee::json_rpc::response<command_type::response, epee::json_rpc::dummy_error>& resp = *resp_; \
   resp.jsonrpc = "2.0"; \
   resp.id = req.id;
 
 #define FINALIZE_OBJECTS_TO_JSON(method_name) \
   uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
-  epee::serialization::store_t_to_json(resp, response_info.m_body); \
-  uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
+  response_info.m_body_writer = epee::net_utils::http::json_body_writer(resp_); \
   response_info.m_mime_tipe = "application/json"; \
   response_info.m_header_info.m_content_type = " application/json"; \
-  MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms");
+  MDEBUG( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms");
 
 #define MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, cond) \
     else if((callback_name == method_name) && (cond)) \
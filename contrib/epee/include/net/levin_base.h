@@ -72,6 +72,11 @@ namespace levin
 
 #define LEVIN_PACKET_REQUEST			0x00000001
 #define LEVIN_PACKET_RESPONSE		0x00000002
+#define LEVIN_PACKET_FRAGMENT		0x00000004 // part of a notification split in several packets
+#define LEVIN_PACKET_END			0x00000008 // last part of a fragmented notification
+#define LEVIN_PACKET_FRAGMENTS_OK	0x00000010 // the sender reassembles fragmented notifications
+
+#define LEVIN_DEFAULT_FRAGMENT_SIZE (64 * 1024) // bulk notifications are split in parts of this size, for peers which reassemble them
 
 
 #define LEVIN_PROTOCOL_VER_0         0
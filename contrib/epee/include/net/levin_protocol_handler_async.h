@@ -90,7 +90,9 @@ public:
   template<class callback_t>
   int invoke_async(int command, const epee::span<const uint8_t> in_buff, boost::uuids::uuid connection_id, const callback_t &cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
 
-  int notify(int command, const epee::span<const uint8_t> in_buff, boost::uuids::uuid connection_id);
+  int notify(int command, const epee::span<const uint8_t> in_buff, boost::uuids::uuid connection_id, net_utils::send_priority priority = net_utils::send_priority_block);
+  int notify(int command, const shared_buffer& in_buff, boost::uuids::uuid connection_id, net_utils::send_priority priority = net_utils::send_priority_block);
+  int notify(int command, const std::vector<shared_buffer>& in_pieces, boost::uuids::uuid connection_id, net_utils::send_priority priority = net_utils::send_priority_block);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
@@ -150,8 +152,14 @@ public:
   stream_state m_state;
 
   int32_t m_oponent_protocol_ver;
+  std::atomic<bool> m_oponent_fragments; // the peer reassembles fragmented notifications
   bool m_connection_initialized;
 
+  // a fragmented notification being received
+  bool m_fragmented;
+  uint32_t m_fragment_command;
+  std::string m_fragment_buffer;
+
   struct invoke_response_handler_base
   {
     virtual bool handle(int res, const epee::span<const uint8_t> buff, connection_context& context)=0;
@@ -276,7 +284,10 @@ public:
     m_protocol_released = false;
     m_wait_count = 0;
     m_oponent_protocol_ver = 0;
+    m_oponent_fragments = false;
     m_connection_initialized = false;
+    m_fragmented = false;
+    m_fragment_command = 0;
     m_invoke_buf_ready = 0;
     m_invoke_result_code = LEVIN_ERROR_CONNECTION;
   }
@@ -419,7 +430,31 @@ public:
             <<", cmd = " << m_current_head.m_command
             << ", v=" << m_current_head.m_protocol_version);
 
-          if(is_response)
+          if(!is_response && (m_current_head.m_flags & LEVIN_PACKET_FRAGMENT))
+          {
+            // a part of a notification the peer split, other messages may come
+            // between the parts. It is handled once the last part is in
+            if(m_current_head.m_have_to_return_data || (m_fragmented && m_current_head.m_command != m_fragment_command)
+                || m_fragment_buffer.size() + buff_to_invoke.size() > m_config.m_max_packet_size)
+            {
+              LOG_ERROR_CC(m_connection_context, "Bad fragmented notification (cmd = " << m_current_head.m_command << "), connection will be closed");
+              return false;
+            }
+            if(!m_fragmented)
+            {
+              m_fragmented = true;
+              m_fragment_command = m_current_head.m_command;
+            }
+            m_fragment_buffer.append((const char*)buff_to_invoke.data(), buff_to_invoke.size());
+            if(m_current_head.m_flags & LEVIN_PACKET_END)
+            {
+              std::string message;
+              message.swap(m_fragment_buffer);
+              m_fragmented = false;
+              m_config.m_pcommands_handler->notify(m_fragment_command, epee::strspan<uint8_t>(message), m_connection_context);
+            }
+          }
+          else if(is_response)
           {//response to some invoke
 
             epee::critical_region_t<decltype(m_invoke_response_handlers_lock)> invoke_response_handlers_guard(m_invoke_response_handlers_lock);
@@ -466,9 +501,9 @@ public:
               m_current_head.m_cb = return_buff.size();
               m_current_head.m_have_to_return_data = false;
               m_current_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
-              m_current_head.m_flags = LEVIN_PACKET_RESPONSE;
+              m_current_head.m_flags = LEVIN_PACKET_RESPONSE | LEVIN_PACKET_FRAGMENTS_OK;
 #if BYTE_ORDER == LITTLE_ENDIAN
-              std::string send_buff((const char*)&m_current_head, sizeof(m_current_head));
+              const bucket_head2& head = m_current_head;
 #else
               bucket_head2 head = m_current_head;
               head.m_signature = SWAP64LE(head.m_signature);
@@ -477,11 +512,9 @@ public:
               head.m_return_code = SWAP32LE(head.m_return_code);
               head.m_flags = SWAP32LE(head.m_flags);
               head.m_protocol_version = SWAP32LE(head.m_protocol_version);
-              std::string send_buff((const char*)&head, sizeof(head));
 #endif
-              send_buff += return_buff;
               CRITICAL_REGION_BEGIN(m_send_lock);
-              if(!m_pservice_endpoint->do_send(send_buff.data(), send_buff.size()))
+              if(!m_pservice_endpoint->do_send_shared(&head, sizeof(head), shared_buffer(std::move(return_buff))))
                 return false;
               CRITICAL_REGION_END();
               MDEBUG(m_connection_context << "LEVIN_PACKET_SENT. [len=" << m_current_head.m_cb
@@ -530,6 +563,8 @@ public:
           m_cache_in_buffer.erase(sizeof(bucket_head2));
           m_state = stream_state_body;
           m_oponent_protocol_ver = m_current_head.m_protocol_version;
+          if(m_current_head.m_flags & LEVIN_PACKET_FRAGMENTS_OK)
+            m_oponent_fragments = true;
           if(m_current_head.m_cb > m_config.m_max_packet_size)
           {
             LOG_ERROR_CC(m_connection_context, "Maximum packet size exceed!, m_max_packet_size = " << m_config.m_max_packet_size
@@ -589,21 +624,14 @@ public:
       head.m_cb = SWAP64LE(in_buff.size());
       head.m_have_to_return_data = true;
 
-      head.m_flags = SWAP32LE(LEVIN_PACKET_REQUEST);
+      head.m_flags = SWAP32LE(LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENTS_OK);
       head.m_command = SWAP32LE(command);
       head.m_protocol_version = SWAP32LE(LEVIN_PROTOCOL_VER_1);
 
       boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
       CRITICAL_REGION_BEGIN(m_send_lock);
       CRITICAL_REGION_LOCAL1(m_invoke_response_handlers_lock);
-      if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-      {
-        LOG_ERROR_CC(m_connection_context, "Failed to do_send");
-        err_code = LEVIN_ERROR_CONNECTION;
-        break;
-      }
-
-      if(!m_pservice_endpoint->do_send(in_buff.data(), in_buff.size()))
+      if(!m_pservice_endpoint->do_send_shared(&head, sizeof(head), shared_buffer(in_buff)))
       {
         LOG_ERROR_CC(m_connection_context, "Failed to do_send");
         err_code = LEVIN_ERROR_CONNECTION;
@@ -647,19 +675,13 @@ public:
     head.m_cb = SWAP64LE(in_buff.size());
     head.m_have_to_return_data = true;
 
-    head.m_flags = SWAP32LE(LEVIN_PACKET_REQUEST);
+    head.m_flags = SWAP32LE(LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENTS_OK);
     head.m_command = SWAP32LE(command);
     head.m_protocol_version = SWAP32LE(LEVIN_PROTOCOL_VER_1);
 
     boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-    {
-      LOG_ERROR_CC(m_connection_context, "Failed to do_send");
-      return LEVIN_ERROR_CONNECTION;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), in_buff.size()))
+    if(!m_pservice_endpoint->do_send_shared(&head, sizeof(head), shared_buffer(in_buff)))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send");
       return LEVIN_ERROR_CONNECTION;
@@ -703,7 +725,18 @@ public:
     return m_invoke_result_code;
   }
 
-  int notify(int command, const epee::span<const uint8_t> in_buff)
+  int notify(int command, const epee::span<const uint8_t> in_buff, net_utils::send_priority priority = net_utils::send_priority_block)
+  {
+    return notify(command, shared_buffer(in_buff), priority);
+  }
+
+  int notify(int command, const shared_buffer& in_buff, net_utils::send_priority priority = net_utils::send_priority_block)
+  {
+    return notify(command, std::vector<shared_buffer>{in_buff}, priority);
+  }
+
+  //! sends the pieces as one notification, without copying them when they can go out as fragments
+  int notify(int command, const std::vector<shared_buffer>& in_pieces, net_utils::send_priority priority = net_utils::send_priority_block)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
                           boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -716,22 +749,61 @@ public:
     if(m_deletion_initiated)
       return LEVIN_ERROR_CONNECTION_DESTROYED;
 
+    size_t total = 0;
+    for(const shared_buffer& piece: in_pieces)
+      total += piece.size();
+
     bucket_head2 head = {0};
     head.m_signature = SWAP64LE(LEVIN_SIGNATURE);
     head.m_have_to_return_data = false;
-    head.m_cb = SWAP64LE(in_buff.size());
+    head.m_cb = SWAP64LE(total);
 
     head.m_command = SWAP32LE(command);
     head.m_protocol_version = SWAP32LE(LEVIN_PROTOCOL_VER_1);
-    head.m_flags = SWAP32LE(LEVIN_PACKET_REQUEST);
-    CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
+    head.m_flags = SWAP32LE(LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENTS_OK);
+
+    // a big bulk notification is split, so the connection can send more
+    // urgent messages between its parts rather than after all of it. The
+    // fragments do not cross pieces, so the pieces are not copied.
+    std::vector<net_utils::send_que_entry> frames;
+    shared_buffer body;
+    if(priority == net_utils::send_priority_bulk && m_oponent_fragments && total > LEVIN_DEFAULT_FRAGMENT_SIZE)
     {
-      LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
-      return -1;
+      frames.reserve((total + LEVIN_DEFAULT_FRAGMENT_SIZE - 1) / LEVIN_DEFAULT_FRAGMENT_SIZE + in_pieces.size());
+      size_t sent_size = 0;
+      for(const shared_buffer& piece: in_pieces)
+      {
+        for(size_t offset = 0; offset < piece.size(); offset += LEVIN_DEFAULT_FRAGMENT_SIZE)
+        {
+          const size_t size = std::min<size_t>(LEVIN_DEFAULT_FRAGMENT_SIZE, piece.size() - offset);
+          sent_size += size;
+          uint32_t flags = LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENTS_OK | LEVIN_PACKET_FRAGMENT;
+          if(sent_size == total)
+            flags |= LEVIN_PACKET_END;
+          bucket_head2 fragment_head = head;
+          fragment_head.m_cb = SWAP64LE(size);
+          fragment_head.m_flags = SWAP32LE(flags);
+          frames.push_back({std::string((const char*)&fragment_head, sizeof(fragment_head)), piece.get_slice(offset, size)});
+        }
+      }
+    }
+    else if(in_pieces.size() == 1)
+    {
+      body = in_pieces.front();
+    }
+    else if(!in_pieces.empty())
+    {
+      std::string joined;
+      joined.reserve(total);
+      for(const shared_buffer& piece: in_pieces)
+        joined.append((const char*)piece.data(), piece.size());
+      body = shared_buffer(std::move(joined));
     }
 
-    if(!m_pservice_endpoint->do_send(in_buff.data(), in_buff.size()))
+    CRITICAL_REGION_BEGIN(m_send_lock);
+    const bool sent = frames.empty() ? m_pservice_endpoint->do_send_shared(&head, sizeof(head), body, priority)
+      : m_pservice_endpoint->do_send_frames(std::move(frames), priority);
+    if(!sent)
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
@@ -915,11 +987,27 @@ void async_protocol_handler_config<t_connection_context>::set_handler(levin_comm
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
-int async_protocol_handler_config<t_connection_context>::notify(int command, const epee::span<const uint8_t> in_buff, boost::uuids::uuid connection_id)
+int async_protocol_handler_config<t_connection_context>::notify(int command, const epee::span<const uint8_t> in_buff, boost::uuids::uuid connection_id, net_utils::send_priority priority)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->notify(command, in_buff, priority) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::notify(int command, const shared_buffer& in_buff, boost::uuids::uuid connection_id, net_utils::send_priority priority)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->notify(command, in_buff, priority) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::notify(int command, const std::vector<shared_buffer>& in_pieces, boost::uuids::uuid connection_id, net_utils::send_priority priority)
 {
   async_protocol_handler<t_connection_context>* aph;
   int r = find_and_lock_connection(connection_id, aph);
-  return LEVIN_OK == r ? aph->notify(command, in_buff) : r;
+  return LEVIN_OK == r ? aph->notify(command, in_pieces, priority) : r;
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
@@ -33,9 +33,11 @@
 #include <boost/asio/io_service.hpp>
 #include <typeinfo>
 #include <type_traits>
+#include <vector>
 #include "enums.h"
 #include "serialization/keyvalue_serialization.h"
 #include "misc_log_ex.h"
+#include "shared_buffer.h"
 
 #undef ARQMA_DEFAULT_LOG_CATEGORY
 #define ARQMA_DEFAULT_LOG_CATEGORY "net"
@@ -317,12 +319,43 @@ namespace net_utils
 
 	};
 
+	//! Egress classes of a connection: queued messages of a lower class are sent first
+	enum send_priority
+	{
+		send_priority_block = 0, //!< block relay, and small requests and replies that keep the protocol going
+		send_priority_tx,        //!< transaction relay
+		send_priority_bulk,      //!< responses to sync requests
+		send_priority_count
+	};
+
+	//! One queued write: a small prefix copied when queued (eg, a levin header) and a part of a shared payload, sent with one gather write
+	struct send_que_entry
+	{
+		std::string head;
+		shared_buffer body;
+
+		size_t size() const noexcept { return head.size() + body.size(); }
+	};
+
 	/************************************************************************/
 	/*                                                                      */
 	/************************************************************************/
 	struct i_service_endpoint
 	{
 	virtual bool do_send(const void* ptr, size_t cb) = 0;
+    //! Sends `head` then `body` as one write; `body` is shared, not copied, when the endpoint supports it
+    virtual bool do_send_shared(const void* head, size_t head_cb, const shared_buffer& body, send_priority priority = send_priority_block)
+    {
+      return do_send(head, head_cb) && do_send(body.data(), body.size());
+    }
+    //! Sends the frames of one message in order, queued together; more urgent messages may go out between two frames
+    virtual bool do_send_frames(std::vector<send_que_entry>&& frames, send_priority priority = send_priority_block)
+    {
+      for (const send_que_entry& frame: frames)
+        if (!do_send_shared(frame.head.data(), frame.head.size(), frame.body, priority))
+          return false;
+      return true;
+    }
     virtual bool close() = 0;
     virtual bool send_done() = 0;
     virtual bool call_run_once_service_io() = 0;
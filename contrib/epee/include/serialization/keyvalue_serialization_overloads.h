@@ -30,8 +30,11 @@
 #include <list>
 #include <vector>
 #include <deque>
+#include <cstring>
 #include <boost/mpl/vector.hpp>
 #include <boost/mpl/contains_fwd.hpp>
+#include "shared_buffer.h"
+#include "span.h"
 
 #undef ARQMA_DEFAULT_LOG_CATEGORY
 #define ARQMA_DEFAULT_LOG_CATEGORY "serialization"
@@ -69,11 +72,11 @@ namespace epee
     template<class t_type, class t_storage>
     static bool unserialize_t_val_as_blob(t_type& d, t_storage& stg, typename t_storage::hsection hparent_section, const char* pname)
     {
-      std::string blob;
-      if(!stg.get_value(pname, blob, hparent_section))
+      epee::span<const uint8_t> blob;
+      if(!stg.get_blob(pname, blob, hparent_section))
         return false;
       CHECK_AND_ASSERT_MES(blob.size() == sizeof(d), false, "unserialize_t_val_as_blob: size of " << typeid(t_type).name() << " = " << sizeof(t_type) << ", but stored blod size = " << blob.size() << ", value name = " << pname);
-      d = *(const t_type*)blob.data();
+      memcpy((void*)&d, blob.data(), sizeof(d));
       return true;
     }
     //-------------------------------------------------------------------------------------------------------------------
@@ -156,19 +159,24 @@ namespace epee
     static bool unserialize_stl_container_pod_val_as_blob(stl_container& container, t_storage& stg, typename t_storage::hsection hparent_section, const char* pname)
     {
       container.clear();
-      std::string buff;
-      bool res = stg.get_value(pname, buff, hparent_section);
+      epee::span<const uint8_t> buff;
+      bool res = stg.get_blob(pname, buff, hparent_section);
       if(res)
       {
         size_t loaded_size = buff.size();
-        typename stl_container::value_type* pelem =  (typename stl_container::value_type*)buff.data();
+        const uint8_t* pelem = buff.data();
         CHECK_AND_ASSERT_MES(!(loaded_size%sizeof(typename stl_container::value_type)),
           false,
           "size in blob " << loaded_size << " not have not zero modulo for sizeof(value_type) = " << sizeof(typename stl_container::value_type) << ", type " << typeid(typename stl_container::value_type).name());
         size_t count = (loaded_size/sizeof(typename stl_container::value_type));
         hint_resize(container, count);
-        for(size_t i = 0; i < count; i++)
-          container.insert(container.end(), *(pelem++));
+        for(size_t i = 0; i < count; i++, pelem += sizeof(typename stl_container::value_type))
+        {
+          // the blob may not be aligned for value_type
+          typename stl_container::value_type v;
+          memcpy((void*)&v, pelem, sizeof(v));
+          container.insert(container.end(), v);
+        }
       }
       return res;
     }
@@ -451,5 +459,45 @@ namespace epee
     {
       return kv_serialization_overloads_impl_is_base_serializable_types<boost::mpl::contains<base_serializable_types<t_storage>, typename std::remove_const<t_type>::type>::value>::kv_unserialize(d, stg, hparent_section, pname);
     }
+    //-------------------------------------------------------------------------------------------------------------------
+    // shared_buffer is stored as a string; storages which can write it out without a copy overload these
+    template<class t_storage>
+    bool kv_serialize(const shared_buffer& d, t_storage& stg, typename t_storage::hsection hparent_section, const char* pname)
+    {
+      return stg.set_value(pname, std::string(reinterpret_cast<const char*>(d.data()), d.size()), hparent_section);
+    }
+    //-------------------------------------------------------------------------------------------------------------------
+    template<class t_storage>
+    bool kv_unserialize(shared_buffer& d, t_storage& stg, typename t_storage::hsection hparent_section, const char* pname)
+    {
+      std::string blob;
+      if(!stg.get_value(pname, blob, hparent_section))
+        return false;
+      d = shared_buffer(std::move(blob));
+      return true;
+    }
+    //-------------------------------------------------------------------------------------------------------------------
+    template<class t_storage>
+    bool kv_serialize(const std::vector<shared_buffer>& d, t_storage& stg, typename t_storage::hsection hparent_section, const char* pname)
+    {
+      std::vector<std::string> blobs;
+      blobs.reserve(d.size());
+      for(const shared_buffer& blob: d)
+        blobs.emplace_back(reinterpret_cast<const char*>(blob.data()), blob.size());
+      return serialize_stl_container_t_val(blobs, stg, hparent_section, pname);
+    }
+    //-------------------------------------------------------------------------------------------------------------------
+    template<class t_storage>
+    bool kv_unserialize(std::vector<shared_buffer>& d, t_storage& stg, typename t_storage::hsection hparent_section, const char* pname)
+    {
+      d.clear();
+      std::vector<std::string> blobs;
+      if(!unserialize_stl_container_t_val(blobs, stg, hparent_section, pname))
+        return false;
+      d.reserve(blobs.size());
+      for(std::string& blob: blobs)
+        d.emplace_back(std::move(blob));
+      return true;
+    }
   }
 }
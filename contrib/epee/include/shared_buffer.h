@@ -0,0 +1,89 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "span.h"
+
+namespace epee
+{
+  /**
+   * @brief refcounted, immutable bytes
+   *
+   * Copies share the same storage, so a payload serialized once can be
+   * queued on many connections without a copy per connection. A slice views
+   * part of the storage and keeps all of it alive.
+   */
+  class shared_buffer
+  {
+  public:
+    shared_buffer() noexcept: m_data(nullptr), m_size(0) {}
+
+    //! Takes ownership of `source` without copying its bytes.
+    explicit shared_buffer(std::string&& source)
+      : m_storage(std::make_shared<const std::string>(std::move(source)))
+      , m_data(reinterpret_cast<const std::uint8_t*>(m_storage->data()))
+      , m_size(m_storage->size())
+    {}
+
+    //! Copies `source` once.
+    explicit shared_buffer(const span<const std::uint8_t> source)
+      : shared_buffer(std::string(reinterpret_cast<const char*>(source.data()), source.size()))
+    {}
+
+    const std::uint8_t* data() const noexcept { return m_data; }
+    std::size_t size() const noexcept { return m_size; }
+    bool empty() const noexcept { return m_size == 0; }
+
+    span<const std::uint8_t> to_span() const noexcept { return {m_data, m_size}; }
+
+    //! \return `size` bytes from `offset`, sharing this storage. \throw std::out_of_range
+    shared_buffer get_slice(std::size_t offset, std::size_t size) const
+    {
+      if (offset > m_size || size > m_size - offset)
+        throw std::out_of_range("shared_buffer slice out of range");
+      shared_buffer slice;
+      slice.m_storage = m_storage;
+      slice.m_data = m_data + offset;
+      slice.m_size = size;
+      return slice;
+    }
+
+  private:
+    std::shared_ptr<const std::string> m_storage;
+    const std::uint8_t* m_data;
+    std::size_t m_size;
+  };
+}
@@ -0,0 +1,159 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "misc_log_ex.h"
+#include "shared_buffer.h"
+
+// smallest chunk handed on, later chunks grow with the output
+#define CHUNKED_OUTPUT_MIN_CHUNK_SIZE (64 * 1024)
+#define CHUNKED_OUTPUT_GROWTH_DIVISOR 32
+// shared pieces smaller than this are copied into the chunk, a piece of its own costs a write
+#define CHUNKED_OUTPUT_MIN_SHARED_SIZE (8 * 1024)
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /**
+     * @brief collects serialized output in chunks and hands them on to a sink
+     *
+     * A chunk is handed on once full. Chunks grow with the output: each is at
+     * least 1/32 of what was written before it, so even a very large output
+     * is a few hundred chunks.
+     *
+     * Bytes that are already held in a shared_buffer can be handed on as they
+     * are, between two chunks, with write_shared().
+     *
+     * If the sink refuses a chunk, the rest of the output is dropped and
+     * flush() returns false.
+     */
+    class chunked_output
+    {
+    public:
+      //! takes a chunk of output, false if it can not (eg, the connection is gone)
+      typedef std::function<bool(shared_buffer&&)> sink_t;
+
+      explicit chunked_output(sink_t sink, size_t min_chunk_size = CHUNKED_OUTPUT_MIN_CHUNK_SIZE);
+
+      void write(const char* data, size_t size);
+      void write(const std::string& s) { write(s.data(), s.size()); }
+      //! writes `piece` without copying it, unless it is small
+      void write_shared(const shared_buffer& piece);
+      //! the number of bytes written so far
+      uint64_t size() const { return m_size; }
+      //! hands on everything written so far, false if the sink refused anything
+      bool flush();
+
+    private:
+      void next_chunk();
+      void pass_on(shared_buffer&& chunk);
+
+      sink_t m_sink;
+      size_t m_min_chunk_size;
+      size_t m_chunk_size;
+      std::string m_chunk;
+      uint64_t m_size;
+      bool m_failed;
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    chunked_output::chunked_output(sink_t sink, size_t min_chunk_size):
+      m_sink(std::move(sink)),
+      m_min_chunk_size(std::max<size_t>(min_chunk_size, 1)),
+      m_chunk_size(m_min_chunk_size),
+      m_size(0),
+      m_failed(false)
+    {
+      m_chunk.reserve(m_chunk_size);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void chunked_output::write(const char* data, size_t size)
+    {
+      m_size += size;
+      if(m_failed)
+        return;
+      m_chunk.append(data, size);
+      if(m_chunk.size() >= m_chunk_size)
+        next_chunk();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void chunked_output::write_shared(const shared_buffer& piece)
+    {
+      if(piece.size() < CHUNKED_OUTPUT_MIN_SHARED_SIZE)
+      {
+        write(reinterpret_cast<const char*>(piece.data()), piece.size());
+        return;
+      }
+      flush();
+      m_size += piece.size();
+      pass_on(shared_buffer(piece));
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool chunked_output::flush()
+    {
+      if(!m_chunk.empty())
+      {
+        std::string chunk;
+        chunk.swap(m_chunk);
+        pass_on(shared_buffer(std::move(chunk)));
+      }
+      return !m_failed;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void chunked_output::next_chunk()
+    {
+      std::string chunk;
+      chunk.swap(m_chunk);
+      pass_on(shared_buffer(std::move(chunk)));
+      m_chunk_size = std::max<uint64_t>(m_min_chunk_size, m_size / CHUNKED_OUTPUT_GROWTH_DIVISOR);
+      m_chunk.reserve(m_chunk_size);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void chunked_output::pass_on(shared_buffer&& chunk)
+    {
+      if(!m_failed && !m_sink(std::move(chunk)))
+        m_failed = true;
+    }
+  }
+}
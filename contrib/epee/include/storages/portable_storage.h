@@ -60,6 +60,8 @@ namespace epee
       template<class t_value>
       bool       get_value(const std::string& value_name, t_value& val, hsection hparent_section);
       bool       get_value(const std::string& value_name, storage_entry& val, hsection hparent_section);
+      //! the string value `value_name`, valid until the storage is changed
+      bool       get_blob(const std::string& value_name, epee::span<const uint8_t>& blob, hsection hparent_section);
       template<class t_value>
       bool       set_value(const std::string& value_name, const t_value& target, hsection hparent_section);
 
@@ -242,6 +244,18 @@ namespace epee
       //CATCH_ENTRY("portable_storage::template<>get_value", false);
     }
     //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage::get_blob(const std::string& value_name, epee::span<const uint8_t>& blob, hsection hparent_section)
+    {
+      if(!hparent_section) hparent_section = &m_root;
+      storage_entry* pentry = find_storage_entry(value_name, hparent_section);
+      if(!pentry)
+        return false;
+      CHECK_AND_ASSERT_THROW_MES(pentry->type() == typeid(std::string), "WRONG DATA CONVERSION: blob " << value_name << " is not a string");
+      blob = epee::strspan<uint8_t>(boost::get<std::string>(*pentry));
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
     template<class t_value>
     bool portable_storage::set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
     {
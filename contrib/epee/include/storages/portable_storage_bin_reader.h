@@ -0,0 +1,484 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <boost/mpl/contains.hpp>
+
+#include "misc_log_ex.h"
+#include "portable_storage_base.h"
+#include "portable_storage_from_bin.h"
+#include "portable_storage_val_converters.h"
+#include "span.h"
+#include "int-util.h"
+
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /**
+     * @brief loads a binary portable storage blob straight into KV_SERIALIZE_MAP structs
+     *
+     * A drop-in for portable_storage on the load path, which does not build a
+     * section tree. Each section is indexed on first use: one scan records
+     * where each of its entries starts and skips over its value. Values are
+     * then decoded from the source buffer directly into the target fields when
+     * the struct asks for them by name, and blobs are handed out as spans of
+     * the source. Lookups, conversions and limits behave as in
+     * portable_storage: the whole blob is checked when loading, so a message
+     * rejected by one is rejected by the other.
+     *
+     * The source buffer must outlive the reader.
+     */
+    class portable_storage_bin_reader
+    {
+    public:
+      struct entry
+      {
+        const char* name;
+        size_t name_size;
+        const uint8_t* type_ptr; // the entry's type, as serialized
+        uint8_t type;            // SERIALIZE_TYPE_ARRAY entries have their element type here, with SERIALIZE_FLAG_ARRAY
+        const uint8_t* value;
+      };
+      struct section_index
+      {
+        std::vector<entry> entries;
+      };
+      struct array_cursor
+      {
+        uint8_t type;
+        size_t remaining;
+        const uint8_t* next;
+        section_index section; // the current element of an array of sections
+      };
+
+      typedef section_index* hsection;
+      typedef array_cursor* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_bin_reader(): m_end(nullptr) {}
+
+      bool load_from_binary(const epee::span<const uint8_t> source);
+      bool load_from_binary(const std::string& source) { return load_from_binary(epee::strspan<uint8_t>(source)); }
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool get_value(const std::string& value_name, t_value& val, hsection hparent_section);
+      bool get_value(const std::string& value_name, storage_entry& val, hsection hparent_section);
+      bool get_blob(const std::string& value_name, epee::span<const uint8_t>& blob, hsection hparent_section);
+
+      template<class t_value>
+      harray get_first_value(const std::string& value_name, t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool get_next_value(harray hval_array, t_value& target);
+      harray get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section);
+      bool get_next_section(harray hsec_array, hsection& h_child_section);
+
+    private:
+      const entry* find_entry(const std::string& name, hsection hparent_section);
+      const uint8_t* index_section(const uint8_t* ptr, section_index& index, size_t level);
+      const uint8_t* skip_section(const uint8_t* ptr, size_t level);
+      const uint8_t* read_entry(const uint8_t* ptr, entry& e, size_t level);
+      const uint8_t* skip_value(const uint8_t* ptr, uint8_t type, size_t level);
+      static void check_level(size_t level);
+      void check_remaining(const uint8_t* ptr, size_t count) const;
+      size_t read_varint(const uint8_t*& ptr) const;
+      template<class t_pod_type>
+      t_pod_type read_pod(const uint8_t*& ptr) const;
+      epee::span<const uint8_t> read_string(const uint8_t*& ptr) const;
+      void read_value(const uint8_t*& ptr, uint8_t type, std::string& target) const;
+      template<class t_value>
+      void read_value(const uint8_t*& ptr, uint8_t type, t_value& target) const;
+      template<class t_value>
+      void read_array_value(array_cursor& cursor, t_value& target);
+
+      const uint8_t* m_end;
+      section_index m_root;
+      std::deque<section_index> m_sections;
+      std::deque<array_cursor> m_arrays;
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_bin_reader::load_from_binary(const epee::span<const uint8_t> source)
+    {
+      m_root.entries.clear();
+      m_sections.clear();
+      m_arrays.clear();
+      const size_t header_size = 2 * sizeof(uint32_t) + sizeof(uint8_t);
+      if(source.size() < header_size)
+      {
+        LOG_ERROR("portable_storage: wrong binary format, packet size = " << source.size() << " less than expected header size " << header_size);
+        return false;
+      }
+      uint32_t signature_a, signature_b;
+      memcpy(&signature_a, source.data(), sizeof(signature_a));
+      memcpy(&signature_b, source.data() + sizeof(signature_a), sizeof(signature_b));
+      if(signature_a != SWAP32LE(PORTABLE_STORAGE_SIGNATUREA) || signature_b != SWAP32LE(PORTABLE_STORAGE_SIGNATUREB))
+      {
+        LOG_ERROR("portable_storage: wrong binary format - signature mismatch");
+        return false;
+      }
+      const uint8_t ver = source.data()[2 * sizeof(uint32_t)];
+      if(ver != PORTABLE_STORAGE_FORMAT_VER)
+      {
+        LOG_ERROR("portable_storage: wrong binary format - unknown format ver = " << ver);
+        return false;
+      }
+      TRY_ENTRY();
+      CHECK_AND_ASSERT_THROW_MES(source.size() > header_size, "portable_storage: empty storage");
+      m_end = source.data() + source.size();
+      index_section(source.data() + header_size, m_root, 1);
+      return true;
+      CATCH_ENTRY("portable_storage_bin_reader::load_from_binary", false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_bin_reader::check_remaining(const uint8_t* ptr, size_t count) const
+    {
+      CHECK_AND_ASSERT_THROW_MES(count <= size_t(m_end - ptr), " attempt to read " << count << " bytes from buffer with " << (m_end - ptr) << " bytes remained");
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_pod_type>
+    t_pod_type portable_storage_bin_reader::read_pod(const uint8_t*& ptr) const
+    {
+      static_assert(std::is_pod<t_pod_type>::value, "POD type expected");
+      check_remaining(ptr, sizeof(t_pod_type));
+      t_pod_type v;
+      memcpy(&v, ptr, sizeof(v));
+      ptr += sizeof(v);
+      return v;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    size_t portable_storage_bin_reader::read_varint(const uint8_t*& ptr) const
+    {
+      CHECK_AND_ASSERT_THROW_MES(ptr < m_end, "empty buff, expected place for varint");
+      size_t v = 0;
+      switch (*ptr & PORTABLE_RAW_SIZE_MARK_MASK)
+      {
+      case PORTABLE_RAW_SIZE_MARK_BYTE: v = read_pod<uint8_t>(ptr); break;
+      case PORTABLE_RAW_SIZE_MARK_WORD: v = read_pod<uint16_t>(ptr); break;
+      case PORTABLE_RAW_SIZE_MARK_DWORD: v = read_pod<uint32_t>(ptr); break;
+      case PORTABLE_RAW_SIZE_MARK_INT64: v = read_pod<uint64_t>(ptr); break;
+      }
+      return v >> 2;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    epee::span<const uint8_t> portable_storage_bin_reader::read_string(const uint8_t*& ptr) const
+    {
+      const size_t len = read_varint(ptr);
+      CHECK_AND_ASSERT_THROW_MES(len < MAX_STRING_LEN_POSSIBLE, "to big string len value in storage: " << len);
+      CHECK_AND_ASSERT_THROW_MES(len <= size_t(m_end - ptr), "string len count value " << len << " goes out of remain storage len " << (m_end - ptr));
+      const epee::span<const uint8_t> s{ptr, len};
+      ptr += len;
+      return s;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    // The nesting limit is the one of throwable_buffer_reader, which counts its
+    // active calls while parsing. A level here is that count while it reads a
+    // section, and each check is the deepest count it reaches for that part of
+    // the blob, so both reject exactly the same blobs.
+    inline
+    void portable_storage_bin_reader::check_level(size_t level)
+    {
+      CHECK_AND_ASSERT_THROW_MES(level < EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL, "Wrong blob data in portable storage: recursion limitation (" << EPEE_PORTABLE_STORAGE_RECURSION_LIMIT_INTERNAL << ") exceeded");
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const uint8_t* portable_storage_bin_reader::skip_value(const uint8_t* ptr, uint8_t type, size_t level)
+    {
+      if(type & SERIALIZE_FLAG_ARRAY)
+      {
+        check_level(level + 7);
+        type &= ~SERIALIZE_FLAG_ARRAY;
+        size_t count = read_varint(ptr);
+        size_t pod_size = 0;
+        switch(type)
+        {
+        case SERIALIZE_TYPE_INT64: case SERIALIZE_TYPE_UINT64: case SERIALIZE_TYPE_DUOBLE: pod_size = 8; break;
+        case SERIALIZE_TYPE_INT32: case SERIALIZE_TYPE_UINT32: pod_size = 4; break;
+        case SERIALIZE_TYPE_INT16: case SERIALIZE_TYPE_UINT16: pod_size = 2; break;
+        case SERIALIZE_TYPE_INT8: case SERIALIZE_TYPE_UINT8: case SERIALIZE_TYPE_BOOL: pod_size = 1; break;
+        case SERIALIZE_TYPE_STRING:
+          if(count)
+            check_level(level + 9);
+          while(count--)
+            read_string(ptr);
+          return ptr;
+        case SERIALIZE_TYPE_OBJECT:
+          while(count--)
+            ptr = skip_section(ptr, level + 5);
+          return ptr;
+        case SERIALIZE_TYPE_ARRAY:
+          CHECK_AND_ASSERT_THROW_MES(count == 0, "Reading array entry is not supported");
+          return ptr;
+        default:
+          CHECK_AND_ASSERT_THROW_MES(false, "unknown entry_type code = " << (unsigned)type);
+        }
+        CHECK_AND_ASSERT_THROW_MES(count <= size_t(m_end - ptr) / pod_size, " attempt to read " << count << " values of " << pod_size << " bytes from buffer with " << (m_end - ptr) << " bytes remained");
+        return ptr + count * pod_size;
+      }
+
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64: case SERIALIZE_TYPE_UINT64: case SERIALIZE_TYPE_DUOBLE: check_remaining(ptr, 8); return ptr + 8;
+      case SERIALIZE_TYPE_INT32: case SERIALIZE_TYPE_UINT32: check_remaining(ptr, 4); return ptr + 4;
+      case SERIALIZE_TYPE_INT16: case SERIALIZE_TYPE_UINT16: check_remaining(ptr, 2); return ptr + 2;
+      case SERIALIZE_TYPE_INT8: case SERIALIZE_TYPE_UINT8: case SERIALIZE_TYPE_BOOL: check_remaining(ptr, 1); return ptr + 1;
+      case SERIALIZE_TYPE_STRING: check_level(level + 8); read_string(ptr); return ptr;
+      case SERIALIZE_TYPE_OBJECT: return skip_section(ptr, level + 3);
+      default:
+        CHECK_AND_ASSERT_THROW_MES(false, "unknown entry_type code = " << (unsigned)type);
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const uint8_t* portable_storage_bin_reader::read_entry(const uint8_t* ptr, entry& e, size_t level)
+    {
+      e.name_size = read_pod<uint8_t>(ptr);
+      check_remaining(ptr, e.name_size);
+      e.name = (const char*)ptr;
+      ptr += e.name_size;
+      e.type_ptr = ptr;
+      e.type = read_pod<uint8_t>(ptr);
+      if(e.type == SERIALIZE_TYPE_ARRAY)
+      {
+        // the tree parser goes one call deeper for these
+        ++level;
+        e.type = read_pod<uint8_t>(ptr);
+        CHECK_AND_ASSERT_THROW_MES(e.type & SERIALIZE_FLAG_ARRAY, "wrong type sequenses");
+      }
+      e.value = ptr;
+      return skip_value(ptr, e.type, level);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const uint8_t* portable_storage_bin_reader::skip_section(const uint8_t* ptr, size_t level)
+    {
+      check_level(level + 4);
+      size_t count = read_varint(ptr);
+      entry e;
+      while(count--)
+        ptr = read_entry(ptr, e, level);
+      return ptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const uint8_t* portable_storage_bin_reader::index_section(const uint8_t* ptr, section_index& index, size_t level)
+    {
+      check_level(level + 4);
+      index.entries.clear();
+      size_t count = read_varint(ptr);
+      while(count--)
+      {
+        entry e;
+        ptr = read_entry(ptr, e, level);
+        index.entries.push_back(e);
+      }
+      return ptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    const portable_storage_bin_reader::entry* portable_storage_bin_reader::find_entry(const std::string& name, hsection hparent_section)
+    {
+      // like the section tree, the first of several entries with the same name is used
+      const section_index& index = hparent_section ? *hparent_section : m_root;
+      for(const entry& e: index.entries)
+        if(e.name_size == name.size() && memcmp(e.name, name.data(), e.name_size) == 0)
+          return &e;
+      return nullptr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_bin_reader::read_value(const uint8_t*& ptr, uint8_t type, std::string& target) const
+    {
+      if(type == SERIALIZE_TYPE_STRING)
+      {
+        const epee::span<const uint8_t> s = read_string(ptr);
+        target.assign((const char*)s.data(), s.size());
+      }
+      else
+        read_value<std::string>(ptr, type, target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_storage_bin_reader::read_value(const uint8_t*& ptr, uint8_t type, t_value& target) const
+    {
+      switch(type)
+      {
+      case SERIALIZE_TYPE_INT64:  convert_t(read_pod<int64_t>(ptr), target); break;
+      case SERIALIZE_TYPE_INT32:  convert_t(read_pod<int32_t>(ptr), target); break;
+      case SERIALIZE_TYPE_INT16:  convert_t(read_pod<int16_t>(ptr), target); break;
+      case SERIALIZE_TYPE_INT8:   convert_t(read_pod<int8_t>(ptr), target); break;
+      case SERIALIZE_TYPE_UINT64: convert_t(read_pod<uint64_t>(ptr), target); break;
+      case SERIALIZE_TYPE_UINT32: convert_t(read_pod<uint32_t>(ptr), target); break;
+      case SERIALIZE_TYPE_UINT16: convert_t(read_pod<uint16_t>(ptr), target); break;
+      case SERIALIZE_TYPE_UINT8:  convert_t(read_pod<uint8_t>(ptr), target); break;
+      case SERIALIZE_TYPE_DUOBLE: convert_t(read_pod<double>(ptr), target); break;
+      case SERIALIZE_TYPE_BOOL:   convert_t(read_pod<uint8_t>(ptr) != 0, target); break;
+      case SERIALIZE_TYPE_STRING:
+      {
+        const epee::span<const uint8_t> s = read_string(ptr);
+        convert_t(std::string((const char*)s.data(), s.size()), target);
+        break;
+      }
+      default:
+        CHECK_AND_ASSERT_THROW_MES(false, "WRONG DATA CONVERSION: from entry type " << (unsigned)type << " to type " << typeid(t_value).name());
+      }
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_reader::hsection portable_storage_bin_reader::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT_MES(!create_if_notexist, nullptr, "portable_storage_bin_reader is read only");
+      const entry* pentry = find_entry(section_name, hparent_section);
+      if(!pentry || pentry->type != SERIALIZE_TYPE_OBJECT)
+        return nullptr;
+      m_sections.emplace_back();
+      index_section(pentry->value, m_sections.back(), 1);
+      return &m_sections.back();
+      CATCH_ENTRY("portable_storage_bin_reader::open_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_bin_reader::get_value(const std::string& value_name, t_value& val, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      const entry* pentry = find_entry(value_name, hparent_section);
+      if(!pentry)
+        return false;
+      const uint8_t* ptr = pentry->value;
+      read_value(ptr, pentry->type, val);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_bin_reader::get_value(const std::string& value_name, storage_entry& val, hsection hparent_section)
+    {
+      const entry* pentry = find_entry(value_name, hparent_section);
+      if(!pentry)
+        return false;
+      throwable_buffer_reader buf_reader(pentry->type_ptr, m_end - pentry->type_ptr);
+      val = buf_reader.load_storage_entry();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_bin_reader::get_blob(const std::string& value_name, epee::span<const uint8_t>& blob, hsection hparent_section)
+    {
+      const entry* pentry = find_entry(value_name, hparent_section);
+      if(!pentry)
+        return false;
+      CHECK_AND_ASSERT_THROW_MES(pentry->type == SERIALIZE_TYPE_STRING, "WRONG DATA CONVERSION: blob " << value_name << " is stored with type " << (unsigned)pentry->type);
+      const uint8_t* ptr = pentry->value;
+      blob = read_string(ptr);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    void portable_storage_bin_reader::read_array_value(array_cursor& cursor, t_value& target)
+    {
+      --cursor.remaining;
+      read_value(cursor.next, cursor.type, target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_storage_bin_reader::harray portable_storage_bin_reader::get_first_value(const std::string& value_name, t_value& target, hsection hparent_section)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      const entry* pentry = find_entry(value_name, hparent_section);
+      if(!pentry || !(pentry->type & SERIALIZE_FLAG_ARRAY))
+        return nullptr;
+      m_arrays.emplace_back();
+      array_cursor& cursor = m_arrays.back();
+      cursor.type = pentry->type & ~SERIALIZE_FLAG_ARRAY;
+      cursor.next = pentry->value;
+      cursor.remaining = read_varint(cursor.next);
+      if(!cursor.remaining)
+        return nullptr;
+      read_array_value(cursor, target);
+      return &cursor;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_bin_reader::get_next_value(harray hval_array, t_value& target)
+    {
+      BOOST_MPL_ASSERT(( boost::mpl::contains<storage_entry::types, t_value> ));
+      CHECK_AND_ASSERT(hval_array, false);
+      if(!hval_array->remaining)
+        return false;
+      read_array_value(*hval_array, target);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_reader::harray portable_storage_bin_reader::get_first_section(const std::string& section_name, hsection& h_child_section, hsection hparent_section)
+    {
+      TRY_ENTRY();
+      const entry* pentry = find_entry(section_name, hparent_section);
+      if(!pentry || pentry->type != (SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY))
+        return nullptr;
+      m_arrays.emplace_back();
+      array_cursor& cursor = m_arrays.back();
+      cursor.type = SERIALIZE_TYPE_OBJECT;
+      cursor.next = pentry->value;
+      cursor.remaining = read_varint(cursor.next);
+      if(!get_next_section(&cursor, h_child_section))
+        return nullptr;
+      return &cursor;
+      CATCH_ENTRY("portable_storage_bin_reader::get_first_section", nullptr);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_bin_reader::get_next_section(harray hsec_array, hsection& h_child_section)
+    {
+      TRY_ENTRY();
+      CHECK_AND_ASSERT(hsec_array, false);
+      if(hsec_array->type != SERIALIZE_TYPE_OBJECT || !hsec_array->remaining)
+        return false;
+      --hsec_array->remaining;
+      // the previous element is done with, so its index is reused
+      hsec_array->next = index_section(hsec_array->next, hsec_array->section, 1);
+      h_child_section = &hsec_array->section;
+      return true;
+      CATCH_ENTRY("portable_storage_bin_reader::get_next_section", false);
+    }
+  }
+}
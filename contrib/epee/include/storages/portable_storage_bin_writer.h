@@ -0,0 +1,389 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <deque>
+#include <limits>
+#include <string>
+#include <typeinfo>
+
+#include "misc_log_ex.h"
+#include "chunked_output.h"
+#include "shared_buffer.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+#include "int-util.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /**
+     * @brief counts the entries a KV_SERIALIZE_MAP stores into its own section
+     *
+     * Nested sections and arrays count as one entry and are not walked (see
+     * the overloads below), so counting a struct does not serialize anything.
+     */
+    class portable_storage_entry_counter
+    {
+    public:
+      typedef portable_storage_entry_counter* hsection;
+      typedef portable_storage_entry_counter* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_entry_counter(): m_count(0) {}
+
+      size_t count() const { return m_count; }
+      void add() { ++m_count; }
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false) { add(); return this; }
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& target, hsection hparent_section) { add(); return true; }
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section) { add(); return this; }
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& target) { return true; }
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section) { add(); hinserted_childsection = this; return this; }
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection) { hinserted_childsection = this; return true; }
+
+    private:
+      size_t m_count;
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_struct>
+    size_t count_entries(const t_struct& str_in)
+    {
+      portable_storage_entry_counter counter;
+      str_in.store(counter);
+      return counter.count();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class serializible_type>
+    bool serialize_t_obj(const serializible_type& obj, portable_storage_entry_counter& stg, portable_storage_entry_counter::hsection hparent_section, const char* pname)
+    {
+      stg.add();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_type>
+    bool serialize_t_val_as_blob(const t_type& d, portable_storage_entry_counter& stg, portable_storage_entry_counter::hsection hparent_section, const char* pname)
+    {
+      stg.add();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class stl_container>
+    bool serialize_stl_container_t_val(const stl_container& container, portable_storage_entry_counter& stg, portable_storage_entry_counter::hsection hparent_section, const char* pname)
+    {
+      if(!container.empty())
+        stg.add();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class stl_container>
+    bool serialize_stl_container_pod_val_as_blob(const stl_container& container, portable_storage_entry_counter& stg, portable_storage_entry_counter::hsection hparent_section, const char* pname)
+    {
+      if(!container.empty())
+        stg.add();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class stl_container>
+    bool serialize_stl_container_t_obj(const stl_container& container, portable_storage_entry_counter& stg, portable_storage_entry_counter::hsection hparent_section, const char* pname)
+    {
+      if(!container.empty())
+        stg.add();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool kv_serialize(const shared_buffer& d, portable_storage_entry_counter& stg, portable_storage_entry_counter::hsection hparent_section, const char* pname)
+    {
+      stg.add();
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool kv_serialize(const std::vector<shared_buffer>& d, portable_storage_entry_counter& stg, portable_storage_entry_counter::hsection hparent_section, const char* pname)
+    {
+      if(!d.empty())
+        stg.add();
+      return true;
+    }
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /**
+     * @brief writes KV_SERIALIZE_MAP structs in the binary format straight to a chunked_output
+     *
+     * A drop-in for portable_storage on the store path, which does not build a
+     * section tree: each field is written out as the struct stores it. The
+     * binary format has entry and element counts ahead of the entries. Element
+     * counts are the container sizes, and entry counts are taken by running a
+     * struct's map through portable_storage_entry_counter first, so nothing is
+     * held back and the output is handed on as it is written. The result is
+     * what portable_storage::store_to_binary gives, but with fields in the
+     * order they are stored in rather than sorted by name.
+     *
+     * shared_buffer fields are written as strings, and handed on as they are
+     * rather than copied into the output (see chunked_output::write_shared).
+     *
+     * Storing into a section closes any section or array opened after it.
+     */
+    class portable_storage_bin_writer
+    {
+    public:
+      struct scope
+      {
+        size_t count;
+        size_t expected;       // the count written ahead of the entries
+        uint8_t array_type;    // the element type for arrays, 0 for sections
+      };
+      typedef scope* hsection;
+      typedef scope* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_bin_writer(chunked_output& out, size_t root_entries);
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, size_t entries);
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      bool set_value(const std::string& value_name, const storage_entry& target, hsection hparent_section);
+
+      //! opens an array of `elements` values of `array_type`, or of sections for SERIALIZE_TYPE_OBJECT
+      harray open_array(const std::string& array_name, uint8_t array_type, size_t elements, hsection hparent_section);
+      template<class t_value>
+      bool insert_value(harray hval_array, const t_value& target);
+      hsection insert_section(harray hsec_array, size_t entries);
+
+      //! closes all open sections and hands the output on, false if the sink refused it
+      bool finish();
+
+      static uint8_t type_code(const uint64_t&) { return SERIALIZE_TYPE_UINT64; }
+      static uint8_t type_code(const uint32_t&) { return SERIALIZE_TYPE_UINT32; }
+      static uint8_t type_code(const uint16_t&) { return SERIALIZE_TYPE_UINT16; }
+      static uint8_t type_code(const uint8_t&) { return SERIALIZE_TYPE_UINT8; }
+      static uint8_t type_code(const int64_t&) { return SERIALIZE_TYPE_INT64; }
+      static uint8_t type_code(const int32_t&) { return SERIALIZE_TYPE_INT32; }
+      static uint8_t type_code(const int16_t&) { return SERIALIZE_TYPE_INT16; }
+      static uint8_t type_code(const int8_t&) { return SERIALIZE_TYPE_INT8; }
+      static uint8_t type_code(const double&) { return SERIALIZE_TYPE_DUOBLE; }
+      static uint8_t type_code(const bool&) { return SERIALIZE_TYPE_BOOL; }
+      static uint8_t type_code(const std::string&) { return SERIALIZE_TYPE_STRING; }
+      static uint8_t type_code(const shared_buffer&) { return SERIALIZE_TYPE_STRING; }
+
+    private:
+      scope& enter(hsection hsec);
+      void begin_entry(scope& sec, const std::string& name);
+      scope& open_scope(uint8_t array_type, size_t expected);
+      void close_scope();
+
+      void write_value(const std::string& v) { put_string(m_out, v); }
+      void write_value(const shared_buffer& v) { pack_varint(m_out, v.size()); m_out.write_shared(v); }
+      template<class t_pod_type>
+      void write_value(const t_pod_type& v) { m_out.write((const char*)&v, sizeof(v)); }
+
+      chunked_output& m_out;
+      std::deque<scope> m_scopes; // the open sections and arrays, the root first
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_writer::portable_storage_bin_writer(chunked_output& out, size_t root_entries):
+      m_out(out)
+    {
+      const uint32_t signature_a = SWAP32LE(PORTABLE_STORAGE_SIGNATUREA);
+      const uint32_t signature_b = SWAP32LE(PORTABLE_STORAGE_SIGNATUREB);
+      const uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+      m_out.write((const char*)&signature_a, sizeof(signature_a));
+      m_out.write((const char*)&signature_b, sizeof(signature_b));
+      m_out.write((const char*)&ver, sizeof(ver));
+      open_scope(0, root_entries);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_writer::scope& portable_storage_bin_writer::enter(hsection hsec)
+    {
+      size_t level = m_scopes.size();
+      if(hsec)
+      {
+        while(level && &m_scopes[level - 1] != hsec)
+          --level;
+      }
+      else if(level)
+      {
+        level = 1;
+      }
+      CHECK_AND_ASSERT_THROW_MES(level, "portable_storage_bin_writer: section is not open");
+      while(m_scopes.size() > level)
+        close_scope();
+      return m_scopes.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_bin_writer::begin_entry(scope& sec, const std::string& name)
+    {
+      CHECK_AND_ASSERT_THROW_MES(!sec.array_type, "portable_storage_bin_writer: entry " << name << " added to an array");
+      CHECK_AND_ASSERT_THROW_MES(sec.count < sec.expected, "portable_storage_bin_writer: more entries than the " << sec.expected << " counted, at " << name);
+      CHECK_AND_ASSERT_THROW_MES(name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << name.size() << ", val: " << name);
+      const uint8_t len = static_cast<uint8_t>(name.size());
+      m_out.write((const char*)&len, sizeof(len));
+      m_out.write(name);
+      ++sec.count;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_writer::scope& portable_storage_bin_writer::open_scope(uint8_t array_type, size_t expected)
+    {
+      pack_varint(m_out, expected);
+      m_scopes.push_back(scope{0, expected, array_type});
+      return m_scopes.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_bin_writer::close_scope()
+    {
+      const scope& s = m_scopes.back();
+      CHECK_AND_ASSERT_THROW_MES(s.count == s.expected, "portable_storage_bin_writer: " << s.count << " entries stored, " << s.expected << " counted");
+      m_scopes.pop_back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_writer::hsection portable_storage_bin_writer::open_section(const std::string& section_name, hsection hparent_section, size_t entries)
+    {
+      begin_entry(enter(hparent_section), section_name);
+      const uint8_t type = SERIALIZE_TYPE_OBJECT;
+      m_out.write((const char*)&type, sizeof(type));
+      return &open_scope(0, entries);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_bin_writer::set_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+    {
+      begin_entry(enter(hparent_section), value_name);
+      const uint8_t type = type_code(target);
+      m_out.write((const char*)&type, sizeof(type));
+      write_value(target);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_bin_writer::set_value(const std::string& value_name, const storage_entry& target, hsection hparent_section)
+    {
+      begin_entry(enter(hparent_section), value_name);
+      return pack_entry_to_buff(m_out, target);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_writer::harray portable_storage_bin_writer::open_array(const std::string& array_name, uint8_t array_type, size_t elements, hsection hparent_section)
+    {
+      begin_entry(enter(hparent_section), array_name);
+      const uint8_t type = array_type | SERIALIZE_FLAG_ARRAY;
+      m_out.write((const char*)&type, sizeof(type));
+      return &open_scope(array_type, elements);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_bin_writer::insert_value(harray hval_array, const t_value& target)
+    {
+      CHECK_AND_ASSERT(hval_array, false);
+      scope& arr = enter(hval_array);
+      CHECK_AND_ASSERT_MES(arr.array_type == type_code(target), false, "unexpected type in insert_value: " << typeid(t_value).name());
+      CHECK_AND_ASSERT_THROW_MES(arr.count < arr.expected, "portable_storage_bin_writer: more elements than the " << arr.expected << " counted");
+      write_value(target);
+      ++arr.count;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_bin_writer::hsection portable_storage_bin_writer::insert_section(harray hsec_array, size_t entries)
+    {
+      CHECK_AND_ASSERT(hsec_array, nullptr);
+      scope& arr = enter(hsec_array);
+      CHECK_AND_ASSERT_MES(arr.array_type == SERIALIZE_TYPE_OBJECT, nullptr, "unexpected type in insert_section");
+      CHECK_AND_ASSERT_THROW_MES(arr.count < arr.expected, "portable_storage_bin_writer: more sections than the " << arr.expected << " counted");
+      ++arr.count;
+      return &open_scope(0, entries);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_bin_writer::finish()
+    {
+      while(!m_scopes.empty())
+        close_scope();
+      return m_out.flush();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class serializible_type>
+    bool serialize_t_obj(const serializible_type& obj, portable_storage_bin_writer& stg, portable_storage_bin_writer::hsection hparent_section, const char* pname)
+    {
+      portable_storage_bin_writer::hsection hchild_section = stg.open_section(pname, hparent_section, count_entries(obj));
+      return obj.store(stg, hchild_section);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class stl_container>
+    bool serialize_stl_container_t_val(const stl_container& container, portable_storage_bin_writer& stg, portable_storage_bin_writer::hsection hparent_section, const char* pname)
+    {
+      if(container.empty())
+        return true;
+      typename stl_container::const_iterator it = container.begin();
+      portable_storage_bin_writer::harray hval_array = stg.open_array(pname, portable_storage_bin_writer::type_code(*it), container.size(), hparent_section);
+      for(; it != container.end(); ++it)
+        stg.insert_value(hval_array, *it);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class stl_container>
+    bool serialize_stl_container_t_obj(const stl_container& container, portable_storage_bin_writer& stg, portable_storage_bin_writer::hsection hparent_section, const char* pname)
+    {
+      if(container.empty())
+        return true;
+      bool res = false;
+      portable_storage_bin_writer::harray hsec_array = stg.open_array(pname, SERIALIZE_TYPE_OBJECT, container.size(), hparent_section);
+      for(typename stl_container::const_iterator it = container.begin(); it != container.end(); ++it)
+        res |= it->store(stg, stg.insert_section(hsec_array, count_entries(*it)));
+      return res;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool kv_serialize(const shared_buffer& d, portable_storage_bin_writer& stg, portable_storage_bin_writer::hsection hparent_section, const char* pname)
+    {
+      return stg.set_value(pname, d, hparent_section);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool kv_serialize(const std::vector<shared_buffer>& d, portable_storage_bin_writer& stg, portable_storage_bin_writer::hsection hparent_section, const char* pname)
+    {
+      return serialize_stl_container_t_val(d, stg, hparent_section, pname);
+    }
+  }
+}
@@ -0,0 +1,288 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <deque>
+#include <sstream>
+#include <string>
+
+#include "misc_log_ex.h"
+#include "chunked_output.h"
+#include "parserse_base_utils.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_json.h"
+
+namespace epee
+{
+  namespace serialization
+  {
+    /************************************************************************/
+    /*                                                                      */
+    /************************************************************************/
+    /**
+     * @brief writes KV_SERIALIZE_MAP structs as JSON straight to a chunked_output
+     *
+     * A drop-in for portable_storage on the store path, which does not build a
+     * section tree: each field is written out as the struct stores it, so
+     * output can be handed on while the rest is still being written. The text
+     * is what portable_storage::dump_as_json gives, except that fields come in
+     * the order they are stored in rather than sorted by name.
+     *
+     * Storing into a section closes any section or array opened after it.
+     */
+    class portable_storage_json_writer
+    {
+    public:
+      struct scope
+      {
+        size_t indent;
+        bool array;
+        size_t count; // entries or elements written so far
+      };
+      typedef scope* hsection;
+      typedef scope* harray;
+      typedef storage_entry meta_entry;
+
+      portable_storage_json_writer(chunked_output& out, size_t indent = 0, bool insert_newlines = true);
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist = false);
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section);
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& target);
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section);
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection);
+
+      //! closes all open sections and hands the output on, false if the sink refused it
+      bool finish();
+
+    private:
+      scope& enter(hsection hsec);
+      void begin_entry(scope& sec, const std::string& name);
+      scope& open_scope(size_t indent, bool array);
+      void close_scope();
+
+      void write_value(const std::string& v);
+      void write_value(const bool& v);
+      void write_value(const int8_t& v) { m_out.write(std::to_string(static_cast<int32_t>(v))); }
+      void write_value(const uint8_t& v) { m_out.write(std::to_string(static_cast<int32_t>(v))); }
+      void write_value(const double& v);
+      void write_value(const storage_entry& v);
+      template<class t_value>
+      void write_value(const t_value& v) { m_out.write(std::to_string(v)); }
+
+      chunked_output& m_out;
+      std::string m_newline;
+      std::deque<scope> m_scopes; // the open sections and arrays, the root first
+    };
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_json_writer::portable_storage_json_writer(chunked_output& out, size_t indent, bool insert_newlines):
+      m_out(out),
+      m_newline(insert_newlines ? "\r\n" : "")
+    {
+      open_scope(indent, false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_json_writer::scope& portable_storage_json_writer::enter(hsection hsec)
+    {
+      size_t level = m_scopes.size();
+      if(hsec)
+      {
+        while(level && &m_scopes[level - 1] != hsec)
+          --level;
+      }
+      else if(level)
+      {
+        level = 1;
+      }
+      CHECK_AND_ASSERT_THROW_MES(level, "portable_storage_json_writer: section is not open");
+      while(m_scopes.size() > level)
+        close_scope();
+      return m_scopes.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_json_writer::begin_entry(scope& sec, const std::string& name)
+    {
+      CHECK_AND_ASSERT_THROW_MES(!sec.array, "portable_storage_json_writer: entry " << name << " added to an array");
+      if(sec.count++)
+      {
+        m_out.write(",", 1);
+        m_out.write(m_newline);
+      }
+      m_out.write(make_indent(sec.indent + 1));
+      write_value(name);
+      m_out.write(": ", 2);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_json_writer::scope& portable_storage_json_writer::open_scope(size_t indent, bool array)
+    {
+      if(array)
+      {
+        m_out.write("[", 1);
+      }
+      else
+      {
+        m_out.write("{", 1);
+        m_out.write(m_newline);
+      }
+      m_scopes.push_back(scope{indent, array, 0});
+      return m_scopes.back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_json_writer::close_scope()
+    {
+      const scope& s = m_scopes.back();
+      if(s.array)
+      {
+        m_out.write("]", 1);
+      }
+      else
+      {
+        if(s.count)
+          m_out.write(m_newline);
+        m_out.write(make_indent(s.indent));
+        m_out.write("}", 1);
+      }
+      m_scopes.pop_back();
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_json_writer::write_value(const std::string& v)
+    {
+      m_out.write("\"", 1);
+      m_out.write(misc_utils::parse::transform_to_escape_sequence(v));
+      m_out.write("\"", 1);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_json_writer::write_value(const bool& v)
+    {
+      if(v)
+        m_out.write("true", 4);
+      else
+        m_out.write("false", 5);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_json_writer::write_value(const double& v)
+    {
+      std::stringstream ss;
+      ss << v;
+      m_out.write(ss.str());
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    void portable_storage_json_writer::write_value(const storage_entry& v)
+    {
+      std::stringstream ss;
+      dump_as_json(ss, v, m_scopes.back().indent + 1, !m_newline.empty());
+      m_out.write(ss.str());
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_json_writer::hsection portable_storage_json_writer::open_section(const std::string& section_name, hsection hparent_section, bool create_if_notexist)
+    {
+      scope& parent = enter(hparent_section);
+      begin_entry(parent, section_name);
+      return &open_scope(parent.indent + 1, false);
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_json_writer::set_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+    {
+      begin_entry(enter(hparent_section), value_name);
+      write_value(target);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    portable_storage_json_writer::harray portable_storage_json_writer::insert_first_value(const std::string& value_name, const t_value& target, hsection hparent_section)
+    {
+      scope& parent = enter(hparent_section);
+      begin_entry(parent, value_name);
+      scope& arr = open_scope(parent.indent + 1, true);
+      write_value(target);
+      ++arr.count;
+      return &arr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    template<class t_value>
+    bool portable_storage_json_writer::insert_next_value(harray hval_array, const t_value& target)
+    {
+      CHECK_AND_ASSERT(hval_array, false);
+      scope& arr = enter(hval_array);
+      CHECK_AND_ASSERT_THROW_MES(arr.array, "portable_storage_json_writer: value added to a section as an array element");
+      m_out.write(",", 1);
+      write_value(target);
+      ++arr.count;
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    portable_storage_json_writer::harray portable_storage_json_writer::insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+    {
+      scope& parent = enter(hparent_section);
+      begin_entry(parent, section_name);
+      scope& arr = open_scope(parent.indent + 1, true);
+      ++arr.count;
+      // sections in an array are indented like the array itself
+      hinserted_childsection = &open_scope(arr.indent, false);
+      return &arr;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_json_writer::insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+    {
+      CHECK_AND_ASSERT(hsec_array, false);
+      scope& arr = enter(hsec_array);
+      CHECK_AND_ASSERT_THROW_MES(arr.array, "portable_storage_json_writer: section added to a section as an array element");
+      m_out.write(",", 1);
+      ++arr.count;
+      hinserted_childsection = &open_scope(arr.indent, false);
+      return true;
+    }
+    //---------------------------------------------------------------------------------------------------------------
+    inline
+    bool portable_storage_json_writer::finish()
+    {
+      while(!m_scopes.empty())
+        close_scope();
+      return m_out.flush();
+    }
+  }
+}
@@ -30,6 +30,9 @@
 
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_bin_reader.h"
+#include "portable_storage_bin_writer.h"
+#include "portable_storage_json_writer.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -68,6 +71,14 @@ namespace epee
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
+    bool store_t_to_json(t_struct& str_in, chunked_output& out, size_t indent = 0, bool insert_newlines = true)
+    {
+      portable_storage_json_writer writer(out, indent, insert_newlines);
+      str_in.store(writer);
+      return writer.finish();
+    }
+    //-----------------------------------------------------------------------------------------------------------
+    template<class t_struct>
     std::string store_t_to_json(t_struct& str_in, size_t indent = 0, bool insert_newlines = true)
     {
       std::string json_buff;
@@ -86,7 +97,7 @@ namespace epee
     template<class t_struct>
     bool load_t_from_binary(t_struct& out, const epee::span<const uint8_t> binary_buff)
     {
-      portable_storage ps;
+      portable_storage_bin_reader ps;
       bool rs = ps.load_from_binary(binary_buff);
       if(!rs)
         return false;
@@ -119,6 +130,14 @@ namespace epee
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
+    bool store_t_to_binary(t_struct& str_in, chunked_output& out)
+    {
+      portable_storage_bin_writer writer(out, count_entries(str_in));
+      str_in.store(writer);
+      return writer.finish();
+    }
+    //-----------------------------------------------------------------------------------------------------------
+    template<class t_struct>
     std::string store_t_to_binary(t_struct& str_in, size_t indent = 0)
     {
       std::string binary_buff;
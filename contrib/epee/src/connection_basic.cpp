@@ -41,6 +41,7 @@
 #include "misc_language.h"
 #include "pragma_comp_defs.h"
 #include <iomanip>
+#include <chrono>
 
 #include <boost/asio/basic_socket.hpp>
 
@@ -116,6 +117,100 @@ namespace epee
 namespace net_utils
 {
 
+// ================================================================================================
+// send_queue
+// ================================================================================================
+
+send_queue::send_queue()
+	: m_bytes(), m_count(0), m_current_priority(send_priority_block), m_have_current(false), m_offset(0), m_write_size(0)
+{
+}
+
+void send_queue::push(send_que_entry&& entry, send_priority priority)
+{
+	m_bytes[priority] += entry.size();
+	m_queues[priority].push_back(std::move(entry));
+	++m_count;
+}
+
+send_queue::buffers_t send_queue::start_write(size_t max_size)
+{
+	CHECK_AND_ASSERT_THROW_MES(!writing(), "a write is already in progress");
+	if (!m_have_current)
+	{
+		CHECK_AND_ASSERT_THROW_MES(m_count != 0, "nothing to write");
+		size_t priority = 0;
+		while (m_queues[priority].empty())
+			++priority;
+		m_current = std::move(m_queues[priority].front());
+		m_queues[priority].pop_front();
+		--m_count;
+		m_current_priority = send_priority(priority);
+		m_have_current = true;
+		m_offset = 0;
+	}
+	m_write_size = std::min(max_size, m_current.size() - m_offset);
+	return write_buffers();
+}
+
+send_queue::buffers_t send_queue::write_buffers() const
+{
+	const std::string &head = m_current.head;
+	const shared_buffer &body = m_current.body;
+	const size_t end = m_offset + m_write_size;
+	const size_t head_start = std::min(m_offset, head.size());
+	const size_t head_end = std::min(end, head.size());
+	const size_t body_start = m_offset - head_start;
+	const size_t body_end = end - head_end;
+	return {{
+		boost::asio::buffer(head.data() + head_start, head_end - head_start),
+		boost::asio::buffer(body.data() + body_start, body_end - body_start)
+	}};
+}
+
+void send_queue::finish_write()
+{
+	m_bytes[m_current_priority] -= m_write_size;
+	m_offset += m_write_size;
+	m_write_size = 0;
+	if (m_offset == m_current.size())
+	{
+		m_current = send_que_entry();
+		m_have_current = false;
+		m_offset = 0;
+	}
+}
+
+// ================================================================================================
+// token_bucket
+// ================================================================================================
+
+token_bucket::token_bucket(double burst)
+	: m_rate(0), m_burst(burst), m_tokens(0), m_last(0)
+{
+}
+
+void token_bucket::set_rate(double rate)
+{
+	if (rate == m_rate)
+		return;
+	m_rate = rate;
+	m_tokens = std::min(m_tokens, m_rate * m_burst);
+}
+
+double token_bucket::take(size_t bytes, double now)
+{
+	if (m_rate <= 0)
+		return 0; // no limit
+	if (now > m_last)
+	{
+		m_tokens = std::min(m_tokens + (now - m_last) * m_rate, m_rate * m_burst);
+		m_last = now;
+	}
+	m_tokens -= bytes;
+	return m_tokens < 0 ? -m_tokens / m_rate : 0;
+}
+
 // ================================================================================================
 // connection_basic_pimpl
 // ================================================================================================
@@ -129,6 +224,9 @@ connection_basic_pimpl::connection_basic_pimpl(const std::string &name) : m_thro
 // static variables:
 int connection_basic_pimpl::m_default_tos;
 
+// the io_service the current thread alone runs, in io_service per thread mode
+static __thread boost::asio::io_service* thread_io_service = NULL;
+
 // methods:
 connection_basic::connection_basic(boost::asio::ip::tcp::socket&& sock, boost::shared_ptr<connection_basic_shared_state> state, ssl_support_t ssl_support)
 	: m_state(std::move(state)),
@@ -182,6 +280,14 @@ connection_basic::~connection_basic() noexcept(false) {
 	_note("Destructing connection #" << mI->m_peer_number << " to " << remote_addr_str);
 }
 
+void connection_basic::set_thread_io_service(boost::asio::io_service* io_service) {
+	thread_io_service = io_service;
+}
+
+bool connection_basic::runs_on_this_thread_only() {
+	return thread_io_service && thread_io_service == &GET_IO_SERVICE(socket());
+}
+
 void connection_basic::set_rate_up_limit(uint64_t limit) {
 	{
 		CRITICAL_REGION_LOCAL( network_throttle_manager::m_lock_get_global_throttle_out );
@@ -232,34 +338,24 @@ int connection_basic::get_tos_flag() {
 	return connection_basic_pimpl::m_default_tos;
 }
 
-void connection_basic::sleep_before_packet(size_t packet_size, int phase, int q_len) {
-	double delay = 0; // will be calculated
-	do
-	{ // rate limiting
-		if (m_was_shutdown) {
-			_dbg2("m_was_shutdown - so abort sleep");
-			return;
-		}
-
-		{
-			CRITICAL_REGION_LOCAL( network_throttle_manager::m_lock_get_global_throttle_out );
-			delay = network_throttle_manager::get_global_throttle_out().get_sleep_time_after_tick( packet_size );
-		}
-
-		delay *= 0.50;
-		if (delay > 0) {
-            long int ms = (long int)(delay * 1000);
-			MTRACE("Sleeping in " << __FUNCTION__ << " for " << ms << " ms before packet_size=" << packet_size); // debug sleep
-			boost::this_thread::sleep(boost::posix_time::milliseconds( ms ) );
-		}
-	} while(delay > 0);
-
-// XXX LATER XXX
+double connection_basic::get_send_delay(size_t packet_size) {
+	// each connection fills its own bucket at an even share of the global upload
+	// limit, so a big write on one connection does not hold back the others
+	const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	const long connections = std::max(m_state->sock_count.load(), 1l);
+
+	double rate;
 	{
-	  CRITICAL_REGION_LOCAL( network_throttle_manager::m_lock_get_global_throttle_out );
-		network_throttle_manager::get_global_throttle_out().handle_trafic_exact( packet_size ); // increase counter - global
+		CRITICAL_REGION_LOCAL( network_throttle_manager::m_lock_get_global_throttle_out );
+		i_network_throttle &throttle = network_throttle_manager::get_global_throttle_out();
+		throttle.handle_trafic_exact( packet_size ); // increase counter - global
+		rate = throttle.get_target_speed() * 1024;
 	}
-
+	m_send_bucket.set_rate(rate / connections);
+	const double delay = m_send_bucket.take(packet_size, now);
+	if (delay > 0)
+		MTRACE("Delaying packet_size=" << packet_size << " by " << (long int)(delay * 1000) << " ms");
+	return delay;
 }
 
 void connection_basic::do_send_handler_write(const void* ptr, size_t cb) {
@@ -337,6 +337,21 @@ bool BlockchainDB::get_pruned_tx(const crypto::hash& h, cryptonote::transaction
   return true;
 }
 
+void BlockchainDB::get_block_blob_view_from_height(const uint64_t& height, const std::function<void(const cryptonote::blobdata_ref&)> &f) const
+{
+  const blobdata bd = get_block_blob_from_height(height);
+  f(blobdata_ref{bd.data(), bd.size()});
+}
+
+bool BlockchainDB::get_tx_blob_view(const crypto::hash& h, bool pruned, const std::function<void(const cryptonote::blobdata_ref&, const cryptonote::blobdata_ref&)> &f) const
+{
+  blobdata bd;
+  if (!(pruned ? get_pruned_tx_blob(h, bd) : get_tx_blob(h, bd)))
+    return false;
+  f(blobdata_ref{bd.data(), bd.size()}, blobdata_ref{});
+  return true;
+}
+
 transaction BlockchainDB::get_tx(const crypto::hash& h) const
 {
   transaction tx;
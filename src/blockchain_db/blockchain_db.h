@@ -909,6 +909,20 @@ public:
    */
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const = 0;
 
+  /**
+   * @brief gives a view of the block blob at the given height
+   *
+   * The view points straight into the database where the subclass allows
+   * it, and is only valid while f runs: f must copy whatever it keeps.
+   * The default implementation copies the blob first.
+   *
+   * If the block does not exist, the subclass should throw BLOCK_DNE
+   *
+   * @param height the height to look for
+   * @param f the function to call with the block blob
+   */
+  virtual void get_block_blob_view_from_height(const uint64_t& height, const std::function<void(const cryptonote::blobdata_ref&)> &f) const;
+
   /**
    * @brief fetch a block by height
    *
@@ -1266,6 +1280,27 @@ public:
    */
   virtual bool get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const = 0;
 
+  /**
+   * @brief gives a view of the transaction blob with the given hash
+   *
+   * The blob is given as its pruned and prunable parts, which make up the
+   * whole transaction blob when concatenated. The views point straight into
+   * the database where the subclass allows it, and are only valid while f
+   * runs: f must copy whatever it keeps. The default implementation copies
+   * the blob first.
+   *
+   * If the transaction does not exist, or if its prunable data is wanted
+   * and we do not have it, the subclass should return false.
+   *
+   * @param h the hash to look for
+   * @param pruned whether only the pruned part is wanted, if so the
+   *        prunable part given to f is empty
+   * @param f the function to call with the pruned and prunable parts
+   *
+   * @return true iff the transaction was found
+   */
+  virtual bool get_tx_blob_view(const crypto::hash& h, bool pruned, const std::function<void(const cryptonote::blobdata_ref&, const cryptonote::blobdata_ref&)> &f) const;
+
   /**
    * @brief fetches the prunable transaction hash
    *
@@ -1595,6 +1630,28 @@ public:
    * @brief drop all alternative blocks
    */
   virtual void drop_alt_blocks() = 0;
+
+  /**
+   * @brief stores a block's proof of work hash in the PoW hash index
+   *
+   * The index is keyed by block hash, so an entry stays valid when its
+   * block is popped or is on an alternative chain, and can be used again
+   * when the block is (re)added to the main chain.
+   *
+   * @param: blkid the block hash
+   * @param: pow_hash the block's proof of work hash
+   */
+  virtual void add_block_pow_hash(const crypto::hash &blkid, const crypto::hash &pow_hash) = 0;
+
+  /**
+   * @brief gets a block's proof of work hash from the PoW hash index
+   *
+   * @param: blkid the block hash
+   * @param: pow_hash return-by-reference the block's proof of work hash
+   *
+   * @return true if the block's PoW hash was found, false otherwise
+   */
+  virtual bool get_block_pow_hash(const crypto::hash &blkid, crypto::hash &pow_hash) const = 0;
   
   /**
    * @brief runs a function over all txpool transactions
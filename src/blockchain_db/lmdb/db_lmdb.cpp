@@ -32,6 +32,7 @@
 #include <boost/circular_buffer.hpp>
 #include <memory>  // std::unique_ptr
 #include <cstring>  // memcpy
+#include <algorithm>  // std::sort
 
 #include "string_tools.h"
 #include "file_io_utils.h"
@@ -196,6 +197,8 @@ namespace
  *
  * alt_blocks       block hash   {block data, block blob}
  *
+ * block_pow_hashes block hash   PoW hash
+ *
  * Note: where the data items are of uniform size, DUPFIXED tables have
  * been used to save space. In most of these cases, a dummy "zerokval"
  * key is used when accessing the table; the Key listed above will be
@@ -225,6 +228,8 @@ const char* const LMDB_TXPOOL_BLOB = "txpool_blob";
 
 const char* const LMDB_ALT_BLOCKS = "alt_blocks";
 
+const char* const LMDB_BLOCK_POW_HASHES = "block_pow_hashes";
+
 const char* const LMDB_HF_STARTING_HEIGHTS = "hf_starting_heights";
 const char* const LMDB_HF_VERSIONS = "hf_versions";
 
@@ -245,6 +250,76 @@ inline void lmdb_db_open(MDB_txn* txn, const char* name, int flags, MDB_dbi& dbi
     throw0(cryptonote::DB_OPEN_FAILURE((lmdb_error(error_string + " : ", res) + std::string(" - you may want to start with --db-salvage")).c_str()));
 }
 
+// one entry of a batched lookup: which duplicate to find, and where the
+// caller wants the result
+struct dup_lookup
+{
+  uint64_t key;
+  uint64_t index;
+  size_t position;
+
+  bool operator<(const dup_lookup &other) const
+  {
+    return key < other.key || (key == other.key && (index < other.index || (index == other.index && position < other.position)));
+  }
+};
+
+// Finds fixed size duplicates of one key, whose data starts with a uint64_t
+// index, for lookups sorted by index. Rather than a MDB_GET_BOTH per lookup,
+// each leaf page is read whole with MDB_GET_MULTIPLE and merged against all
+// the lookups it covers; nearby lookups continue on the next page with
+// MDB_NEXT_MULTIPLE, and only far ones search the tree again.
+// found(position, data) is called for every lookup which exists.
+template<typename F>
+void get_sorted_dups(MDB_cursor *cur, MDB_val k, size_t item_size, const dup_lookup *begin, const dup_lookup *end, const F &found)
+{
+  const dup_lookup *lookup = begin;
+  while (lookup != end)
+  {
+    uint64_t index = lookup->index;
+    MDB_val v = {sizeof(index), (void *)&index};
+    int result = mdb_cursor_get(cur, &k, &v, MDB_GET_BOTH);
+    if (result == MDB_NOTFOUND)
+    {
+      ++lookup;
+      continue;
+    }
+    if (result == 0)
+      result = mdb_cursor_get(cur, &k, &v, MDB_GET_MULTIPLE);
+    while (result == 0)
+    {
+      const char *items = (const char *)v.mv_data;
+      const size_t n_items = v.mv_size / item_size;
+      if (n_items == 0)
+        throw0(cryptonote::DB_ERROR("Unexpected empty page of duplicates"));
+      size_t i = 0;
+      uint64_t item_index = 0;
+      while (lookup != end && i < n_items)
+      {
+        memcpy(&item_index, items + i * item_size, sizeof(item_index));
+        if (item_index < lookup->index)
+          ++i;
+        else
+        {
+          if (item_index == lookup->index)
+            found(lookup->position, items + i * item_size);
+          ++lookup;
+        }
+      }
+      if (lookup == end)
+        return;
+      memcpy(&item_index, items + (n_items - 1) * item_size, sizeof(item_index));
+      if (lookup->index - item_index > n_items)
+        break;
+      result = mdb_cursor_get(cur, &k, &v, MDB_NEXT_MULTIPLE);
+    }
+    if (result == MDB_NOTFOUND)
+      return;
+    if (result)
+      throw0(cryptonote::DB_ERROR(lmdb_error("Error attempting to look up duplicates: ", result).c_str()));
+  }
+}
+
 
 }  // anonymous namespace
 
@@ -1391,6 +1466,20 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
 
   lmdb_db_open(txn, LMDB_ALT_BLOCKS, MDB_CREATE, m_alt_blocks, "Failed to open db handle for m_alt_blocks");
 
+  // this subdb was added without a schema version bump, so an older database
+  // opened read-only will not have it. It is only a cache, so we do without.
+  m_has_block_pow_hashes = true;
+  if (mdb_flags & MDB_RDONLY)
+  {
+    result = mdb_dbi_open(txn, LMDB_BLOCK_POW_HASHES, 0, &m_block_pow_hashes);
+    if (result == MDB_NOTFOUND)
+      m_has_block_pow_hashes = false;
+    else if (result)
+      throw0(DB_OPEN_FAILURE(lmdb_error("Failed to open db handle for m_block_pow_hashes : ", result).c_str()));
+  }
+  else
+    lmdb_db_open(txn, LMDB_BLOCK_POW_HASHES, MDB_CREATE, m_block_pow_hashes, "Failed to open db handle for m_block_pow_hashes");
+
   // this subdb is dropped on sight, so it may not be present when we open the DB.
   // Since we use MDB_CREATE, we'll get an exception if we open read-only and it does not exist.
   // So we don't open for read-only, and also not drop below. It is not used elsewhere.
@@ -1415,6 +1504,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   mdb_set_compare(txn, m_txpool_meta, compare_hash32);
   mdb_set_compare(txn, m_txpool_blob, compare_hash32);
   mdb_set_compare(txn, m_alt_blocks, compare_hash32);
+  if (m_has_block_pow_hashes)
+    mdb_set_compare(txn, m_block_pow_hashes, compare_hash32);
   mdb_set_compare(txn, m_properties, compare_string);
 
   if (!(mdb_flags & MDB_RDONLY))
@@ -1582,6 +1673,8 @@ void BlockchainLMDB::reset()
     throw0(DB_ERROR(lmdb_error("Failed to drop m_output_amounts: ", result).c_str()));
   if (auto result = mdb_drop(txn, m_spent_keys, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_spent_keys: ", result).c_str()));
+  if (auto result = mdb_drop(txn, m_block_pow_hashes, 0))
+    throw0(DB_ERROR(lmdb_error("Failed to drop m_block_pow_hashes: ", result).c_str()));
   (void)mdb_drop(txn, m_hf_starting_heights, 0); // this one is dropped in new code
   if (auto result = mdb_drop(txn, m_hf_versions, 0))
     throw0(DB_ERROR(lmdb_error("Failed to drop m_hf_versions: ", result).c_str()));
@@ -2372,6 +2465,30 @@ cryptonote::blobdata BlockchainLMDB::get_block_blob_from_height(const uint64_t&
   return bd;
 }
 
+void BlockchainLMDB::get_block_blob_view_from_height(const uint64_t& height, const std::function<void(const cryptonote::blobdata_ref&)> &f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(blocks);
+
+  MDB_val_copy<uint64_t> key(height);
+  MDB_val result;
+  auto get_result = mdb_cursor_get(m_cur_blocks, &key, &result, MDB_SET);
+  if (get_result == MDB_NOTFOUND)
+  {
+    throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+  }
+  else if (get_result)
+    throw0(DB_ERROR("Error attempting to retrieve a block from the db"));
+
+  // the data stays mapped until the read txn ends, which is after f returns
+  f(blobdata_ref{reinterpret_cast<const char*>(result.mv_data), result.mv_size});
+
+  TXN_POSTFIX_RDONLY();
+}
+
 uint64_t BlockchainLMDB::get_block_timestamp(const uint64_t& height) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2928,6 +3045,7 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
+  bd.reserve(result0.mv_size + result1.mv_size);
   bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
   bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
 
@@ -2996,6 +3114,40 @@ bool BlockchainLMDB::get_prunable_tx_blob(const crypto::hash& h, cryptonote::blo
   return true;
 }
 
+bool BlockchainLMDB::get_tx_blob_view(const crypto::hash& h, bool pruned, const std::function<void(const cryptonote::blobdata_ref&, const cryptonote::blobdata_ref&)> &f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(tx_indices);
+  RCURSOR(txs_pruned);
+  RCURSOR(txs_prunable);
+
+  MDB_val_set(v, h);
+  MDB_val result0, result1 = {0, NULL};
+  auto get_result = mdb_cursor_get(m_cur_tx_indices, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
+  if (get_result == 0)
+  {
+    const txindex *tip = (const txindex *)v.mv_data;
+    MDB_val_set(val_tx_id, tip->data.tx_id);
+    get_result = mdb_cursor_get(m_cur_txs_pruned, &val_tx_id, &result0, MDB_SET);
+    if (get_result == 0 && !pruned)
+      get_result = mdb_cursor_get(m_cur_txs_prunable, &val_tx_id, &result1, MDB_SET);
+  }
+  if (get_result == MDB_NOTFOUND)
+    return false;
+  else if (get_result)
+    throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
+
+  f(blobdata_ref{reinterpret_cast<const char*>(result0.mv_data), result0.mv_size},
+    blobdata_ref{reinterpret_cast<const char*>(result1.mv_data), result1.mv_size});
+
+  TXN_POSTFIX_RDONLY();
+
+  return true;
+}
+
 bool BlockchainLMDB::get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -3298,10 +3450,8 @@ bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, st
     if (ret)
       throw0(DB_ERROR("Failed to enumerate blocks"));
     uint64_t height = *(const uint64_t*)k.mv_data;
-    blobdata bd;
-    bd.assign(reinterpret_cast<char*>(v.mv_data), v.mv_size);
     block b;
-    if (!parse_and_validate_block_from_blob(bd, b))
+    if (!parse_and_validate_block_from_blob(blobdata_ref{reinterpret_cast<const char*>(v.mv_data), v.mv_size}, b))
       throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
     crypto::hash hash;
     if (!get_block_hash(b, hash))
@@ -3783,26 +3933,29 @@ void BlockchainLMDB::get_output_tx_and_index_from_global(const std::vector<uint6
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
   tx_out_indices.clear();
-  tx_out_indices.reserve(global_indices.size());
+
+  std::vector<dup_lookup> lookups;
+  lookups.reserve(global_indices.size());
+  for (size_t i = 0; i < global_indices.size(); ++i)
+    lookups.push_back({0, global_indices[i], i});
+  std::sort(lookups.begin(), lookups.end());
 
   TXN_PREFIX_RDONLY();
   RCURSOR(output_txs);
 
-  for (const uint64_t &output_id : global_indices)
-  {
-    MDB_val_set(v, output_id);
-
-    auto get_result = mdb_cursor_get(m_cur_output_txs, (MDB_val *)&zerokval, &v, MDB_GET_BOTH);
-    if (get_result == MDB_NOTFOUND)
-      throw1(OUTPUT_DNE("output with given index not in db"));
-    else if (get_result)
-      throw0(DB_ERROR("DB error attempting to fetch output tx hash"));
-
-    const outtx *ot = (const outtx *)v.mv_data;
-    tx_out_indices.push_back(tx_out_index(ot->tx_hash, ot->local_index));
-  }
+  std::vector<tx_out_index> results(global_indices.size());
+  std::vector<bool> found(global_indices.size(), false);
+  get_sorted_dups(m_cur_output_txs, zerokval, sizeof(outtx), lookups.data(), lookups.data() + lookups.size(), [&](size_t position, const char *data) {
+    const outtx *ot = (const outtx *)data;
+    results[position] = tx_out_index(ot->tx_hash, ot->local_index);
+    found[position] = true;
+  });
+  if (std::find(found.begin(), found.end(), false) != found.end())
+    throw1(OUTPUT_DNE("output with given index not in db"));
 
   TXN_POSTFIX_RDONLY();
+
+  tx_out_indices = std::move(results);
 }
 
 void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs, bool allow_partial) const
@@ -3814,43 +3967,57 @@ void BlockchainLMDB::get_output_key(const epee::span<const uint64_t> &amounts, c
   TIME_MEASURE_START(db3);
   check_open();
   outputs.clear();
-  outputs.reserve(offsets.size());
+
+  // look the outputs up in key order, so each page is visited once
+  std::vector<dup_lookup> lookups;
+  lookups.reserve(offsets.size());
+  for (size_t i = 0; i < offsets.size(); ++i)
+    lookups.push_back({amounts.size() == 1 ? amounts[0] : amounts[i], offsets[i], i});
+  std::sort(lookups.begin(), lookups.end());
 
   TXN_PREFIX_RDONLY();
 
   RCURSOR(output_amounts);
 
-  for (size_t i = 0; i < offsets.size(); ++i)
+  outputs.resize(offsets.size());
+  std::vector<bool> found(offsets.size(), false);
+  for (auto group = lookups.begin(); group != lookups.end(); )
   {
-    const uint64_t amount = amounts.size() == 1 ? amounts[0] : amounts[i];
-	  MDB_val_set(k, amount);
-	  MDB_val_set(v, offsets[i]);
-
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
-    if (get_result == MDB_NOTFOUND)
+    const uint64_t amount = group->key;
+    const auto group_end = std::find_if(group, lookups.end(), [amount](const dup_lookup &lookup) { return lookup.key != amount; });
+    MDB_val_set(k, amount);
+    if (amount == 0)
     {
-      if (allow_partial)
-      {
-        MDEBUG("Partial result: " << outputs.size() << "/" << offsets.size());
-        break;
-      }
-      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(offsets[i]) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
+      get_sorted_dups(m_cur_output_amounts, k, sizeof(outkey), &*group, &*group + (group_end - group), [&](size_t position, const char *data) {
+        outputs[position] = ((const outkey *)data)->data;
+        found[position] = true;
+      });
     }
-    else if (get_result)
-      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output pubkey from the db", get_result).c_str()));
+    else
+    {
+      const rct::key commitment = rct::zeroCommit(amount);
+      get_sorted_dups(m_cur_output_amounts, k, sizeof(pre_rct_outkey), &*group, &*group + (group_end - group), [&](size_t position, const char *data) {
+        output_data_t &output = outputs[position];
+        memcpy(&output, &((const pre_rct_outkey *)data)->data, sizeof(pre_rct_output_data_t));
+        output.commitment = commitment;
+        found[position] = true;
+      });
+    }
+    group = group_end;
+  }
 
-    if (amount == 0)
+  const size_t first_missing = std::find(found.begin(), found.end(), false) - found.begin();
+  if (first_missing != offsets.size())
+  {
+    if (allow_partial)
     {
-      const outkey *okp = (const outkey *)v.mv_data;
-      outputs.push_back(okp->data);
+      MDEBUG("Partial result: " << first_missing << "/" << offsets.size());
+      outputs.resize(first_missing);
     }
     else
     {
-      const pre_rct_outkey *okp = (const pre_rct_outkey *)v.mv_data;
-      outputs.resize(outputs.size() + 1);
-      output_data_t &data = outputs.back();
-      memcpy(&data, &okp->data, sizeof(pre_rct_output_data_t));
-      data.commitment = rct::zeroCommit(amount);
+      const uint64_t amount = amounts.size() == 1 ? amounts[0] : amounts[first_missing];
+      throw1(OUTPUT_DNE((std::string("Attempting to get output pubkey by global index (amount ") + boost::lexical_cast<std::string>(amount) + ", index " + boost::lexical_cast<std::string>(offsets[first_missing]) + ", count " + boost::lexical_cast<std::string>(get_num_outputs(amount)) + "), but key does not exist (current height " + boost::lexical_cast<std::string>(height()) + ")").c_str()));
     }
   }
 
@@ -3866,26 +4033,26 @@ void BlockchainLMDB::get_output_tx_and_index(const uint64_t& amount, const std::
   check_open();
   indices.clear();
 
-  std::vector <uint64_t> tx_indices;
-  tx_indices.reserve(offsets.size());
+  std::vector<dup_lookup> lookups;
+  lookups.reserve(offsets.size());
+  for (size_t i = 0; i < offsets.size(); ++i)
+    lookups.push_back({amount, offsets[i], i});
+  std::sort(lookups.begin(), lookups.end());
+
+  std::vector <uint64_t> tx_indices(offsets.size());
+  std::vector<bool> found(offsets.size(), false);
   TXN_PREFIX_RDONLY();
 
   RCURSOR(output_amounts);
 
+  // outkey and pre_rct_outkey both start with amount_index and output_id
   MDB_val_set(k, amount);
-  for (const uint64_t &index : offsets)
-  {
-    MDB_val_set(v, index);
-
-    auto get_result = mdb_cursor_get(m_cur_output_amounts, &k, &v, MDB_GET_BOTH);
-    if (get_result == MDB_NOTFOUND)
-      throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
-    else if (get_result)
-      throw0(DB_ERROR(lmdb_error("Error attempting to retrieve an output from the db", get_result).c_str()));
-
-    const outkey *okp = (const outkey *)v.mv_data;
-    tx_indices.push_back(okp->output_id);
-  }
+  get_sorted_dups(m_cur_output_amounts, k, amount == 0 ? sizeof(outkey) : sizeof(pre_rct_outkey), lookups.data(), lookups.data() + lookups.size(), [&](size_t position, const char *data) {
+    memcpy(&tx_indices[position], data + offsetof(outkey, output_id), sizeof(uint64_t));
+    found[position] = true;
+  });
+  if (std::find(found.begin(), found.end(), false) != found.end())
+    throw1(OUTPUT_DNE("Attempting to get output by index, but key does not exist"));
 
   TIME_MEASURE_START(db3);
   if(tx_indices.size() > 0)
@@ -4199,6 +4366,47 @@ void BlockchainLMDB::drop_alt_blocks()
   TXN_POSTFIX_SUCCESS();
 }
 
+void BlockchainLMDB::add_block_pow_hash(const crypto::hash &blkid, const crypto::hash &pow_hash)
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+  mdb_txn_cursors *m_cursors = &m_wcursors;
+
+  CURSOR(block_pow_hashes)
+
+  MDB_val k = {sizeof(blkid), (void *)&blkid};
+  MDB_val v = {sizeof(pow_hash), (void *)&pow_hash};
+  // a block's PoW hash never changes, so overwriting is harmless
+  if (auto result = mdb_cursor_put(m_cur_block_pow_hashes, &k, &v, 0))
+    throw1(DB_ERROR(lmdb_error("Error adding block PoW hash to db transaction: ", result).c_str()));
+}
+
+bool BlockchainLMDB::get_block_pow_hash(const crypto::hash &blkid, crypto::hash &pow_hash) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  if (!m_has_block_pow_hashes)
+    return false;
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(block_pow_hashes);
+
+  MDB_val_set(k, blkid);
+  MDB_val v;
+  int result = mdb_cursor_get(m_cur_block_pow_hashes, &k, &v, MDB_SET);
+  if (result == MDB_NOTFOUND)
+    return false;
+  if (result)
+    throw0(DB_ERROR(lmdb_error("Error attempting to retrieve PoW hash for block " + epee::string_tools::pod_to_hex(blkid) + " from the db: ", result).c_str()));
+  if (v.mv_size != sizeof(pow_hash))
+    throw0(DB_ERROR("Record size is not the expected size"));
+  memcpy(&pow_hash, v.mv_data, sizeof(pow_hash));
+
+  TXN_POSTFIX_RDONLY();
+  return true;
+}
+
 bool BlockchainLMDB::is_read_only() const
 {
   unsigned int flags;
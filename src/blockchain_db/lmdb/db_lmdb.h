@@ -69,6 +69,8 @@ typedef struct mdb_txn_cursors
   
   MDB_cursor *m_txc_alt_blocks;
 
+  MDB_cursor *m_txc_block_pow_hashes;
+
   MDB_cursor *m_txc_hf_versions;
 
   MDB_cursor *m_txc_properties;
@@ -90,6 +92,7 @@ typedef struct mdb_txn_cursors
 #define m_cur_txpool_meta	m_cursors->m_txc_txpool_meta
 #define m_cur_txpool_blob	m_cursors->m_txc_txpool_blob
 #define m_cur_alt_blocks  m_cursors->m_txc_alt_blocks
+#define m_cur_block_pow_hashes	m_cursors->m_txc_block_pow_hashes
 #define m_cur_hf_versions	m_cursors->m_txc_hf_versions
 #define m_cur_properties	m_cursors->m_txc_properties
 
@@ -112,6 +115,7 @@ typedef struct mdb_rflags
   bool m_rf_txpool_meta;
   bool m_rf_txpool_blob;
   bool m_rf_alt_blocks;
+  bool m_rf_block_pow_hashes;
   bool m_rf_hf_versions;
   bool m_rf_properties;
 } mdb_rflags;
@@ -214,6 +218,7 @@ public:
   virtual cryptonote::blobdata get_block_blob(const crypto::hash& h) const;
 
   virtual cryptonote::blobdata get_block_blob_from_height(const uint64_t& height) const;
+  virtual void get_block_blob_view_from_height(const uint64_t& height, const std::function<void(const cryptonote::blobdata_ref&)> &f) const;
 
   virtual std::vector<uint64_t> get_block_cumulative_rct_outputs(const std::vector<uint64_t> &heights) const;
 
@@ -255,6 +260,7 @@ public:
   virtual bool get_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
   virtual bool get_prunable_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const;
+  virtual bool get_tx_blob_view(const crypto::hash& h, bool pruned, const std::function<void(const cryptonote::blobdata_ref&, const cryptonote::blobdata_ref&)> &f) const;
   virtual bool get_prunable_tx_hash(const crypto::hash& tx_hash, crypto::hash &prunable_hash) const;
 
   virtual uint64_t get_tx_count() const;
@@ -298,6 +304,9 @@ public:
   virtual uint64_t get_alt_block_count();
   virtual void drop_alt_blocks();
 
+  virtual void add_block_pow_hash(const crypto::hash &blkid, const crypto::hash &pow_hash);
+  virtual bool get_block_pow_hash(const crypto::hash &blkid, crypto::hash &pow_hash) const;
+
   virtual bool for_all_txpool_txes(std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> f, bool include_blob = false, bool include_unrelayed_txes = true) const;
 
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
@@ -462,6 +471,9 @@ private:
   
   MDB_dbi m_alt_blocks;
 
+  MDB_dbi m_block_pow_hashes;
+  bool m_has_block_pow_hashes; // false if opened read-only before the table existed
+
   MDB_dbi m_hf_starting_heights;
   MDB_dbi m_hf_versions;
 
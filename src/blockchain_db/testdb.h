@@ -164,6 +164,8 @@ public:
   virtual void remove_alt_block(const crypto::hash &blkid) override {}
   virtual uint64_t get_alt_block_count() override { return 0; }
   virtual void drop_alt_blocks() override {}
+  virtual void add_block_pow_hash(const crypto::hash &blkid, const crypto::hash &pow_hash) override {}
+  virtual bool get_block_pow_hash(const crypto::hash &blkid, crypto::hash &pow_hash) const override { return false; }
   virtual bool for_all_alt_blocks(std::function<bool(const crypto::hash &blkid, const alt_block_data_t &data, const cryptonote::blobdata *blob)> f, bool include_blob = false) const override { return true; }
 };
 
@@ -34,6 +34,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#if defined(__linux__)
+#include <sys/resource.h>
+#endif
 
 #include "randomx.h"
 #include "c_threads.h"
@@ -49,14 +52,52 @@ static CTHR_MUTEX_TYPE rx_mutex = CTHR_MUTEX_INIT;
 
 typedef struct rx_state {
   volatile uint64_t  rs_height;
+  volatile uint64_t  rs_gen;	/* bumped each time rs_cache is (re)initialized */
   randomx_cache *rs_cache;
+  char rs_hash[32];	/* seed hash rs_cache was initialized with */
+  int rs_users;	/* light VMs hashing on rs_cache, under rx_vm_mutex */
 } rx_state;
 
 static rx_state rx_s[2];
 
 static randomx_dataset *rx_dataset;
+static uint64_t rx_dataset_height;	/* seed height rx_dataset was built for */
 THREADV int rx_s_toggle;
-THREADV randomx_vm *rx_vm = NULL;
+
+/* When mining, the next epoch's dataset is built ahead of time in the
+ * background, and swapped with rx_dataset once the epoch starts. */
+static randomx_dataset *rx_next_dataset;
+static uint64_t rx_next_dataset_height;
+
+/* Bumped by rx_reorg, under rx_mutex. Work prepared in the background from
+ * a seed hash read before a reorg is dropped rather than published. */
+static uint64_t rx_reorg_gen;
+
+static CTHR_MUTEX_TYPE rx_prep_mutex = CTHR_MUTEX_INIT;
+static CTHR_THREAD_TYPE rx_prep_thread;
+static volatile int rx_prep_state;	/* 0: idle, 1: running, 2: done, needs joining */
+static volatile int rx_prep_stop;	/* set while joining, a dataset build gives up early */
+static uint64_t rx_prep_height;
+static char rx_prep_hash[32];
+static uint64_t rx_prep_gen;	/* rx_reorg_gen when the prep was started */
+
+/* VMs are shared by all threads: a thread borrows one for the duration of a
+ * hash, and gives it back for other threads to reuse. Light mode VMs point to
+ * one of the rx_s caches, full mode VMs to rx_dataset. */
+#define RX_VM_POOL_SIZE	64
+
+typedef struct rx_vm_entry {
+  randomx_vm *re_vm;
+  const rx_state *re_state;	/* cache the VM was last set to, light mode only */
+  uint64_t re_gen;
+  randomx_dataset *re_dataset;	/* dataset the VM was last set to, full mode only */
+  bool re_full;
+  bool re_busy;
+} rx_vm_entry;
+
+static CTHR_MUTEX_TYPE rx_vm_mutex = CTHR_MUTEX_INIT;
+static rx_vm_entry rx_vms[RX_VM_POOL_SIZE];
+static int rx_nvms;
 
 static void local_abort(const char *msg)
 {
@@ -154,10 +195,14 @@ static inline int use_rx_jit(void)
 void rx_reorg(const uint64_t split_height) {
   int i;
   CTHR_MUTEX_LOCK(rx_mutex);
+  /* a seed at the split height was replaced too */
   for (i=0; i<2; i++) {
-    if (split_height < rx_s[i].rs_height)
+    if (split_height <= rx_s[i].rs_height)
       rx_s[i].rs_height = 1;	/* set to an invalid seed height */
   }
+  if (rx_next_dataset != NULL && split_height <= rx_next_dataset_height)
+    rx_next_dataset_height = 1;
+  rx_reorg_gen++;
   CTHR_MUTEX_UNLOCK(rx_mutex);
 }
 
@@ -177,14 +222,12 @@ bool rx_needhash(const uint64_t height, uint64_t *seedheight) {
   uint64_t s_height = rx_seedheight(height);
   int toggle = (s_height & SEEDHASH_EPOCH_BLOCKS) != 0;
   bool ret;
-  bool changed = (toggle != rx_s_toggle);
   *seedheight = s_height;
   rx_s_toggle = toggle;
   rx_sp = &rx_s[rx_s_toggle];
   ret = (rx_sp->rs_cache == NULL) || (rx_sp->rs_height != s_height);
-  /* if cache is ok but we've flipped caches, reset vm */
-  if (!ret && changed && rx_vm != NULL)
-    randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
+  /* no need to reset any VM if we've flipped caches, VMs are pointed at
+   * the right cache when borrowed */
   return ret;
 }
 
@@ -238,31 +281,49 @@ static void rx_initdata(randomx_cache *rs_cache, const int miners) {
   }
 }
 
-static void rx_seedhash_int(rx_state *rx_sp, const uint64_t height, const char *hash, const int miners) {
+static randomx_cache *rx_alloc_cache(void) {
   randomx_flags flags = RANDOMX_FLAG_DEFAULT;
   randomx_cache *cache;
-  CTHR_MUTEX_LOCK(rx_mutex);
-  cache = rx_sp->rs_cache;
+  if (use_rx_jit())
+    flags |= RANDOMX_FLAG_JIT;
+  cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+  if (cache == NULL)
+    cache = randomx_alloc_cache(flags);
+  if (cache == NULL)
+    local_abort("Couldn't allocate RandomARQ cache");
+  return cache;
+}
+
+static randomx_dataset *rx_alloc_dataset(void) {
+  randomx_dataset *dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+  if (dataset == NULL)
+    dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+  return dataset;
+}
+
+/* rx_mutex must be held */
+static void rx_seedhash_locked(rx_state *rx_sp, const uint64_t height, const char *hash, const int miners) {
+  randomx_cache *cache = rx_sp->rs_cache;
   if (rx_sp->rs_height != height || cache == NULL) {
-    if (use_rx_jit())
-      flags |= RANDOMX_FLAG_JIT;
-    if (cache == NULL) {
-      cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
-      if (cache == NULL)
-        cache = randomx_alloc_cache(flags);
-      if (cache == NULL)
-        local_abort("Couldn't allocate RandomARQ cache");
-    }
+    if (cache == NULL)
+      cache = rx_alloc_cache();
     randomx_init_cache(cache, hash, 32);
-    if (miners && rx_dataset != NULL)
+    if (miners && rx_dataset != NULL) {
       rx_initdata(cache, miners);
+      rx_dataset_height = height;
+    }
+    memcpy(rx_sp->rs_hash, hash, sizeof(rx_sp->rs_hash));
     rx_sp->rs_height = height;
+    rx_sp->rs_gen++;
     if (rx_sp->rs_cache == NULL)
       rx_sp->rs_cache = cache;
   }
+}
+
+static void rx_seedhash_int(rx_state *rx_sp, const uint64_t height, const char *hash, const int miners) {
+  CTHR_MUTEX_LOCK(rx_mutex);
+  rx_seedhash_locked(rx_sp, height, hash, miners);
   CTHR_MUTEX_UNLOCK(rx_mutex);
-  if (rx_vm != NULL)
-    randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
 }
 
 void rx_seedhash(const uint64_t height, const char *hash, const int miners) {
@@ -270,87 +331,410 @@ void rx_seedhash(const uint64_t height, const char *hash, const int miners) {
   rx_seedhash_int(rx_sp, height, hash, miners);
 }
 
-static char rx_althash[32];	// seedhash for alternate blocks
+static void rx_lower_thread_priority(void) {
+#if defined(_WIN32)
+  SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#elif defined(__linux__)
+  /* on Linux, this only affects the calling thread */
+  setpriority(PRIO_PROCESS, 0, 19);
+#endif
+}
+
+static void rx_sleep_ms(const unsigned ms) {
+#if defined(_WIN32)
+  Sleep(ms);
+#else
+  usleep(ms * 1000);
+#endif
+}
+
+/* Puts a cache built privately for the given seed into rx_sp, once no light VM
+ * is hashing on the one it replaces. Returns the cache the caller should
+ * release, which is the given one if it is not needed anymore. */
+static randomx_cache *rx_swap_cache(rx_state *rx_sp, const uint64_t height, const char *hash, const uint64_t gen, randomx_cache *cache) {
+  for (;;) {
+    CTHR_MUTEX_LOCK(rx_mutex);
+    /* dropped by a reorg, or built in the meantime for an alt block */
+    if (rx_reorg_gen != gen || (rx_sp->rs_height == height && rx_sp->rs_cache != NULL && !memcmp(rx_sp->rs_hash, hash, sizeof(rx_sp->rs_hash)))) {
+      CTHR_MUTEX_UNLOCK(rx_mutex);
+      return cache;
+    }
+    CTHR_MUTEX_LOCK(rx_vm_mutex);
+    if (rx_sp->rs_users == 0) {
+      randomx_cache *old_cache = rx_sp->rs_cache;
+      rx_sp->rs_cache = cache;
+      memcpy(rx_sp->rs_hash, hash, sizeof(rx_sp->rs_hash));
+      rx_sp->rs_height = height;
+      rx_sp->rs_gen++;
+      CTHR_MUTEX_UNLOCK(rx_vm_mutex);
+      CTHR_MUTEX_UNLOCK(rx_mutex);
+      return old_cache;
+    }
+    CTHR_MUTEX_UNLOCK(rx_vm_mutex);
+    CTHR_MUTEX_UNLOCK(rx_mutex);
+    /* an alt block is being hashed on the old cache, which won't take long */
+    rx_sleep_ms(1);
+  }
+}
+
+/* Same as randomx_init_dataset, but gives up early on shutdown */
+static bool rx_prep_dataset(randomx_dataset *dataset, randomx_cache *cache) {
+  const unsigned long count = randomx_dataset_item_count();
+  const unsigned long step = count / 64 + 1;
+  unsigned long start;
+  for (start = 0; start < count; start += step) {
+    if (rx_prep_stop)
+      return false;
+    randomx_init_dataset(dataset, cache, start, start + step < count ? step : count - start);
+  }
+  return true;
+}
+
+static CTHR_THREAD_RTYPE rx_prepthread(void *arg) {
+  const uint64_t height = rx_prep_height;
+  const uint64_t gen = rx_prep_gen;
+  const int toggle = (height & SEEDHASH_EPOCH_BLOCKS) != 0;
+  rx_state *rx_sp = &rx_s[toggle];
+  randomx_dataset *dataset = NULL;
+  randomx_cache *cache;
+  bool need_cache;
+  char hash[32];
+  (void)arg;
+
+  memcpy(hash, rx_prep_hash, sizeof(hash));
+  rx_lower_thread_priority();
+
+  /* the slot we're building for is the one the current epoch is not using,
+   * and rx_needhash will find it ready when the epoch starts. If the chain
+   * was reorganized since the hash was read, it may not be the seed anymore */
+  CTHR_MUTEX_LOCK(rx_mutex);
+  need_cache = rx_reorg_gen == gen && (rx_sp->rs_cache == NULL || rx_sp->rs_height != height || memcmp(rx_sp->rs_hash, hash, sizeof(rx_sp->rs_hash)));
+  if (rx_dataset != NULL && rx_reorg_gen == gen) {
+    if (rx_next_dataset == NULL)
+      rx_next_dataset = rx_alloc_dataset();
+    if (rx_next_dataset != NULL && rx_next_dataset_height != height) {
+      dataset = rx_next_dataset;
+      /* never a seed height, so it won't get swapped in while being built */
+      rx_next_dataset_height = 1;
+    }
+  }
+  CTHR_MUTEX_UNLOCK(rx_mutex);
+
+  if (!need_cache && dataset == NULL) {
+    rx_prep_state = 2;
+    CTHR_THREAD_RETURN;
+  }
+
+  /* everything is built privately, without holding rx_mutex: alt blocks may
+   * be hashed on the slot's current cache meanwhile, and this takes a while */
+  cache = rx_alloc_cache();
+  randomx_init_cache(cache, hash, 32);
+  if (dataset != NULL && rx_prep_dataset(dataset, cache)) {
+    CTHR_MUTEX_LOCK(rx_mutex);
+    if (rx_next_dataset == dataset && rx_reorg_gen == gen)
+      rx_next_dataset_height = height;
+    CTHR_MUTEX_UNLOCK(rx_mutex);
+  }
+  if (need_cache)
+    cache = rx_swap_cache(rx_sp, height, hash, gen, cache);
+  if (cache != NULL)
+    randomx_release_cache(cache);
+
+  rx_prep_state = 2;
+  CTHR_THREAD_RETURN;
+}
+
+/* Returns false if another prep is still running, in which case the caller
+ * should ask again later */
+bool rx_prepare_next_seedhash(const uint64_t seedheight, const char *hash) {
+  uint64_t gen;
+  bool same;
+  CTHR_MUTEX_LOCK(rx_mutex);
+  gen = rx_reorg_gen;
+  CTHR_MUTEX_UNLOCK(rx_mutex);
+  CTHR_MUTEX_LOCK(rx_prep_mutex);
+  /* a prep for the same seed is only redone if a reorg may have dropped it */
+  same = rx_prep_state != 0 && rx_prep_height == seedheight && rx_prep_gen == gen &&
+      !memcmp(rx_prep_hash, hash, sizeof(rx_prep_hash));
+  if (rx_prep_state == 1 || same) {
+    CTHR_MUTEX_UNLOCK(rx_prep_mutex);
+    return same;
+  }
+  if (rx_prep_state == 2)
+    CTHR_THREAD_JOIN(rx_prep_thread);
+  rx_prep_height = seedheight;
+  rx_prep_gen = gen;
+  memcpy(rx_prep_hash, hash, sizeof(rx_prep_hash));
+  rx_prep_state = 1;
+  CTHR_THREAD_CREATE(rx_prep_thread, rx_prepthread, NULL);
+  CTHR_MUTEX_UNLOCK(rx_prep_mutex);
+  return true;
+}
+
+/* Joins a running prep, stopping any dataset build early */
+static void rx_wait_prepare(void) {
+  CTHR_MUTEX_LOCK(rx_prep_mutex);
+  if (rx_prep_state != 0) {
+    rx_prep_stop = 1;
+    CTHR_THREAD_JOIN(rx_prep_thread);
+    rx_prep_stop = 0;
+    rx_prep_state = 0;
+  }
+  CTHR_MUTEX_UNLOCK(rx_prep_mutex);
+}
+
+/* Makes rx_dataset match the current seed, using the dataset built ahead of
+ * time if there is one */
+static void rx_update_dataset(const rx_state *rx_sp, const int miners) {
+  CTHR_MUTEX_LOCK(rx_mutex);
+  if (rx_dataset_height != rx_sp->rs_height) {
+    if (rx_next_dataset != NULL && rx_next_dataset_height == rx_sp->rs_height) {
+      randomx_dataset *dataset = rx_dataset;
+      const uint64_t height = rx_dataset_height;
+      rx_dataset = rx_next_dataset;
+      rx_dataset_height = rx_next_dataset_height;
+      rx_next_dataset = dataset;
+      rx_next_dataset_height = height;
+    } else {
+      rx_initdata(rx_sp->rs_cache, miners);
+      rx_dataset_height = rx_sp->rs_height;
+    }
+  }
+  CTHR_MUTEX_UNLOCK(rx_mutex);
+}
+
+static randomx_vm *rx_create_vm(randomx_cache *cache, randomx_dataset *dataset) {
+  const int full = dataset != NULL;
+  randomx_flags flags = RANDOMX_FLAG_DEFAULT;
+  randomx_vm *vm;
+  if (use_rx_jit())
+    flags |= RANDOMX_FLAG_JIT;
+  if(!force_software_aes() && check_aes_hw())
+    flags |= RANDOMX_FLAG_HARD_AES;
+  if (full)
+    flags |= RANDOMX_FLAG_FULL_MEM;
+  vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, cache, dataset);
+  if(vm == NULL) //large pages failed
+    vm = randomx_create_vm(flags, cache, dataset);
+  if(vm == NULL) {//fallback if everything fails
+    flags = RANDOMX_FLAG_DEFAULT | (full ? RANDOMX_FLAG_FULL_MEM : 0);
+    vm = randomx_create_vm(flags, cache, dataset);
+  }
+  if(vm == NULL)
+    local_abort("Couldn't allocate RandomARQ VM");
+  return vm;
+}
+
+/* Returns the pool slot of the borrowed VM, or -1 if the pool was exhausted
+ * and a light VM was created just for this caller, to be destroyed on return.
+ * A full VM is only borrowed if full_mem is set and there is a dataset, which
+ * is returned in *dataset, NULL otherwise. Full VMs always come from the pool,
+ * so rx_stop_mining can tell which dataset each one is hashing on. A light VM
+ * counts as a user of rx_sp's cache until it is returned. */
+static int rx_borrow_vm(rx_state *rx_sp, const bool full_mem, randomx_dataset **dataset, randomx_vm **vm) {
+  randomx_dataset *old_dataset = NULL;
+  rx_vm_entry *re = NULL;
+  bool full;
+  int i, slot = -1;
+
+  CTHR_MUTEX_LOCK(rx_vm_mutex);
+  /* read under rx_vm_mutex, so rx_stop_mining can't release it under us */
+  *dataset = full_mem ? rx_dataset : NULL;
+  full = *dataset != NULL;
+  for (i=0; i<rx_nvms; i++) {
+    if (rx_vms[i].re_busy || rx_vms[i].re_full != full)
+      continue;
+    /* prefer a VM which does not need its cache switched */
+    if (slot < 0 || (rx_vms[i].re_state == rx_sp && rx_vms[i].re_gen == rx_sp->rs_gen))
+      slot = i;
+    if (rx_vms[slot].re_state == rx_sp && rx_vms[slot].re_gen == rx_sp->rs_gen)
+      break;
+  }
+  if (slot < 0 && rx_nvms < RX_VM_POOL_SIZE) {
+    slot = rx_nvms++;
+    rx_vms[slot].re_vm = NULL;
+    rx_vms[slot].re_state = NULL;
+    rx_vms[slot].re_dataset = NULL;
+    rx_vms[slot].re_full = full;
+  }
+  if (slot >= 0) {
+    re = &rx_vms[slot];
+    re->re_busy = true;
+    old_dataset = re->re_dataset;
+    re->re_dataset = *dataset;
+  } else if (full) {
+    *dataset = NULL;
+    full = false;
+  }
+  if (!full)
+    rx_sp->rs_users++;
+  CTHR_MUTEX_UNLOCK(rx_vm_mutex);
+
+  if (re == NULL) {
+    *vm = rx_create_vm(rx_sp->rs_cache, *dataset);
+    return -1;
+  }
+  if (re->re_vm == NULL) {
+    re->re_vm = rx_create_vm(rx_sp->rs_cache, *dataset);
+  } else if (full && old_dataset != *dataset) {
+    randomx_vm_set_dataset(re->re_vm, *dataset);
+  } else if (!full && (re->re_state != rx_sp || re->re_gen != rx_sp->rs_gen)) {
+    randomx_vm_set_cache(re->re_vm, rx_sp->rs_cache);
+  }
+  re->re_state = rx_sp;
+  re->re_gen = rx_sp->rs_gen;
+  *vm = re->re_vm;
+  return slot;
+}
+
+static void rx_return_vm(rx_state *rx_sp, randomx_dataset *dataset, const int slot, randomx_vm *vm) {
+  if (slot < 0)
+    randomx_destroy_vm(vm);
+  CTHR_MUTEX_LOCK(rx_vm_mutex);
+  if (slot >= 0) {
+    rx_vms[slot].re_busy = false;
+    /* the dataset may be released once not current, and its address reused */
+    if (dataset != rx_dataset)
+      rx_vms[slot].re_dataset = NULL;
+  }
+  if (dataset == NULL)
+    rx_sp->rs_users--;
+  CTHR_MUTEX_UNLOCK(rx_vm_mutex);
+}
+
+/* Waits until no VM is hashing on the given dataset, or on any cache if
+ * dataset is NULL */
+static void rx_wait_vms(const randomx_dataset *dataset) {
+  for (;;) {
+    bool busy = false;
+    int i;
+    CTHR_MUTEX_LOCK(rx_vm_mutex);
+    if (dataset == NULL)
+      busy = rx_s[0].rs_users != 0 || rx_s[1].rs_users != 0;
+    else for (i=0; i<rx_nvms && !busy; i++)
+      busy = rx_vms[i].re_busy && rx_vms[i].re_full && rx_vms[i].re_dataset == dataset;
+    CTHR_MUTEX_UNLOCK(rx_vm_mutex);
+    if (!busy)
+      return;
+    rx_sleep_ms(1);
+  }
+}
+
+/* Destroys the idle VMs of the given mode, all of them if full is negative */
+static void rx_destroy_idle_vms(const int full) {
+  int i;
+  CTHR_MUTEX_LOCK(rx_vm_mutex);
+  for (i=0; i<rx_nvms; i++) {
+    if (rx_vms[i].re_busy || rx_vms[i].re_vm == NULL)
+      continue;
+    if (full >= 0 && rx_vms[i].re_full != (full != 0))
+      continue;
+    randomx_destroy_vm(rx_vms[i].re_vm);
+    rx_vms[i].re_vm = NULL;
+    rx_vms[i].re_state = NULL;
+  }
+  CTHR_MUTEX_UNLOCK(rx_vm_mutex);
+}
 
 void rx_alt_slowhash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length, char *hash) {
   uint64_t s_height = rx_seedheight(mainheight);
   int alt_toggle = (s_height & SEEDHASH_EPOCH_BLOCKS) == 0;
   rx_state *rx_sp = &rx_s[alt_toggle];
-  if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_althash, sizeof(rx_althash))) {
-    memcpy(rx_althash, seedhash, sizeof(rx_althash));
-    rx_sp->rs_height = 1;
-    rx_seedhash_int(rx_sp, seedheight, seedhash, 0);
-  }
-  if (rx_vm == NULL) {
-    randomx_flags flags = RANDOMX_FLAG_DEFAULT;
-    if (use_rx_jit())
-      flags |= RANDOMX_FLAG_JIT;
-    if(!force_software_aes() && check_aes_hw())
-      flags |= RANDOMX_FLAG_HARD_AES;
-    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, NULL);
-    if(rx_vm == NULL) //large pages failed
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, NULL);
-    if(rx_vm == NULL) {//fallback if everything fails
-      flags = RANDOMX_FLAG_DEFAULT;
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, NULL);
+  randomx_dataset *dataset;
+  randomx_vm *vm;
+  int slot;
+  for (;;) {
+    if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, sizeof(rx_sp->rs_hash))) {
+      CTHR_MUTEX_LOCK(rx_mutex);
+      if (memcmp(seedhash, rx_sp->rs_hash, sizeof(rx_sp->rs_hash)))
+        rx_sp->rs_height = 1;
+      rx_seedhash_locked(rx_sp, seedheight, seedhash, 0);
+      CTHR_MUTEX_UNLOCK(rx_mutex);
     }
-    if(rx_vm == NULL)
-      local_abort("Couldn't allocate RandomARQ VM");
+    slot = rx_borrow_vm(rx_sp, false, &dataset, &vm);
+    /* the next seed's cache may have been swapped in before the VM was
+     * borrowed, it can't be anymore until it's returned */
+    if (rx_sp->rs_height == seedheight && !memcmp(seedhash, rx_sp->rs_hash, sizeof(rx_sp->rs_hash)))
+      break;
+    rx_return_vm(rx_sp, NULL, slot, vm);
   }
-  randomx_calculate_hash(rx_vm, data, length, hash);
+  randomx_calculate_hash(vm, data, length, hash);
+  rx_return_vm(rx_sp, NULL, slot, vm);
 }
 
 void rx_slow_hash(const void *data, size_t length, char *hash, int miners) {
-  if (rx_vm == NULL) {
-    rx_state *rx_sp = &rx_s[rx_s_toggle];
-    randomx_flags flags = RANDOMX_FLAG_DEFAULT;
-    if (use_rx_jit())
-      flags |= RANDOMX_FLAG_JIT;
-    if(!force_software_aes() && check_aes_hw())
-      flags |= RANDOMX_FLAG_HARD_AES;
-    if (miners) {
+  rx_state *rx_sp = &rx_s[rx_s_toggle];
+  randomx_dataset *dataset;
+  randomx_vm *vm;
+  int slot;
+  if (miners) {
+    if (rx_dataset == NULL) {
+      CTHR_MUTEX_LOCK(rx_mutex);
       if (rx_dataset == NULL) {
-        CTHR_MUTEX_LOCK(rx_mutex);
-        if (rx_dataset == NULL) {
-          rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
-          if (rx_dataset == NULL)
-            rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
-          if (rx_dataset != NULL)
-            rx_initdata(rx_sp->rs_cache, miners);
+        rx_dataset = rx_alloc_dataset();
+        if (rx_dataset != NULL) {
+          rx_initdata(rx_sp->rs_cache, miners);
+          rx_dataset_height = rx_sp->rs_height;
         }
-        CTHR_MUTEX_UNLOCK(rx_mutex);
       }
-      if (rx_dataset != NULL)
-        flags |= RANDOMX_FLAG_FULL_MEM;
-      else
-        miners = 0;
+      CTHR_MUTEX_UNLOCK(rx_mutex);
     }
-    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
-    if(rx_vm == NULL) //large pages failed
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
-    if(rx_vm == NULL) {//fallback if everything fails
-      flags = RANDOMX_FLAG_DEFAULT | (miners ? RANDOMX_FLAG_FULL_MEM : 0);
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
-    }
-    if (rx_vm == NULL)
-      local_abort("Couldn't allocate RandomARQ VM");
+    /* the seed cache may have been built ahead of time, in which case
+     * rx_seedhash was not called to rebuild the dataset */
+    if (rx_dataset != NULL && rx_dataset_height != rx_sp->rs_height)
+      rx_update_dataset(rx_sp, miners);
   }
-  randomx_calculate_hash(rx_vm, data, length, hash);
+  slot = rx_borrow_vm(rx_sp, miners != 0, &dataset, &vm);
+  randomx_calculate_hash(vm, data, length, hash);
+  rx_return_vm(rx_sp, dataset, slot, vm);
 }
 
 void rx_slow_hash_allocate_state(void) {
 }
 
-void rx_slow_hash_free_state(void) {
-  if (rx_vm != NULL) {
-    randomx_destroy_vm(rx_vm);
-    rx_vm = NULL;
+void rx_stop_mining(void) {
+  randomx_dataset *dataset, *next_dataset;
+  int i;
+  /* from now on, no VM is borrowed in full mode, and no dataset is built
+   * ahead of time */
+  CTHR_MUTEX_LOCK(rx_mutex);
+  CTHR_MUTEX_LOCK(rx_vm_mutex);
+  for (i=0; i<rx_nvms; i++) {
+    if (!rx_vms[i].re_busy)
+      rx_vms[i].re_dataset = NULL;
+  }
+  dataset = rx_dataset;
+  next_dataset = rx_next_dataset;
+  rx_dataset = NULL;
+  rx_next_dataset = NULL;
+  rx_next_dataset_height = 1;
+  CTHR_MUTEX_UNLOCK(rx_vm_mutex);
+  CTHR_MUTEX_UNLOCK(rx_mutex);
+  /* but a prep may still be building into the next dataset, and full mode
+   * VMs borrowed before may still be hashing on either */
+  rx_wait_prepare();
+  if (next_dataset != NULL) {
+    rx_wait_vms(next_dataset);
+    randomx_release_dataset(next_dataset);
+  }
+  if (dataset != NULL) {
+    rx_wait_vms(dataset);
+    randomx_release_dataset(dataset);
   }
+  rx_destroy_idle_vms(1);
 }
 
-void rx_stop_mining(void) {
-  if (rx_dataset != NULL) {
-    randomx_release_dataset(rx_dataset);
-      rx_dataset = NULL;
+void rx_slow_hash_free_state(void) {
+  int i;
+  rx_stop_mining();
+  rx_wait_vms(NULL);
+  rx_destroy_idle_vms(-1);
+  CTHR_MUTEX_LOCK(rx_mutex);
+  for (i=0; i<2; i++) {
+    if (rx_s[i].rs_cache != NULL) {
+      randomx_release_cache(rx_s[i].rs_cache);
+      rx_s[i].rs_cache = NULL;
+    }
   }
+  CTHR_MUTEX_UNLOCK(rx_mutex);
 }
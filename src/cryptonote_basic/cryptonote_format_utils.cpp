@@ -1231,9 +1231,14 @@ namespace cryptonote
   }
   //--------------------------------------------------------------- */
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b)
+  {
+    return parse_and_validate_block_from_blob(blobdata_ref{b_blob.data(), b_blob.size()}, b);
+  }
+  //---------------------------------------------------------------
+  bool parse_and_validate_block_from_blob(const blobdata_ref& b_blob, block& b)
   {
     std::stringstream ss;
-    ss << b_blob;
+    ss.write(b_blob.data(), b_blob.size());
     binary_archive<false> ba(ss);
     bool r = ::serialization::serialize(ba, b);
     CHECK_AND_ASSERT_MES(r, false, "Failed to parse block from blob");
@@ -31,6 +31,8 @@
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
 #pragma once
+#include "crypto/hash.h"
+
 namespace cryptonote
 {
   /************************************************************************/
@@ -50,6 +52,7 @@ namespace cryptonote
     bool m_overspend;
     bool m_fee_too_low;
     bool m_not_rct;
+    crypto::hash m_tx_hash; // set once the tx parsed, so callers relaying it need not parse it again
   };
 
   struct block_verification_context
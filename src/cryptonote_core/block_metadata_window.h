@@ -0,0 +1,169 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "span.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief one per-block value (timestamp, weight...) for the most recent main chain blocks
+   *
+   * Values are kept in a single vector indexed by height, so any range of
+   * heights within the window is one contiguous slice. Blocks are appended
+   * and popped at the top as the chain changes. Once the vector holds twice
+   * the capacity, the oldest values are dropped in one go, which keeps
+   * appends amortized O(1). Half a window of slack is kept when trimming so
+   * short reorgs do not need a reload.
+   *
+   * If the window is out of step with the chain, it is reloaded from the
+   * database on the next request. Ranges starting below the window (eg, for
+   * a deep alternative chain) are loaded into a separate buffer so they do
+   * not evict the recent values.
+   */
+  template<typename T>
+  class block_metadata_column
+  {
+  public:
+    typedef std::function<std::vector<T>(uint64_t start_height, size_t count)> loader_t;
+
+    block_metadata_column(size_t capacity = 0): m_start_height(0), m_capacity(capacity) {}
+
+    void set_capacity(size_t capacity) { m_capacity = capacity; }
+    size_t capacity() const { return m_capacity; }
+
+    void clear() { m_start_height = 0; m_values.clear(); m_old_values.clear(); }
+    bool empty() const { return m_values.empty(); }
+    uint64_t start_height() const { return m_start_height; }
+    uint64_t height() const { return m_start_height + m_values.size(); }
+
+    /**
+     * @brief appends the value for the block at height()
+     */
+    void push_back(const T &value)
+    {
+      m_values.push_back(value);
+      if (m_capacity > 0 && m_values.size() >= 2 * m_capacity)
+      {
+        const size_t excess = m_values.size() - (m_capacity + m_capacity / 2);
+        m_values.erase(m_values.begin(), m_values.begin() + excess);
+        m_start_height += excess;
+      }
+    }
+
+    /**
+     * @brief removes the value for the top block
+     */
+    void pop_back()
+    {
+      if (!m_values.empty())
+        m_values.pop_back();
+    }
+
+    /**
+     * @brief appends the value for a block added to the chain
+     *
+     * If the window does not end just below that block, it is out of step
+     * with the chain and is cleared instead, to be reloaded when next needed.
+     */
+    void push_back_or_clear(uint64_t block_height, const T &value)
+    {
+      if (!m_values.empty() && height() == block_height)
+        push_back(value);
+      else
+        clear();
+    }
+
+    /**
+     * @brief removes the value for a block popped from the chain
+     *
+     * If that block is not the top of the window, the window is cleared.
+     */
+    void pop_back_or_clear(uint64_t block_height)
+    {
+      if (!m_values.empty() && height() == block_height + 1)
+        pop_back();
+      else
+        clear();
+    }
+
+    bool contains(uint64_t start_height, size_t count) const
+    {
+      return start_height >= m_start_height && start_height + count <= height();
+    }
+
+    /**
+     * @brief gets the values for a range of blocks, loading them if needed
+     *
+     * @param start_height the height of the first block
+     * @param count the number of blocks, start_height + count must not be above chain_height
+     * @param chain_height the current blockchain height
+     * @param load gets the values for a range of blocks from the database
+     *
+     * @return a view of the values, valid until the next call to a non const method
+     */
+    epee::span<const T> get(uint64_t start_height, size_t count, uint64_t chain_height, const loader_t &load)
+    {
+      if (count == 0)
+        return {};
+      if (start_height + std::min<uint64_t>(chain_height, m_capacity) < chain_height)
+      {
+        m_old_values = load(start_height, count);
+        return {m_old_values.data(), m_old_values.size()};
+      }
+      if (height() != chain_height || !contains(start_height, count))
+      {
+        // a few blocks behind, catch up
+        if (!m_values.empty() && height() < chain_height && chain_height - height() <= m_capacity)
+        {
+          for (const T &value: load(height(), chain_height - height()))
+            push_back(value);
+        }
+        if (height() != chain_height || !contains(start_height, count))
+        {
+          const uint64_t start = chain_height - std::min<uint64_t>(chain_height, m_capacity);
+          m_values = load(start, chain_height - start);
+          m_start_height = start;
+        }
+      }
+      return {m_values.data() + (start_height - m_start_height), count};
+    }
+
+  private:
+    uint64_t m_start_height;
+    size_t m_capacity;
+    std::vector<T> m_values;
+    std::vector<T> m_old_values;
+  };
+}
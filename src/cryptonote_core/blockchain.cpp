@@ -121,14 +121,15 @@ static const struct {
 
 //------------------------------------------------------------------
 Blockchain::Blockchain(tx_memory_pool& tx_pool) :
-  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_timestamps_and_difficulties_height(0), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
+  m_db(), m_tx_pool(tx_pool), m_hardfork(NULL), m_db_sync([this]() { return db_sync_worker(); }, [this](const std::function<void()> &f) { m_async_service.post(f); }), m_prehashed_blocks(BLOCKS_SYNCHRONIZING_MAX_COUNT), m_current_block_cumul_weight_limit(0), m_current_block_cumul_weight_median(0),
   m_enforce_dns_checkpoints(false), m_max_prepare_blocks_threads(4), m_db_sync_on_blocks(true), m_db_sync_threshold(1), m_db_sync_mode(db_async), m_db_default_sync(false),
-  m_fast_sync(true), m_show_time_stats(true), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
+  m_fast_sync(true), m_show_time_stats(true), m_pow_hash_index(true), m_sync_counter(0), m_bytes_to_sync(0), m_cancel(false),
   m_long_term_block_weights_window(CRYPTONOTE_LONG_TERM_BLOCK_WEIGHT_WINDOW_SIZE),
   m_long_term_effective_median_block_weight(0),
   m_difficulty_for_next_block_top_hash(crypto::null_hash),
   m_difficulty_for_next_block(1),
   m_btc_valid(false),
+  m_rx_prepared_seed_height(0), m_rx_prepared_seed_hash(crypto::null_hash),
   m_batch_success(true),
   m_prepare_height(0)
 {
@@ -451,7 +452,7 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   }
   if (num_popped_blocks > 0)
   {
-    m_timestamps_and_difficulties_height = 0;
+    clear_recent_block_metadata();
     m_hardfork->reorganize_from_chain_height(get_current_blockchain_height());
     uint64_t top_block_height;
     crypto::hash top_block_hash = get_tail_id(top_block_height);
@@ -461,6 +462,13 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   if (test_options && test_options->long_term_block_weight_window)
     m_long_term_block_weights_window = test_options->long_term_block_weight_window;
 
+  const size_t recent_window = std::max<size_t>({DIFFICULTY_BLOCKS_COUNT, CRYPTONOTE_REWARD_BLOCKS_WINDOW, BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW});
+  m_recent_timestamps.set_capacity(recent_window);
+  m_recent_cumulative_difficulties.set_capacity(recent_window);
+  m_recent_weights.set_capacity(recent_window);
+  m_recent_long_term_weights.set_capacity(m_long_term_block_weights_window + 1);
+  clear_recent_block_metadata();
+
   {
     db_txn_guard txn_guard(m_db, m_db->is_read_only());
     if(!update_next_cumulative_weight_limit())
@@ -527,6 +535,124 @@ bool Blockchain::store_blockchain()
   return true;
 }
 //------------------------------------------------------------------
+uint64_t Blockchain::request_db_sync()
+{
+  return m_db_sync.request();
+}
+//------------------------------------------------------------------
+bool Blockchain::wait_for_db_sync(uint64_t ticket)
+{
+  return m_db_sync.wait(ticket);
+}
+//------------------------------------------------------------------
+bool Blockchain::db_sync_worker()
+{
+  try
+  {
+    if (store_blockchain())
+      return true;
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to sync the blockchain in the background: " << e.what());
+  }
+  catch (...)
+  {
+    MERROR("Failed to sync the blockchain in the background: unknown exception");
+  }
+  MERROR("Background blockchain sync failed, it will be retried on the next sync request");
+  return false;
+}
+//------------------------------------------------------------------
+bool Blockchain::prehash_incoming_blocks(uint64_t height, const std::vector<blobdata> &block_blobs)
+{
+  MTRACE("Blockchain::" << __func__);
+  if (m_prehashed_blocks.running())
+    return false;
+
+  std::vector<block> blocks;
+  // the job must not look seeds up itself, the pending blocks it would
+  // find them among belong to prepare_handle_incoming_blocks
+  std::map<uint64_t, crypto::hash> seed_ids;
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    const uint64_t db_height = m_db->height();
+    if (height < db_height || height + block_blobs.size() < m_blocks_hash_check.size())
+      return true;
+
+    blocks.reserve(block_blobs.size());
+    for (const auto &blob: block_blobs)
+    {
+      block b;
+      if (!parse_and_validate_block_from_blob(blob, b))
+        break;
+      if (b.major_version >= RX_BLOCK_VERSION)
+      {
+        // the seed must be committed, the blocks below these may not be yet
+        const uint64_t seed_height = rx_seedheight(height + blocks.size());
+        if (seed_height >= db_height)
+          break;
+        if (seed_ids.find(seed_height) == seed_ids.end())
+          seed_ids[seed_height] = m_db->get_block_hash_from_height(seed_height);
+      }
+      blocks.push_back(std::move(b));
+    }
+  }
+  if (blocks.empty())
+    return true;
+
+  uint64_t generation;
+  if (!m_prehashed_blocks.start(generation))
+    return false;
+  MDEBUG("Hashing " << blocks.size() << " blocks from height " << height << " ahead of time");
+  std::shared_ptr<std::vector<block>> pblocks = std::make_shared<std::vector<block>>(std::move(blocks));
+  tools::threadpool::getInstance().submit(&m_prehash_waiter, [this, height, pblocks, seed_ids, generation]() { prehash_worker(height, *pblocks, seed_ids, generation); });
+  return true;
+}
+//------------------------------------------------------------------
+void Blockchain::prehash_worker(uint64_t height, const std::vector<block> &blocks, const std::map<uint64_t, crypto::hash> &seed_ids, uint64_t generation)
+{
+  // same split as prepare_handle_incoming_blocks, runs do not cross a seed epoch
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  const unsigned threads = std::max(1u, std::min<unsigned>(tpool.get_max_concurrency(), m_max_prepare_blocks_threads));
+  const size_t max_run = (blocks.size() + threads - 1) / threads;
+  std::vector<std::pair<size_t, size_t>> runs; // first block index, number of blocks
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (runs.empty() || runs.back().second >= max_run || rx_seedheight(height + i) != rx_seedheight(height + runs.back().first))
+      runs.push_back(std::make_pair(i, 1));
+    else
+      ++runs.back().second;
+  }
+
+  std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(runs.size());
+  tools::threadpool::waiter waiter;
+  for (size_t i = 0; i < runs.size(); ++i)
+  {
+    const auto seed = seed_ids.find(rx_seedheight(height + runs[i].first));
+    const crypto::hash *seed_id = seed == seed_ids.end() ? NULL : &seed->second;
+    tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, height + runs[i].first, epee::span<const block>(&blocks[runs[i].first], runs[i].second), std::ref(maps[i]), seed_id), true);
+  }
+  waiter.wait(&tpool);
+
+  std::vector<prehashed_blocks::entry> hashes;
+  hashes.reserve(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    const crypto::hash id = get_block_hash(blocks[i]);
+    for (const auto &map: maps)
+    {
+      const auto it = map.find(id);
+      if (it != map.end())
+      {
+        hashes.push_back({id, height + i, it->second});
+        break;
+      }
+    }
+  }
+  m_prehashed_blocks.finish(generation, hashes, m_cancel);
+}
+//------------------------------------------------------------------
 bool Blockchain::deinit()
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -538,6 +664,8 @@ bool Blockchain::deinit()
   m_async_pool.join_all();
   m_async_service.stop();
 
+  m_prehash_waiter.wait(&tools::threadpool::getInstance());
+
   // as this should be called if handling a SIGSEGV, need to check
   // if m_db is a NULL pointer (and thus may have caused the illegal
   // memory operation), otherwise we may cause a loop.
@@ -608,6 +736,7 @@ void Blockchain::pop_blocks(uint64_t nblocks)
     LOG_ERROR("Error when popping blocks after processing " << i << " blocks: " << e.what());
     if(stop_batch)
       m_db->batch_abort();
+    clear_recent_block_metadata();
     return;
   }
 
@@ -623,8 +752,6 @@ block Blockchain::pop_block_from_blockchain()
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   block popped_block;
   std::vector<transaction> popped_txs;
 
@@ -633,6 +760,7 @@ block Blockchain::pop_block_from_blockchain()
   try
   {
     m_db->pop_block(popped_block, popped_txs);
+    pop_recent_block_metadata();
   }
   // anything that could cause this to throw is likely catastrophic,
   // so we re-throw
@@ -689,6 +817,7 @@ block Blockchain::pop_block_from_blockchain()
   m_scan_table.clear();
   m_blocks_txs_check.clear();
   m_check_txin_table.clear();
+  m_prehashed_blocks.clear();
 
   CHECK_AND_ASSERT_THROW_MES(update_next_cumulative_weight_limit(), "Error updating next cumulative weight limit");
   uint64_t top_block_height;
@@ -703,7 +832,7 @@ bool Blockchain::reset_and_set_genesis_block(const block& b)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
+  clear_recent_block_metadata();
   invalidate_block_template_cache();
   m_db->reset();
   m_db->drop_alt_blocks();
@@ -906,8 +1035,6 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   }
 
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  std::vector<uint64_t> timestamps;
-  std::vector<difficulty_type> difficulties;
   auto height = m_db->height();
   top_hash = get_tail_id(height); // get it again now that we have the lock
   ++height; // top block height to blockchain height
@@ -915,43 +1042,18 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   uint8_t version = get_current_hard_fork_version();
   size_t difficulty_blocks_count = get_difficulty_blocks_count(version);
 
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1) && m_timestamps.size() >= difficulty_blocks_count)
-  {
-    uint64_t index = height - 1;
-    m_timestamps.push_back(m_db->get_block_timestamp(index));
-    m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
-    while (m_timestamps.size() > difficulty_blocks_count)
-      m_timestamps.erase(m_timestamps.begin());
-    while (m_difficulties.size() > difficulty_blocks_count)
-      m_difficulties.erase(m_difficulties.begin());
+  uint64_t offset = height - std::min <uint64_t> (height, static_cast<uint64_t>(difficulty_blocks_count));
+  if (offset == 0)
+    ++offset;
 
-    m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
-  }
-  else
+  std::vector<uint64_t> timestamps;
+  std::vector<difficulty_type> difficulties;
+  if (height > offset)
   {
-    uint64_t offset = height - std::min <uint64_t> (height, static_cast<uint64_t>(difficulty_blocks_count));
-    if (offset == 0)
-      ++offset;
-
-    timestamps.clear();
-    difficulties.clear();
-    if (height > offset)
-    {
-      timestamps.reserve(height - offset);
-      difficulties.reserve(height - offset);
-    }
-    for (; offset < height; offset++)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-    }
-
-    m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
+    const epee::span<const uint64_t> recent_timestamps = get_recent_timestamps(offset, height - offset);
+    const epee::span<const difficulty_type> recent_difficulties = get_recent_cumulative_difficulties(offset, height - offset);
+    timestamps.assign(recent_timestamps.begin(), recent_timestamps.end());
+    difficulties.assign(recent_difficulties.begin(), recent_difficulties.end());
   }
 
   if (version >= 10) {
@@ -978,8 +1080,6 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
     return true;
   }
 
-  m_timestamps_and_difficulties_height = 0;
-
   // remove blocks from blockchain until we get back to where we should be.
   while (m_db->height() != rollback_height)
   {
@@ -1031,8 +1131,6 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<block_extended_info>
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   // if empty alt chain passed (not sure how that could happen), return false
   CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
 
@@ -1182,6 +1280,9 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<block_extended_info>
 
   m_hardfork->reorganize_from_chain_height(split_height);
   get_block_longhash_reorg(split_height);
+  m_prehashed_blocks.clear();
+  m_rx_prepared_seed_height = 0;
+  m_rx_prepared_seed_hash = crypto::null_hash;
 
   std::shared_ptr<tools::Notify> reorg_notify = m_reorg_notify;
   if (reorg_notify)
@@ -1223,10 +1324,13 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
       ++main_chain_start_offset; //skip genesis block
 
     // get difficulties and timestamps from relevant main chain blocks
-    for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+    if (main_chain_start_offset < main_chain_stop_offset)
     {
-      timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      const size_t count = main_chain_stop_offset - main_chain_start_offset;
+      const epee::span<const uint64_t> recent_timestamps = get_recent_timestamps(main_chain_start_offset, count);
+      timestamps.assign(recent_timestamps.begin(), recent_timestamps.end());
+      const epee::span<const difficulty_type> recent_difficulties = get_recent_cumulative_difficulties(main_chain_start_offset, count);
+      cumulative_difficulties.assign(recent_difficulties.begin(), recent_difficulties.end());
     }
 
     // make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
@@ -1348,7 +1452,8 @@ void Blockchain::get_last_n_blocks_weights(std::vector<uint64_t>& weights, size_
 
   // add weight of last <count> blocks to vector <weights> (or less, if blockchain size < count)
   size_t start_offset = h - std::min<size_t>(h, count);
-  weights = m_db->get_block_weights(start_offset, count);
+  const epee::span<const uint64_t> recent_weights = get_recent_weights(start_offset, h - start_offset);
+  weights.assign(recent_weights.begin(), recent_weights.end());
 }
 //------------------------------------------------------------------
 void Blockchain::get_long_term_block_weights(std::vector<uint64_t>& weights, uint64_t start_height, size_t count) const
@@ -1356,7 +1461,78 @@ void Blockchain::get_long_term_block_weights(std::vector<uint64_t>& weights, uin
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  weights = m_db->get_long_term_block_weights(start_height, count);
+  const epee::span<const uint64_t> recent_weights = get_recent_long_term_weights(start_height, count);
+  weights.assign(recent_weights.begin(), recent_weights.end());
+}
+//------------------------------------------------------------------
+epee::span<const uint64_t> Blockchain::get_recent_timestamps(uint64_t start_height, size_t count) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_recent_timestamps.get(start_height, count, m_db->height(), [this](uint64_t start_height, size_t count) {
+    std::vector<uint64_t> timestamps;
+    timestamps.reserve(count);
+    db_rtxn_guard rtxn_guard(m_db);
+    for (uint64_t height = start_height; height < start_height + count; ++height)
+      timestamps.push_back(m_db->get_block_timestamp(height));
+    return timestamps;
+  });
+}
+//------------------------------------------------------------------
+epee::span<const difficulty_type> Blockchain::get_recent_cumulative_difficulties(uint64_t start_height, size_t count) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_recent_cumulative_difficulties.get(start_height, count, m_db->height(), [this](uint64_t start_height, size_t count) {
+    std::vector<difficulty_type> difficulties;
+    difficulties.reserve(count);
+    db_rtxn_guard rtxn_guard(m_db);
+    for (uint64_t height = start_height; height < start_height + count; ++height)
+      difficulties.push_back(m_db->get_block_cumulative_difficulty(height));
+    return difficulties;
+  });
+}
+//------------------------------------------------------------------
+epee::span<const uint64_t> Blockchain::get_recent_weights(uint64_t start_height, size_t count) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_recent_weights.get(start_height, count, m_db->height(), [this](uint64_t start_height, size_t count) {
+    return m_db->get_block_weights(start_height, count);
+  });
+}
+//------------------------------------------------------------------
+epee::span<const uint64_t> Blockchain::get_recent_long_term_weights(uint64_t start_height, size_t count) const
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  return m_recent_long_term_weights.get(start_height, count, m_db->height(), [this](uint64_t start_height, size_t count) {
+    return m_db->get_long_term_block_weights(start_height, count);
+  });
+}
+//------------------------------------------------------------------
+void Blockchain::push_recent_block_metadata(uint64_t timestamp, const difficulty_type &cumulative_difficulty, uint64_t weight, uint64_t long_term_weight)
+{
+  // the block was just added to the db
+  const uint64_t height = m_db->height() - 1;
+  m_recent_timestamps.push_back_or_clear(height, timestamp);
+  m_recent_cumulative_difficulties.push_back_or_clear(height, cumulative_difficulty);
+  m_recent_weights.push_back_or_clear(height, weight);
+  m_recent_long_term_weights.push_back_or_clear(height, long_term_weight);
+}
+//------------------------------------------------------------------
+void Blockchain::pop_recent_block_metadata()
+{
+  // the block was just removed from the db
+  const uint64_t height = m_db->height();
+  m_recent_timestamps.pop_back_or_clear(height);
+  m_recent_cumulative_difficulties.pop_back_or_clear(height);
+  m_recent_weights.pop_back_or_clear(height);
+  m_recent_long_term_weights.pop_back_or_clear(height);
+}
+//------------------------------------------------------------------
+void Blockchain::clear_recent_block_metadata()
+{
+  m_recent_timestamps.clear();
+  m_recent_cumulative_difficulties.clear();
+  m_recent_weights.clear();
+  m_recent_long_term_weights.clear();
 }
 //------------------------------------------------------------------
 uint64_t Blockchain::get_current_cumulative_block_weight_limit() const
@@ -1389,25 +1565,57 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
   uint64_t already_generated_coins;
   uint64_t pool_cookie;
 
-  CRITICAL_REGION_BEGIN(m_blockchain_lock);
-  if (m_btc_valid && !from_block) {
-    // The pool cookie is atomic. The lack of locking is OK, as if it changes
-    // just as we compare it, we'll just use a slightly old template, but
-    // this would be the case anyway if we'd lock, and the change happened
-    // just after the block template was created
-    if (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address)) && m_btc_nonce == ex_nonce && m_btc_pool_cookie == m_tx_pool.cookie() && m_btc.prev_id == get_tail_id()) {
-      MDEBUG("Using cached template");
-      m_btc.timestamp = time(NULL); // update timestamp unconditionally
-      b = m_btc;
-      diffic = m_btc_difficulty;
-      height = m_btc_height;
-      expected_reward = m_btc_expected_reward;
+  if (!from_block)
+  {
+    tx_memory_pool::block_template_candidates candidates;
+    size_t txs_weight;
+    uint64_t fee;
+    bool cached = false;
+    {
+      // the pool lock is taken before the blockchain lock, as elsewhere
+      CRITICAL_REGION_LOCAL(m_tx_pool);
+      CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+      if (m_btc_valid)
+      {
+        if (update_block_template_cache(miner_address, ex_nonce, candidates))
+        {
+          MDEBUG("Using cached template");
+          m_btc.timestamp = time(NULL); // update timestamp unconditionally
+          b = m_btc;
+          diffic = m_btc_difficulty;
+          height = m_btc_height;
+          expected_reward = m_btc_expected_reward;
+          pool_cookie = m_btc_pool_cookie;
+          median_weight = m_btc_median_weight;
+          already_generated_coins = m_btc_already_generated_coins;
+          txs_weight = m_btc_txs_weight;
+          fee = m_btc_fee;
+          cached = true;
+        }
+        else
+        {
+          invalidate_block_template_cache();
+        }
+      }
+    }
+    if (cached)
+    {
+      // the local search runs on the copy, without the locks
+      const std::vector<crypto::hash> tx_hashes = b.tx_hashes;
+      if (!tx_memory_pool::improve_block_template(b, candidates, txs_weight, fee, expected_reward))
+        return true;
+      if (!construct_block_template_miner_tx(b, height, median_weight, already_generated_coins, txs_weight, fee, miner_address, ex_nonce))
+        return false;
+      CRITICAL_REGION_LOCAL(m_blockchain_lock);
+      // keep the improvement unless the cached template moved on meanwhile
+      if (m_btc_valid && m_btc_pool_cookie == pool_cookie && m_btc.prev_id == b.prev_id && m_btc.tx_hashes == tx_hashes)
+        cache_block_template(b, miner_address, ex_nonce, diffic, height, expected_reward, pool_cookie, median_weight, already_generated_coins, txs_weight, fee);
       return true;
     }
-    MDEBUG("Not using cached template: address " << (!memcmp(&miner_address, &m_btc_address, sizeof(cryptonote::account_public_address))) << ", nonce " << (m_btc_nonce == ex_nonce) << ", cookie " << (m_btc_pool_cookie == m_tx_pool.cookie()) << ", from_block " << (!from_block));
-    invalidate_block_template_cache();
   }
 
+  CRITICAL_REGION_BEGIN(m_blockchain_lock);
+
   if (from_block)
   {
     //build alternative subchain, front -> mainchain, back -> alternative head
@@ -1481,13 +1689,9 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
   uint64_t blockchain_timestamp_check_window = version > 9 ? BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW_V11 : BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW_V9;
 
   if(m_db->height() >= blockchain_timestamp_check_window) {
-    std::vector<uint64_t> timestamps;
     auto h = m_db->height();
-
-    for(size_t offset = h - blockchain_timestamp_check_window; offset < h; ++offset)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-    }
+    const epee::span<const uint64_t> recent_timestamps = get_recent_timestamps(h - blockchain_timestamp_check_window, blockchain_timestamp_check_window);
+    std::vector<uint64_t> timestamps(recent_timestamps.begin(), recent_timestamps.end());
     uint64_t median_ts = epee::misc_utils::median(timestamps);
     if (b.timestamp < median_ts) {
       b.timestamp = median_ts;
@@ -1500,11 +1704,12 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
 
   size_t txs_weight;
   uint64_t fee;
+  // taken first, so any change made while filling is picked up by the next update
+  pool_cookie = m_tx_pool.cookie();
   if (!m_tx_pool.fill_block_template(b, median_weight, already_generated_coins, txs_weight, fee, expected_reward, b.major_version))
   {
     return false;
   }
-  pool_cookie = m_tx_pool.cookie();
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
   size_t real_txs_weight = 0;
   uint64_t real_fee = 0;
@@ -1560,6 +1765,16 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
       ", fee " << fee);
 #endif
 
+  if (!construct_block_template_miner_tx(b, height, median_weight, already_generated_coins, txs_weight, fee, miner_address, ex_nonce))
+    return false;
+
+  if (!from_block)
+    cache_block_template(b, miner_address, ex_nonce, diffic, height, expected_reward, pool_cookie, median_weight, already_generated_coins, txs_weight, fee);
+  return true;
+}
+//------------------------------------------------------------------
+bool Blockchain::construct_block_template_miner_tx(block& b, uint64_t height, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee, const account_public_address& miner_address, const blobdata& ex_nonce) const
+{
   /*
    two-phase miner transaction generation: we don't know exact block weight until we prepare block, but we don't know reward until we know
    block weight, so first miner transaction generated with fake amount of money, and with phase we know think we know expected block weight
@@ -1620,8 +1835,6 @@ bool Blockchain::create_block_template(block& b, const crypto::hash *from_block,
         ", cumulative weight " << cumulative_weight << " is now good");
 #endif
 
-    if (!from_block)
-      cache_block_template(b, miner_address, ex_nonce, diffic, height, expected_reward, pool_cookie);
     return true;
   }
   LOG_ERROR("Failed to create_block_template with " << 10 << " tries");
@@ -1646,12 +1859,11 @@ bool Blockchain::complete_timestamps_vector(uint64_t start_top_height, std::vect
   size_t need_elements = BLOCKCHAIN_TIMESTAMP_CHECK_WINDOW_V11 - timestamps.size();
   CHECK_AND_ASSERT_MES(start_top_height < m_db->height(), false, "internal error: passed start_height not < " << " m_db->height() -- " << start_top_height << " >= " << m_db->height());
   size_t stop_offset = start_top_height > need_elements ? start_top_height - need_elements : 0;
-  timestamps.reserve(timestamps.size() + start_top_height - stop_offset);
-  while (start_top_height != stop_offset)
-  {
-    timestamps.push_back(m_db->get_block_timestamp(start_top_height));
-    --start_top_height;
-  }
+  if (start_top_height == stop_offset)
+    return true;
+  // newest first, from start_top_height down to stop_offset + 1
+  const epee::span<const uint64_t> recent_timestamps = get_recent_timestamps(stop_offset + 1, start_top_height - stop_offset);
+  timestamps.insert(timestamps.end(), std::reverse_iterator<const uint64_t*>(recent_timestamps.end()), std::reverse_iterator<const uint64_t*>(recent_timestamps.begin()));
   return true;
 }
 //------------------------------------------------------------------
@@ -1719,7 +1931,6 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
   uint64_t block_height = get_block_height(b);
   if(0 == block_height)
   {
@@ -1789,7 +2000,12 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     difficulty_type current_diff = get_next_difficulty_for_alternative_chain(alt_chain, bei);
     CHECK_AND_ASSERT_MES(current_diff, false, "!!!!!!! DIFFICULTY OVERHEAD !!!!!!!");
     crypto::hash proof_of_work = null_hash;
-    if(b.major_version >= RX_BLOCK_VERSION)
+    const bool pow_indexed = m_pow_hash_index && m_db->get_block_pow_hash(id, proof_of_work);
+    if (pow_indexed)
+    {
+      // seen before, eg on a chain we reorganized away from
+    }
+    else if(b.major_version >= RX_BLOCK_VERSION)
     {
       crypto::hash seedhash = null_hash;
       uint64_t seedheight = rx_seedheight(bei.height);
@@ -1853,6 +2069,8 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
     data.cumulative_difficulty = bei.cumulative_difficulty;
     data.already_generated_coins = bei.already_generated_coins;
     m_db->add_alt_block(id, data, cryptonote::block_to_blob(bei.bl));
+    if (m_pow_hash_index && !pow_indexed)
+      m_db->add_block_pow_hash(id, proof_of_work);
     alt_chain.push_back(bei);
 
     // FIXME: is it even possible for a checkpoint to show up not on the main chain?
@@ -1942,6 +2160,32 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
   return true;
 }
 //------------------------------------------------------------------
+bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  db_rtxn_guard rtxn_guard(m_db);
+  const uint64_t height = m_db->height();
+  if(start_offset >= height)
+    return false;
+
+  blocks.reserve(blocks.size() + std::min<uint64_t>(count, height - start_offset));
+  bool valid = true;
+  for(size_t i = start_offset; i < start_offset + count && i < height && valid; i++)
+  {
+    blocks.push_back(block());
+    m_db->get_block_blob_view_from_height(i, [&](const cryptonote::blobdata_ref &blob) {
+      valid = parse_and_validate_block_from_blob(blob, blocks.back());
+    });
+  }
+  if (!valid)
+  {
+    LOG_ERROR("Invalid block");
+    return false;
+  }
+  return true;
+}
+//------------------------------------------------------------------
 //TODO: This function *looks* like it won't need to be rewritten
 //      to use BlockchainDB, as it calls other functions that were,
 //      but it warrants some looking into later.
@@ -1949,7 +2193,7 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
 //FIXME: This function appears to want to return false if any transactions
 //       that belong with blocks are missing, but not if blocks themselves
 //       are missing.
-bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp)
+bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::shared_request& rsp)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
@@ -1962,8 +2206,8 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
   {
     std::vector<crypto::hash> missed_tx_ids;
 
-    rsp.blocks.push_back(block_complete_entry());
-    block_complete_entry& e = rsp.blocks.back();
+    rsp.blocks.push_back(shared_block_complete_entry());
+    shared_block_complete_entry& e = rsp.blocks.back();
 
     // FIXME: s/rsp.missed_ids/missed_tx_id/ ?  Seems like rsp.missed_ids
     //        is for missed blocks, not missed transactions as well.
@@ -1984,7 +2228,7 @@ bool Blockchain::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NO
     }
 
     //pack block
-    e.block = std::move(bl.first);
+    e.block = epee::shared_buffer(std::move(bl.first));
   }
   //get and pack other transactions, if needed
   get_transactions_blobs(arg.txs, rsp.txs, rsp.missed_ids);
@@ -2264,17 +2508,21 @@ bool Blockchain::get_transactions_blobs(const t_ids_container& txs_ids, t_tx_con
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
+  db_rtxn_guard rtxn_guard(m_db);
   reserve_container(txs, txs_ids.size());
   for (const auto& tx_hash : txs_ids)
   {
     try
     {
-      cryptonote::blobdata tx;
-      if (pruned && m_db->get_pruned_tx_blob(tx_hash, tx))
-        txs.push_back(std::move(tx));
-      else if (!pruned && m_db->get_tx_blob(tx_hash, tx))
-        txs.push_back(std::move(tx));
-      else
+      // build each blob in one allocation, straight from the db
+      const bool found = m_db->get_tx_blob_view(tx_hash, pruned, [&txs](const cryptonote::blobdata_ref &pruned_part, const cryptonote::blobdata_ref &prunable_part) {
+        cryptonote::blobdata tx;
+        tx.reserve(pruned_part.size() + prunable_part.size());
+        tx.append(pruned_part.data(), pruned_part.size());
+        tx.append(prunable_part.data(), prunable_part.size());
+        txs.emplace_back(std::move(tx));
+      });
+      if (!found)
         missed_txs.push_back(tx_hash);
     }
     catch (const std::exception& e)
@@ -2851,7 +3099,7 @@ bool Blockchain::expand_transaction_2(transaction &tx, const crypto::hash &tx_pr
 //        check_tx_input() rather than here, and use this function simply
 //        to iterate the inputs as necessary (splitting the task
 //        using threads, etc.)
-bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height)
+bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height, block_signature_checks *deferred)
 {
   PERF_TIMER(check_tx_inputs);
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -3093,6 +3341,13 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
     // obviously, the original and simple rct APIs use a mixRing that's indexes
     // in opposite orders, because it'd be too simple otherwise...
     const rct::rctSig &rv = tx.rct_signatures;
+
+    // if the pool (or an earlier block) already verified these signatures over
+    // these very ring members, we don't need to do it again
+    const crypto::hash verified_key = verified_tx_cache::make_key(get_transaction_hash(tx), get_transaction_prunable_hash(tx), verified_tx_cache::get_ring_hash(pubkeys));
+    const bool already_verified = m_verified_tx_cache.has(verified_key);
+    if (already_verified)
+      MDEBUG("Signatures of tx " << get_transaction_hash(tx) << " already verified, skipping");
     switch (rv.type)
     {
     case rct::RCTTypeNull: {
@@ -3152,7 +3407,17 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRctNonSemanticsSimple(rv))
+      if (already_verified)
+        break;
+      if (deferred)
+      {
+        if (!rct::getRctNonSemanticsSimpleChecks(rv, deferred->checks))
+        {
+          MERROR_VER("Failed to check ringct signatures!");
+          return false;
+        }
+      }
+      else if (!rct::verRctNonSemanticsSimple(rv))
       {
         MERROR_VER("Failed to check ringct signatures!");
         return false;
@@ -3212,7 +3477,13 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
         }
       }
 
-      if (!rct::verRct(rv, false))
+      if (already_verified)
+        break;
+      if (deferred)
+      {
+        deferred->checks.push_back([&rv] { return rct::verRct(rv, false); });
+      }
+      else if (!rct::verRct(rv, false))
       {
         MERROR_VER("Failed to check ringct signatures!");
         return false;
@@ -3224,6 +3495,14 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
       return false;
     }
 
+    if (!already_verified)
+    {
+      if (deferred)
+        deferred->verified_keys.push_back(verified_key);
+      else
+        m_verified_tx_cache.add(verified_key);
+    }
+
     // for bulletproofs, check they're only multi-output after v13
     if(rct::is_rct_bulletproof(rv.type) && rv.type == rct::RCTTypeBulletproof)
     {
@@ -3244,6 +3523,36 @@ bool Blockchain::check_tx_inputs(transaction& tx, tx_verification_context &tvc,
   return true;
 }
 
+//------------------------------------------------------------------
+bool Blockchain::run_block_signature_checks(const block_signature_checks &sig_checks, size_t &failed_tx) const
+{
+  PERF_TIMER(run_block_signature_checks);
+
+  const size_t n_checks = sig_checks.checks.size();
+  std::atomic<size_t> first_failed(n_checks);
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  for (size_t i = 0; i < n_checks; ++i)
+  {
+    tpool.submit(&waiter, [&, i] {
+      // once anything failed, the block is bad, no need to check the rest
+      if (first_failed.load(std::memory_order_relaxed) != n_checks)
+        return;
+      if (!sig_checks.checks[i]())
+      {
+        size_t none = n_checks;
+        first_failed.compare_exchange_strong(none, i);
+      }
+    }, true);
+  }
+  waiter.wait(&tpool);
+
+  if (first_failed == n_checks)
+    return true;
+  failed_tx = sig_checks.owners[first_failed];
+  return false;
+}
+
 //------------------------------------------------------------------
 void Blockchain::check_ring_signature(const crypto::hash &tx_prefix_hash, const crypto::key_image &key_image, const std::vector<rct::ctkey> &pubkeys, const std::vector<crypto::signature>& sig, uint64_t &result)
 {
@@ -3570,15 +3879,9 @@ bool Blockchain::check_median_block_timestamp(const block& b, uint64_t& median_t
     return true;
   }
 
-  std::vector<uint64_t> timestamps;
-
-  // need most recent 60 blocks, get index of first of those
-  size_t offset = h - blockchain_timestamp_check_window;
-  timestamps.reserve(h - offset);
-  for(;offset < h; ++offset)
-  {
-    timestamps.push_back(m_db->get_block_timestamp(offset));
-  }
+  // need most recent blockchain_timestamp_check_window blocks
+  const epee::span<const uint64_t> recent_timestamps = get_recent_timestamps(h - blockchain_timestamp_check_window, blockchain_timestamp_check_window);
+  std::vector<uint64_t> timestamps(recent_timestamps.begin(), recent_timestamps.end());
 
   return check_block_timestamp(timestamps, b);
 }
@@ -3736,6 +4039,8 @@ leave:
       precomputed = true;
       proof_of_work = it->second;
     }
+    else if (m_pow_hash_index && m_db->get_block_pow_hash(id, proof_of_work))
+      precomputed = true;
     else
       proof_of_work = get_block_longhash(this, bl, blockchain_height, 0);
 
@@ -3790,6 +4095,9 @@ leave:
 // XXX old code adds miner tx here
 
   size_t tx_index = 0;
+  // ringct signatures of all txes are checked together once all are resolved,
+  // so they need to stay in place in txs, which is reserved for this reason
+  block_signature_checks sig_checks;
   // Iterate over the block's transaction hashes, grabbing each
   // from the tx_pool and validating them.  Each is then added
   // to txs.  Keys spent in each are added to <keys> by the double spend check.
@@ -3855,7 +4163,7 @@ leave:
     {
       // validate that transaction inputs and the keys spending them are correct.
       tx_verification_context tvc;
-      if(!check_tx_inputs(tx, tvc))
+      if(!check_tx_inputs(txs.back(), tvc, NULL, &sig_checks))
       {
         MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << tx_id << ") with wrong inputs.");
 
@@ -3884,12 +4192,33 @@ leave:
       }
     }
 #endif
+    sig_checks.owners.resize(sig_checks.checks.size(), txs.size() - 1);
     TIME_MEASURE_FINISH(cc);
     t_checktx += cc;
     fee_summary += fee;
     cumulative_block_weight += tx_weight;
   }
 
+  if (!sig_checks.checks.empty())
+  {
+    TIME_MEASURE_START(sc);
+    size_t failed_tx = 0;
+    if (!run_block_signature_checks(sig_checks, failed_tx))
+    {
+      MERROR_VER("Block with id: " << id  << " has at least one transaction (id: " << bl.tx_hashes[failed_tx] << ") with wrong inputs.");
+
+      add_block_as_invalid(bl, id);
+      MERROR_VER("Block with id " << id << " added as invalid because of wrong inputs in transactions");
+      bvc.m_verifivation_failed = true;
+      return_tx_to_pool(txs);
+      goto leave;
+    }
+    for (const crypto::hash &key: sig_checks.verified_keys)
+      m_verified_tx_cache.add(key);
+    TIME_MEASURE_FINISH(sc);
+    t_checktx += sc;
+  }
+
   m_blocks_txs_check.clear();
 
   TIME_MEASURE_START(vmt);
@@ -3931,6 +4260,11 @@ leave:
     {
       uint64_t long_term_block_weight = get_next_long_term_block_weight(block_weight);
       new_height = m_db->add_block(bl, block_weight, long_term_block_weight, cumulative_difficulty, already_generated_coins, txs);
+      push_recent_block_metadata(bl.timestamp, cumulative_difficulty, block_weight, long_term_block_weight);
+      // keep the PoW hash so it does not need recomputing if this block is
+      // popped and added again, or queried over RPC
+      if (m_pow_hash_index && proof_of_work != crypto::null_hash)
+        m_db->add_block_pow_hash(id, proof_of_work);
     }
     catch (const KEY_IMAGE_EXISTS& e)
     {
@@ -3982,6 +4316,7 @@ leave:
   m_tx_pool.on_blockchain_inc(new_height, id);
   get_difficulty_for_next_block(); // just to cache it
   invalidate_block_template_cache();
+  prepare_next_rx_seed(new_height, bl.major_version);
 
     if (zmq_enabled)
   {
@@ -4251,7 +4586,7 @@ void Blockchain::set_enforce_dns_checkpoints(bool enforce_checkpoints)
 }
 
 //------------------------------------------------------------------
-void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const
+void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map, const crypto::hash *seed_id) const
 {
   TIME_MEASURE_START(t);
 
@@ -4260,7 +4595,7 @@ void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const b
     if (m_cancel)
        break;
     crypto::hash id = get_block_hash(block);
-    crypto::hash pow = get_block_longhash(this, block, height++, 0);
+    crypto::hash pow = seed_id ? get_block_longhash(block, height++, *seed_id, 0) : get_block_longhash(this, block, height++, 0);
     map.emplace(id, pow);
   }
 
@@ -4271,6 +4606,7 @@ void Blockchain::block_longhash_worker(uint64_t height, const epee::span<const b
 bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
 {
   bool success = false;
+  uint64_t sync_ticket = 0;
 
   MTRACE("Blockchain::" << __func__);
   CRITICAL_REGION_BEGIN(m_blockchain_lock);
@@ -4281,7 +4617,11 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
     if(m_batch_success)
       m_db->batch_stop();
     else
+    {
       m_db->batch_abort();
+      clear_recent_block_metadata();
+      m_prehashed_blocks.clear();
+    }
     success = true;
   }
   catch (const std::exception &e)
@@ -4293,8 +4633,10 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   {
     if (force_sync)
     {
+      // waited for below, out of the locks; this also waits for a background
+      // sync which may be running already, rather than syncing twice
       if(m_db_sync_mode != db_nosync)
-        store_blockchain();
+        sync_ticket = request_db_sync();
       m_sync_counter = 0;
     }
     else if (m_db_sync_threshold && ((m_db_sync_on_blocks && m_sync_counter >= m_db_sync_threshold) || (!m_db_sync_on_blocks && m_bytes_to_sync >= m_db_sync_threshold)))
@@ -4304,7 +4646,7 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
       {
         m_sync_counter = 0;
         m_bytes_to_sync = 0;
-        m_async_service.dispatch(boost::bind(&Blockchain::store_blockchain, this));
+        request_db_sync();
       }
       else if(m_db_sync_mode == db_sync)
       {
@@ -4334,6 +4676,9 @@ bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
   CRITICAL_REGION_END();
   m_tx_pool.unlock();
 
+  if (sync_ticket && !wait_for_db_sync(sync_ticket))
+    MERROR("Failed to sync the blockchain");
+
   update_blockchain_pruning();
 
   return success;
@@ -4481,6 +4826,10 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
   //  needs a batch, since a batch could otherwise be active while the
   //  txpool and blockchain locks were not held
 
+  // these blocks may be the ones being hashed in the background, and with
+  // no pool thread free (or none at all on a single CPU) this hashes them here
+  m_prehash_waiter.wait(&tools::threadpool::getInstance());
+
   m_tx_pool.lock();
   CRITICAL_REGION_LOCAL1(m_blockchain_lock);
 
@@ -4525,7 +4874,6 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     unsigned int batches = blocks_entry.size() / threads;
     unsigned int extra = blocks_entry.size() % threads;
     MDEBUG("block_batches: " << batches);
-    std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(threads);
     auto it = blocks_entry.begin();
     unsigned blockidx = 0;
 
@@ -4577,19 +4925,36 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
     if (!blocks_exist)
     {
       m_blocks_longhash_table.clear();
-      uint64_t thread_height = height;
+
+      // blocks already in the PoW hash index are not hashed again. The rest
+      // are split in runs which do not cross a seed epoch, so each worker
+      // keeps the same RandomX cache and VM for its whole run
+      const size_t max_run = (blocks.size() + threads - 1) / threads;
+      std::vector<std::pair<size_t, size_t>> runs; // first block index, number of blocks
+      for (size_t i = 0; i < blocks.size(); ++i)
+      {
+        const crypto::hash id = get_block_hash(blocks[i]);
+        crypto::hash pow_hash;
+        if (m_prehashed_blocks.take(id, height + i, pow_hash) || (m_pow_hash_index && m_db->get_block_pow_hash(id, pow_hash)))
+        {
+          m_blocks_longhash_table.emplace(id, pow_hash);
+          continue;
+        }
+        if (runs.empty() || runs.back().first + runs.back().second != i || runs.back().second >= max_run
+            || rx_seedheight(height + i) != rx_seedheight(height + runs.back().first))
+          runs.push_back(std::make_pair(i, 1));
+        else
+          ++runs.back().second;
+      }
+      MDEBUG(blocks.size() - m_blocks_longhash_table.size() << " blocks to hash in " << runs.size() << " runs");
+
+      std::vector<std::unordered_map<crypto::hash, crypto::hash>> maps(runs.size());
       tools::threadpool::waiter waiter;
       m_prepare_height = height;
       m_prepare_nblocks = blocks_entry.size();
       m_prepare_blocks = &blocks;
-      for (unsigned int i = 0; i < threads; i++)
-      {
-        unsigned nblocks = batches;
-        if (i < extra)
-          ++nblocks;
-        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, thread_height, epee::span<const block>(&blocks[i], nblocks), std::ref(maps[i])), true);
-        thread_height += nblocks;
-      }
+      for (size_t i = 0; i < runs.size(); ++i)
+        tpool.submit(&waiter, boost::bind(&Blockchain::block_longhash_worker, this, height + runs[i].first, epee::span<const block>(&blocks[runs[i].first], runs[i].second), std::ref(maps[i]), (const crypto::hash*)NULL), true);
 
       waiter.wait(&tpool);
       m_prepare_height = 0;
@@ -5123,7 +5488,39 @@ void Blockchain::invalidate_block_template_cache()
   m_btc_valid = false;
 }
 
-void Blockchain::cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie)
+crypto::hash Blockchain::get_block_pow_hash(const crypto::hash &id, const block &b, uint64_t height) const
+{
+  crypto::hash pow_hash;
+  if (m_pow_hash_index && m_db->get_block_pow_hash(id, pow_hash))
+    return pow_hash;
+  return get_block_longhash(this, b, height, 0);
+}
+
+void Blockchain::prepare_next_rx_seed(uint64_t height, uint8_t version)
+{
+  // no PoW is computed for blocks within the precomputed hashes
+  if (version < RX_BLOCK_VERSION || height < m_blocks_hash_check.size())
+    return;
+
+  uint64_t seed_height, next_height;
+  rx_seedheights(height, &seed_height, &next_height);
+  if (next_height == seed_height)
+    return;
+
+  const crypto::hash seed_hash = m_db->get_block_hash_from_height(next_height);
+  if (next_height == m_rx_prepared_seed_height && seed_hash == m_rx_prepared_seed_hash)
+    return;
+
+  MDEBUG("Preparing RandomX seed " << seed_hash << " at height " << next_height << " in the background");
+  // if a prep for another seed is still running, this is retried on the next block
+  if (rx_prepare_next_seedhash(next_height, seed_hash.data))
+  {
+    m_rx_prepared_seed_height = next_height;
+    m_rx_prepared_seed_hash = seed_hash;
+  }
+}
+
+void Blockchain::cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee)
 {
   MDEBUG("Setting block template cache");
   m_btc = b;
@@ -5133,9 +5530,58 @@ void Blockchain::cache_block_template(const block &b, const cryptonote::account_
   m_btc_height = height;
   m_btc_expected_reward = expected_reward;
   m_btc_pool_cookie = pool_cookie;
+  m_btc_median_weight = median_weight;
+  m_btc_already_generated_coins = already_generated_coins;
+  m_btc_txs_weight = txs_weight;
+  m_btc_fee = fee;
   m_btc_valid = true;
 }
 
+bool Blockchain::update_block_template_cache(const cryptonote::account_public_address &address, const blobdata &nonce, tx_memory_pool::block_template_candidates &candidates)
+{
+  if (m_btc.prev_id != get_tail_id())
+  {
+    MDEBUG("Not using cached template: chain changed");
+    return false;
+  }
+
+  bool rebuild_miner_tx = memcmp(&address, &m_btc_address, sizeof(cryptonote::account_public_address)) || m_btc_nonce != nonce;
+
+  // take in transactions added to the pool since, if nothing else changed
+  const uint64_t pool_cookie = m_tx_pool.cookie();
+  if (m_btc_pool_cookie != pool_cookie)
+  {
+    std::vector<crypto::hash> added_txs;
+    if (!m_tx_pool.get_txs_added_since(m_btc_pool_cookie, added_txs))
+    {
+      MDEBUG("Not using cached template: pool changed");
+      return false;
+    }
+    const std::vector<crypto::hash> tx_hashes = m_btc.tx_hashes;
+    const size_t txs_weight = m_btc_txs_weight;
+    const uint64_t fee = m_btc_fee;
+    if (!m_tx_pool.add_to_block_template(m_btc, added_txs, m_btc_median_weight, m_btc_already_generated_coins, m_btc_txs_weight, m_btc_fee, m_btc_expected_reward, m_btc.major_version, candidates))
+    {
+      MDEBUG("Not using cached template: failed to add transactions, or a refill is needed");
+      return false;
+    }
+    MDEBUG("Added " << m_btc.tx_hashes.size() - tx_hashes.size() << "/" << added_txs.size() << " new pool txes to cached template");
+    // the miner tx pays the fees and depends on the weight, whatever the count
+    if (m_btc.tx_hashes != tx_hashes || m_btc_txs_weight != txs_weight || m_btc_fee != fee)
+      rebuild_miner_tx = true;
+    m_btc_pool_cookie = pool_cookie;
+  }
+
+  if (rebuild_miner_tx)
+  {
+    if (!construct_block_template_miner_tx(m_btc, m_btc_height, m_btc_median_weight, m_btc_already_generated_coins, m_btc_txs_weight, m_btc_fee, address, nonce))
+      return false;
+    m_btc_address = address;
+    m_btc_nonce = nonce;
+  }
+  return true;
+}
+
 namespace cryptonote {
 template bool Blockchain::get_transactions(const std::vector<crypto::hash>&, std::vector<transaction>&, std::vector<crypto::hash>&) const;
 template bool Blockchain::get_transactions_blobs(const std::vector<crypto::hash>&, std::vector<cryptonote::blobdata>&, std::vector<crypto::hash>&, bool) const;
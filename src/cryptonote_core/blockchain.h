@@ -32,6 +32,7 @@
 
 #pragma once
 #include <boost/asio/io_service.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/version.hpp>
 #include <boost/serialization/list.hpp>
@@ -51,10 +52,16 @@
 #include "string_tools.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "common/util.h"
+#include "common/threadpool.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
 #include "cryptonote_tx_utils.h"
+#include "verified_tx_cache.h"
+#include "block_metadata_window.h"
+#include "db_sync_stage.h"
+#include "prehashed_blocks.h"
+#include "tx_pool.h"
 #include "cryptonote_basic/verification_context.h"
 #include "crypto/hash.h"
 #include "checkpoints/checkpoints.h"
@@ -65,7 +72,6 @@ namespace tools { class Notify; }
 
 namespace cryptonote
 {
-  class tx_memory_pool;
   struct test_options;
 
   /** Declares ways in which the BlockchainDB backend should be told to sync
@@ -178,6 +184,20 @@ namespace cryptonote
      */
     bool get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata,block>>& blocks) const;
 
+    /**
+     * @brief get blocks from blocks based on start height and count, without their blobs
+     *
+     * The blocks are parsed straight from the database, without copying
+     * their blobs.
+     *
+     * @param start_offset the height on the blockchain to start at
+     * @param count the number of blocks to get, if there are as many after start_offset
+     * @param blocks return-by-reference container to put result blocks in
+     *
+     * @return false if start_offset > blockchain height, else true
+     */
+    bool get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const;
+
     /**
      * @brief compiles a list of all blocks stored as alternative chains
      *
@@ -244,6 +264,22 @@ namespace cryptonote
      */
     bool cleanup_handle_incoming_blocks(bool force_sync = false);
 
+    /**
+     * @brief starts computing the PoW hashes of incoming blocks in the background
+     *
+     * While syncing, this lets the next span be hashed while the current one
+     * is verified and committed. prepare_handle_incoming_blocks waits for the
+     * hashing to finish, and uses the hashes of blocks which end up at the
+     * height they were hashed for. Blocks whose RandomX seed block is not in
+     * the database yet are left for prepare_handle_incoming_blocks to hash.
+     *
+     * @param height the height the first block is expected at
+     * @param block_blobs the incoming blocks, without their transactions
+     *
+     * @return false if previous blocks are still being hashed, else true
+     */
+    bool prehash_incoming_blocks(uint64_t height, const std::vector<blobdata> &block_blobs);
+
     /**
      * @brief search the blockchain for a transaction by hash
      *
@@ -457,7 +493,7 @@ namespace cryptonote
      *
      * @return true unless any blocks or transactions are missing
      */
-    bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp);
+    bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::shared_request& rsp);
 
     /**
      * @brief get number of outputs of an amount past the minimum spendable age
@@ -541,6 +577,26 @@ namespace cryptonote
      */
     bool store_blockchain();
 
+    /**
+     * @brief asks for the blockchain to be synced to disk in the background
+     *
+     * Requests made while a sync is running are merged into a single sync
+     * started when it finishes, so at most one sync runs and one waits.
+     * After a failed sync, the next request retries.
+     *
+     * @return a ticket to pass to wait_for_db_sync
+     */
+    uint64_t request_db_sync();
+
+    /**
+     * @brief waits until everything committed before a sync request is on disk
+     *
+     * @param ticket the value returned by request_db_sync
+     *
+     * @return true if the data is on disk, false if syncing failed
+     */
+    bool wait_for_db_sync(uint64_t ticket);
+
     /**
      * @brief validates a transaction's inputs
      *
@@ -773,6 +829,27 @@ namespace cryptonote
      */
     void set_show_time_stats(bool stats) { m_show_time_stats = stats; }
 
+    /**
+     * @brief set whether or not to keep block PoW hashes in the database
+     *
+     * @param enabled the new PoW hash index setting
+     */
+    void set_pow_hash_index(bool enabled) { m_pow_hash_index = enabled; }
+
+    /**
+     * @brief gets a block's proof of work hash
+     *
+     * Reads it from the PoW hash index if the block is there, and computes
+     * it otherwise.
+     *
+     * @param id the block's hash
+     * @param b the block
+     * @param height the block's height
+     *
+     * @return the block's proof of work hash
+     */
+    crypto::hash get_block_pow_hash(const crypto::hash &id, const block &b, uint64_t height) const;
+
     /**
      * @brief gets the hardfork voting state object
      *
@@ -958,10 +1035,11 @@ namespace cryptonote
      * @brief computes the "short" and "long" hashes for a set of blocks
      *
      * @param height the height of the first block
-     * @param blocks the blocks to be hashed
+     * @param blocks the blocks to be hashed, within one RandomX seed epoch
      * @param map return-by-reference the hashes for each block
+     * @param seed_id the id of the blocks' RandomX seed block, or NULL to look it up
      */
-    void block_longhash_worker(uint64_t height, const epee::span<const block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map) const;
+    void block_longhash_worker(uint64_t height, const epee::span<const block> &blocks, std::unordered_map<crypto::hash, crypto::hash> &map, const crypto::hash *seed_id) const;
 
     /**
      * @brief returns a set of known alternate chains
@@ -1017,6 +1095,14 @@ namespace cryptonote
 
     typedef std::unordered_map<crypto::hash, block_extended_info> blocks_ext_by_hash;
 
+    // ringct signature checks of a block's transactions, gathered by check_tx_inputs
+    struct block_signature_checks
+    {
+      std::vector<std::function<bool()>> checks; // one per MLSAG, or per full rct signature
+      std::vector<size_t> owners; // index in the block of the transaction each check belongs to
+      std::vector<crypto::hash> verified_keys; // verified tx cache keys to add once all checks pass
+    };
+
 
     BlockchainDB* m_db;
 
@@ -1033,6 +1119,9 @@ namespace cryptonote
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
 
+    // txes whose ringct signatures were already verified, shared by the pool and block validation
+    verified_tx_cache m_verified_tx_cache;
+
     // SHA-3 hashes for each block and for fast pow checking
     std::vector<crypto::hash> m_blocks_hash_of_hashes;
     std::vector<crypto::hash> m_blocks_hash_check;
@@ -1041,6 +1130,7 @@ namespace cryptonote
     blockchain_db_sync_mode m_db_sync_mode;
     bool m_fast_sync;
     bool m_show_time_stats;
+    bool m_pow_hash_index;
     bool m_db_default_sync;
     bool m_db_sync_on_blocks;
     uint64_t m_db_sync_threshold;
@@ -1049,9 +1139,13 @@ namespace cryptonote
     uint64_t m_fake_scan_time;
     uint64_t m_sync_counter;
     uint64_t m_bytes_to_sync;
-    std::vector<uint64_t> m_timestamps;
-    std::vector<difficulty_type> m_difficulties;
-    uint64_t m_timestamps_and_difficulties_height;
+    // per-block values for the most recent main chain blocks, kept in step
+    // with the chain so the difficulty, weight and timestamp windows do not
+    // need to be read back from the db for every block
+    mutable block_metadata_column<uint64_t> m_recent_timestamps;
+    mutable block_metadata_column<difficulty_type> m_recent_cumulative_difficulties;
+    mutable block_metadata_column<uint64_t> m_recent_weights;
+    mutable block_metadata_column<uint64_t> m_recent_long_term_weights;
     uint64_t m_long_term_block_weights_window;
     uint64_t m_long_term_effective_median_block_weight;
 
@@ -1063,6 +1157,13 @@ namespace cryptonote
     boost::thread_group m_async_pool;
     std::unique_ptr<boost::asio::io_service::work> m_async_work_idle;
 
+    // background db syncs, see request_db_sync
+    db_sync_stage m_db_sync;
+
+    // PoW hashes computed ahead of prepare_handle_incoming_blocks, see prehash_incoming_blocks
+    tools::threadpool::waiter m_prehash_waiter; // waiting on it runs the job if no pool thread picked it up
+    prehashed_blocks m_prehashed_blocks; // cleared when the chain goes back
+
     // some invalid blocks
     blocks_ext_by_hash m_invalid_blocks;     // crypto::hash -> block_extended_info
 
@@ -1086,7 +1187,15 @@ namespace cryptonote
     uint64_t m_btc_height;
     uint64_t m_btc_pool_cookie;
     uint64_t m_btc_expected_reward;
+    size_t m_btc_median_weight;
+    uint64_t m_btc_already_generated_coins;
+    size_t m_btc_txs_weight;
+    uint64_t m_btc_fee;
     bool m_btc_valid;
+
+    // seed of the last RandomX cache prepared ahead of time
+    uint64_t m_rx_prepared_seed_height;
+    crypto::hash m_rx_prepared_seed_hash;
     
     bool m_batch_success;
 
@@ -1170,10 +1279,26 @@ namespace cryptonote
      * @param tx the transaction to validate
      * @param tvc returned information about tx verification
      * @param pmax_related_block_height return-by-pointer the height of the most recent block in the input set
+     * @param deferred if not NULL, ringct signature checks are added there instead of being run
      *
      * @return false if any validation step fails, otherwise true
      */
-    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL);
+    bool check_tx_inputs(transaction& tx, tx_verification_context &tvc, uint64_t* pmax_used_block_height = NULL, block_signature_checks *deferred = NULL);
+
+    /**
+     * @brief runs the deferred signature checks of a block's transactions
+     *
+     * All checks are submitted to the threadpool at once, so a block made of
+     * many small transactions keeps all threads busy rather than waiting on
+     * each transaction in turn. Once a check fails, the remaining ones are
+     * skipped.
+     *
+     * @param sig_checks the checks gathered by check_tx_inputs
+     * @param failed_tx return-by-reference the index of a failing transaction
+     *
+     * @return true if all checks passed, false otherwise
+     */
+    bool run_block_signature_checks(const block_signature_checks &sig_checks, size_t &failed_tx) const;
 
     /**
      * @brief performs a blockchain reorganization according to the longest chain rule
@@ -1328,6 +1453,80 @@ namespace cryptonote
      */
     void get_long_term_block_weights(std::vector<uint64_t>& weights, uint64_t start_height, size_t count) const;
 
+    /**
+     * @brief gets the timestamps of a range of main chain blocks
+     *
+     * Recent blocks are served from memory, without reading the db.
+     *
+     * @param start_height the height of the first block
+     * @param count the number of blocks
+     *
+     * @return the timestamps, valid until the blockchain next changes
+     */
+    epee::span<const uint64_t> get_recent_timestamps(uint64_t start_height, size_t count) const;
+
+    /**
+     * @brief gets the cumulative difficulties of a range of main chain blocks
+     *
+     * @copydetails get_recent_timestamps
+     */
+    epee::span<const difficulty_type> get_recent_cumulative_difficulties(uint64_t start_height, size_t count) const;
+
+    /**
+     * @brief gets the weights of a range of main chain blocks
+     *
+     * @copydetails get_recent_timestamps
+     */
+    epee::span<const uint64_t> get_recent_weights(uint64_t start_height, size_t count) const;
+
+    /**
+     * @brief gets the long term weights of a range of main chain blocks
+     *
+     * @copydetails get_recent_timestamps
+     */
+    epee::span<const uint64_t> get_recent_long_term_weights(uint64_t start_height, size_t count) const;
+
+    /**
+     * @brief records the metadata of a block just added to the main chain
+     *
+     * @param timestamp the block's timestamp
+     * @param cumulative_difficulty the block's cumulative difficulty
+     * @param weight the block's weight
+     * @param long_term_weight the block's long term weight
+     */
+    void push_recent_block_metadata(uint64_t timestamp, const difficulty_type &cumulative_difficulty, uint64_t weight, uint64_t long_term_weight);
+
+    /**
+     * @brief forgets the metadata of a block just popped from the main chain
+     */
+    void pop_recent_block_metadata();
+
+    /**
+     * @brief drops all recent block metadata, to be reloaded from the db when next needed
+     */
+    void clear_recent_block_metadata();
+
+    /**
+     * @brief syncs the blockchain for a background sync request
+     *
+     * Runs on the async service, see request_db_sync.
+     *
+     * @return true on success, false if the sync failed or threw
+     */
+    bool db_sync_worker();
+
+    /**
+     * @brief computes the PoW hashes of blocks for prehash_incoming_blocks
+     *
+     * Runs on the thread pool.
+     *
+     * @param height the height of the first block
+     * @param blocks the blocks to hash
+     * @param seed_ids the ids of the blocks' RandomX seed blocks, by height
+     * @param generation the value m_prehashed_blocks.start returned
+     */
+    void prehash_worker(uint64_t height, const std::vector<block> &blocks, const std::map<uint64_t, crypto::hash> &seed_ids, uint64_t generation);
+
     /**
      * @brief checks if a transaction is unlocked (its outputs spendable)
      *
@@ -1497,11 +1696,55 @@ namespace cryptonote
      */
     void invalidate_block_template_cache();
 
+    /**
+     * @brief starts building the next RandomX seed cache in the background
+     *
+     * Once the next seed block is known, the cache (and the mining dataset,
+     * if mining) for the next epoch is built at low priority, so hashing
+     * does not stall when the epoch starts.
+     *
+     * @param height the current blockchain height
+     * @param version the major version of the top block
+     */
+    void prepare_next_rx_seed(uint64_t height, uint8_t version);
+
      /**
      * @brief stores a new cached block template
      *
      * At some point, may be used to push an update to miners
      */
-    void cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie);
+    void cache_block_template(const block &b, const cryptonote::account_public_address &address, const blobdata &nonce, const difficulty_type &diff, uint64_t height, uint64_t expected_reward, uint64_t pool_cookie, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee);
+
+    /**
+     * @brief brings the cached block template up to date, if it can be
+     *
+     * Transactions added to the pool since the template was made are added
+     * to it if they fit, and the miner tx is rebuilt for a different address
+     * or nonce, or whenever the transactions or their fees changed. Any other
+     * change to the chain or pool needs a new template.
+     *
+     * @param address the address of the miner the template is for
+     * @param nonce the extra nonce for the miner tx
+     * @param candidates return-by-reference the transactions which may improve the template
+     *
+     * @return true if the cached template can be used, false if it must be rebuilt
+     */
+    bool update_block_template_cache(const cryptonote::account_public_address &address, const blobdata &nonce, tx_memory_pool::block_template_candidates &candidates);
+
+    /**
+     * @brief builds the miner tx of a block template whose transactions are chosen
+     *
+     * @param b the block template, whose miner tx is replaced
+     * @param height the height of the block
+     * @param median_weight the median block weight
+     * @param already_generated_coins the current total number of coins "minted"
+     * @param txs_weight the total weight of the block's transactions
+     * @param fee the total of fees from the block's transactions
+     * @param miner_address the address the block reward goes to
+     * @param ex_nonce the extra nonce for the miner tx
+     *
+     * @return true on success, false if no miner tx of a consistent weight could be made
+     */
+    bool construct_block_template_miner_tx(block& b, uint64_t height, size_t median_weight, uint64_t already_generated_coins, size_t txs_weight, uint64_t fee, const account_public_address& miner_address, const blobdata& ex_nonce) const;
   };
 }  // namespace cryptonote
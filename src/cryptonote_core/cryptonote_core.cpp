@@ -205,6 +205,11 @@ namespace cryptonote
   , "Keep Alternative Blocks on Restart"
   , false
   };
+  static const command_line::arg_descriptor<bool> arg_no_pow_hash_index = {
+    "no-pow-hash-index"
+  , "Do not keep block PoW hashes in the database (they are then recomputed on reorgs and RPC queries)"
+  , false
+  };
 
   //-----------------------------------------------------------------------------------------------
   core::core(i_cryptonote_protocol* pprotocol):
@@ -321,6 +326,7 @@ namespace cryptonote
     command_line::add_arg(desc, arg_prune_blockchain);
     command_line::add_arg(desc, arg_reorg_notify);
     command_line::add_arg(desc, arg_keep_alt_blocks);
+    command_line::add_arg(desc, arg_no_pow_hash_index);
 
     miner::init_options(desc);
     BlockchainDB::init_options(desc);
@@ -394,12 +400,7 @@ namespace cryptonote
   //-----------------------------------------------------------------------------------------------
   bool core::get_blocks(uint64_t start_offset, size_t count, std::vector<block>& blocks) const
   {
-    std::vector<std::pair<cryptonote::blobdata, cryptonote::block>> bs;
-    if (!m_blockchain_storage.get_blocks(start_offset, count, bs))
-      return false;
-    for (const auto &b: bs)
-      blocks.push_back(b.second);
-    return true;
+    return m_blockchain_storage.get_blocks(start_offset, count, blocks);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::blobdata>& txs, std::vector<crypto::hash>& missed_txs) const
@@ -418,6 +419,19 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
+  void core::get_pool_fee_histogram(fee_rate_histogram &histogram, bool include_unrelayed_txes) const
+  {
+    m_mempool.get_fee_histogram(histogram, include_unrelayed_txes);
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_pool_backlog_fee_estimate(uint64_t base_fee) const
+  {
+    // the penalty free part of a block, as wallets see it
+    const uint64_t block_weight = m_blockchain_storage.get_current_cumulative_block_weight_limit() / 2;
+    const uint64_t fee_unit = m_blockchain_storage.get_current_hard_fork_version() < HF_VERSION_PER_BYTE_FEE ? 1024 : 1;
+    return m_mempool.get_backlog_fee_estimate(base_fee, fee_unit, block_weight);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<transaction>& txs, std::vector<crypto::hash>& missed_txs) const
   {
     return m_blockchain_storage.get_transactions(txs_ids, txs, missed_txs);
@@ -593,6 +607,7 @@ namespace cryptonote
     }
 
     m_blockchain_storage.set_user_options(blocks_threads, sync_on_blocks, sync_threshold, sync_mode, fast_sync);
+    m_blockchain_storage.set_pow_hash_index(!command_line::get_arg(vm, arg_no_pow_hash_index));
 
     try
     {
@@ -722,6 +737,9 @@ namespace cryptonote
     m_miner.stop();
     m_mempool.deinit();
     m_blockchain_storage.deinit();
+    // joins a RandomX seed prep the blockchain may have left running, and
+    // releases the VMs, caches and datasets kept around for reuse
+    crypto::rx_slow_hash_free_state();
     return true;
   }
   //-----------------------------------------------------------------------------------------------
@@ -783,6 +801,7 @@ namespace cryptonote
       tvc.m_verifivation_failed = true;
       return false;
     }
+    tvc.m_tx_hash = tx_hash;
     //std::cout << "!"<< tx.vin.size() << std::endl;
 
     bad_semantics_txes_lock.lock();
@@ -890,6 +909,7 @@ namespace cryptonote
     }
 
     std::vector<const rct::rctSig*> rvv;
+    std::vector<size_t> rvv_idx; // tx_info index of each entry of rvv
     for (size_t n = 0; n < tx_info.size(); ++n)
     {
       if (!check_tx_semantic(*tx_info[n].tx, keeped_by_block))
@@ -951,7 +971,10 @@ namespace cryptonote
             tx_info[n].result = false;
             break;
           }
+          if (keeped_by_block && m_span_semantics_verified.find(tx_info[n].tx_hash) != m_span_semantics_verified.end())
+            break; // already batch verified with the rest of its span
           rvv.push_back(&rv); // delayed batch verification
+          rvv_idx.push_back(n);
           break;
         default:
           MERROR_VER("Unknown rct type: " << rv.type);
@@ -965,13 +988,11 @@ namespace cryptonote
     {
       LOG_PRINT_L1("One transaction among this group has bad semantics, verifying one at a time");
       ret = false;
+      // only txes which were part of the failed batch are suspect, those already
+      // batch verified with their span were skipped and must not be blamed
       const bool assumed_bad = rvv.size() == 1; // if there's only one tx, it must be the bad one
-      for (size_t n = 0; n < tx_info.size(); ++n)
+      for (size_t n: rvv_idx)
       {
-        if (!tx_info[n].result)
-          continue;
-        if (tx_info[n].tx->rct_signatures.type != rct::RCTTypeBulletproof)
-          continue;
         if (assumed_bad || !rct::verRctSemanticsSimple(tx_info[n].tx->rct_signatures))
         {
           set_semantics_failed(tx_info[n].tx_hash);
@@ -1324,11 +1345,14 @@ namespace cryptonote
       cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
       tx_verification_context tvc = AUTO_VAL_INIT(tvc);
       NOTIFY_NEW_TRANSACTIONS::request r;
+      std::vector<crypto::hash> tx_hashes;
+      tx_hashes.reserve(txs.size());
       for (auto it = txs.begin(); it != txs.end(); ++it)
       {
         r.txs.push_back(it->second);
+        tx_hashes.push_back(it->first);
       }
-      get_protocol()->relay_transactions(r, fake_context);
+      get_protocol()->relay_transactions(r, tx_hashes, fake_context);
       m_mempool.set_relayed(txs);
     }
     return true;
@@ -1475,11 +1499,70 @@ namespace cryptonote
     return m_blockchain_storage.add_new_block(b, bvc);
   }
 
+  //-----------------------------------------------------------------------------------------------
+  void core::prevalidate_span_semantics(const std::vector<block_complete_entry> &blocks)
+  {
+    m_span_semantics_verified.clear();
+
+    std::vector<const blobdata*> tx_blobs;
+    const uint64_t height = m_blockchain_storage.get_current_blockchain_height();
+    for (size_t b = 0; b < blocks.size(); ++b)
+    {
+      // txes in the embedded hash area skip the semantics check altogether
+      if (m_blockchain_storage.is_within_compiled_block_hash_area(height + b))
+        continue;
+      for (const auto &tx_blob: blocks[b].txs)
+        tx_blobs.push_back(&tx_blob);
+    }
+    if (tx_blobs.size() < 2)
+      return;
+
+    struct result { bool res; cryptonote::transaction tx; crypto::hash hash; };
+    std::vector<result> results(tx_blobs.size());
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    tools::threadpool::waiter waiter;
+    for (size_t i = 0; i < tx_blobs.size(); ++i)
+    {
+      tpool.submit(&waiter, [&, i] {
+        results[i].res = parse_tx_from_blob(results[i].tx, results[i].hash, *tx_blobs[i]);
+      });
+    }
+    waiter.wait(&tpool);
+
+    std::vector<const rct::rctSig*> rvv;
+    std::vector<const crypto::hash*> hashes;
+    for (const auto &r: results)
+    {
+      if (!r.res || r.tx.version < 2)
+        continue;
+      const rct::rctSig &rv = r.tx.rct_signatures;
+      if (rv.type != rct::RCTTypeBulletproof || !is_canonical_bulletproof_layout(rv.p.bulletproofs))
+        continue;
+      rvv.push_back(&rv);
+      hashes.push_back(&r.hash);
+    }
+    if (rvv.empty())
+      return;
+
+    std::vector<bool> valid;
+    if (!rct::verRctSemanticsSimpleBatch(rvv, valid))
+      LOG_PRINT_L1("Some transactions in the incoming span have bad semantics");
+    for (size_t i = 0; i < rvv.size(); ++i)
+    {
+      if (valid[i])
+        m_span_semantics_verified.insert(*hashes[i]);
+      else
+        set_semantics_failed(*hashes[i]);
+    }
+    MDEBUG("Batch verified semantics of " << rvv.size() << " transactions in " << blocks.size() << " blocks");
+  }
+
   //-----------------------------------------------------------------------------------------------
   bool core::prepare_handle_incoming_blocks(const std::vector<block_complete_entry> &blocks)
   {
     m_incoming_tx_lock.lock();
     m_blockchain_storage.prepare_handle_incoming_blocks(blocks);
+    prevalidate_span_semantics(blocks);
     return true;
   }
 
@@ -1491,10 +1574,17 @@ namespace cryptonote
       success = m_blockchain_storage.cleanup_handle_incoming_blocks(force_sync);
     }
     catch (...) {}
+    m_span_semantics_verified.clear();
     m_incoming_tx_lock.unlock();
     return success;
   }
 
+  //-----------------------------------------------------------------------------------------------
+  bool core::prehash_incoming_blocks(uint64_t height, const std::vector<blobdata> &block_blobs)
+  {
+    return m_blockchain_storage.prehash_incoming_blocks(height, block_blobs);
+  }
+
   //-----------------------------------------------------------------------------------------------
   bool core::handle_incoming_block(const blobdata& block_blob, block_verification_context& bvc, bool update_miner_blocktemplate)
   {
@@ -1599,6 +1689,11 @@ namespace cryptonote
     return m_mempool.get_transaction(id, tx);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_relayable_pool_transaction(const crypto::hash &id, cryptonote::blobdata& tx) const
+  {
+    return m_mempool.get_relayable_transaction(id, tx);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::pool_has_tx(const crypto::hash &id) const
   {
     return m_mempool.have_tx(id);
@@ -1619,7 +1714,7 @@ namespace cryptonote
     return m_blockchain_storage.get_short_chain_history(ids);
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context)
+  bool core::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::shared_request& rsp, cryptonote_connection_context& context)
   {
     return m_blockchain_storage.handle_get_objects(arg, rsp);
   }
@@ -98,7 +98,7 @@ namespace cryptonote
      * @note see Blockchain::handle_get_objects()
      * @param context connection context associated with the request
      */
-     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote_connection_context& context);
+     bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::shared_request& rsp, cryptonote_connection_context& context);
 
      /**
       * @brief calls various idle routines
@@ -171,6 +171,13 @@ namespace cryptonote
       */
      bool cleanup_handle_incoming_blocks(bool force_sync = false);
 
+     /**
+      * @copydoc Blockchain::prehash_incoming_blocks
+      *
+      * @note see Blockchain::prehash_incoming_blocks
+      */
+     bool prehash_incoming_blocks(uint64_t height, const std::vector<blobdata> &block_blobs);
+
      /**
       * @brief check the size of a block against the current maximum
       *
@@ -453,6 +460,23 @@ namespace cryptonote
       */
      bool get_txpool_backlog(std::vector<tx_backlog_entry>& backlog) const;
 
+     /**
+      * @copydoc tx_memory_pool::get_fee_histogram
+      *
+      * @note see tx_memory_pool::get_fee_histogram
+      */
+     void get_pool_fee_histogram(fee_rate_histogram &histogram, bool include_unrelayed_txes = true) const;
+
+     /**
+      * @brief get a fee for a transaction to be mined soon given the pool backlog
+      *
+      * @param base_fee the fee to use if the pool is not backlogged, per kB
+      * before HF_VERSION_PER_BYTE_FEE and per byte from it, as get_dynamic_base_fee_estimate
+      *
+      * @note see tx_memory_pool::get_backlog_fee_estimate
+      */
+     uint64_t get_pool_backlog_fee_estimate(uint64_t base_fee) const;
+
      /**
       * @copydoc tx_memory_pool::get_transactions
       * @param include_unrelayed_txes include unrelayed txes in result
@@ -476,6 +500,13 @@ namespace cryptonote
       */
      bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx) const;
 
+     /**
+      * @copydoc tx_memory_pool::get_relayable_transaction
+      *
+      * @note see tx_memory_pool::get_relayable_transaction
+      */
+     bool get_relayable_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx) const;
+
      /**
       * @copydoc tx_memory_pool::get_pool_transactions_and_spent_keys_info
       * @param include_unrelayed_txes include unrelayed txes in result
@@ -884,6 +915,19 @@ namespace cryptonote
       */
      bool check_tx_syntax(const transaction& tx) const;
 
+     /**
+      * @brief batch verifies the rct semantics of all transactions in a block span
+      *
+      * Range proofs of every bulletproof transaction in the span are checked
+      * together, one aggregate batch per thread, instead of once per block.
+      * Transactions which pass are remembered so the per block semantics check
+      * can skip them, and transactions which fail are marked as having bad
+      * semantics so they get rejected when their block is processed.
+      *
+      * @param blocks the blocks about to be added
+      */
+     void prevalidate_span_semantics(const std::vector<block_complete_entry> &blocks);
+
      /**
       * @brief validates some simple properties of a transaction
       *
@@ -1035,6 +1079,8 @@ namespace cryptonote
      std::unordered_set<crypto::hash> bad_semantics_txes[2];
      boost::mutex bad_semantics_txes_lock;
 
+     std::unordered_set<crypto::hash> m_span_semantics_verified; //!< txes of the current incoming span whose semantics were already batch verified, guarded by m_incoming_tx_lock
+
      enum {
        UPDATES_DISABLED,
        UPDATES_NOTIFY,
@@ -37,6 +37,7 @@
 using namespace epee;
 
 #include "common/apply_permutation.h"
+#include "common/perf_timer.h"
 #include "cryptonote_tx_utils.h"
 #include "cryptonote_config.h"
 #include "blockchain.h"
@@ -668,10 +669,11 @@ namespace cryptonote
   void get_altblock_longhash(const block& b, crypto::hash& res, const uint64_t main_height, const uint64_t height, const uint64_t seed_height, const crypto::hash& seed_hash)
   {
     blobdata bd = get_block_hashing_blob(b);
+    PERF_TIMER(rx_alt_slowhash);
     rx_alt_slowhash(main_height, seed_height, seed_hash.data, bd.data(), bd.size(), res.data);
   }
 
-  bool get_block_longhash(const Blockchain *pbc, const block& b, crypto::hash& res, const uint64_t height, const int miners)
+  static bool get_block_longhash(const Blockchain *pbc, const crypto::hash *seed_id, const block& b, crypto::hash& res, const uint64_t height, const int miners)
   {
     blobdata bd = get_block_hashing_blob(b);
 
@@ -680,13 +682,18 @@ namespace cryptonote
       uint64_t seed_height;
       if(rx_needhash(height, &seed_height))
       {
+        // cache init, and dataset init when mining
+        PERF_TIMER(rx_seedhash);
         crypto::hash hash;
-        if(pbc != NULL)
+        if(seed_id != NULL)
+          hash = *seed_id;
+        else if(pbc != NULL)
           hash = pbc->get_pending_block_id_by_height(seed_height);
         else
           memset(&hash, 0, sizeof(hash)); // Can only happens when generating Genesis Block
         rx_seedhash(seed_height, hash.data, miners);
       }
+      PERF_TIMER(rx_slow_hash);
       rx_slow_hash(bd.data(), bd.size(), res.data, miners);
       return true;
     }
@@ -705,6 +712,11 @@ namespace cryptonote
     return true;
   }
 
+  bool get_block_longhash(const Blockchain *pbc, const block& b, crypto::hash& res, const uint64_t height, const int miners)
+  {
+    return get_block_longhash(pbc, NULL, b, res, height, miners);
+  }
+
   crypto::hash get_block_longhash(const Blockchain *pbc, const block& b, const uint64_t height, const int miners)
   {
     crypto::hash p = crypto::null_hash;
@@ -712,6 +724,13 @@ namespace cryptonote
     return p;
   }
 
+  crypto::hash get_block_longhash(const block& b, const uint64_t height, const crypto::hash& seed_id, const int miners)
+  {
+    crypto::hash p = crypto::null_hash;
+    get_block_longhash(NULL, &seed_id, b, p, height, miners);
+    return p;
+  }
+
   void get_block_longhash_reorg(const uint64_t split_height)
   {
     rx_reorg(split_height);
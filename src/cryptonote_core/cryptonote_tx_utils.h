@@ -107,6 +107,8 @@ namespace cryptonote
   bool get_block_longhash(const Blockchain *pb, const block& b, crypto::hash& res, const uint64_t height, const int miners);
   void get_altblock_longhash(const block& b, crypto::hash& res, const uint64_t main_height, const uint64_t height, const uint64_t seed_height, const crypto::hash& seed_hash);
   crypto::hash get_block_longhash(const Blockchain *pb, const block& b, const uint64_t height, const int miners);
+  // seed_id is the id of the block's RandomX seed block, which is then not looked up
+  crypto::hash get_block_longhash(const block& b, const uint64_t height, const crypto::hash& seed_id, const int miners);
   void get_block_longhash_reorg(const uint64_t split_height);
 
 }
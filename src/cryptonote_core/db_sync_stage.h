@@ -0,0 +1,127 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+namespace cryptonote
+{
+  /**
+   * @brief syncs a database in the background, merging the requests made while a sync runs
+   *
+   * Each request gets a ticket. At most one sync runs at a time, and the
+   * requests made while it runs are served by a single follow-up sync, so
+   * at most one sync runs and one waits. A failed sync fails every pending
+   * request and stops the run; the next request starts a new one, which
+   * retries everything not synced yet.
+   */
+  class db_sync_stage
+  {
+  public:
+    typedef std::function<bool()> sync_t;
+    typedef std::function<void(const std::function<void()>&)> post_t;
+
+    /**
+     * @param sync syncs the database, returns false or throws on failure
+     * @param post runs a function in the background
+     */
+    db_sync_stage(sync_t sync, post_t post): m_sync(std::move(sync)), m_post(std::move(post)), m_requested(0), m_done(0), m_failed(0), m_running(false) {}
+
+    /**
+     * @brief asks for a sync, starting one if none is running
+     *
+     * @return a ticket to pass to wait
+     */
+    uint64_t request()
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      const uint64_t ticket = ++m_requested;
+      if (!m_running)
+      {
+        m_running = true;
+        m_post([this]() { run(); });
+      }
+      return ticket;
+    }
+
+    /**
+     * @brief waits until everything committed before a request is synced
+     *
+     * @param ticket the value returned by request
+     *
+     * @return true if synced, false if the sync covering the request failed
+     */
+    bool wait(uint64_t ticket)
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      while (m_done < ticket && m_failed < ticket)
+        m_cond.wait(lock);
+      return m_done >= ticket;
+    }
+
+  private:
+    void run()
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      while (m_done < m_requested)
+      {
+        // one sync covers every request made before it starts
+        const uint64_t ticket = m_requested;
+        lock.unlock();
+        bool r = false;
+        try { r = m_sync(); }
+        catch (...) {} // a throw fails the run too, or the waiters would hang
+        lock.lock();
+        if (!r)
+        {
+          // the requests made meanwhile were waiting on this run too
+          m_failed = m_requested;
+          break;
+        }
+        m_done = ticket;
+        m_cond.notify_all();
+      }
+      m_running = false;
+      m_cond.notify_all();
+    }
+
+    const sync_t m_sync;
+    const post_t m_post;
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    uint64_t m_requested;
+    uint64_t m_done;
+    uint64_t m_failed; //!< the last ticket pending when a sync failed
+    bool m_running;
+  };
+}
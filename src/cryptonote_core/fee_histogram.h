@@ -0,0 +1,168 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace cryptonote
+{
+  /**
+   * @brief the transactions in the pool, binned by fee per byte
+   *
+   * Bins are logarithmic, with four per power of two of the fee per byte.
+   * The first bin holds everything under one atomic unit per byte, the last
+   * everything above the range. Transactions are added and removed as the
+   * pool changes, so queries cost O(bins) whatever the pool size.
+   */
+  class fee_rate_histogram
+  {
+  public:
+    struct bin
+    {
+      uint64_t txs;
+      uint64_t weight;
+      uint64_t fee;
+    };
+
+    static const size_t BINS_PER_DOUBLING = 4;
+    static const size_t BINS = 1 + 64 * BINS_PER_DOUBLING;
+
+    fee_rate_histogram(): m_bins(BINS, bin{0, 0, 0}), m_txs(0), m_weight(0) {}
+
+    /**
+     * @brief gets the bin for a fee per byte
+     */
+    static size_t bin_index(double fee_per_byte)
+    {
+      if (!(fee_per_byte >= 1.0))
+        return 0;
+      const double index = 1 + std::floor(std::log2(fee_per_byte) * BINS_PER_DOUBLING);
+      return index >= BINS ? BINS - 1 : (size_t)index;
+    }
+
+    /**
+     * @brief gets the lowest fee per byte in a bin
+     */
+    static double bin_lower_bound(size_t index)
+    {
+      return index == 0 ? 0.0 : std::exp2((index - 1) / (double)BINS_PER_DOUBLING);
+    }
+
+    void add(uint64_t fee, uint64_t weight) { update(fee, weight, true); }
+    void remove(uint64_t fee, uint64_t weight) { update(fee, weight, false); }
+
+    void clear()
+    {
+      m_bins.assign(BINS, bin{0, 0, 0});
+      m_txs = 0;
+      m_weight = 0;
+    }
+
+    const std::vector<bin> &bins() const { return m_bins; }
+    uint64_t txs() const { return m_txs; }
+    uint64_t weight() const { return m_weight; }
+
+    /**
+     * @brief gets the weight of the transactions paying at least about a given fee per byte
+     *
+     * The whole bin holding that fee per byte is counted.
+     */
+    uint64_t weight_paying_at_least(double fee_per_byte) const
+    {
+      uint64_t weight = 0;
+      for (size_t i = bin_index(fee_per_byte); i < BINS; ++i)
+        weight += m_bins[i].weight;
+      return weight;
+    }
+
+    /**
+     * @brief gets a fee per byte above which transactions weigh at most a given weight
+     *
+     * @param max_weight the weight, eg a block's worth
+     *
+     * @return the lower bound of the lowest bin such that the transactions
+     * in it and above weigh no more than max_weight, 0 if all do
+     */
+    double fee_per_byte_for_weight(uint64_t max_weight) const
+    {
+      uint64_t weight = 0;
+      for (size_t i = BINS; i-- > 0; )
+      {
+        weight += m_bins[i].weight;
+        if (weight > max_weight)
+          return i + 1 < BINS ? bin_lower_bound(i + 1) : bin_lower_bound(i);
+      }
+      return 0.0;
+    }
+
+    fee_rate_histogram &operator+=(const fee_rate_histogram &other)
+    {
+      for (size_t i = 0; i < BINS; ++i)
+      {
+        m_bins[i].txs += other.m_bins[i].txs;
+        m_bins[i].weight += other.m_bins[i].weight;
+        m_bins[i].fee += other.m_bins[i].fee;
+      }
+      m_txs += other.m_txs;
+      m_weight += other.m_weight;
+      return *this;
+    }
+
+  private:
+    void update(uint64_t fee, uint64_t weight, bool add)
+    {
+      if (weight == 0)
+        return;
+      bin &b = m_bins[bin_index(fee / (double)weight)];
+      if (add)
+      {
+        ++b.txs;
+        b.weight += weight;
+        b.fee += fee;
+        ++m_txs;
+        m_weight += weight;
+      }
+      else
+      {
+        --b.txs;
+        b.weight -= weight;
+        b.fee -= fee;
+        --m_txs;
+        m_weight -= weight;
+      }
+    }
+
+    std::vector<bin> m_bins;
+    uint64_t m_txs;
+    uint64_t m_weight;
+  };
+}
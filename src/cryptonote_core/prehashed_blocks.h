@@ -0,0 +1,149 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief PoW hashes computed by a background job ahead of block verification
+   *
+   * At most one job runs at a time. A job publishes its hashes when it ends,
+   * unless clear was called since it started, so hashes computed for a chain
+   * which was popped in the meantime are never used.
+   */
+  class prehashed_blocks
+  {
+  public:
+    struct entry
+    {
+      crypto::hash id;
+      uint64_t height;
+      crypto::hash pow_hash;
+    };
+
+    /**
+     * @param max_blocks the number of hashes kept, beyond which the unused ones are dropped
+     */
+    explicit prehashed_blocks(size_t max_blocks): m_max_blocks(max_blocks), m_running(false), m_generation(0) {}
+
+    /**
+     * @return true if a job is running
+     */
+    bool running() const
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      return m_running;
+    }
+
+    /**
+     * @brief marks a job as running
+     *
+     * @param generation return-by-reference the value to pass to finish
+     *
+     * @return false if a job is running already
+     */
+    bool start(uint64_t &generation)
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      if (m_running)
+        return false;
+      m_running = true;
+      generation = m_generation;
+      return true;
+    }
+
+    /**
+     * @brief ends the running job, publishing its hashes
+     *
+     * @param generation the value start returned
+     * @param hashes the hashes computed, dropped if the job was cleared or cancelled
+     * @param cancelled true if the job was cut short
+     */
+    void finish(uint64_t generation, const std::vector<entry> &hashes, bool cancelled)
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      if (!cancelled && generation == m_generation)
+      {
+        // only ever a span or two ahead, anything left over was not used
+        if (m_blocks.size() > m_max_blocks)
+          m_blocks.clear();
+        for (const entry &e: hashes)
+          m_blocks[e.id] = std::make_pair(e.height, e.pow_hash);
+      }
+      m_running = false;
+    }
+
+    /**
+     * @brief gets and forgets the hash computed for a block
+     *
+     * @param id the block's hash
+     * @param height the height the block is being added at
+     * @param pow_hash return-by-reference the PoW hash
+     *
+     * @return true if the block was hashed for that height, else false
+     */
+    bool take(const crypto::hash &id, uint64_t height, crypto::hash &pow_hash)
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      const auto it = m_blocks.find(id);
+      if (it == m_blocks.end())
+        return false;
+      const bool r = it->second.first == height;
+      if (r)
+        pow_hash = it->second.second;
+      m_blocks.erase(it);
+      return r;
+    }
+
+    /**
+     * @brief drops all hashes, including those of the running job
+     */
+    void clear()
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      ++m_generation;
+      m_blocks.clear();
+    }
+
+  private:
+    const size_t m_max_blocks;
+    mutable boost::mutex m_mutex;
+    bool m_running;
+    uint64_t m_generation; //!< bumped by clear, so running jobs get discarded
+    std::unordered_map<crypto::hash, std::pair<uint64_t, crypto::hash>> m_blocks; //!< block id -> height, PoW hash
+  };
+}
@@ -46,6 +46,7 @@
 #include "misc_language.h"
 #include "warnings.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "crypto/hash.h"
 
 #undef EVOLUTION_DEFAULT_LOG_CATEGORY
@@ -67,6 +68,11 @@ namespace cryptonote
     time_t const MIN_RELAY_TIME = (60 * 5); // only start re-relaying transactions after that many seconds
     time_t const MAX_RELAY_TIME = (60 * 60 * 4); // at most that many seconds between resends
     float const ACCEPT_THRESHOLD = 1.0f;
+    size_t const MAX_ADDED_TXS = 4096; // at most that many additions are remembered for incremental block templates
+    size_t const MAX_DEFERRED_TXS = 256; // at most that many left out txes are reconsidered when improving a block template
+    size_t const MAX_TEMPLATE_IMPROVEMENT_STEPS = 100000; // bound on block rewards evaluated when improving a block template
+    size_t const MAX_TEMPLATE_DROPPED_TXS = 8; // at most that many txes are swapped out of a block template for another
+    uint64_t const MAX_SNAPSHOT_LAG = 16; // readers wait for a new pool snapshot once the last one is that many changes behind
 
     // a kind of increasing backoff within min/max bounds
     uint64_t get_relay_delay(time_t now, time_t received)
@@ -77,6 +83,20 @@ namespace cryptonote
       return d;
     }
 
+    // the order of BlockchainLMDB::compare_hash32, which the pool txes are listed in
+    bool db_hash_less(const crypto::hash &a, const crypto::hash &b)
+    {
+      uint32_t va[8], vb[8];
+      memcpy(va, a.data, sizeof(va));
+      memcpy(vb, b.data, sizeof(vb));
+      for (int n = 7; n >= 0; n--)
+      {
+        if (va[n] != vb[n])
+          return va[n] < vb[n];
+      }
+      return false;
+    }
+
     uint64_t template_accept_threshold(uint64_t amount)
     {
       return amount * ACCEPT_THRESHOLD;
@@ -90,6 +110,23 @@ namespace cryptonote
         return config::tx_settings::TRANSACTION_SIZE_LIMIT * 4;
     }
 
+    // calls f(i) for each i in [0, n), spread over the thread pool in contiguous chunks
+    void parallel_for(size_t n, const std::function<void(size_t)> &f)
+    {
+      tools::threadpool& tpool = tools::threadpool::getInstance();
+      tools::threadpool::waiter waiter;
+      const size_t chunks = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), n / 64));
+      for (size_t chunk = 0; chunk < chunks; ++chunk)
+      {
+        const size_t begin = n * chunk / chunks, end = n * (chunk + 1) / chunks;
+        tpool.submit(&waiter, [&f, begin, end]() {
+          for (size_t i = begin; i < end; ++i)
+            f(i);
+        });
+      }
+      waiter.wait(&tpool);
+    }
+
     // This class is meant to create a batch when none currently exists.
     // If a batch exists, it can't be from another thread, since we can
     // only be called with the txpool lock taken, and it is held during
@@ -111,7 +148,7 @@ namespace cryptonote
   }
   //---------------------------------------------------------------------------------
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0)
+  tx_memory_pool::tx_memory_pool(Blockchain& bchs): m_blockchain(bchs), m_txpool_max_weight(DEFAULT_TXPOOL_MAX_WEIGHT), m_txpool_weight(0), m_cookie(0), m_added_txs_since(0), m_meta_version(0)
   {
 
   }
@@ -260,6 +297,7 @@ namespace cryptonote
           if (!insert_key_images(tx, id, kept_by_block))
             return false;
           m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+          add_tx_meta(id, meta, tx);
           lock.commit();
         }
         catch (const std::exception &e)
@@ -305,6 +343,7 @@ namespace cryptonote
         if (!insert_key_images(tx, id, kept_by_block))
           return false;
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, std::time_t>(fee / (double)tx_weight, receive_time), id);
+        add_tx_meta(id, meta, tx);
         lock.commit();
       }
       catch (const std::exception &e)
@@ -323,6 +362,16 @@ namespace cryptonote
 
     ++m_cookie;
 
+    if (m_added_txs.size() >= MAX_ADDED_TXS)
+    {
+      m_added_txs.clear();
+      m_added_txs_since = m_cookie;
+    }
+    else
+    {
+      m_added_txs.emplace_back(m_cookie, id);
+    }
+
     MINFO("Transaction added to pool: txid " << id << " weight: " << tx_weight << " fee/byte: " << (fee / (double)tx_weight));
 
     prune(m_txpool_max_weight);
@@ -370,13 +419,14 @@ namespace cryptonote
         break;
       try
       {
-        const crypto::hash &txid = it->second;
-        txpool_tx_meta_t meta;
-        if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+        const crypto::hash txid = it->second;
+        const auto meta_it = m_tx_meta.find(txid);
+        if (meta_it == m_tx_meta.end())
         {
           MERROR("Failed to find tx in txpool");
           return;
         }
+        const txpool_tx_meta_t meta = meta_it->second.meta;
         // don't prune the kept_by_block ones, they're likely added because we're adding a block with those
         if (meta.kept_by_block)
         {
@@ -397,6 +447,7 @@ namespace cryptonote
         remove_transaction_keyimages(tx, txid);
         MINFO("Pruned tx " << txid << " from txpool: weight: " << meta.weight << ", fee/byte: " << it->first.first);
         m_txs_by_fee_and_receive_time.erase(it--);
+        remove_tx_meta(txid);
         changed = true;
       }
       catch (const std::exception &e)
@@ -407,11 +458,177 @@ namespace cryptonote
     }
     lock.commit();
     if(changed)
-      ++m_cookie;
+      note_pool_change();
     if(m_txpool_weight > bytes)
       MINFO("Pool weight after pruning is larger than limit: " << m_txpool_weight << "/" << bytes);
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::note_pool_change()
+  {
+    ++m_cookie;
+    m_added_txs.clear();
+    m_added_txs_since = m_cookie;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_txs_added_since(uint64_t cookie, std::vector<crypto::hash> &txids) const
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    if (cookie < m_added_txs_since)
+      return false;
+    for (const auto &e: m_added_txs)
+    {
+      if (e.first > cookie)
+        txids.push_back(e.second);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::add_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta, const transaction_prefix &tx)
+  {
+    const auto inserted = m_tx_meta.emplace(txid, tx_meta_entry());
+    tx_meta_entry &entry = inserted.first->second;
+    {
+      boost::lock_guard<boost::mutex> lock(m_fee_histogram_lock);
+      if (!inserted.second)
+        m_fee_histograms[entry.meta.do_not_relay ? 1 : 0].remove(entry.meta.fee, entry.meta.weight);
+      m_fee_histograms[meta.do_not_relay ? 1 : 0].add(meta.fee, meta.weight);
+    }
+    entry.meta = meta;
+    entry.key_images.clear();
+    entry.key_images.reserve(tx.vin.size());
+    for (const auto &in: tx.vin)
+    {
+      if (in.type() == typeid(txin_to_key))
+        entry.key_images.push_back(boost::get<txin_to_key>(in).k_image);
+    }
+    ++m_meta_version;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::update_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta)
+  {
+    m_blockchain.update_txpool_tx(txid, meta);
+    const auto it = m_tx_meta.find(txid);
+    if (it != m_tx_meta.end())
+    {
+      if (it->second.meta.do_not_relay != meta.do_not_relay || it->second.meta.fee != meta.fee || it->second.meta.weight != meta.weight)
+      {
+        boost::lock_guard<boost::mutex> lock(m_fee_histogram_lock);
+        m_fee_histograms[it->second.meta.do_not_relay ? 1 : 0].remove(it->second.meta.fee, it->second.meta.weight);
+        m_fee_histograms[meta.do_not_relay ? 1 : 0].add(meta.fee, meta.weight);
+      }
+      it->second.meta = meta;
+    }
+    ++m_meta_version;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::remove_tx_meta(const crypto::hash &txid)
+  {
+    const auto it = m_tx_meta.find(txid);
+    if (it == m_tx_meta.end())
+      return;
+    {
+      boost::lock_guard<boost::mutex> lock(m_fee_histogram_lock);
+      m_fee_histograms[it->second.meta.do_not_relay ? 1 : 0].remove(it->second.meta.fee, it->second.meta.weight);
+    }
+    m_tx_meta.erase(it);
+    ++m_meta_version;
+  }
+  //---------------------------------------------------------------------------------
+  const txpool_tx_meta_t *tx_memory_pool::pool_snapshot::find_tx(const crypto::hash &txid) const
+  {
+    const auto it = std::lower_bound(txes.begin(), txes.end(), txid, [](const std::pair<crypto::hash, txpool_tx_meta_t> &e, const crypto::hash &txid) {
+      return db_hash_less(e.first, txid);
+    });
+    if (it == txes.end() || it->first != txid)
+      return NULL;
+    return &it->second;
+  }
+  //---------------------------------------------------------------------------------
+  std::shared_ptr<const tx_memory_pool::pool_snapshot> tx_memory_pool::get_snapshot() const
+  {
+    std::shared_ptr<const pool_snapshot> snapshot;
+    {
+      boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+      snapshot = m_snapshot;
+    }
+    if (snapshot && snapshot->cookie == m_cookie && snapshot->meta_version == m_meta_version)
+      return snapshot;
+
+    // a change is in progress, make do with the last published state rather
+    // than wait, unless it is too far behind
+    if (!m_transactions_lock.tryLock())
+    {
+      if (snapshot && (m_cookie - snapshot->cookie) + (m_meta_version - snapshot->meta_version) <= MAX_SNAPSHOT_LAG)
+        return snapshot;
+      m_transactions_lock.lock();
+    }
+
+    std::shared_ptr<pool_snapshot> new_snapshot = std::make_shared<pool_snapshot>();
+    {
+      auto unlock = epee::misc_utils::create_scope_leave_handler([this](){ m_transactions_lock.unlock(); });
+      {
+        boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+        snapshot = m_snapshot;
+      }
+      if (snapshot && snapshot->cookie == m_cookie && snapshot->meta_version == m_meta_version)
+        return snapshot;
+
+      new_snapshot->cookie = m_cookie;
+      new_snapshot->meta_version = m_meta_version;
+      new_snapshot->txes.reserve(m_tx_meta.size());
+      for (const auto &e: m_tx_meta)
+        new_snapshot->txes.emplace_back(e.first, e.second.meta);
+      // the key images only change along with the cookie
+      if (snapshot && snapshot->cookie == m_cookie)
+        new_snapshot->spent_key_images = snapshot->spent_key_images;
+      else
+        new_snapshot->spent_key_images = std::make_shared<const key_images_container>(m_spent_key_images);
+    }
+
+    std::sort(new_snapshot->txes.begin(), new_snapshot->txes.end(), [](const std::pair<crypto::hash, txpool_tx_meta_t> &a, const std::pair<crypto::hash, txpool_tx_meta_t> &b) {
+      return db_hash_less(a.first, b.first);
+    });
+
+    // another reader may have published a newer one meanwhile
+    boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+    if (!m_snapshot || (new_snapshot->cookie >= m_snapshot->cookie && new_snapshot->meta_version >= m_snapshot->meta_version))
+      m_snapshot = new_snapshot;
+    return new_snapshot;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::for_all_snapshot_txes(const pool_snapshot &snapshot, const std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> &f, bool include_blob, bool include_unrelayed_txes) const
+  {
+    cryptonote::blobdata bd;
+    for (const auto &e: snapshot.txes)
+    {
+      if (!include_unrelayed_txes && e.second.do_not_relay)
+        continue;
+      if (include_blob)
+      {
+        try
+        {
+          if (!m_blockchain.get_txpool_tx_blob(e.first, bd))
+            continue;
+        }
+        catch (const std::exception &ex)
+        {
+          // gone from the pool since
+          continue;
+        }
+      }
+      if (!f(e.first, e.second, include_blob ? &bd : NULL))
+        return false;
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  size_t tx_memory_pool::count_snapshot_txes(const pool_snapshot &snapshot, bool include_unrelayed_txes)
+  {
+    if (include_unrelayed_txes)
+      return snapshot.txes.size();
+    return std::count_if(snapshot.txes.begin(), snapshot.txes.end(), [](const std::pair<crypto::hash, txpool_tx_meta_t> &e) { return !e.second.do_not_relay; });
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::insert_key_images(const transaction_prefix &tx, const crypto::hash &id, bool kept_by_block)
   {
     for(const auto& in: tx.vin)
@@ -456,7 +673,7 @@ namespace cryptonote
         m_spent_key_images.erase(it);
       }
     }
-    ++m_cookie;
+    note_pool_change();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -472,12 +689,13 @@ namespace cryptonote
     try
     {
       LockedTXN lock(m_blockchain);
-      txpool_tx_meta_t meta;
-      if(!m_blockchain.get_txpool_tx_meta(id, meta))
+      const auto meta_it = m_tx_meta.find(id);
+      if(meta_it == m_tx_meta.end())
       {
         MERROR("Failed to find tx in txpool");
         return false;
       }
+      const txpool_tx_meta_t &meta = meta_it->second.meta;
       cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(id);
       auto ci = m_parsed_tx_cache.find(id);
       if(ci != m_parsed_tx_cache.end())
@@ -512,7 +730,8 @@ namespace cryptonote
     }
 
     m_txs_by_fee_and_receive_time.erase(sorted_it);
-    ++m_cookie;
+    remove_tx_meta(id);
+    note_pool_change();
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -523,6 +742,15 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   sorted_tx_container::iterator tx_memory_pool::find_tx_in_sorted_container(const crypto::hash& id) const
   {
+    const auto meta_it = m_tx_meta.find(id);
+    if (meta_it != m_tx_meta.end())
+    {
+      // same key as when the transaction was added
+      const txpool_tx_meta_t &meta = meta_it->second.meta;
+      const auto sorted_it = m_txs_by_fee_and_receive_time.find(tx_by_fee_and_receive_time_entry(std::pair<double, std::time_t>(meta.fee / (double)meta.weight, meta.receive_time), id));
+      if (sorted_it != m_txs_by_fee_and_receive_time.end())
+        return sorted_it;
+    }
     return std::find_if(m_txs_by_fee_and_receive_time.begin(), m_txs_by_fee_and_receive_time.end(), [&](const sorted_tx_container::value_type& a)
     {
       return a.second == id;
@@ -551,6 +779,7 @@ namespace cryptonote
         {
           m_txs_by_fee_and_receive_time.erase(sorted_it);
         }
+        remove_tx_meta(txid);
         m_timed_out_transactions.insert(txid);
         remove.push_back(std::make_pair(txid, meta.weight));
       }
@@ -587,7 +816,7 @@ namespace cryptonote
         }
       }
       lock.commit();
-      ++m_cookie;
+      note_pool_change();
     }
     return true;
   }
@@ -636,12 +865,13 @@ namespace cryptonote
     {
       try
       {
-        txpool_tx_meta_t meta;
-        if (m_blockchain.get_txpool_tx_meta(it->first, meta))
+        const auto meta_it = m_tx_meta.find(it->first);
+        if (meta_it != m_tx_meta.end())
         {
+          txpool_tx_meta_t meta = meta_it->second.meta;
           meta.relayed = true;
           meta.last_relayed_time = now;
-          m_blockchain.update_txpool_tx(it->first, meta);
+          update_tx_meta(it->first, meta);
         }
       }
       catch (const std::exception &e)
@@ -655,17 +885,14 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   size_t tx_memory_pool::get_transactions_count(bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    return m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+    return count_snapshot_txes(*get_snapshot(), include_unrelayed_txes);
   }
   //---------------------------------------------------------------------------------
   void tx_memory_pool::get_transactions(std::vector<transaction>& txs, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    txs.reserve(count_snapshot_txes(*snapshot, include_unrelayed_txes));
+    for_all_snapshot_txes(*snapshot, [&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       transaction tx;
       if (!parse_and_validate_tx_from_blob(*bd, tx))
       {
@@ -680,10 +907,9 @@ namespace cryptonote
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    txs.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    txs.reserve(count_snapshot_txes(*snapshot, include_unrelayed_txes));
+    for_all_snapshot_txes(*snapshot, [&txs](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       txs.push_back(txid);
       return true;
     }, false, include_unrelayed_txes);
@@ -691,26 +917,44 @@ namespace cryptonote
   //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
     const uint64_t now = time(NULL);
-    backlog.reserve(m_blockchain.get_txpool_tx_count(include_unrelayed_txes));
-    m_blockchain.for_all_txpool_txes([&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    backlog.reserve(count_snapshot_txes(*snapshot, include_unrelayed_txes));
+    for_all_snapshot_txes(*snapshot, [&backlog, now](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       backlog.push_back({meta.weight, meta.fee, meta.receive_time - now});
       return true;
     }, false, include_unrelayed_txes);
   }
   //------------------------------------------------------------------
+  void tx_memory_pool::get_fee_histogram(fee_rate_histogram &histogram, bool include_unrelayed_txes) const
+  {
+    boost::lock_guard<boost::mutex> lock(m_fee_histogram_lock);
+    histogram = m_fee_histograms[0];
+    if (include_unrelayed_txes)
+      histogram += m_fee_histograms[1];
+  }
+  //------------------------------------------------------------------
+  uint64_t tx_memory_pool::get_backlog_fee_estimate(uint64_t base_fee, uint64_t fee_unit, uint64_t block_weight) const
+  {
+    // what others will see when choosing which transactions to mine
+    fee_rate_histogram histogram;
+    get_fee_histogram(histogram, false);
+    // the histogram is per byte
+    if (histogram.weight_paying_at_least(base_fee / (double)fee_unit) <= block_weight)
+      return base_fee;
+    const double fee = std::ceil(histogram.fee_per_byte_for_weight(block_weight) * fee_unit);
+    return std::max<uint64_t>(base_fee, fee);
+  }
+  //------------------------------------------------------------------
   void tx_memory_pool::get_transaction_stats(struct txpool_stats& stats, bool include_unrelayed_txes) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
     const uint64_t now = time(NULL);
     std::map<uint64_t, txpool_histo> agebytes;
-    stats.txs_total = m_blockchain.get_txpool_tx_count(include_unrelayed_txes);
+    stats.txs_total = count_snapshot_txes(*snapshot, include_unrelayed_txes);
     std::vector<uint32_t> weights;
     weights.reserve(stats.txs_total);
-    m_blockchain.for_all_txpool_txes([&stats, &weights, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    for_all_snapshot_txes(*snapshot, [&stats, &weights, now, &agebytes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       weights.push_back(meta.weight);
       stats.bytes_total += meta.weight;
       if (!stats.bytes_min || meta.weight < stats.bytes_min)
@@ -781,11 +1025,10 @@ namespace cryptonote
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::get_transactions_and_spent_keys_info(std::vector<tx_info>& tx_infos, std::vector<spent_key_image_info>& key_image_infos, bool include_sensitive_data) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    tx_infos.reserve(m_blockchain.get_txpool_tx_count());
-    key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    tx_infos.reserve(count_snapshot_txes(*snapshot, false));
+    key_image_infos.reserve(count_snapshot_txes(*snapshot, false));
+    for_all_snapshot_txes(*snapshot, [&tx_infos, key_image_infos, include_sensitive_data](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       tx_info txi;
       txi.id_hash = epee::string_tools::pod_to_hex(txid);
       txi.tx_blob = *bd;
@@ -817,8 +1060,7 @@ namespace cryptonote
       return true;
     }, true, include_sensitive_data);
 
-    txpool_tx_meta_t meta;
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
+    for (const key_images_container::value_type& kee : *snapshot->spent_key_images) {
       const crypto::key_image& k_image = kee.first;
       const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
       spent_key_image_info ki;
@@ -827,22 +1069,15 @@ namespace cryptonote
       {
         if (!include_sensitive_data)
         {
-          try
+          const txpool_tx_meta_t *meta = snapshot->find_tx(tx_id_hash);
+          if (!meta)
           {
-            if (!m_blockchain.get_txpool_tx_meta(tx_id_hash, meta))
-            {
-              MERROR("Failed to get tx meta from txpool");
-              return false;
-            }
-            if (!meta.relayed)
-              // Do not include that transaction if in restricted mode and it's not relayed
-              continue;
-          }
-          catch (const std::exception &e)
-          {
-            MERROR("Failed to get tx meta from txpool: " << e.what());
+            MERROR("Failed to get tx meta from txpool");
             return false;
           }
+          if (!meta->relayed)
+            // Do not include that transaction if in restricted mode and it's not relayed
+            continue;
         }
         ki.txs_hashes.push_back(epee::string_tools::pod_to_hex(tx_id_hash));
       }
@@ -855,11 +1090,10 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_pool_for_rpc(std::vector<cryptonote::rpc::tx_in_pool>& tx_infos, cryptonote::rpc::key_images_with_tx_hashes& key_image_infos) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
-    tx_infos.reserve(m_blockchain.get_txpool_tx_count());
-    key_image_infos.reserve(m_blockchain.get_txpool_tx_count());
-    m_blockchain.for_all_txpool_txes([&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
+    tx_infos.reserve(count_snapshot_txes(*snapshot, false));
+    key_image_infos.reserve(count_snapshot_txes(*snapshot, false));
+    for_all_snapshot_txes(*snapshot, [&tx_infos, key_image_infos](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd){
       cryptonote::rpc::tx_in_pool txi;
       txi.tx_hash = txid;
       if (!parse_and_validate_tx_from_blob(*bd, txi.tx))
@@ -886,7 +1120,7 @@ namespace cryptonote
       return true;
     }, true, false);
 
-    for (const key_images_container::value_type& kee : m_spent_key_images) {
+    for (const key_images_container::value_type& kee : *snapshot->spent_key_images) {
       std::vector<crypto::hash> tx_hashes;
       const std::unordered_set<crypto::hash>& kei_image_set = kee.second;
       for (const crypto::hash& tx_id_hash : kei_image_set)
@@ -902,14 +1136,13 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::check_for_key_images(const std::vector<crypto::key_image>& key_images, std::vector<bool> spent) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    const std::shared_ptr<const pool_snapshot> snapshot = get_snapshot();
 
     spent.clear();
 
     for (const auto& image : key_images)
     {
-      spent.push_back(m_spent_key_images.find(image) == m_spent_key_images.end() ? false : true);
+      spent.push_back(snapshot->spent_key_images->find(image) == snapshot->spent_key_images->end() ? false : true);
     }
 
     return true;
@@ -917,8 +1150,7 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::get_transaction(const crypto::hash& id, cryptonote::blobdata& txblob) const
   {
-    CRITICAL_REGION_LOCAL(m_transactions_lock);
-    CRITICAL_REGION_LOCAL1(m_blockchain);
+    // a read from the db, which does not need to wait for pool changes
     try
     {
       return m_blockchain.get_txpool_tx_blob(id, txblob);
@@ -929,6 +1161,18 @@ namespace cryptonote
     }
   }
   //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_relayable_transaction(const crypto::hash& id, cryptonote::blobdata& txblob) const
+  {
+    {
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      const auto it = m_tx_meta.find(id);
+      // 0 fee transactions are never relayed
+      if (it == m_tx_meta.end() || it->second.meta.do_not_relay || it->second.meta.fee == 0)
+        return false;
+    }
+    return get_transaction(id, txblob);
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
@@ -940,6 +1184,8 @@ namespace cryptonote
   bool tx_memory_pool::on_blockchain_dec(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
+    // signature checks are kept across the reorg in the blockchain's verified
+    // tx cache, so re-checking these inputs will only redo the cheap parts
     m_input_cache.clear();
     m_parsed_tx_cache.clear();
     return true;
@@ -1000,27 +1246,27 @@ namespace cryptonote
     return ret;
   }
   //---------------------------------------------------------------------------------
-  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction &tx) const
+  bool tx_memory_pool::is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const std::vector<crypto::key_image> &key_images) const
   {
     struct transction_parser
     {
-      transction_parser(const cryptonote::blobdata &txblob, const crypto::hash &txid, transaction &tx): txblob(txblob), txid(txid), tx(tx), parsed(false) {}
+      transction_parser(const Blockchain &blockchain, const crypto::hash &txid): blockchain(blockchain), txid(txid), parsed(false) {}
       cryptonote::transaction &operator()()
       {
         if (!parsed)
         {
-          if (!parse_and_validate_tx_from_blob(txblob, tx))
+          if (!parse_and_validate_tx_from_blob(blockchain.get_txpool_tx_blob(txid), tx))
             throw std::runtime_error("failed to parse transaction blob");
           tx.set_hash(txid);
           parsed = true;
         }
         return tx;
       }
-      const cryptonote::blobdata &txblob;
+      const Blockchain &blockchain;
       const crypto::hash &txid;
-      transaction &tx;
+      transaction tx;
       bool parsed;
-    } lazy_tx(txblob, txid, tx);
+    } lazy_tx(m_blockchain, txid);
 
     //not the best implementation at this time, sorry :(
     //check is ring_signature already checked ?
@@ -1057,10 +1303,13 @@ namespace cryptonote
       }
     }
     //if we here, transaction seems valid, but, anyway, check for key_images collisions with blockchain, just to be sure
-    if(m_blockchain.have_tx_keyimges_as_spent(lazy_tx()))
+    for (const crypto::key_image &key_image: key_images)
     {
-      txd.double_spend_seen = true;
-      return false;
+      if(m_blockchain.have_tx_keyimg_as_spent(key_image))
+      {
+        txd.double_spend_seen = true;
+        return false;
+      }
     }
 
     //transaction is ok.
@@ -1103,13 +1352,14 @@ namespace cryptonote
       {
         for (const crypto::hash &txid: it->second)
         {
-          txpool_tx_meta_t meta;
-          if (!m_blockchain.get_txpool_tx_meta(txid, meta))
+          const auto meta_it = m_tx_meta.find(txid);
+          if (meta_it == m_tx_meta.end())
           {
             MERROR("Failed to find tx meta in txpool");
             // continue, not fatal
             continue;
           }
+          txpool_tx_meta_t meta = meta_it->second.meta;
           if (!meta.double_spend_seen)
           {
             MDEBUG("Marking " << txid << " as double spending " << itk.k_image);
@@ -1117,7 +1367,7 @@ namespace cryptonote
             changed = true;
             try
             {
-              m_blockchain.update_txpool_tx(txid, meta);
+              update_tx_meta(txid, meta);
             }
             catch (const std::exception &e)
             {
@@ -1130,7 +1380,7 @@ namespace cryptonote
     }
     lock.commit();
     if(changed)
-      ++m_cookie;
+      note_pool_change();
   }
   //---------------------------------------------------------------------------------
   std::string tx_memory_pool::print_pool(bool short_format) const
@@ -1166,127 +1416,314 @@ namespace cryptonote
   //---------------------------------------------------------------------------------
   //TODO: investigate whether boolean return is appropriate
   bool tx_memory_pool::fill_block_template(block &bl, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version)
+  {
+    block_template_state state;
+    block_template_candidates candidates;
+    {
+      CRITICAL_REGION_LOCAL(m_transactions_lock);
+      CRITICAL_REGION_LOCAL1(m_blockchain);
+
+      init_block_template_state(state, median_weight, already_generated_coins, version);
+
+      //baseline empty block
+      get_block_reward(median_weight, 0, already_generated_coins, state.best_coinbase, version);
+
+      LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
+
+      LockedTXN lock(m_blockchain);
+
+      for (const auto &entry: m_txs_by_fee_and_receive_time)
+      {
+        if (!add_tx_to_block_template(bl, entry.second, state))
+          break;
+      }
+      get_block_template_candidates(bl, state, candidates);
+      lock.commit();
+    }
+
+    total_weight = state.total_weight;
+    fee = state.fee;
+    expected_reward = state.best_coinbase;
+    // the search only needs the snapshot taken above, so the pool is not held meanwhile
+    improve_block_template(bl, candidates, total_weight, fee, expected_reward);
+    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
+        << total_weight << "/" << state.max_total_weight << ", coinbase " << print_money(expected_reward)
+        << " (including " << print_money(fee) << " in fees)");
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_to_block_template(block &bl, const std::vector<crypto::hash> &txids, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version, block_template_candidates &candidates)
   {
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     CRITICAL_REGION_LOCAL1(m_blockchain);
 
-    uint64_t best_coinbase = 0, coinbase = 0;
-    total_weight = 0;
-    fee = 0;
-
-    //baseline empty block
-    get_block_reward(median_weight, total_weight, already_generated_coins, best_coinbase, version);
+    block_template_state state;
+    init_block_template_state(state, median_weight, already_generated_coins, version);
+    state.total_weight = total_weight;
+    state.fee = fee;
+    state.best_coinbase = expected_reward;
 
+    const std::unordered_set<crypto::hash> included(bl.tx_hashes.begin(), bl.tx_hashes.end());
+    for (const crypto::hash &txid: bl.tx_hashes)
+    {
+      const auto meta_it = m_tx_meta.find(txid);
+      if (meta_it == m_tx_meta.end())
+      {
+        MDEBUG("Block template transaction " << txid << " is not in the pool anymore");
+        return false;
+      }
+      state.k_images.insert(meta_it->second.key_images.begin(), meta_it->second.key_images.end());
+    }
 
-    size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
-    size_t max_total_weight = version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
-    std::unordered_set<crypto::key_image> k_images;
+    // consider the new transactions in the same order as fill_block_template would
+    sorted_tx_container sorted_candidates;
+    for (const crypto::hash &txid: txids)
+    {
+      const auto meta_it = m_tx_meta.find(txid);
+      if (meta_it == m_tx_meta.end() || included.find(txid) != included.end())
+        continue;
+      const txpool_tx_meta_t &meta = meta_it->second.meta;
+      sorted_candidates.emplace(std::pair<double, std::time_t>(meta.fee / (double)meta.weight, meta.receive_time), txid);
+    }
 
-    LOG_PRINT_L2("Filling block template, median weight " << median_weight << ", " << m_txs_by_fee_and_receive_time.size() << " txes in the pool");
+    LOG_PRINT_L2("Adding up to " << sorted_candidates.size() << " txes to block template with " << bl.tx_hashes.size() << " txes");
 
     LockedTXN lock(m_blockchain);
 
-    auto sorted_it = m_txs_by_fee_and_receive_time.begin();
-    for (; sorted_it != m_txs_by_fee_and_receive_time.end(); ++sorted_it)
+    for (const auto &entry: sorted_candidates)
+    {
+      if (!add_tx_to_block_template(bl, entry.second, state))
+        break;
+    }
+
+    // a denser tx which does not fit would have been considered before the
+    // sparser ones fill_block_template took, a swap may not find room for it
+    if (state.max_deferred_fee_per_byte > 0)
     {
-      txpool_tx_meta_t meta;
-      if (!m_blockchain.get_txpool_tx_meta(sorted_it->second, meta))
+      for (const crypto::hash &txid: bl.tx_hashes)
       {
-        MERROR("  failed to find tx meta");
-        continue;
+        const txpool_tx_meta_t &meta = m_tx_meta.find(txid)->second.meta;
+        if (meta.fee / (double)meta.weight < state.max_deferred_fee_per_byte)
+        {
+          LOG_PRINT_L2("A tx left out of the block template pays more per byte than " << txid << ", refilling it");
+          lock.commit(); // keeps the readiness updates
+          return false;
+        }
       }
-      LOG_PRINT_L2("Considering " << sorted_it->second << ", weight " << meta.weight << ", current block weight " << total_weight << "/" << max_total_weight << ", current coinbase " << print_money(best_coinbase));
+    }
 
-      // Can not exceed maximum block weight
-      if (max_total_weight < total_weight + meta.weight)
+    get_block_template_candidates(bl, state, candidates);
+    lock.commit();
+
+    total_weight = state.total_weight;
+    fee = state.fee;
+    expected_reward = state.best_coinbase;
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::init_block_template_state(block_template_state &state, size_t median_weight, uint64_t already_generated_coins, uint8_t version) const
+  {
+    size_t max_total_weight_pre_v5 = (130 * median_weight) / 100 - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+    size_t max_total_weight_v5 = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+    state.median_weight = median_weight;
+    state.already_generated_coins = already_generated_coins;
+    state.version = version;
+    state.max_total_weight = version >= 5 ? max_total_weight_v5 : max_total_weight_pre_v5;
+    state.total_weight = 0;
+    state.fee = 0;
+    state.best_coinbase = 0;
+    state.k_images.clear();
+    state.max_deferred = version >= 5 ? MAX_DEFERRED_TXS : 0;
+    state.deferred.clear();
+    state.max_deferred_fee_per_byte = 0;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::add_tx_to_block_template(block &bl, const crypto::hash &txid, block_template_state &state)
+  {
+    const auto meta_it = m_tx_meta.find(txid);
+    if (meta_it == m_tx_meta.end())
+    {
+      MERROR("  failed to find tx meta");
+      return true;
+    }
+    txpool_tx_meta_t meta = meta_it->second.meta;
+    const std::vector<crypto::key_image> &key_images = meta_it->second.key_images;
+    LOG_PRINT_L2("Considering " << txid << ", weight " << meta.weight << ", current block weight " << state.total_weight << "/" << state.max_total_weight << ", current coinbase " << print_money(state.best_coinbase));
+
+    // Can not exceed maximum block weight
+    if (state.max_total_weight < state.total_weight + meta.weight)
+    {
+      LOG_PRINT_L2("  would exceed maximum block weight");
+      state.defer(txid, meta.fee / (double)meta.weight);
+      return true;
+    }
+
+    uint64_t coinbase = 0;
+    // start using the optimal filling algorithm from v5
+    if (state.version >= 5)
+    {
+      // If we're getting lower coinbase tx,
+      // stop including more tx
+      uint64_t block_reward;
+      if(!get_block_reward(state.median_weight, state.total_weight + meta.weight, state.already_generated_coins, block_reward, state.version))
       {
         LOG_PRINT_L2("  would exceed maximum block weight");
-        continue;
+        return true;
       }
-
-      // start using the optimal filling algorithm from v5
-      if (version >= 5)
+      coinbase = block_reward + state.fee + meta.fee;
+      if (coinbase < template_accept_threshold(state.best_coinbase))
       {
-        // If we're getting lower coinbase tx,
-        // stop including more tx
-        uint64_t block_reward;
-        if(!get_block_reward(median_weight, total_weight + meta.weight, already_generated_coins, block_reward, version))
-        {
-          LOG_PRINT_L2("  would exceed maximum block weight");
-          continue;
-        }
-        coinbase = block_reward + fee + meta.fee;
-        if (coinbase < template_accept_threshold(best_coinbase))
-        {
-          LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
-          continue;
-        }
+        LOG_PRINT_L2("  would decrease coinbase to " << print_money(coinbase));
+        state.defer(txid, meta.fee / (double)meta.weight);
+        return true;
       }
-      else
+    }
+    else
+    {
+      // If we've exceeded the penalty free weight,
+      // stop including more tx
+      if (state.total_weight > state.median_weight)
       {
-        // If we've exceeded the penalty free weight,
-        // stop including more tx
-        if (total_weight > median_weight)
-        {
-          LOG_PRINT_L2("  would exceed median block weight");
-          break;
-        }
+        LOG_PRINT_L2("  would exceed median block weight");
+        return false;
       }
+    }
 
-      cryptonote::blobdata txblob = m_blockchain.get_txpool_tx_blob(sorted_it->second);
-      cryptonote::transaction tx;
+    // Skip transactions that are not ready to be
+    // included into the blockchain or that are
+    // missing key images
+    if (!check_tx_ready_for_block_template(txid, meta_it->second))
+    {
+      LOG_PRINT_L2("  not ready to go");
+      return true;
+    }
+    if (std::any_of(key_images.begin(), key_images.end(), [&state](const crypto::key_image &key_image) { return state.k_images.count(key_image) != 0; }))
+    {
+      LOG_PRINT_L2("  key images already seen");
+      return true;
+    }
 
-      // Skip transactions that are not ready to be
-      // included into the blockchain or that are
-      // missing key images
-      const cryptonote::txpool_tx_meta_t original_meta = meta;
-      bool ready = false;
+    bl.tx_hashes.push_back(txid);
+    state.total_weight += meta.weight;
+    state.fee += meta.fee;
+    state.best_coinbase = coinbase;
+    state.k_images.insert(key_images.begin(), key_images.end());
+    LOG_PRINT_L2("  added, new block weight " << state.total_weight << "/" << state.max_total_weight << ", coinbase " << print_money(state.best_coinbase));
+    return true;
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::check_tx_ready_for_block_template(const crypto::hash &txid, tx_meta_entry &entry)
+  {
+    txpool_tx_meta_t meta = entry.meta;
+    bool ready = false;
+    try
+    {
+      ready = is_transaction_ready_to_go(meta, txid, entry.key_images);
+    }
+    catch (const std::exception &e)
+    {
+      MERROR("Failed to check transaction readiness: " << e.what());
+      // continue, not fatal
+    }
+    if (memcmp(&entry.meta, &meta, sizeof(meta)))
+    {
       try
       {
-        ready = is_transaction_ready_to_go(meta, sorted_it->second, txblob, tx);
+        update_tx_meta(txid, meta);
       }
       catch (const std::exception &e)
       {
-        MERROR("Failed to check transaction readiness: " << e.what());
+        MERROR("Failed to update tx meta: " << e.what());
         // continue, not fatal
       }
-      if (memcmp(&original_meta, &meta, sizeof(meta)))
+    }
+    return ready;
+  }
+  //---------------------------------------------------------------------------------
+  void tx_memory_pool::get_block_template_candidates(const block &bl, const block_template_state &state, block_template_candidates &candidates)
+  {
+    candidates.median_weight = state.median_weight;
+    candidates.already_generated_coins = state.already_generated_coins;
+    candidates.version = state.version;
+    candidates.max_total_weight = state.max_total_weight;
+    candidates.items.clear();
+    candidates.txids.clear();
+    if (state.version < 5 || state.deferred.empty())
+      return;
+
+    candidates.items.reserve(bl.tx_hashes.size() + state.deferred.size());
+    candidates.txids.reserve(bl.tx_hashes.size() + state.deferred.size());
+    for (const crypto::hash &txid: bl.tx_hashes)
+    {
+      const auto meta_it = m_tx_meta.find(txid);
+      if (meta_it == m_tx_meta.end())
       {
-        try
-        {
-          m_blockchain.update_txpool_tx(sorted_it->second, meta);
-        }
-        catch (const std::exception &e)
-        {
-          MERROR("Failed to update tx meta: " << e.what());
-          // continue, not fatal
-        }
+        candidates.items.clear();
+        candidates.txids.clear();
+        return;
       }
-      if (!ready)
-      {
-        LOG_PRINT_L2("  not ready to go");
+      candidates.items.push_back({meta_it->second.meta.weight, meta_it->second.meta.fee, true});
+      candidates.txids.push_back(txid);
+    }
+
+    // the candidates must not conflict with the block nor with each other
+    std::unordered_set<crypto::key_image> candidate_k_images;
+    for (const crypto::hash &txid: state.deferred)
+    {
+      const auto meta_it = m_tx_meta.find(txid);
+      if (meta_it == m_tx_meta.end())
         continue;
-      }
-      if (have_key_images(k_images, tx))
-      {
-        LOG_PRINT_L2("  key images already seen");
+      const std::vector<crypto::key_image> &key_images = meta_it->second.key_images;
+      if (std::any_of(key_images.begin(), key_images.end(), [&](const crypto::key_image &key_image) {
+          return state.k_images.count(key_image) != 0 || candidate_k_images.count(key_image) != 0; }))
         continue;
-      }
-
-      bl.tx_hashes.push_back(sorted_it->second);
-      total_weight += meta.weight;
-      fee += meta.fee;
-      best_coinbase = coinbase;
-      append_key_images(k_images, tx);
-      LOG_PRINT_L2("  added, new block weight " << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase));
+      if (!check_tx_ready_for_block_template(txid, meta_it->second))
+        continue;
+      candidate_k_images.insert(key_images.begin(), key_images.end());
+      candidates.items.push_back({meta_it->second.meta.weight, meta_it->second.meta.fee, false});
+      candidates.txids.push_back(txid);
     }
-    lock.commit();
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::improve_block_template(block &bl, block_template_candidates &candidates, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward)
+  {
+    std::vector<tx_selection_item> &items = candidates.items;
+    if (items.size() <= bl.tx_hashes.size())
+      return false;
+    CHECK_AND_ASSERT_MES(items.size() == candidates.txids.size(), false, "Mismatched block template candidates");
+
+    const size_t median_weight = candidates.median_weight;
+    const uint64_t already_generated_coins = candidates.already_generated_coins;
+    const uint8_t version = candidates.version;
+    const size_t moves = improve_tx_selection(items, candidates.max_total_weight, [median_weight, already_generated_coins, version](uint64_t total_weight, uint64_t &reward) {
+      return get_block_reward(median_weight, total_weight, already_generated_coins, reward, version);
+    }, MAX_TEMPLATE_IMPROVEMENT_STEPS, MAX_TEMPLATE_DROPPED_TXS);
+    if (moves == 0)
+      return false;
 
-    expected_reward = best_coinbase;
-    LOG_PRINT_L2("Block template filled with " << bl.tx_hashes.size() << " txes, weight "
-        << total_weight << "/" << max_total_weight << ", coinbase " << print_money(best_coinbase)
-        << " (including " << print_money(fee) << " in fees)");
+    // keep the block's transactions in their order, then the added ones
+    std::vector<crypto::hash> tx_hashes;
+    uint64_t new_total_weight = 0, new_fee = 0;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+      if (items[i].selected)
+      {
+        tx_hashes.push_back(candidates.txids[i]);
+        new_total_weight += items[i].weight;
+        new_fee += items[i].fee;
+      }
+    }
+    uint64_t block_reward;
+    if (!get_block_reward(median_weight, new_total_weight, already_generated_coins, block_reward, version))
+    {
+      MERROR("Improved block template is too heavy, keeping the original one");
+      return false;
+    }
+    LOG_PRINT_L2("Block template improved with " << moves << " moves, coinbase " << print_money(expected_reward) << " -> " << print_money(block_reward + new_fee));
+    bl.tx_hashes = std::move(tx_hashes);
+    total_weight = new_total_weight;
+    fee = new_fee;
+    expected_reward = block_reward + new_fee;
     return true;
   }
   //---------------------------------------------------------------------------------
@@ -1298,18 +1735,32 @@ namespace cryptonote
     std::unordered_set<crypto::hash> remove;
 
     m_txpool_weight = 0;
-    m_blockchain.for_all_txpool_txes([this, &remove, tx_weight_limit](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+    std::vector<crypto::hash> txids;
+    txids.reserve(m_tx_meta.size());
+    for (const auto &e: m_tx_meta)
+    {
+      const txpool_tx_meta_t &meta = e.second.meta;
       m_txpool_weight += meta.weight;
       if (meta.weight > tx_weight_limit) {
-        LOG_PRINT_L1("Transaction " << txid << " is too big (" << meta.weight << " bytes), removing it from pool");
-        remove.insert(txid);
+        LOG_PRINT_L1("Transaction " << e.first << " is too big (" << meta.weight << " bytes), removing it from pool");
+        remove.insert(e.first);
       }
-      else if (m_blockchain.have_tx(txid)) {
-        LOG_PRINT_L1("Transaction " << txid << " is in the blockchain, removing it from pool");
-        remove.insert(txid);
+      else
+        txids.push_back(e.first);
+    }
+
+    // the chain lookups are independent, and the db can be read from several threads
+    std::unique_ptr<bool[]> in_chain(new bool[txids.size()]);
+    parallel_for(txids.size(), [this, &txids, &in_chain](size_t i) {
+      in_chain[i] = m_blockchain.have_tx(txids[i]);
+    });
+    for (size_t i = 0; i < txids.size(); ++i)
+    {
+      if (in_chain[i]) {
+        LOG_PRINT_L1("Transaction " << txids[i] << " is in the blockchain, removing it from pool");
+        remove.insert(txids[i]);
       }
-      return true;
-    }, false);
+    }
 
     size_t n_removed = 0;
     if (!remove.empty())
@@ -1339,6 +1790,7 @@ namespace cryptonote
           {
             m_txs_by_fee_and_receive_time.erase(sorted_it);
           }
+          remove_tx_meta(txid);
           ++n_removed;
         }
         catch (const std::exception &e)
@@ -1350,7 +1802,7 @@ namespace cryptonote
       lock.commit();
     }
     if(n_removed > 0)
-      ++m_cookie;
+      note_pool_change();
     return n_removed;
   }
   //---------------------------------------------------------------------------------
@@ -1361,36 +1813,63 @@ namespace cryptonote
 
     m_txpool_max_weight = max_txpool_weight ? max_txpool_weight : DEFAULT_TXPOOL_MAX_WEIGHT;
     m_txs_by_fee_and_receive_time.clear();
+    m_tx_meta.clear();
+    {
+      boost::lock_guard<boost::mutex> lock(m_fee_histogram_lock);
+      m_fee_histograms[0].clear();
+      m_fee_histograms[1].clear();
+    }
     m_spent_key_images.clear();
     m_txpool_weight = 0;
     std::vector<crypto::hash> remove;
 
+    std::vector<std::pair<crypto::hash, txpool_tx_meta_t>> txes;
+    m_blockchain.for_all_txpool_txes([&txes](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata*) {
+      txes.emplace_back(txid, meta);
+      return true;
+    }, false);
+
+    // reading and parsing the blobs is the bulk of the work, and is independent for each tx
+    std::vector<cryptonote::transaction_prefix> prefixes(txes.size());
+    std::unique_ptr<bool[]> parsed(new bool[txes.size()]);
+    parallel_for(txes.size(), [this, &txes, &prefixes, &parsed](size_t i) {
+      cryptonote::blobdata bd;
+      try
+      {
+        parsed[i] = m_blockchain.get_txpool_tx_blob(txes[i].first, bd) && parse_and_validate_tx_prefix_from_blob(bd, prefixes[i]);
+      }
+      catch (const std::exception &e)
+      {
+        parsed[i] = false;
+      }
+    });
+
     // first add the not kept by block, then the kept by block,
     // to avoid rejection due to key image collision
     for(int pass = 0; pass < 2; ++pass)
     {
       const bool kept = pass == 1;
-      bool r = m_blockchain.for_all_txpool_txes([this, &remove, kept](const crypto::hash &txid, const txpool_tx_meta_t &meta, const cryptonote::blobdata *bd) {
+      for(size_t i = 0; i < txes.size(); ++i)
+      {
+        const crypto::hash &txid = txes[i].first;
+        const txpool_tx_meta_t &meta = txes[i].second;
         if(!!kept != !!meta.kept_by_block)
-          return true;
-        cryptonote::transaction_prefix tx;
-        if(!parse_and_validate_tx_prefix_from_blob(*bd, tx))
+          continue;
+        if(!parsed[i])
         {
           MWARNING("Failed to parse tx from txpool, removing");
           remove.push_back(txid);
-          return true;
+          continue;
         }
-        if(!insert_key_images(tx, txid, meta.kept_by_block))
+        if(!insert_key_images(prefixes[i], txid, meta.kept_by_block))
         {
           MFATAL("Failed to insert key images from txpool tx");
           return false;
         }
         m_txs_by_fee_and_receive_time.emplace(std::pair<double, time_t>(meta.fee / (double)meta.weight, meta.receive_time), txid);
+        add_tx_meta(txid, meta, prefixes[i]);
         m_txpool_weight += meta.weight;
-        return true;
-      }, true);
-      if(!r)
-        return false;
+      }
     }
     if(!remove.empty())
     {
@@ -1411,6 +1890,12 @@ namespace cryptonote
     }
 
     m_cookie = 0;
+    m_added_txs.clear();
+    m_added_txs_since = 0;
+    {
+      boost::lock_guard<boost::mutex> lock(m_snapshot_lock);
+      m_snapshot.reset();
+    }
 
     // Ignore deserialization error
     return true;
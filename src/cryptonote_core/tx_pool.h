@@ -33,11 +33,13 @@
 #pragma once
 #include "include_base_utils.h"
 
+#include <memory>
 #include <set>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
 #include <boost/serialization/version.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/utility.hpp>
 
 #include "string_tools.h"
@@ -47,6 +49,8 @@
 #include "cryptonote_basic/verification_context.h"
 #include "blockchain_db/blockchain_db.h"
 #include "crypto/hash.h"
+#include "fee_histogram.h"
+#include "tx_selection.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "rpc/message_data_structs.h"
 
@@ -217,6 +221,17 @@ namespace cryptonote
      */
     bool deinit();
 
+    //! a snapshot of the transactions which may improve a block template, taken while filling it
+    struct block_template_candidates
+    {
+      size_t median_weight;
+      uint64_t already_generated_coins;
+      uint8_t version;
+      size_t max_total_weight;
+      std::vector<tx_selection_item> items; //!< the block's transactions, in order, then the candidates
+      std::vector<crypto::hash> txids; //!< the ids of the items
+    };
+
     /**
      * @brief Chooses transactions for a block to include
      *
@@ -232,6 +247,58 @@ namespace cryptonote
      */
     bool fill_block_template(block &bl, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version);
 
+    /**
+     * @brief Considers more transactions for a block filled by fill_block_template
+     *
+     * The given transactions are considered in fee order, with the same
+     * rules as fill_block_template, and appended to the block if they fit.
+     * Appending is not enough when one is left out for weight or penalty
+     * while paying more per byte than a transaction in the block, the
+     * block must then be filled again.
+     *
+     * @param bl the block to add transactions to
+     * @param txids the transactions to consider
+     * @param median_weight the median block weight the block was filled with
+     * @param already_generated_coins the current total number of coins "minted"
+     * @param total_weight the total weight of the block's transactions, updated
+     * @param fee the total of fees from the block's transactions, updated
+     * @param expected_reward the total reward awarded to the miner finding the block, updated
+     * @param version hard fork version to use for consensus rules
+     * @param candidates return-by-reference the transactions to pass to improve_block_template
+     *
+     * @return false if a transaction already in the block left the pool, or
+     * if the block must be filled again, otherwise true
+     */
+    bool add_to_block_template(block &bl, const std::vector<crypto::hash> &txids, size_t median_weight, uint64_t already_generated_coins, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward, uint8_t version, block_template_candidates &candidates);
+
+    /**
+     * @brief swaps transactions in and out of a filled block template for a better reward
+     *
+     * improve_tx_selection looks for a better combination of the block's
+     * transactions and the ones left out while filling it. This works on
+     * the snapshot only, so no lock is needed, and it may change the
+     * transactions without changing their count.
+     *
+     * @param bl the block whose transactions to change
+     * @param candidates the snapshot taken when the block was filled, updated
+     * @param total_weight the total weight of the block's transactions, updated
+     * @param fee the total of fees from the block's transactions, updated
+     * @param expected_reward the total reward awarded to the miner finding the block, updated
+     *
+     * @return true if the block's transactions changed, otherwise false
+     */
+    static bool improve_block_template(block &bl, block_template_candidates &candidates, size_t &total_weight, uint64_t &fee, uint64_t &expected_reward);
+
+    /**
+     * @brief gets the transactions added to the pool since a given cookie
+     *
+     * @param cookie a value previously returned by cookie()
+     * @param txids return-by-reference the transactions added since
+     *
+     * @return false if the pool changed in other ways since, otherwise true
+     */
+    bool get_txs_added_since(uint64_t cookie, std::vector<crypto::hash> &txids) const;
+
     /**
      * @brief get a list of all transactions in the pool
      *
@@ -259,6 +326,29 @@ namespace cryptonote
      */
     void get_transaction_backlog(std::vector<tx_backlog_entry>& backlog, bool include_unrelayed_txes = true) const;
 
+    /**
+     * @brief get the pool transactions binned by fee per byte
+     *
+     * The histogram is kept up to date as transactions come and go, so this
+     * does not go through the pool, nor wait for the pool lock.
+     *
+     * @param histogram return-by-reference the histogram
+     * @param include_unrelayed_txes include unrelayed txes in the result
+     */
+    void get_fee_histogram(fee_rate_histogram &histogram, bool include_unrelayed_txes = true) const;
+
+    /**
+     * @brief get a fee per byte for a transaction to be mined soon given the pool backlog
+     *
+     * @param base_fee the fee per fee unit to use if the pool is not backlogged
+     * @param fee_unit the bytes base_fee is for, 1 or 1024 before per byte fees
+     * @param block_weight the weight of transactions a block can take without penalty
+     *
+     * @return base_fee if the transactions paying at least that fit in a block,
+     * otherwise a fee per fee unit above most of the ones which would not fit
+     */
+    uint64_t get_backlog_fee_estimate(uint64_t base_fee, uint64_t fee_unit, uint64_t block_weight) const;
+
     /**
      * @brief get a summary statistics of all transaction hashes in the pool
      *
@@ -313,6 +403,19 @@ namespace cryptonote
      */
     bool get_transaction(const crypto::hash& h, cryptonote::blobdata& txblob) const;
 
+    /**
+     * @brief get a specific transaction from the pool, if it may be relayed
+     *
+     * Used to answer peers asking for txes they were told about, so txes
+     * which are not to be relayed are not given away.
+     *
+     * @param h the hash of the transaction to get
+     * @param txblob return-by-reference the transaction blob requested
+     *
+     * @return true if the transaction is found and may be relayed, otherwise false
+     */
+    bool get_relayable_transaction(const crypto::hash& h, cryptonote::blobdata& txblob) const;
+
     /**
      * @brief get a list of all relayable transactions and their hashes
      *
@@ -432,6 +535,160 @@ namespace cryptonote
 
   private:
 
+    //TODO: confirm the below comments and investigate whether or not this
+    //      is the desired behavior
+    //! map key images to transactions which spent them
+    /*! this seems odd, but it seems that multiple transactions can exist
+     *  in the pool which both have the same spent key.  This would happen
+     *  in the event of a reorg where someone creates a new/different
+     *  transaction on the assumption that the original will not be in a
+     *  block again.
+     */
+    typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash> > key_images_container;
+
+    //! in-memory copy of a pool transaction's db metadata, with its key images
+    struct tx_meta_entry
+    {
+      txpool_tx_meta_t meta;
+      std::vector<crypto::key_image> key_images;
+    };
+
+    //! an immutable copy of the pool's in-memory state, shared by readers
+    struct pool_snapshot
+    {
+      uint64_t cookie;
+      uint64_t meta_version;
+      std::vector<std::pair<crypto::hash, txpool_tx_meta_t>> txes; //!< in the order the db lists them
+      std::shared_ptr<const key_images_container> spent_key_images; //!< shared by the snapshots of the same cookie
+
+      //! @return the transaction's metadata, or NULL if not in the snapshot
+      const txpool_tx_meta_t *find_tx(const crypto::hash &txid) const;
+    };
+
+    //! the running totals of a block template being filled
+    struct block_template_state
+    {
+      size_t median_weight;
+      uint64_t already_generated_coins;
+      uint8_t version;
+      size_t max_total_weight;
+      size_t total_weight;
+      uint64_t fee;
+      uint64_t best_coinbase;
+      std::unordered_set<crypto::key_image> k_images;
+      size_t max_deferred;
+      std::vector<crypto::hash> deferred; //!< ready to go as far as we know, but left out for weight or penalty
+      double max_deferred_fee_per_byte; //!< of all the txes left out for weight or penalty, capped or not
+
+      void defer(const crypto::hash &txid, double fee_per_byte)
+      {
+        max_deferred_fee_per_byte = std::max(max_deferred_fee_per_byte, fee_per_byte);
+        if (deferred.size() < max_deferred)
+          deferred.push_back(txid);
+      }
+    };
+
+    /**
+     * @brief sets up an empty block template's running totals
+     */
+    void init_block_template_state(block_template_state &state, size_t median_weight, uint64_t already_generated_coins, uint8_t version) const;
+
+    /**
+     * @brief considers one pool transaction for a block template
+     *
+     * @param bl the block to add the transaction to, if it fits
+     * @param txid the transaction to consider
+     * @param state the template's running totals, updated if the transaction is added
+     *
+     * @return false if no more transactions should be considered, otherwise true
+     */
+    bool add_tx_to_block_template(block &bl, const crypto::hash &txid, block_template_state &state);
+
+    /**
+     * @brief snapshots a filled block template for improve_block_template
+     *
+     * The transactions deferred while filling the template are checked, and
+     * the ones which conflict with neither the block nor each other are
+     * kept as candidates.
+     *
+     * @param bl the filled block
+     * @param state the template's running totals
+     * @param candidates return-by-reference the snapshot
+     */
+    void get_block_template_candidates(const block &bl, const block_template_state &state, block_template_candidates &candidates);
+
+    /**
+     * @brief checks whether a pool transaction can go in a block, recording the outcome
+     *
+     * @param txid the transaction to check
+     * @param entry the transaction's in-memory metadata, updated
+     *
+     * @return true if the transaction is ready to go, otherwise false
+     */
+    bool check_tx_ready_for_block_template(const crypto::hash &txid, tx_meta_entry &entry);
+
+    /**
+     * @brief gets a snapshot of the pool for readers
+     *
+     * The last published snapshot is returned if the pool did not change
+     * since. Otherwise a new one is published, unless a change is in
+     * progress, in which case the last one is returned rather than waiting
+     * for the pool lock, as long as it is at most a few changes behind.
+     * The pool lock is only held while copying, the copy is sorted after.
+     *
+     * @return the snapshot, which stays valid as long as it is held
+     */
+    std::shared_ptr<const pool_snapshot> get_snapshot() const;
+
+    /**
+     * @brief calls a function for each transaction in a snapshot
+     *
+     * Blobs are read from the db without the pool lock, so a transaction
+     * which left the pool after the snapshot was taken is skipped.
+     *
+     * @param snapshot the snapshot to go through
+     * @param f the function to call, returning false to stop
+     * @param include_blob whether to read the transactions' blobs
+     * @param include_unrelayed_txes whether to include transactions which are not to be relayed
+     *
+     * @return false if f returned false, otherwise true
+     */
+    bool for_all_snapshot_txes(const pool_snapshot &snapshot, const std::function<bool(const crypto::hash&, const txpool_tx_meta_t&, const cryptonote::blobdata*)> &f, bool include_blob, bool include_unrelayed_txes) const;
+
+    /**
+     * @brief counts the transactions in a snapshot
+     */
+    static size_t count_snapshot_txes(const pool_snapshot &snapshot, bool include_unrelayed_txes);
+
+    /**
+     * @brief bumps the cookie for a change which is not just a transaction being added
+     */
+    void note_pool_change();
+
+    /**
+     * @brief adds a transaction to the in-memory metadata
+     *
+     * @param txid the transaction's hash
+     * @param meta the transaction's metadata, as stored in the db
+     * @param tx the transaction
+     */
+    void add_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta, const transaction_prefix &tx);
+
+    /**
+     * @brief updates a transaction's metadata in the db and in memory
+     *
+     * @param txid the transaction's hash
+     * @param meta the new metadata
+     */
+    void update_tx_meta(const crypto::hash &txid, const txpool_tx_meta_t &meta);
+
+    /**
+     * @brief removes a transaction from the in-memory metadata
+     *
+     * @param txid the transaction's hash
+     */
+    void remove_tx_meta(const crypto::hash &txid);
+
     /**
      * @brief insert key images into m_spent_key_images
      *
@@ -510,14 +767,15 @@ namespace cryptonote
     /**
      * @brief check if a transaction is a valid candidate for inclusion in a block
      *
+     * The transaction is only loaded and parsed if its inputs need checking.
+     *
      * @param txd the transaction to check (and info about it)
      * @param txid the txid of the transaction to check
-     * @param txblob the transaction blob to check
-     * @param tx the parsed transaction, if successful
+     * @param key_images the key images spent by the transaction
      *
      * @return true if the transaction is good to go, otherwise false
      */
-    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const cryptonote::blobdata &txblob, transaction&tx) const;
+    bool is_transaction_ready_to_go(txpool_tx_meta_t& txd, const crypto::hash &txid, const std::vector<crypto::key_image> &key_images) const;
 
     /**
      * @brief mark all transactions double spending the one passed
@@ -531,17 +789,6 @@ namespace cryptonote
      */
     void prune(size_t bytes = 0);
 
-    //TODO: confirm the below comments and investigate whether or not this
-    //      is the desired behavior
-    //! map key images to transactions which spent them
-    /*! this seems odd, but it seems that multiple transactions can exist
-     *  in the pool which both have the same spent key.  This would happen
-     *  in the event of a reorg where someone creates a new/different
-     *  transaction on the assumption that the original will not be in a
-     *  block again.
-     */
-    typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash> > key_images_container;
-
 #if defined(DEBUG_CREATE_BLOCK_TEMPLATE)
 public:
 #endif
@@ -561,8 +808,25 @@ private:
     //!< container for transactions organized by fee per size and receive time
     sorted_tx_container m_txs_by_fee_and_receive_time;
 
+    //! metadata of the transactions in m_txs_by_fee_and_receive_time, kept
+    //! in step with the db so the hot paths do not need to read it back
+    std::unordered_map<crypto::hash, tx_meta_entry> m_tx_meta;
+
     std::atomic<uint64_t> m_cookie; //!< incremented at each change
 
+    //! transactions added since the cookie was m_added_txs_since, with the cookie after each
+    std::vector<std::pair<uint64_t, crypto::hash>> m_added_txs;
+    uint64_t m_added_txs_since;
+
+    std::atomic<uint64_t> m_meta_version; //!< incremented at each metadata change, which may not change the cookie
+
+    //! the transactions in m_tx_meta binned by fee per byte, the relayable ones then the unrelayed ones
+    fee_rate_histogram m_fee_histograms[2];
+    mutable boost::mutex m_fee_histogram_lock; //!< guards m_fee_histograms, so readers do not need the pool lock
+
+    mutable boost::mutex m_snapshot_lock; //!< guards m_snapshot, not what it points to
+    mutable std::shared_ptr<const pool_snapshot> m_snapshot; //!< the last published snapshot, for readers
+
     /**
      * @brief get an iterator to a transaction in the sorted container
      *
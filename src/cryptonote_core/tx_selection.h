@@ -0,0 +1,184 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace cryptonote
+{
+  //! a transaction considered for a block: its weight, fee, and whether it is in the block
+  struct tx_selection_item
+  {
+    uint64_t weight;
+    uint64_t fee;
+    bool selected;
+  };
+
+  /**
+   * @brief improves a greedy choice of transactions for a block
+   *
+   * Greedy filling by fee per byte skips any transaction which would lower
+   * the coinbase, which can leave a better packing behind once the block is
+   * in the penalty zone: a dense transaction too heavy for the remaining
+   * room, or light transactions whose fees do not cover the penalty they
+   * cause. This runs a local search from the greedy choice. A move adds one
+   * unselected transaction (or none), drops up to max_dropped of the least
+   * dense selected ones, then refills greedily from the other unselected
+   * ones. The best move which increases block reward plus fees is applied,
+   * and the search goes on until no move helps or max_steps rewards were
+   * evaluated, so the time spent is bounded whatever the pool looks like.
+   *
+   * The items must not conflict with each other, ie spend the same key
+   * images, since any of them may end up together in the block.
+   *
+   * @param items the transactions, with the greedy choice selected, updated
+   * @param max_total_weight the largest total weight of transactions allowed
+   * @param get_reward gets the block reward for a total weight of transactions, returns false if not allowed
+   * @param max_steps the most rewards to evaluate
+   * @param max_dropped the most selected transactions a single move may drop
+   *
+   * @return the number of moves applied
+   */
+  inline size_t improve_tx_selection(std::vector<tx_selection_item> &items, uint64_t max_total_weight,
+      const std::function<bool(uint64_t total_weight, uint64_t &reward)> &get_reward, size_t max_steps, size_t max_dropped)
+  {
+    uint64_t total_weight = 0, fee = 0;
+    for (const tx_selection_item &item: items)
+    {
+      if (item.selected)
+      {
+        total_weight += item.weight;
+        fee += item.fee;
+      }
+    }
+    uint64_t reward;
+    if (total_weight > max_total_weight || !get_reward(total_weight, reward))
+      return 0;
+    uint64_t best = reward + fee;
+
+    const auto denser = [&items](size_t a, size_t b) {
+      return items[a].fee / (double)std::max<uint64_t>(items[a].weight, 1) > items[b].fee / (double)std::max<uint64_t>(items[b].weight, 1);
+    };
+
+    std::vector<size_t> selected, unselected, refilled, best_refilled;
+    size_t steps = 0, moves = 0;
+    while (steps < max_steps)
+    {
+      selected.clear();
+      unselected.clear();
+      for (size_t i = 0; i < items.size(); ++i)
+        (items[i].selected ? selected : unselected).push_back(i);
+      // the least dense selected transactions are dropped first, the densest unselected ones are added first
+      std::sort(selected.begin(), selected.end(), [&denser](size_t a, size_t b) { return denser(b, a); });
+      std::sort(unselected.begin(), unselected.end(), denser);
+
+      uint64_t best_value = best;
+      size_t best_added = 0, best_dropped = 0;
+      bool found = false;
+      // the last round adds nothing and only drops
+      for (size_t c = 0; c <= unselected.size() && steps < max_steps; ++c)
+      {
+        const bool adding = c < unselected.size();
+        if (adding && items[unselected[c]].weight > max_total_weight)
+          continue;
+        uint64_t w = total_weight + (adding ? items[unselected[c]].weight : 0);
+        uint64_t f = fee + (adding ? items[unselected[c]].fee : 0);
+        for (size_t k = 0; k <= std::min(max_dropped, selected.size()) && steps < max_steps; ++k)
+        {
+          if (k > 0)
+          {
+            w -= items[selected[k - 1]].weight;
+            f -= items[selected[k - 1]].fee;
+          }
+          else if (!adding)
+            continue;
+          if (w > max_total_weight)
+            continue;
+          ++steps;
+          uint64_t value_w = w, value_f = f;
+          if (!get_reward(value_w, reward))
+            continue;
+          uint64_t value = reward + value_f;
+
+          // refill with the densest transactions which still pay for themselves
+          refilled.clear();
+          for (size_t u = 0; u < unselected.size() && steps < max_steps; ++u)
+          {
+            if (u == c || value_w + items[unselected[u]].weight > max_total_weight)
+              continue;
+            ++steps;
+            if (!get_reward(value_w + items[unselected[u]].weight, reward))
+              continue;
+            if (reward + value_f + items[unselected[u]].fee >= value)
+            {
+              value_w += items[unselected[u]].weight;
+              value_f += items[unselected[u]].fee;
+              value = reward + value_f;
+              refilled.push_back(unselected[u]);
+            }
+          }
+
+          if (value > best_value)
+          {
+            best_value = value;
+            best_added = c;
+            best_dropped = k;
+            best_refilled.swap(refilled);
+            found = true;
+          }
+        }
+      }
+      if (!found)
+        break;
+
+      if (best_added < unselected.size())
+        best_refilled.push_back(unselected[best_added]);
+      for (size_t i: best_refilled)
+      {
+        items[i].selected = true;
+        total_weight += items[i].weight;
+        fee += items[i].fee;
+      }
+      for (size_t k = 0; k < best_dropped; ++k)
+      {
+        items[selected[k]].selected = false;
+        total_weight -= items[selected[k]].weight;
+        fee -= items[selected[k]].fee;
+      }
+      best = best_value;
+      ++moves;
+    }
+    return moves;
+  }
+}
@@ -0,0 +1,107 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "verified_tx_cache.h"
+
+namespace cryptonote
+{
+  //---------------------------------------------------------------------------------
+  verified_tx_cache::verified_tx_cache(size_t max_entries):
+    m_max_entries_per_shard(std::max<size_t>(max_entries / NUM_SHARDS, 1))
+  {
+  }
+  //---------------------------------------------------------------------------------
+  crypto::hash verified_tx_cache::get_ring_hash(const std::vector<std::vector<rct::ctkey>> &pubkeys)
+  {
+    std::vector<rct::key> data;
+    for (const auto &ring: pubkeys)
+    {
+      // the ring size is part of the data, so rings can't be shifted around
+      data.push_back(rct::d2h(ring.size()));
+      for (const auto &member: ring)
+      {
+        data.push_back(member.dest);
+        data.push_back(member.mask);
+      }
+    }
+    crypto::hash h;
+    crypto::cn_fast_hash(data.data(), data.size() * sizeof(rct::key), h);
+    return h;
+  }
+  //---------------------------------------------------------------------------------
+  crypto::hash verified_tx_cache::make_key(const crypto::hash &txid, const crypto::hash &prunable_hash, const crypto::hash &ring_hash)
+  {
+    const crypto::hash data[3] = { txid, prunable_hash, ring_hash };
+    crypto::hash h;
+    crypto::cn_fast_hash(data, sizeof(data), h);
+    return h;
+  }
+  //---------------------------------------------------------------------------------
+  bool verified_tx_cache::has(const crypto::hash &key) const
+  {
+    const shard &s = get_shard(key);
+    boost::unique_lock<boost::mutex> lock(s.lock);
+    return s.entries.find(key) != s.entries.end();
+  }
+  //---------------------------------------------------------------------------------
+  void verified_tx_cache::add(const crypto::hash &key)
+  {
+    shard &s = get_shard(key);
+    boost::unique_lock<boost::mutex> lock(s.lock);
+    if (!s.entries.insert(key).second)
+      return;
+    s.order.push_back(key);
+    while (s.order.size() > m_max_entries_per_shard)
+    {
+      s.entries.erase(s.order.front());
+      s.order.pop_front();
+    }
+  }
+  //---------------------------------------------------------------------------------
+  void verified_tx_cache::clear()
+  {
+    for (shard &s: m_shards)
+    {
+      boost::unique_lock<boost::mutex> lock(s.lock);
+      s.entries.clear();
+      s.order.clear();
+    }
+  }
+  //---------------------------------------------------------------------------------
+  size_t verified_tx_cache::size() const
+  {
+    size_t n = 0;
+    for (const shard &s: m_shards)
+    {
+      boost::unique_lock<boost::mutex> lock(s.lock);
+      n += s.entries.size();
+    }
+    return n;
+  }
+}
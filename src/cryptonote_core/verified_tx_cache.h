@@ -0,0 +1,102 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <boost/thread/mutex.hpp>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+#include "crypto/hash.h"
+#include "ringct/rctTypes.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief a bounded set of transactions whose input signatures are known good
+   *
+   * Entries are keyed by the transaction id, its prunable hash and a hash of
+   * the ring members the signatures were checked against, so a hit means the
+   * exact same signatures were already verified over the exact same rings.
+   * This makes entries independent of the chain state they were checked
+   * against, which is what lets them survive reorgs: if a reorg changes the
+   * outputs a ring refers to, the ring hash changes and the entry just misses.
+   *
+   * The set is split into shards, each with its own lock, so the tx pool and
+   * block validation threads rarely contend. Each shard evicts its oldest
+   * entries once full.
+   */
+  class verified_tx_cache
+  {
+  public:
+    static constexpr size_t DEFAULT_MAX_ENTRIES = 65536;
+    static constexpr size_t NUM_SHARDS = 16;
+
+    verified_tx_cache(size_t max_entries = DEFAULT_MAX_ENTRIES);
+
+    /**
+     * @brief hashes the resolved ring members of all inputs of a transaction
+     *
+     * @param pubkeys the output keys and commitments of each input's ring
+     *
+     * @return a hash committing to every ring member, in order
+     */
+    static crypto::hash get_ring_hash(const std::vector<std::vector<rct::ctkey>> &pubkeys);
+
+    /**
+     * @brief combines the three parts of a cache key
+     *
+     * @param txid the transaction id
+     * @param prunable_hash the hash of the transaction's prunable data
+     * @param ring_hash the hash of the ring members, see get_ring_hash
+     *
+     * @return the key to use with has and add
+     */
+    static crypto::hash make_key(const crypto::hash &txid, const crypto::hash &prunable_hash, const crypto::hash &ring_hash);
+
+    bool has(const crypto::hash &key) const;
+    void add(const crypto::hash &key);
+    void clear();
+    size_t size() const;
+
+  private:
+    struct shard
+    {
+      mutable boost::mutex lock;
+      std::unordered_set<crypto::hash> entries;
+      std::deque<crypto::hash> order;
+    };
+
+    shard &get_shard(const crypto::hash &key) { return m_shards[(unsigned char)key.data[0] % NUM_SHARDS]; }
+    const shard &get_shard(const crypto::hash &key) const { return m_shards[(unsigned char)key.data[0] % NUM_SHARDS]; }
+
+    size_t m_max_entries_per_shard;
+    shard m_shards[NUM_SHARDS];
+  };
+}
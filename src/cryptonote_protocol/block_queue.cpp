@@ -42,6 +42,12 @@
 #undef EVOLUTION_DEFAULT_LOG_CATEGORY
 #define EVOLUTION_DEFAULT_LOG_CATEGORY "cn.block_queue"
 
+#define SPAN_TARGET_SECONDS 8 // spans are sized to take about that long from the peer they go to
+#define NEXT_SPAN_TARGET_SECONDS 2 // but the one the chain is waiting for should come quicker
+#define MIN_SPAN_FRACTION 16 // spans are at least that fraction of the maximum
+#define LATE_SPAN_FACTOR 3 // a span is late after that many times as long as expected
+#define LATE_SPAN_MIN_SECONDS 2 // and at least that long
+
 namespace std {
   static_assert(sizeof(size_t) <= sizeof(boost::uuids::uuid), "boost::uuids::uuid too small");
   template<> struct hash<boost::uuids::uuid> {
@@ -57,6 +63,15 @@ namespace cryptonote
 void block_queue::add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size)
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  if (!bcel.empty() && rate > 0.0f)
+  {
+    const float bytes_per_block = size / (float)bcel.size();
+    const auto i = peer_stats.find(connection_id);
+    if (i == peer_stats.end())
+      peer_stats.insert(std::make_pair(connection_id, connection_stats{rate, bytes_per_block}));
+    else
+      i->second = {(i->second.rate + rate) / 2, (i->second.bytes_per_block + bytes_per_block) / 2};
+  }
   std::vector<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
   blocks.insert(span(height, std::move(bcel), connection_id, rate, size));
@@ -115,6 +130,13 @@ void block_queue::flush_stale_spans(const std::set<boost::uuids::uuid> &live_con
       erase_block(j);
     }
   }
+  for (auto i = peer_stats.begin(); i != peer_stats.end(); )
+  {
+    if (live_connections.find(i->first) == live_connections.end())
+      i = peer_stats.erase(i);
+    else
+      ++i;
+  }
 }
 
 bool block_queue::remove_span(uint64_t start_block_height, std::vector<crypto::hash> *hashes)
@@ -281,6 +303,10 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
     ++span_start_height;
   }
 
+  // the span below all others is the one the chain will need next
+  const bool next = blocks.empty() || span_start_height < blocks.begin()->start_block_height;
+  max_blocks = get_span_size(connection_id, max_blocks, next);
+
   uint64_t span_length = 0;
   std::vector<crypto::hash> hashes;
   while (i != block_hashes.end() && span_length < max_blocks && tools::has_unpruned_block(span_start_height + span_length, blockchain_height, pruning_seed))
@@ -300,6 +326,50 @@ std::pair<uint64_t, uint64_t> block_queue::reserve_span(uint64_t first_block_hei
   return std::make_pair(span_start_height, span_length);
 }
 
+uint64_t block_queue::get_span_size(const boost::uuids::uuid &connection_id, uint64_t max_blocks, bool next) const
+{
+  const auto i = peer_stats.find(connection_id);
+  if (i == peer_stats.end() || i->second.rate <= 0.0f || i->second.bytes_per_block <= 0.0f)
+  {
+    // we don't know how fast that peer is, don't give it all of what the chain waits for
+    return next ? std::max<uint64_t>(1, max_blocks / 4) : max_blocks;
+  }
+  const float seconds = next ? NEXT_SPAN_TARGET_SECONDS : SPAN_TARGET_SECONDS;
+  const uint64_t nblocks = i->second.rate * seconds / i->second.bytes_per_block;
+  const uint64_t min_blocks = std::max<uint64_t>(1, max_blocks / MIN_SPAN_FRACTION);
+  const uint64_t span_size = std::max(min_blocks, std::min(max_blocks, nblocks));
+  MDEBUG("Span size for " << connection_id << " at " << i->second.rate / 1024 << " kB/s, " << i->second.bytes_per_block << " bytes/block"
+      << (next ? ", next span" : "") << ": " << span_size << "/" << max_blocks);
+  return span_size;
+}
+
+bool block_queue::is_next_span_late(uint64_t blockchain_height, const boost::uuids::uuid &connection_id, boost::posix_time::ptime now) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  if (blocks.empty())
+    return false;
+  const span &next = *blocks.begin();
+  if (next.start_block_height > blockchain_height || !next.blocks.empty() || next.connection_id == connection_id)
+    return false;
+
+  // we can only tell we'd be quicker if we know how fast we are
+  const auto ours = peer_stats.find(connection_id);
+  if (ours == peer_stats.end() || ours->second.rate <= 0.0f)
+    return false;
+  const float bytes = next.nblocks * ours->second.bytes_per_block;
+  const auto theirs = peer_stats.find(next.connection_id);
+  const float their_rate = theirs != peer_stats.end() && theirs->second.rate > 0.0f ? theirs->second.rate : ours->second.rate;
+
+  const float elapsed = (now - next.time).total_microseconds() / 1e6f;
+  const float expected = bytes / their_rate;
+  const float our_time = bytes / ours->second.rate;
+  if (elapsed < LATE_SPAN_MIN_SECONDS || elapsed < expected * LATE_SPAN_FACTOR || our_time >= elapsed)
+    return false;
+  MDEBUG("Next span " << next.start_block_height << " from " << next.connection_id << " is late: " << elapsed << " seconds, expected "
+      << expected << ", " << connection_id << " would take " << our_time);
+  return true;
+}
+
 std::pair<uint64_t, uint64_t> block_queue::get_next_span_if_scheduled(std::vector<crypto::hash> &hashes, boost::uuids::uuid &connection_id, boost::posix_time::ptime &time) const
 {
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
@@ -32,6 +32,7 @@
 
 #pragma once
 
+#include <map>
 #include <string>
 #include <vector>
 #include <set>
@@ -69,6 +70,13 @@ namespace cryptonote
     };
     typedef std::set<span> block_map;
 
+    //! download measurements for a connection, averaged with more weight on the latest ones
+    struct connection_stats
+    {
+      float rate; //!< bytes per second, from request to response, so including latency
+      float bytes_per_block;
+    };
+
   public:
     void add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size);
     void add_blocks(uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, boost::posix_time::ptime time = boost::date_time::min_date_time);
@@ -98,9 +106,11 @@ namespace cryptonote
     bool foreach(std::function<bool(const span&)> f) const;
     bool requested(const crypto::hash &hash) const;
     bool have(const crypto::hash &hash) const;
+    bool is_next_span_late(uint64_t blockchain_height, const boost::uuids::uuid &connection_id, boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time()) const;
 
   private:
     void erase_block(block_map::iterator j);
+    uint64_t get_span_size(const boost::uuids::uuid &connection_id, uint64_t max_blocks, bool next) const;
     inline bool requested_internal(const crypto::hash &hash) const;
 
   private:
@@ -108,5 +118,6 @@ namespace cryptonote
     mutable boost::recursive_mutex mutex;
     std::unordered_set<crypto::hash> requested_hashes;
     std::unordered_set<crypto::hash> have_blocks;
+    std::map<boost::uuids::uuid, connection_stats> peer_stats;
   };
 }
@@ -0,0 +1,117 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "int-util.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  //! bytes of a short tx id, a collision just makes the receiver ask for the full tx hashes
+  static constexpr size_t SHORT_TX_ID_SIZE = 6;
+
+  /**
+   * @brief gets the key salting the short tx ids of a compact block
+   *
+   * A new nonce is picked for each relay, so txes can't be crafted ahead of
+   * time to collide with the txes of a block.
+   *
+   * @param block_hash the hash of the block
+   * @param nonce the nonce sent along with the compact block
+   *
+   * @return the key
+   */
+  inline crypto::hash get_compact_block_key(const crypto::hash &block_hash, uint64_t nonce)
+  {
+    char data[sizeof(crypto::hash) + sizeof(uint64_t)];
+    memcpy(data, &block_hash, sizeof(block_hash));
+    nonce = SWAP64LE(nonce);
+    memcpy(data + sizeof(block_hash), &nonce, sizeof(nonce));
+    return crypto::cn_fast_hash(data, sizeof(data));
+  }
+
+  /**
+   * @brief gets the short id of a tx in a compact block
+   *
+   * @param key the key from get_compact_block_key
+   * @param txid the hash of the tx
+   *
+   * @return the short id, in the low SHORT_TX_ID_SIZE bytes
+   */
+  inline uint64_t get_short_tx_id(const crypto::hash &key, const crypto::hash &txid)
+  {
+    char data[2 * sizeof(crypto::hash)];
+    memcpy(data, &key, sizeof(key));
+    memcpy(data + sizeof(key), &txid, sizeof(txid));
+    const crypto::hash h = crypto::cn_fast_hash(data, sizeof(data));
+    uint64_t id = 0;
+    for (size_t i = 0; i < SHORT_TX_ID_SIZE; ++i)
+      id |= (uint64_t)(unsigned char)h.data[i] << (8 * i);
+    return id;
+  }
+
+  /**
+   * @brief appends a short tx id to a blob of short tx ids
+   */
+  inline void add_short_tx_id(std::string &blob, uint64_t id)
+  {
+    for (size_t i = 0; i < SHORT_TX_ID_SIZE; ++i)
+      blob.push_back((char)(id >> (8 * i)));
+  }
+
+  /**
+   * @brief splits a blob of short tx ids
+   *
+   * @param blob the short tx ids, SHORT_TX_ID_SIZE bytes each
+   * @param ids return-by-reference the short tx ids
+   *
+   * @return false if the blob size is not a multiple of SHORT_TX_ID_SIZE, else true
+   */
+  inline bool get_short_tx_ids(const std::string &blob, std::vector<uint64_t> &ids)
+  {
+    if (blob.size() % SHORT_TX_ID_SIZE)
+      return false;
+    ids.clear();
+    ids.reserve(blob.size() / SHORT_TX_ID_SIZE);
+    for (size_t offset = 0; offset < blob.size(); offset += SHORT_TX_ID_SIZE)
+    {
+      uint64_t id = 0;
+      for (size_t i = 0; i < SHORT_TX_ID_SIZE; ++i)
+        id |= (uint64_t)(unsigned char)blob[offset + i] << (8 * i);
+      ids.push_back(id);
+    }
+    return true;
+  }
+}
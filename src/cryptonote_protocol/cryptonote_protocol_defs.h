@@ -34,6 +34,7 @@
 
 #include <list>
 #include "serialization/keyvalue_serialization.h"
+#include "shared_buffer.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/blobdatatype.h"
 namespace cryptonote
@@ -126,6 +127,17 @@ namespace cryptonote
     END_KV_SERIALIZE_MAP()
   };
 
+  //! block_complete_entry as it is sent: the blobs are shared, and the binary writer hands them on without copying them
+  struct shared_block_complete_entry
+  {
+    epee::shared_buffer block;
+    std::vector<epee::shared_buffer> txs;
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(block)
+      KV_SERIALIZE(txs)
+    END_KV_SERIALIZE_MAP()
+  };
+
 
   /************************************************************************/
   /*                                                                      */
@@ -190,10 +202,11 @@ namespace cryptonote
   {
     const static int ID = BC_COMMANDS_POOL_BASE + 4;
 
-    struct request_t
+    template<class t_blob, class t_block_entry>
+    struct request_base_t
     {
-      std::vector<blobdata>              txs;
-      std::vector<block_complete_entry>  blocks;
+      std::vector<t_blob>                txs;
+      std::vector<t_block_entry>         blocks;
       std::vector<crypto::hash>          missed_ids;
       uint64_t                         current_blockchain_height;
 
@@ -204,7 +217,9 @@ namespace cryptonote
         KV_SERIALIZE(current_blockchain_height)
       END_KV_SERIALIZE_MAP()
     };
-    typedef epee::misc_utils::struct_init<request_t> request;
+    typedef epee::misc_utils::struct_init<request_base_t<blobdata, block_complete_entry>> request;
+    //! the request as it is sent, see shared_block_complete_entry
+    typedef epee::misc_utils::struct_init<request_base_t<epee::shared_buffer, shared_block_complete_entry>> shared_request;
   };
 
 
@@ -302,5 +317,71 @@ namespace cryptonote
     };
     typedef epee::misc_utils::struct_init<request_t> request;
   }; 
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request_t
+    {
+      blobdata block; // without its tx hashes
+      crypto::hash block_hash;
+      uint64_t nonce;
+      std::string short_tx_ids; // for the txes which are not prefilled, in block order
+      std::vector<uint64_t> prefilled_tx_indices;
+      std::vector<blobdata> prefilled_txs;
+      uint64_t current_blockchain_height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+        KV_SERIALIZE(nonce)
+        KV_SERIALIZE(short_tx_ids)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(prefilled_tx_indices)
+        KV_SERIALIZE(prefilled_txs)
+        KV_SERIALIZE(current_blockchain_height)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_NEW_TRANSACTION_HASHES
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request_t
+    {
+      std::vector<crypto::hash> tx_hashes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
+
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_TRANSACTIONS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request_t
+    {
+      std::vector<crypto::hash> tx_hashes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+  };
     
 }
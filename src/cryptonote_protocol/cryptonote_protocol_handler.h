@@ -38,6 +38,8 @@
 
 #include <boost/program_options/variables_map.hpp>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 #include "math_helper.h"
 #include "storages/levin_abstract_invoke2.h"
@@ -93,6 +95,9 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_TRANSACTION_HASHES, &cryptonote_protocol_handler::handle_notify_new_transaction_hashes)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TRANSACTIONS, &cryptonote_protocol_handler::handle_request_transactions)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -116,6 +121,16 @@ namespace cryptonote
     std::string get_peers_overview() const;
     std::pair<uint32_t, uint32_t> get_next_needed_pruning_stripe() const;
     bool needs_new_sync_connections() const;
+
+    /**
+     * @brief asks for announced txes again from another peer when the one asked did not send them
+     *
+     * Called from on_idle. Txes with no other peer left are forgotten, and
+     * relayed in full once they arrive.
+     *
+     * @param now the current time
+     */
+    bool retry_requested_txes(time_t now);
   private:
     //----------------- commands handlers ----------------------------------------------
     int handle_notify_new_block(int command, NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& context);
@@ -126,10 +141,14 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context);
+    int handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context);
 
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
-    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context);
+    bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context, const std::unordered_set<crypto::hash> &prefill_txes);
+    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const std::vector<crypto::hash>& tx_hashes, cryptonote_connection_context& exclude_context);
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
     bool should_drop_connection(cryptonote_connection_context& context, uint32_t next_stripe);
@@ -157,6 +176,7 @@ namespace cryptonote
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
     epee::math_helper::once_a_time_milliseconds<100> m_standby_checker;
     epee::math_helper::once_a_time_seconds<101> m_sync_search_checker;
+    epee::math_helper::once_a_time_seconds<5> m_requested_txes_checker;
     std::atomic<unsigned int> m_max_out_peers;
     tools::PerformanceTimer m_sync_timer, m_add_timer;
     uint64_t m_last_add_end_time;
@@ -164,18 +184,59 @@ namespace cryptonote
     uint64_t m_sync_download_chain_size, m_sync_download_objects_size;
     size_t m_block_download_max_size;
 
+    // txes asked for after an announcement, so other peers announcing them are only
+    // asked if the peer asked does not send them in time
+    struct tx_announcer
+    {
+      boost::uuids::uuid id;
+      bool outbound; // we connected to it, so it is harder to place than inbound ones
+      time_t since; // when the connection started, older ones are asked first
+    };
+    struct requested_tx
+    {
+      time_t time; // when it was last asked for
+      boost::uuids::uuid peer; // who it was asked from
+      std::vector<tx_announcer> announcers; // other peers which announced it, best first, capped
+    };
+    boost::mutex m_requested_txes_lock;
+    std::unordered_map<crypto::hash, requested_tx> m_requested_txes;
+    // txes a peer failed to send after announcing them, relayed in full rather
+    // than announced when they arrive, so the next hop is not delayed again
+    std::unordered_map<crypto::hash, time_t> m_missed_txes;
+    static void add_tx_announcer(std::vector<tx_announcer> &announcers, const cryptonote_connection_context &context);
+
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
     boost::circular_buffer<size_t> m_avg_buffer = boost::circular_buffer<size_t>(10);
 
-    template<class t_parameter>
-      bool post_notify(typename t_parameter::request& arg, cryptonote_connection_context& context)
+    //! \return the egress class of a notification: block relay goes ahead of tx relay, which goes ahead of sync responses
+    static epee::net_utils::send_priority get_send_priority(int command)
+    {
+      switch (command)
+      {
+        case NOTIFY_NEW_TRANSACTIONS::ID:
+        case NOTIFY_NEW_TRANSACTION_HASHES::ID:
+        case NOTIFY_REQUEST_TRANSACTIONS::ID:
+          return epee::net_utils::send_priority_tx;
+        case NOTIFY_RESPONSE_GET_OBJECTS::ID:
+        case NOTIFY_RESPONSE_CHAIN_ENTRY::ID:
+          return epee::net_utils::send_priority_bulk;
+        default:
+          return epee::net_utils::send_priority_block;
+      }
+    }
+
+    template<class t_parameter, class t_request>
+      bool post_notify(t_request& arg, cryptonote_connection_context& context)
       {
         LOG_PRINT_L2("[" << epee::net_utils::print_connection_context_short(context) << "] post " << typeid(t_parameter).name() << " -->");
-        std::string blob;
-        epee::serialization::store_t_to_binary(arg, blob);
-        //handler_response_blocks_now(blob.size()); // XXX
-        return m_p2p->invoke_notify_to_peer(t_parameter::ID, epee::strspan<uint8_t>(blob), context);
+        // written straight into the pieces sent, so shared blobs in arg are not copied
+        std::vector<epee::shared_buffer> pieces;
+        epee::serialization::chunked_output out([&pieces](epee::shared_buffer&& piece) { pieces.push_back(std::move(piece)); return true; });
+        if (!epee::serialization::store_t_to_binary(arg, out))
+          return false;
+        //handler_response_blocks_now(out.size()); // XXX
+        return m_p2p->invoke_notify_to_peer(t_parameter::ID, pieces, context, get_send_priority(t_parameter::ID));
       }
   };
 
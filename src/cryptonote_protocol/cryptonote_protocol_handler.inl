@@ -45,6 +45,7 @@
 #include "profile_tools.h"
 #include "net/network_throttle-detail.hpp"
 #include "common/pruning.h"
+#include "compact_block.h"
 
 #undef EVOLUTION_DEFAULT_LOG_CATEGORY
 #define EVOLUTION_DEFAULT_LOG_CATEGORY "net.cn"
@@ -62,6 +63,10 @@
 #define PASSIVE_PEER_KICK_TIME (60 * 1000000) // microseconds
 #define DROP_ON_SYNC_WEDGE_THRESHOLD (30 * 1000000000ull) // nanoseconds
 #define LAST_ACTIVITY_STALL_THRESHOLD (2.0f) // seconds
+#define TX_REQUEST_TIMEOUT 30 // seconds before a tx asked for is asked from another peer which announced it
+#define MAX_TX_ANNOUNCERS 4 // other peers remembered per tx asked for, to ask next
+#define MISSED_TX_RELAY_TIME (10 * TX_REQUEST_TIMEOUT) // seconds a tx a peer did not send is remembered, to relay it in full
+#define MAX_TX_HASHES_PER_NOTIFY 10000
 
 namespace cryptonote
 {
@@ -511,6 +516,9 @@ namespace cryptonote
 
       std::vector<blobdata> have_tx;
 
+      // txes which came with the block, our peers are likely to miss them too
+      std::unordered_set<crypto::hash> received_txes;
+
       // Instead of requesting missing transactions by hash like BTC,
       // we do it by index (thanks to a suggestion from moneromooo) because
       // we're way cooler .. and also because they're smaller than hashes.
@@ -581,6 +589,7 @@ namespace cryptonote
 
             context.m_requested_objects.erase(req_tx_it);
           }
+          received_txes.insert(tx_hash);
 
           // we might already have the tx that the peer
           // sent in our pool, so don't verify again..
@@ -724,7 +733,7 @@ namespace cryptonote
           NOTIFY_NEW_BLOCK::request reg_arg = AUTO_VAL_INIT(reg_arg);
           reg_arg.current_blockchain_height = arg.current_blockchain_height;
           reg_arg.b = b;
-          relay_block(reg_arg, context);
+          relay_block(reg_arg, context, received_txes);
         }
         else if(bvc.m_marked_as_orphaned)
         {
@@ -834,6 +843,120 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_COMPACT_BLOCK (height " << arg.current_blockchain_height << ", " << arg.prefilled_txs.size() << " prefilled txes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized()) // can happen if a peer connection goes to normal but another thread still hasn't finished adding queued blocks
+    {
+      LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+      return 1;
+    }
+
+    block new_block;
+    std::vector<uint64_t> short_tx_ids;
+    if (!parse_and_validate_block_from_blob(arg.block, new_block) || !new_block.tx_hashes.empty()
+        || !get_short_tx_ids(arg.short_tx_ids, short_tx_ids) || arg.prefilled_tx_indices.size() != arg.prefilled_txs.size())
+    {
+      LOG_ERROR_CCONTEXT("sent invalid compact block " << arg.block_hash << ", dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+    if (m_core.have_block(arg.block_hash))
+    {
+      LOG_DEBUG_CC(context, "Already have block " << arg.block_hash);
+      return 1;
+    }
+
+    const size_t n_txes = short_tx_ids.size() + arg.prefilled_txs.size();
+    new_block.tx_hashes.resize(n_txes, crypto::null_hash);
+    std::vector<bool> prefilled(n_txes, false);
+    for (size_t i = 0; i < arg.prefilled_txs.size(); ++i)
+    {
+      const uint64_t tx_idx = arg.prefilled_tx_indices[i];
+      transaction tx;
+      if (tx_idx >= n_txes || prefilled[tx_idx] || !parse_and_validate_tx_from_blob(arg.prefilled_txs[i], tx, new_block.tx_hashes[tx_idx]))
+      {
+        LOG_ERROR_CCONTEXT("sent invalid prefilled tx in compact block " << arg.block_hash << ", dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      prefilled[tx_idx] = true;
+    }
+
+    // match the other txes against the pool, a short id shared by several
+    // pool txes is treated as missing
+    const crypto::hash key = get_compact_block_key(arg.block_hash, arg.nonce);
+    std::vector<crypto::hash> pool_txids;
+    m_core.get_pool_transaction_hashes(pool_txids);
+    std::unordered_map<uint64_t, crypto::hash> pool_short_tx_ids;
+    pool_short_tx_ids.reserve(pool_txids.size());
+    for (const crypto::hash &txid: pool_txids)
+    {
+      const auto ins = pool_short_tx_ids.emplace(get_short_tx_id(key, txid), txid);
+      if (!ins.second)
+        ins.first->second = crypto::null_hash;
+    }
+
+    std::vector<uint64_t> need_tx_indices;
+    size_t short_idx = 0;
+    for (size_t i = 0; i < n_txes; ++i)
+    {
+      if (prefilled[i])
+        continue;
+      const auto it = pool_short_tx_ids.find(short_tx_ids[short_idx++]);
+      if (it == pool_short_tx_ids.end() || it->second == crypto::null_hash)
+        need_tx_indices.push_back(i);
+      else
+        new_block.tx_hashes[i] = it->second;
+    }
+
+    bool reconstructed = false;
+    if (need_tx_indices.empty())
+    {
+      new_block.invalidate_hashes();
+      reconstructed = get_block_hash(new_block) == arg.block_hash;
+      if (!reconstructed)
+        MDEBUG("Short tx id collision in compact block " << arg.block_hash << ", asking for the full tx hashes");
+    }
+
+    if (reconstructed)
+    {
+      // from here on, this is a fluffy block with all the txes we did not have
+      NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+      fluffy_arg.b.block = block_to_blob(new_block);
+      fluffy_arg.b.txs = std::move(arg.prefilled_txs);
+      fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+      return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+    }
+
+    // the fluffy block we get back only has the txes we ask for, so the
+    // prefilled ones have to be in the pool by then
+    for (const blobdata &tx_blob: arg.prefilled_txs)
+    {
+      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      if (!m_core.handle_incoming_tx(tx_blob, tvc, true, true, false) || tvc.m_verifivation_failed)
+      {
+        LOG_PRINT_CCONTEXT_L1("Block verification failed: transaction verification failed, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+    }
+
+    // if all txes were matched, the block hash did not, and asking for no tx
+    // gets us the block with its full tx hashes
+    MDEBUG("We are missing " << need_tx_indices.size() << " txes for compact block " << arg.block_hash);
+    NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+    missing_tx_req.block_hash = arg.block_hash;
+    missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+    missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+    MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_FLUFFY_MISSING_TX: missing_tx_indices.size()=" << missing_tx_req.missing_tx_indices.size() );
+    post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTIONS (" << arg.txs.size() << " txes)");
@@ -850,7 +973,9 @@ namespace cryptonote
     }
 
     std::vector<cryptonote::blobdata> newtxs;
+    std::vector<crypto::hash> newtx_hashes;
     newtxs.reserve(arg.txs.size());
+    newtx_hashes.reserve(arg.txs.size());
     for (size_t i = 0; i < arg.txs.size(); ++i)
     {
       cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
@@ -862,16 +987,106 @@ namespace cryptonote
         return 1;
       }
       if(tvc.m_should_be_relayed)
+      {
         newtxs.push_back(std::move(arg.txs[i]));
+        newtx_hashes.push_back(tvc.m_tx_hash);
+      }
     }
     arg.txs = std::move(newtxs);
 
     if(arg.txs.size())
     {
-      //TODO: add announce usage here
-      relay_transactions(arg, context);
+      relay_transactions(arg, newtx_hashes, context);
+    }
+
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTION_HASHES (" << arg.tx_hashes.size() << " txes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    // same as for NOTIFY_NEW_TRANSACTIONS, we don't need those while syncing
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new tx hashes while syncing, ignored");
+      return 1;
     }
 
+    if (arg.tx_hashes.size() > MAX_TX_HASHES_PER_NOTIFY)
+    {
+      LOG_ERROR_CCONTEXT("Too many tx hashes announced (" << arg.tx_hashes.size() << "), dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // only ask for the txes we don't have, and which no other peer is
+    // already sending us
+    NOTIFY_REQUEST_TRANSACTIONS::request req;
+    const time_t now = time(NULL);
+    for (const crypto::hash &tx_hash: arg.tx_hashes)
+    {
+      if (m_core.pool_has_tx(tx_hash))
+        continue;
+      boost::unique_lock<boost::mutex> lock(m_requested_txes_lock);
+      const auto ins = m_requested_txes.emplace(tx_hash, requested_tx());
+      requested_tx &requested = ins.first->second;
+      if (!ins.second)
+      {
+        const bool timed_out = now - requested.time >= TX_REQUEST_TIMEOUT;
+        if (timed_out)
+          m_missed_txes.emplace(tx_hash, now);
+        // the best announcer is asked next by retry_requested_txes, so a peer
+        // announcing it again cannot jump ahead of the ones already waiting
+        if (!timed_out || !requested.announcers.empty())
+        {
+          if (requested.peer != context.m_connection_id)
+            add_tx_announcer(requested.announcers, context);
+          continue;
+        }
+      }
+      requested.time = now;
+      requested.peer = context.m_connection_id;
+      req.tx_hashes.push_back(tx_hash);
+    }
+
+    if (!req.tx_hashes.empty())
+    {
+      MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_TRANSACTIONS: tx_hashes.size()=" << req.tx_hashes.size());
+      post_notify<NOTIFY_REQUEST_TRANSACTIONS>(req, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_TRANSACTIONS (" << arg.tx_hashes.size() << " txes)");
+    if (arg.tx_hashes.size() > MAX_TX_HASHES_PER_NOTIFY)
+    {
+      LOG_ERROR_CCONTEXT("Too many txes requested (" << arg.tx_hashes.size() << "), dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // txes which left the pool since they were announced are just skipped,
+    // the peer will get them with the block
+    NOTIFY_NEW_TRANSACTIONS::request rsp;
+    for (const crypto::hash &tx_hash: arg.tx_hashes)
+    {
+      cryptonote::blobdata tx_blob;
+      if (m_core.get_relayable_pool_transaction(tx_hash, tx_blob))
+        rsp.txs.push_back(std::move(tx_blob));
+    }
+
+    if (!rsp.txs.empty())
+    {
+      MLOG_P2P_MESSAGE("-->>NOTIFY_NEW_TRANSACTIONS: txs.size()=" << rsp.txs.size());
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(rsp, context);
+    }
     return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -879,7 +1094,7 @@ namespace cryptonote
   int t_cryptonote_protocol_handler<t_core>::handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_GET_OBJECTS (" << arg.blocks.size() << " blocks, " << arg.txs.size() << " txes)");
-    NOTIFY_RESPONSE_GET_OBJECTS::request rsp;
+    NOTIFY_RESPONSE_GET_OBJECTS::shared_request rsp;
     if(!m_core.handle_get_objects(arg, rsp, context))
     {
       LOG_ERROR_CCONTEXT("failed to handle request NOTIFY_REQUEST_GET_OBJECTS, dropping connection");
@@ -1177,6 +1392,25 @@ namespace cryptonote
 
           m_core.prepare_handle_incoming_blocks(blocks);
 
+          // hash the PoW of the following span while this one is verified and committed
+          if (start_height == previous_height)
+          {
+            const uint64_t next_height = start_height + blocks.size();
+            // the span stays queued, only its block blobs are copied, not the txes
+            std::vector<cryptonote::blobdata> next_blocks;
+            m_block_queue.foreach([next_height, &next_blocks](const block_queue::span &span) {
+              if (span.start_block_height != next_height)
+                return span.start_block_height < next_height;
+              next_blocks.reserve(span.blocks.size());
+              for (const auto &entry: span.blocks)
+                next_blocks.push_back(entry.block);
+              return false;
+            });
+            block next_block;
+            if (!next_blocks.empty() && parse_and_validate_block_from_blob(next_blocks.front(), next_block) && next_block.prev_id == last_block_hash)
+              m_core.prehash_incoming_blocks(next_height, next_blocks);
+          }
+
           uint64_t block_process_time_full = 0, transactions_process_time_full = 0;
           size_t num_txs = 0;
           for(const block_complete_entry& block_entry: blocks)
@@ -1374,10 +1608,90 @@ skip:
     m_idle_peer_kicker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::kick_idle_peers, this));
     m_standby_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::check_standby_peers, this));
     m_sync_search_checker.do_call(boost::bind(&t_cryptonote_protocol_handler<t_core>::update_sync_search, this));
+    m_requested_txes_checker.do_call([this]() { return retry_requested_txes(time(NULL)); });
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::retry_requested_txes(time_t now)
+  {
+    std::map<boost::uuids::uuid, NOTIFY_REQUEST_TRANSACTIONS::request> requests;
+    {
+      boost::unique_lock<boost::mutex> lock(m_requested_txes_lock);
+      for (auto it = m_requested_txes.begin(); it != m_requested_txes.end(); )
+      {
+        requested_tx &requested = it->second;
+        if (now - requested.time < TX_REQUEST_TIMEOUT)
+        {
+          ++it;
+          continue;
+        }
+        if (m_core.pool_has_tx(it->first))
+        {
+          it = m_requested_txes.erase(it);
+          continue;
+        }
+        // the peer asked did not send it, the best other one which announced it is asked
+        m_missed_txes.emplace(it->first, now);
+        if (requested.announcers.empty())
+        {
+          it = m_requested_txes.erase(it);
+          continue;
+        }
+        requested.time = now;
+        requested.peer = requested.announcers.front().id;
+        requested.announcers.erase(requested.announcers.begin());
+        requests[requested.peer].tx_hashes.push_back(it->first);
+        ++it;
+      }
+
+      for (auto it = m_missed_txes.begin(); it != m_missed_txes.end(); )
+      {
+        if (now - it->second >= MISSED_TX_RELAY_TIME)
+          it = m_missed_txes.erase(it);
+        else
+          ++it;
+      }
+    }
+
+    // a peer gone meanwhile is skipped, its txes move on at the next timeout
+    for (auto &e: requests)
+    {
+      m_p2p->for_connection(e.first, [&](cryptonote_connection_context &context, nodetool::peerid_type peer_id, uint32_t support_flags)->bool {
+        MLOG_P2P_MESSAGE("-->>NOTIFY_REQUEST_TRANSACTIONS: tx_hashes.size()=" << e.second.tx_hashes.size() << " (asked from another peer first)");
+        post_notify<NOTIFY_REQUEST_TRANSACTIONS>(e.second, context);
+        return true;
+      });
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::add_tx_announcer(std::vector<tx_announcer> &announcers, const cryptonote_connection_context &context)
+  {
+    // outbound peers first, then the longest connected ones: those are the
+    // hardest for a single party to place many of, so cheap inbound connections
+    // can neither be asked before them nor push them out of the capped list
+    for (const tx_announcer &announcer: announcers)
+      if (announcer.id == context.m_connection_id)
+        return;
+    const tx_announcer candidate{context.m_connection_id, !context.m_is_income, context.m_started};
+    const auto better = [](const tx_announcer &a, const tx_announcer &b) {
+      if (a.outbound != b.outbound)
+        return a.outbound;
+      return a.since < b.since;
+    };
+    const size_t pos = std::upper_bound(announcers.begin(), announcers.end(), candidate, better) - announcers.begin();
+    if (announcers.size() >= MAX_TX_ANNOUNCERS)
+    {
+      if (pos == announcers.size())
+        return;
+      announcers.pop_back();
+    }
+    announcers.insert(announcers.begin() + pos, candidate);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::kick_idle_peers()
   {
     MTRACE("Checking for idle peers...");
@@ -1506,6 +1820,13 @@ skip:
           return true;
         }
 
+        // don't wait for the threshold if the peer is well behind what it was measured at, and we'd be quicker
+        if (m_block_queue.is_next_span_late(blockchain_height, context.m_connection_id, now))
+        {
+          MDEBUG(context << " we should download it as it's late for the peer downloading it");
+          return true;
+        }
+
         // in standby, be ready to double download early since we're idling anyway
         // let the fastest peer trigger first
         long threshold;
@@ -2104,6 +2425,12 @@ skip:
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context)
+  {
+    return relay_block(arg, exclude_context, std::unordered_set<crypto::hash>());
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context, const std::unordered_set<crypto::hash> &prefill_txes)
   {
     NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
     fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
@@ -2111,13 +2438,18 @@ skip:
     fluffy_arg.b = arg.b;
     fluffy_arg.b.txs = fluffy_txs;
 
-    // sort peers between fluffy ones and others
-    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // sort peers between compact ones, fluffy ones and others
+    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> fullConnections, fluffyConnections, compactConnections;
+    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id && context.m_remote_address.get_zone() == epee::net_utils::zone::public_)
       {
-        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+        {
+          LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING BLOCK WITH SHORT TX IDS");
+          compactConnections.push_back({context.m_remote_address.get_zone(), context.m_connection_id});
+        }
+        else if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
           fluffyConnections.push_back({context.m_remote_address.get_zone(), context.m_connection_id});
@@ -2131,26 +2463,64 @@ skip:
       return true;
     });
 
-    // send fluffy ones first, we want to encourage people to run that
+    // send compact ones first, they're the smallest and we want to encourage people to run that
+    if (!compactConnections.empty())
+    {
+      block b;
+      if (parse_and_validate_block_from_blob(arg.b.block, b))
+      {
+        NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+        compact_arg.block_hash = get_block_hash(b);
+        compact_arg.nonce = crypto::rand<uint64_t>();
+        compact_arg.current_blockchain_height = arg.current_blockchain_height;
+        const crypto::hash key = get_compact_block_key(compact_arg.block_hash, compact_arg.nonce);
+        const bool can_prefill = arg.b.txs.size() == b.tx_hashes.size();
+        compact_arg.short_tx_ids.reserve(b.tx_hashes.size() * SHORT_TX_ID_SIZE);
+        for (size_t i = 0; i < b.tx_hashes.size(); ++i)
+        {
+          if (can_prefill && prefill_txes.count(b.tx_hashes[i]))
+          {
+            compact_arg.prefilled_tx_indices.push_back(i);
+            compact_arg.prefilled_txs.push_back(arg.b.txs[i]);
+          }
+          else
+          {
+            add_short_tx_id(compact_arg.short_tx_ids, get_short_tx_id(key, b.tx_hashes[i]));
+          }
+        }
+        b.tx_hashes.clear();
+        compact_arg.block = block_to_blob(b);
+
+        std::string compactBlob;
+        epee::serialization::store_t_to_binary(compact_arg, compactBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, epee::shared_buffer(std::move(compactBlob)), std::move(compactConnections), get_send_priority(NOTIFY_NEW_COMPACT_BLOCK::ID));
+      }
+      else
+      {
+        MERROR("Failed to parse block to relay, relaying it as a fluffy block");
+        fluffyConnections.insert(fluffyConnections.end(), compactConnections.begin(), compactConnections.end());
+      }
+    }
     if (!fluffyConnections.empty())
     {
       std::string fluffyBlob;
       epee::serialization::store_t_to_binary(fluffy_arg, fluffyBlob);
-      m_p2p->relay_notify_to_list(NOTIFY_NEW_FLUFFY_BLOCK::ID, epee::strspan<uint8_t>(fluffyBlob), std::move(fluffyConnections));
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_FLUFFY_BLOCK::ID, epee::shared_buffer(std::move(fluffyBlob)), std::move(fluffyConnections), get_send_priority(NOTIFY_NEW_FLUFFY_BLOCK::ID));
     }
     if (!fullConnections.empty())
     {
       std::string fullBlob;
       epee::serialization::store_t_to_binary(arg, fullBlob);
-      m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, epee::strspan<uint8_t>(fullBlob), std::move(fluffyConnections));
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, epee::shared_buffer(std::move(fullBlob)), std::move(fullConnections), get_send_priority(NOTIFY_NEW_BLOCK::ID));
     }
 
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
-  bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
+  bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const std::vector<crypto::hash>& tx_hashes, cryptonote_connection_context& exclude_context)
   {
+    CHECK_AND_ASSERT_MES(tx_hashes.size() == arg.txs.size(), false, "Tx hashes do not match the txes to relay");
     const bool hide_tx_broadcast = 1 < m_p2p->get_zone_count() && exclude_context.m_remote_address.get_zone() == epee::net_utils::zone::invalid;
 
     if (hide_tx_broadcast)
@@ -2189,25 +2559,66 @@ skip:
         arg._.resize(arg._.size() - remove);
       // if the size of _ moved enough, we might lose byte in size encoding, we don't care
     }
-    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections;
-    m_p2p->for_each_connection([hide_tx_broadcast, &exclude_context, &connections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // public peers which support it only get the tx hashes, and ask for the
+    // txes they don't have yet. Padded relays keep sending the full txes.
+    std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections, announceConnections;
+    m_p2p->for_each_connection([hide_tx_broadcast, pad_transactions, &exclude_context, &connections, &announceConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       const epee::net_utils::zone current_zone = context.m_remote_address.get_zone();
       const bool broadcast_to_peer = peer_id && (hide_tx_broadcast != bool(current_zone == epee::net_utils::zone::public_)) && exclude_context.m_connection_id != context.m_connection_id;
 
       if (broadcast_to_peer)
-        connections.push_back({current_zone, context.m_connection_id});
+      {
+        if (!pad_transactions && current_zone == epee::net_utils::zone::public_ && (support_flags & P2P_SUPPORT_FLAG_TX_ANNOUNCEMENTS))
+          announceConnections.push_back({current_zone, context.m_connection_id});
+        else
+          connections.push_back({current_zone, context.m_connection_id});
+      }
 
       return true;
     });
 
-    if (connections.empty())
+    if (connections.empty() && announceConnections.empty())
       MERROR("Transaction not relayed - no" << (hide_tx_broadcast ? " privacy": "") << " peers available");
-    else
+    if (!announceConnections.empty())
+    {
+      // txes some peer announced but did not send are pushed in full, so
+      // whoever delayed them here does not delay them at the next hop too
+      NOTIFY_NEW_TRANSACTION_HASHES::request announce_arg;
+      NOTIFY_NEW_TRANSACTIONS::request push_arg;
+      announce_arg.tx_hashes.reserve(arg.txs.size());
+      {
+        boost::unique_lock<boost::mutex> lock(m_requested_txes_lock);
+        for (size_t i = 0; i < arg.txs.size(); ++i)
+        {
+          const auto missed = m_missed_txes.find(tx_hashes[i]);
+          if (missed == m_missed_txes.end())
+          {
+            announce_arg.tx_hashes.push_back(tx_hashes[i]);
+            continue;
+          }
+          push_arg.txs.push_back(arg.txs[i]);
+          m_missed_txes.erase(missed);
+        }
+      }
+      if (!push_arg.txs.empty())
+      {
+        std::string pushBlob;
+        epee::serialization::store_t_to_binary(push_arg, pushBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, epee::shared_buffer(std::move(pushBlob)), announceConnections, get_send_priority(NOTIFY_NEW_TRANSACTIONS::ID));
+      }
+      if (!announce_arg.tx_hashes.empty())
+      {
+        std::string announceBlob;
+        epee::serialization::store_t_to_binary(announce_arg, announceBlob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTION_HASHES::ID, epee::shared_buffer(std::move(announceBlob)), std::move(announceConnections), get_send_priority(NOTIFY_NEW_TRANSACTION_HASHES::ID));
+      }
+    }
+    if (!connections.empty())
     {
       std::string fullBlob;
       epee::serialization::store_t_to_binary(arg, fullBlob);
-      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, epee::strspan<uint8_t>(fullBlob), std::move(connections));
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, epee::shared_buffer(std::move(fullBlob)), std::move(connections), get_send_priority(NOTIFY_NEW_TRANSACTIONS::ID));
     }
     return true;
   }
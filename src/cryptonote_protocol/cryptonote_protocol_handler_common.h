@@ -43,7 +43,7 @@ namespace cryptonote
   struct i_cryptonote_protocol
   {
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context)=0;
-    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)=0;
+    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const std::vector<crypto::hash>& tx_hashes, cryptonote_connection_context& exclude_context)=0;
     //virtual bool request_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)=0;
   };
 
@@ -56,7 +56,7 @@ namespace cryptonote
     {
       return false;
     }
-    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
+    virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, const std::vector<crypto::hash>& tx_hashes, cryptonote_connection_context& exclude_context)
     {
       return false;
     }
@@ -50,6 +50,7 @@ public:
 private:
   cryptonote::core_rpc_server m_server;
   const std::string m_description;
+  const size_t m_threads;
 public:
   t_rpc(
       boost::program_options::variables_map const & vm
@@ -60,6 +61,7 @@ public:
     , const std::string & description
     )
     : m_server{core.get(), p2p.get()}, m_description{description}
+    , m_threads{std::max<size_t>(1, command_line::get_arg(vm, cryptonote::core_rpc_server::arg_rpc_threads))}
   {
     MGINFO("Initializing " << m_description << " RPC server...");
 
@@ -73,7 +75,7 @@ public:
   void run()
   {
     MGINFO("Starting " << m_description << " RPC server...");
-    if (!m_server.run(2, false))
+    if (!m_server.run(m_threads, false))
     {
       throw std::runtime_error("Failed to start " + m_description + " RPC server.");
     }
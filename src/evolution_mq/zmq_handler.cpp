@@ -361,7 +361,7 @@ namespace evolutionMQ
 
     cryptonote::NOTIFY_NEW_TRANSACTIONS::request r;
     r.txs.push_back(tx_blob);
-    m_core.get_protocol()->relay_transactions(r, fake_context);
+    m_core.get_protocol()->relay_transactions(r, {tvc.m_tx_hash}, fake_context);
 
     //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
     res.status = cryptonote::rpc::Message::STATUS_OK;
@@ -40,6 +40,9 @@
 #include "net/error.h"
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage.h"
+#include "storages/portable_storage_bin_reader.h"
+#include "storages/portable_storage_bin_writer.h"
+#include "storages/portable_storage_json_writer.h"
 #include "string_tools.h"
 
 namespace net
@@ -124,7 +127,8 @@ namespace net
         return tor_address{host, porti};
     }
 
-    bool tor_address::_load(epee::serialization::portable_storage& src, epee::serialization::section* hparent)
+    template<typename t_storage>
+    bool tor_address::_load(t_storage& src, typename t_storage::hsection hparent)
     {
         tor_serialized in{};
         if (in._load(src, hparent) && in.host.size() < sizeof(host_) && (in.host == unknown_host || !host_check(in.host).has_error()))
@@ -140,12 +144,20 @@ namespace net
         return false;
     }
 
-    bool tor_address::store(epee::serialization::portable_storage& dest, epee::serialization::section* hparent) const
+    template<typename t_storage>
+    bool tor_address::store(t_storage& dest, typename t_storage::hsection hparent) const
     {
         const tor_serialized out{std::string{host_}, port_};
         return out.store(dest, hparent);
     }
 
+    template bool tor_address::_load(epee::serialization::portable_storage&, epee::serialization::portable_storage::hsection);
+    template bool tor_address::_load(epee::serialization::portable_storage_bin_reader&, epee::serialization::portable_storage_bin_reader::hsection);
+    template bool tor_address::store(epee::serialization::portable_storage&, epee::serialization::portable_storage::hsection) const;
+    template bool tor_address::store(epee::serialization::portable_storage_bin_writer&, epee::serialization::portable_storage_bin_writer::hsection) const;
+    template bool tor_address::store(epee::serialization::portable_storage_entry_counter&, epee::serialization::portable_storage_entry_counter::hsection) const;
+    template bool tor_address::store(epee::serialization::portable_storage_json_writer&, epee::serialization::portable_storage_json_writer::hsection) const;
+
     tor_address::tor_address(const tor_address& rhs) noexcept
       : port_(rhs.port_)
     {
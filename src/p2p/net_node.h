@@ -322,9 +322,10 @@ namespace nodetool
     virtual void on_connection_close(p2p_connection_context& context);
     virtual void callback(p2p_connection_context& context);
     //----------------- i_p2p_endpoint -------------------------------------------------------------
-    virtual bool relay_notify_to_list(int command, const epee::span<const uint8_t> data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections);
+    virtual bool relay_notify_to_list(int command, const epee::shared_buffer& data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections, epee::net_utils::send_priority priority);
     virtual bool invoke_command_to_peer(int command, const epee::span<const uint8_t> req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context);
-    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context);
+    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority);
+    virtual bool invoke_notify_to_peer(int command, const std::vector<epee::shared_buffer>& req_pieces, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority);
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context);
     virtual void request_callback(const epee::net_utils::connection_context_base& context);
     virtual void for_each_connection(std::function<bool(typename t_payload_net_handler::connection_context&, peerid_type, uint32_t)> f);
@@ -513,6 +514,7 @@ namespace nodetool
     extern const command_line::arg_descriptor<std::vector<std::string>> arg_proxy;
     extern const command_line::arg_descriptor<std::vector<std::string>> arg_anonymous_inbound;
     extern const command_line::arg_descriptor<bool> arg_p2p_hide_my_port;
+    extern const command_line::arg_descriptor<bool> arg_p2p_io_service_per_thread;
 
     extern const command_line::arg_descriptor<bool> arg_no_igd;
     extern const command_line::arg_descriptor<std::string> arg_igd;
@@ -47,9 +47,11 @@ namespace nodetool
   template<class t_connection_context>
   struct i_p2p_endpoint
   {
-    virtual bool relay_notify_to_list(int command, const epee::span<const uint8_t> data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections)=0;
+    virtual bool relay_notify_to_list(int command, const epee::shared_buffer& data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections, epee::net_utils::send_priority priority)=0;
     virtual bool invoke_command_to_peer(int command, const epee::span<const uint8_t> req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context)=0;
-    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context)=0;
+    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority)=0;
+    //! sends the pieces as one notification, see async_protocol_handler::notify
+    virtual bool invoke_notify_to_peer(int command, const std::vector<epee::shared_buffer>& req_pieces, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority)=0;
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context)=0;
     virtual void request_callback(const epee::net_utils::connection_context_base& context)=0;
     virtual uint64_t get_public_connections_count()=0;
@@ -68,7 +70,7 @@ namespace nodetool
   template<class t_connection_context>
   struct p2p_endpoint_stub: public i_p2p_endpoint<t_connection_context>
   {
-    virtual bool relay_notify_to_list(int command, const epee::span<const uint8_t> data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections)
+    virtual bool relay_notify_to_list(int command, const epee::shared_buffer& data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections, epee::net_utils::send_priority priority)
     {
       return false;
     }
@@ -76,10 +78,17 @@ namespace nodetool
     {
       return false;
     }
-    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context)
+    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority)
     {
       return true;
     }
+    virtual bool invoke_notify_to_peer(int command, const std::vector<epee::shared_buffer>& req_pieces, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority)
+    {
+      std::string req_buff;
+      for (const epee::shared_buffer& piece: req_pieces)
+        req_buff.append(reinterpret_cast<const char*>(piece.data()), piece.size());
+      return invoke_notify_to_peer(command, epee::strspan<uint8_t>(req_buff), context, priority);
+    }
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context)
     {
       return false;
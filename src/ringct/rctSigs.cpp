@@ -1341,13 +1341,69 @@ namespace rct {
       return verRctSemanticsSimple(std::vector<const rctSig*>(1, &rv));
     }
 
-    //ver RingCT simple
-    //assumes only post-rct style inputs (at least for max anonymity)
-    bool verRctNonSemanticsSimple(const rctSig & rv) {
-      try
+    // [start, end) is known to contain at least one bad signature
+    static void bisectRctSemanticsSimple(const std::vector<const rctSig*> & rvv, size_t start, size_t end, std::deque<bool> &valid)
+    {
+      if (end - start == 1)
       {
-        PERF_TIMER(verRctNonSemanticsSimple);
+        valid[start] = false;
+        return;
+      }
+      const size_t mid = start + (end - start) / 2;
+      const bool lower_ok = verRctSemanticsSimple(std::vector<const rctSig*>(rvv.begin() + start, rvv.begin() + mid));
+      if (!lower_ok)
+        bisectRctSemanticsSimple(rvv, start, mid, valid);
+      if (lower_ok || !verRctSemanticsSimple(std::vector<const rctSig*>(rvv.begin() + mid, rvv.begin() + end)))
+        bisectRctSemanticsSimple(rvv, mid, end, valid);
+    }
+
+    //verifies the semantics of many simple rctSigs at once, splitting them into one
+    //aggregate batch per thread, and bisecting any failed batch to find the bad ones
+    bool verRctSemanticsSimpleBatch(const std::vector<const rctSig*> & rvv, std::vector<bool> &valid, size_t min_batch_size)
+    {
+      PERF_TIMER(verRctSemanticsSimpleBatch);
+
+      valid.assign(rvv.size(), true);
+      if (rvv.empty())
+        return true;
+
+      tools::threadpool& tpool = tools::threadpool::getInstance();
+      tools::threadpool::waiter waiter;
+      std::deque<bool> results(rvv.size(), true);
+
+      min_batch_size = std::max<size_t>(min_batch_size, 1);
+      const size_t nbatches = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), rvv.size() / min_batch_size));
+      const size_t batch_size = rvv.size() / nbatches, extra = rvv.size() % nbatches;
+      size_t start = 0;
+      for (size_t b = 0; b < nbatches; ++b)
+      {
+        const size_t end = start + batch_size + (b < extra ? 1 : 0);
+        tpool.submit(&waiter, [&, start, end] {
+          if (!verRctSemanticsSimple(std::vector<const rctSig*>(rvv.begin() + start, rvv.begin() + end)))
+          {
+            LOG_PRINT_L1("Batch " << start << "-" << (end - 1) << " failed semantics check, bisecting");
+            bisectRctSemanticsSimple(rvv, start, end, results);
+          }
+        });
+        start = end;
+      }
+      waiter.wait(&tpool);
+
+      bool ret = true;
+      for (size_t i = 0; i < results.size(); ++i)
+      {
+        valid[i] = results[i];
+        ret &= results[i];
+      }
+      return ret;
+    }
 
+    //gathers the per input MLSAG checks of a simple rctSig without running them,
+    //so callers can run the checks of many transactions as a single task set
+    //the checks reference rv, which must outlive them
+    bool getRctNonSemanticsSimpleChecks(const rctSig & rv, std::vector<std::function<bool()>> &checks) {
+      try
+      {
         CHECK_AND_ASSERT_MES(rv.type == RCTTypeSimple || rv.type == RCTTypeBulletproof || rv.type == RCTTypeSimpleBulletproof, false, "verRctNonSemanticsSimple called on non simple rctSig");
         const bool bulletproof = is_rct_bulletproof(rv.type);
         // semantics check is early, and mixRing/MGs aren't resolved yet
@@ -1355,22 +1411,52 @@ namespace rct {
           CHECK_AND_ASSERT_MES(rv.p.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.pseudoOuts and mixRing");
         else
           CHECK_AND_ASSERT_MES(rv.pseudoOuts.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.pseudoOuts and mixRing");
-
-        const size_t threads = std::max(rv.outPk.size(), rv.mixRing.size());
-
-        std::deque<bool> results(threads);
-        tools::threadpool& tpool = tools::threadpool::getInstance();
-        tools::threadpool::waiter waiter;
+        CHECK_AND_ASSERT_MES(rv.p.MGs.size() == rv.mixRing.size(), false, "Mismatched sizes of rv.p.MGs and mixRing");
 
         const keyV &pseudoOuts = bulletproof ? rv.p.pseudoOuts : rv.pseudoOuts;
 
         const key message = get_pre_mlsag_hash(rv, hw::get_device("default"));
 
-        results.clear();
-        results.resize(rv.mixRing.size());
+        checks.reserve(checks.size() + rv.mixRing.size());
         for (size_t i = 0 ; i < rv.mixRing.size() ; i++) {
+          checks.push_back([&rv, &pseudoOuts, message, i] {
+              return verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
+          });
+        }
+
+        return true;
+      }
+      // we can get deep throws from ge_frombytes_vartime if input isn't valid
+      catch (const std::exception &e)
+      {
+        LOG_PRINT_L1("Error in getRctNonSemanticsSimpleChecks: " << e.what());
+        return false;
+      }
+      catch (...)
+      {
+        LOG_PRINT_L1("Error in getRctNonSemanticsSimpleChecks, but not an actual exception");
+        return false;
+      }
+    }
+
+    //ver RingCT simple
+    //assumes only post-rct style inputs (at least for max anonymity)
+    bool verRctNonSemanticsSimple(const rctSig & rv) {
+      try
+      {
+        PERF_TIMER(verRctNonSemanticsSimple);
+
+        std::vector<std::function<bool()>> checks;
+        if (!getRctNonSemanticsSimpleChecks(rv, checks))
+          return false;
+
+        std::deque<bool> results(checks.size());
+        tools::threadpool& tpool = tools::threadpool::getInstance();
+        tools::threadpool::waiter waiter;
+
+        for (size_t i = 0 ; i < checks.size() ; i++) {
           tpool.submit(&waiter, [&, i] {
-              results[i] = verRctMGSimple(message, rv.p.MGs[i], rv.mixRing[i], pseudoOuts[i]);
+              results[i] = checks[i]();
           });
         }
         waiter.wait(&tpool);
@@ -38,6 +38,7 @@
 #define RCTSIGS_H
 
 #include <cstddef>
+#include <functional>
 #include <vector>
 #include <tuple>
 
@@ -131,9 +132,11 @@ namespace rct {
     static inline bool verRct(const rctSig & rv) { return verRct(rv, true) && verRct(rv, false); }
     bool verRctSemanticsSimple(const rctSig & rv);
     bool verRctSemanticsSimple(const std::vector<const rctSig*> & rv);
+    bool verRctSemanticsSimpleBatch(const std::vector<const rctSig*> & rv, std::vector<bool> &valid, size_t min_batch_size = 16);
     bool verRctSemanticsSimple_old(const rctSig & rv);
     bool verRctSemanticsSimple_old(const std::vector<const rctSig*> & rv);
     bool verRctNonSemanticsSimple(const rctSig & rv);
+    bool getRctNonSemanticsSimpleChecks(const rctSig & rv, std::vector<std::function<bool()>> &checks);
     static inline bool verRctSimple(const rctSig & rv) { return verRctSemanticsSimple(rv) && verRctNonSemanticsSimple(rv); }
     xmr_amount decodeRct(const rctSig & rv, const key & sk, unsigned int i, key & mask, hw::device &hwdev);
     xmr_amount decodeRct(const rctSig & rv, const key & sk, unsigned int i, hw::device &hwdev);
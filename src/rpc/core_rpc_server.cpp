@@ -133,6 +133,8 @@ namespace cryptonote
     command_line::add_arg(desc, arg_rpc_payment_address);
     command_line::add_arg(desc, arg_rpc_payment_difficulty);
     command_line::add_arg(desc, arg_rpc_payment_credits);
+    command_line::add_arg(desc, arg_rpc_threads);
+    command_line::add_arg(desc, arg_rpc_io_service_per_thread);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(
@@ -157,6 +159,7 @@ namespace cryptonote
   {
     m_restricted = restricted;
     m_net_server.set_threads_prefix("RPC");
+    m_net_server.set_io_service_per_thread(command_line::get_arg(vm, arg_rpc_io_service_per_thread));
 
     auto rpc_config = cryptonote::rpc_args::process(vm, true);
     if (!rpc_config)
@@ -394,11 +397,11 @@ namespace cryptonote
     END_SERIALIZE()
   };
   //------------------------------------------------------------------------------------------------------------------------------
-  bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res, const connection_context *ctx)
+  bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST_SHARED::request& req, COMMAND_RPC_GET_BLOCKS_FAST_SHARED::response& res, const connection_context *ctx)
   {
     RPC_TRACKER(get_blocks);
     bool r;
-    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_FAST>(invoke_http_mode::BIN, "/getblocks.bin", req, res, r))
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_FAST_SHARED>(invoke_http_mode::BIN, "/getblocks.bin", req, res, r))
       return r;
 
     CHECK_PAYMENT(req, res, 1);
@@ -444,9 +447,9 @@ namespace cryptonote
     for(auto& bd: bs)
     {
       res.blocks.resize(res.blocks.size()+1);
-      res.blocks.back().block = bd.first.first;
       pruned_size += bd.first.first.size();
       unpruned_size += bd.first.first.size();
+      res.blocks.back().block = epee::shared_buffer(std::move(bd.first.first));
       res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
       ntxes += bd.second.size();
       res.output_indices.back().indices.reserve(1 + bd.second.size());
@@ -456,9 +459,7 @@ namespace cryptonote
       for (std::vector<std::pair<crypto::hash, cryptonote::blobdata>>::iterator i = bd.second.begin(); i != bd.second.end(); ++i)
       {
         unpruned_size += i->second.size();
-        res.blocks.back().txs.push_back(std::move(i->second));
-        i->second.clear();
-        i->second.shrink_to_fit();
+        res.blocks.back().txs.emplace_back(std::move(i->second));
         pruned_size += res.blocks.back().txs.back().size();
       }
 
@@ -1034,7 +1035,7 @@ namespace cryptonote
 
     NOTIFY_NEW_TRANSACTIONS::request r;
     r.txs.push_back(tx_blob);
-    m_core.get_protocol()->relay_transactions(r, fake_context);
+    m_core.get_protocol()->relay_transactions(r, {tvc.m_tx_hash}, fake_context);
     //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -1680,7 +1681,7 @@ namespace cryptonote
     response.reward = get_block_reward(blk);
     response.block_size = response.block_weight = m_core.get_blockchain_storage().get_db().get_block_weight(height);
     response.num_txes = blk.tx_hashes.size();
-    response.pow_hash = fill_pow_hash ? string_tools::pod_to_hex(get_block_longhash(&(m_core.get_blockchain_storage()), blk, height, 0)) : "";
+    response.pow_hash = fill_pow_hash ? string_tools::pod_to_hex(m_core.get_blockchain_storage().get_block_pow_hash(hash, blk, height)) : "";
 	 response.long_term_weight = m_core.get_blockchain_storage().get_db().get_block_long_term_weight(height);
     return true;
   }
@@ -2323,6 +2324,8 @@ namespace cryptonote
 
     CHECK_PAYMENT(req, res, COST_PER_FEE_ESTIMATE);
     res.fee = m_core.get_blockchain_storage().get_dynamic_base_fee_estimate(req.grace_blocks);
+    if (req.pool_aware)
+      res.fee = m_core.get_pool_backlog_fee_estimate(res.fee);
     res.quantization_mask = Blockchain::get_fee_quantization_mask();
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -2581,7 +2584,7 @@ namespace cryptonote
         cryptonote_connection_context fake_context = AUTO_VAL_INIT(fake_context);
         NOTIFY_NEW_TRANSACTIONS::request r;
         r.txs.push_back(txblob);
-        m_core.get_protocol()->relay_transactions(r, fake_context);
+        m_core.get_protocol()->relay_transactions(r, {txid}, fake_context);
         //TODO: make sure that tx has reached other nodes here, probably wait to receive reflections from other nodes
       }
       else
@@ -2652,6 +2655,31 @@ namespace cryptonote
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_txpool_fee_histogram(const COMMAND_RPC_GET_TRANSACTION_POOL_FEE_HISTOGRAM::request& req, COMMAND_RPC_GET_TRANSACTION_POOL_FEE_HISTOGRAM::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
+  {
+    RPC_TRACKER(get_txpool_fee_histogram);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_TRANSACTION_POOL_FEE_HISTOGRAM>(invoke_http_mode::JON_RPC, "get_txpool_fee_histogram", req, res, r))
+      return r;
+    CHECK_PAYMENT(req, res, COST_PER_TX_POOL_STATS);
+
+    const bool restricted = m_restricted && ctx;
+    const bool request_has_rpc_origin = ctx != NULL;
+    fee_rate_histogram histogram;
+    m_core.get_pool_fee_histogram(histogram, !request_has_rpc_origin || !restricted);
+    for (size_t i = 0; i < histogram.bins().size(); ++i)
+    {
+      const fee_rate_histogram::bin &bin = histogram.bins()[i];
+      if (bin.txs)
+        res.bins.push_back({fee_rate_histogram::bin_lower_bound(i), bin.txs, bin.weight, bin.fee});
+    }
+    res.txs_total = histogram.txs();
+    res.weight_total = histogram.weight();
+
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_output_distribution(const COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request& req, COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response& res, epee::json_rpc::error& error_resp, const connection_context *ctx)
   {
     RPC_TRACKER(get_output_distribution);
@@ -3046,4 +3074,16 @@ namespace cryptonote
     , "Restrict RPC to clients sending micropayment, yields that many credits per payment"
     , DEFAULT_PAYMENT_CREDITS_PER_HASH
     };
+
+  const command_line::arg_descriptor<uint32_t> core_rpc_server::arg_rpc_threads = {
+      "rpc-threads"
+    , "Number of threads for each RPC server"
+    , 2
+    };
+
+  const command_line::arg_descriptor<bool> core_rpc_server::arg_rpc_io_service_per_thread = {
+      "rpc-io-service-per-thread"
+    , "Give each RPC thread its own io_service and spread connections over them"
+    , false
+    };
 }  // namespace cryptonote
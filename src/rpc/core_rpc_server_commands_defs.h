@@ -90,7 +90,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 3
-#define CORE_RPC_VERSION_MINOR 3
+#define CORE_RPC_VERSION_MINOR 4
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -198,9 +198,10 @@ namespace cryptonote
       END_KV_SERIALIZE_MAP()
     };
 
-    struct response_t: public rpc_access_response_base
+    template<class t_block_entry>
+    struct response_base_t: public rpc_access_response_base
     {
-      std::vector<block_complete_entry> blocks;
+      std::vector<t_block_entry> blocks;
       uint64_t    start_height;
       uint64_t    current_height;
       std::vector<block_output_indices> output_indices;
@@ -213,7 +214,14 @@ namespace cryptonote
         KV_SERIALIZE(output_indices)
       END_KV_SERIALIZE_MAP()
     };
-    typedef epee::misc_utils::struct_init<response_t> response;
+    typedef epee::misc_utils::struct_init<response_base_t<block_complete_entry>> response;
+  };
+
+  //! COMMAND_RPC_GET_BLOCKS_FAST as the daemon answers it, see shared_block_complete_entry
+  struct COMMAND_RPC_GET_BLOCKS_FAST_SHARED
+  {
+    typedef COMMAND_RPC_GET_BLOCKS_FAST::request request;
+    typedef epee::misc_utils::struct_init<COMMAND_RPC_GET_BLOCKS_FAST::response_base_t<shared_block_complete_entry>> response;
   };
 
   struct COMMAND_RPC_GET_BLOCKS_BY_HEIGHT
@@ -1470,6 +1478,47 @@ namespace cryptonote
     typedef epee::misc_utils::struct_init<response_t> response;
   };
 
+  struct txpool_fee_histogram_bin
+  {
+    double fee_per_byte; // the bin's lower bound, bounds are not whole numbers
+    uint64_t txs;
+    uint64_t weight;
+    uint64_t fee;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(fee_per_byte)
+      KV_SERIALIZE(txs)
+      KV_SERIALIZE(weight)
+      KV_SERIALIZE(fee)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct COMMAND_RPC_GET_TRANSACTION_POOL_FEE_HISTOGRAM
+  {
+    struct request_t: public rpc_access_request_base
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_access_request_base)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<request_t> request;
+
+    struct response_t: public rpc_access_response_base
+    {
+      std::vector<txpool_fee_histogram_bin> bins; // non empty ones, by increasing fee per byte
+      uint64_t txs_total;
+      uint64_t weight_total;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_PARENT(rpc_access_response_base)
+        KV_SERIALIZE(bins)
+        KV_SERIALIZE(txs_total)
+        KV_SERIALIZE(weight_total)
+      END_KV_SERIALIZE_MAP()
+    };
+    typedef epee::misc_utils::struct_init<response_t> response;
+  };
+
   struct txpool_histo
   {
     uint32_t txs;
@@ -2073,10 +2122,12 @@ struct request_t: public rpc_access_request_base
     struct request_t: public rpc_access_request_base
     {
       uint64_t grace_blocks;
+      bool pool_aware;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE_PARENT(rpc_access_request_base)
         KV_SERIALIZE(grace_blocks)
+        KV_SERIALIZE_OPT(pool_aware, false)
       END_KV_SERIALIZE_MAP()
     };
     typedef epee::misc_utils::struct_init<request_t> request;
@@ -0,0 +1,195 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+// Measures levin request/response throughput against a local server, once
+// with all server threads sharing one io_service and once with an io_service
+// per thread. Usage: net_load_tests_bench [connections] [requests per connection] [threads]
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+#include "common/util.h"
+
+#include "net_load_tests.h"
+
+using namespace net_load_tests;
+
+namespace
+{
+  const std::string bench_port("36232");
+  const int cmd_bench_id = 73600;
+  const size_t bench_request_size = 256;
+  const size_t bench_timeout_ms = 120000;
+
+  struct bench_state
+  {
+    test_tcp_server* client;
+    std::string request;
+    std::atomic<size_t> finished_connections;
+    std::atomic<size_t> error_count;
+  };
+
+  // Sends the next request on a connection when the previous one is answered
+  struct bench_pinger
+  {
+    bench_state* state;
+    size_t remaining;
+
+    void operator()(int code, const epee::span<const uint8_t> /*buff*/, test_connection_context& context) const
+    {
+      if (code < 0)
+      {
+        ++state->error_count;
+        ++state->finished_connections;
+        return;
+      }
+      if (remaining == 0)
+      {
+        ++state->finished_connections;
+        return;
+      }
+      send(*state, context.m_connection_id, remaining - 1);
+    }
+
+    static void send(bench_state& state, const boost::uuids::uuid& connection_id, size_t remaining)
+    {
+      const epee::span<const uint8_t> in_buff = epee::strspan<uint8_t>(state.request);
+      const bench_pinger next{&state, remaining};
+      if (state.client->get_config_object().invoke_async(cmd_bench_id, in_buff, connection_id, next) < 0)
+      {
+        ++state.error_count;
+        ++state.finished_connections;
+      }
+    }
+  };
+
+  bool run_bench(bool io_service_per_thread, size_t connection_count, size_t request_count, size_t thread_count, double& requests_per_second)
+  {
+    test_levin_commands_handler srv_handler;
+    test_tcp_server srv(epee::net_utils::e_connection_type_RPC);
+    srv.set_io_service_per_thread(io_service_per_thread);
+    srv.get_config_object().set_handler(&srv_handler);
+    if (!srv.init_server(bench_port, "127.0.0.1") || !srv.run_server(thread_count, false))
+      return false;
+
+    test_levin_commands_handler clt_handler;
+    test_tcp_server clt(epee::net_utils::e_connection_type_RPC);
+    clt.set_io_service_per_thread(true);
+    clt.get_config_object().set_handler(&clt_handler);
+    clt.get_config_object().m_invoke_timeout = bench_timeout_ms;
+    if (!clt.run_server(thread_count, false))
+      return false;
+
+    std::vector<boost::uuids::uuid> connections;
+    for (size_t i = 0; i < connection_count; ++i)
+    {
+      test_connection_context context;
+      if (!clt.connect("127.0.0.1", bench_port, bench_timeout_ms, context, "127.0.0.1", epee::net_utils::ssl_support_t::e_ssl_support_disabled))
+        return false;
+      connections.push_back(context.m_connection_id);
+    }
+
+    bench_state state;
+    state.client = &clt;
+    state.request.assign(bench_request_size, 'x');
+    state.finished_connections = 0;
+    state.error_count = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (const boost::uuids::uuid& connection_id: connections)
+      bench_pinger::send(state, connection_id, request_count - 1);
+    const auto deadline = start + std::chrono::milliseconds(bench_timeout_ms);
+    while (state.finished_connections < connection_count && std::chrono::steady_clock::now() < deadline)
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    clt.send_stop_signal();
+    clt.timed_wait_server_stop(10000);
+    srv.send_stop_signal();
+    srv.timed_wait_server_stop(10000);
+
+    if (state.finished_connections < connection_count || state.error_count > 0)
+    {
+      LOG_PRINT_L0("ERROR: " << state.finished_connections << " of " << connection_count << " connections finished, " << state.error_count << " errors");
+      return false;
+    }
+    requests_per_second = connection_count * request_count / seconds;
+    return true;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  tools::on_startup();
+  mlog_configure(mlog_get_default_log_path("net_load_tests_bench.log"), true);
+  mlog_set_log_level(0);
+
+  size_t connection_count = 64;
+  size_t request_count = 500;
+  size_t thread_count = (std::max)(min_thread_count, boost::thread::hardware_concurrency());
+  try
+  {
+    if (argc > 1)
+      connection_count = boost::lexical_cast<size_t>(argv[1]);
+    if (argc > 2)
+      request_count = boost::lexical_cast<size_t>(argv[2]);
+    if (argc > 3)
+      thread_count = boost::lexical_cast<size_t>(argv[3]);
+  }
+  catch (const boost::bad_lexical_cast&)
+  {
+    std::cerr << "Usage: " << argv[0] << " [connections] [requests per connection] [threads]" << std::endl;
+    return 1;
+  }
+  if (connection_count == 0 || request_count == 0 || thread_count == 0)
+  {
+    std::cerr << "connections, requests and threads must be positive" << std::endl;
+    return 1;
+  }
+
+  std::cout << connection_count << " connections, " << request_count << " requests each, " << thread_count << " threads" << std::endl;
+  for (bool io_service_per_thread: {false, true})
+  {
+    double requests_per_second = 0;
+    if (!run_bench(io_service_per_thread, connection_count, request_count, thread_count, requests_per_second))
+    {
+      std::cerr << "Benchmark failed" << std::endl;
+      return 2;
+    }
+    std::cout << (io_service_per_thread ? "io_service per thread: " : "shared io_service:     ")
+      << static_cast<uint64_t>(requests_per_second) << " requests/s" << std::endl;
+  }
+  return 0;
+}
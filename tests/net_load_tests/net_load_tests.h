@@ -33,6 +33,7 @@
 #include <atomic>
 
 #include <boost/asio/io_service.hpp>
+#include <boost/uuid/uuid_io.hpp>
 
 #include "include_base_utils.h"
 #include "string_tools.h"
@@ -62,7 +63,7 @@ namespace net_load_tests
     {
     }
 
-    virtual int invoke(int command, const std::string& in_buff, std::string& buff_out, test_connection_context& context)
+    virtual int invoke(int command, const epee::span<const uint8_t> in_buff, std::string& buff_out, test_connection_context& context)
     {
       //m_invoke_counter.inc();
       //std::unique_lock<std::mutex> lock(m_mutex);
@@ -73,7 +74,7 @@ namespace net_load_tests
       return LEVIN_OK;
     }
 
-    virtual int notify(int command, const std::string& in_buff, test_connection_context& context)
+    virtual int notify(int command, const epee::span<const uint8_t> in_buff, test_connection_context& context)
     {
       //m_notify_counter.inc();
       //std::unique_lock<std::mutex> lock(m_mutex);
@@ -47,10 +47,12 @@
 #include "generate_key_image_helper.h"
 #include "generate_keypair.h"
 #include "is_out_to_acc.h"
+#include "portable_storage.h"
 #include "subaddress_expand.h"
 #include "sc_reduce32.h"
 #include "cn_fast_hash.h"
 #include "rct_mlsag.h"
+#include "tx_selection.h"
 
 namespace po = boost::program_options;
 
@@ -170,6 +172,16 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE3(filter, test_ringct_mlsag, 1, 10, true);
   TEST_PERFORMANCE3(filter, test_ringct_mlsag, 1, 100, true);
 
+  TEST_PERFORMANCE2(filter, test_tx_selection, 100, false);
+  TEST_PERFORMANCE2(filter, test_tx_selection, 100, true);
+  TEST_PERFORMANCE2(filter, test_tx_selection, 1000, false);
+  TEST_PERFORMANCE2(filter, test_tx_selection, 1000, true);
+
+  TEST_PERFORMANCE2(filter, test_load_from_binary, 20, false);
+  TEST_PERFORMANCE2(filter, test_load_from_binary, 20, true);
+  TEST_PERFORMANCE2(filter, test_load_from_binary, 1000, false);
+  TEST_PERFORMANCE2(filter, test_load_from_binary, 1000, true);
+
   std::cout << "Tests finished. Elapsed time: " << timer.elapsed_ms() / 1000 << " sec" << std::endl;
 
   return 0;
@@ -0,0 +1,72 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <string>
+
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "storages/portable_storage_template_helper.h"
+
+// decodes a NOTIFY_RESPONSE_GET_OBJECTS message of n_blocks blocks with a few
+// txes each, through a portable_storage section tree or streamed straight
+// into the struct
+template<size_t n_blocks, bool stream>
+class test_load_from_binary
+{
+public:
+  static const size_t loop_count = 100;
+
+  bool init()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+    r.current_blockchain_height = 1000000;
+    for (size_t i = 0; i < n_blocks; ++i)
+    {
+      cryptonote::block_complete_entry b;
+      b.block = std::string(400, 'b');
+      b.txs.resize(i % 8, std::string(2000, 't'));
+      r.blocks.push_back(std::move(b));
+    }
+    r.missed_ids.resize(16);
+    return epee::serialization::store_t_to_binary(r, m_blob);
+  }
+
+  bool test()
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+    if (stream)
+      return epee::serialization::load_t_from_binary(r, m_blob) && r.blocks.size() == n_blocks;
+    epee::serialization::portable_storage ps;
+    return ps.load_from_binary(m_blob) && r.load(ps) && r.blocks.size() == n_blocks;
+  }
+
+private:
+  std::string m_blob;
+};
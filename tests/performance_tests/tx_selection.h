@@ -0,0 +1,103 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_core/tx_selection.h"
+
+// fills a block from a pool holding several blocks worth of transactions,
+// greedily in fee per byte order as the tx pool does, then improves it
+template<size_t n_txes, bool improve>
+class test_tx_selection
+{
+public:
+  static const size_t loop_count = 100;
+  static const size_t median_weight = 300000;
+  static const uint8_t version = 12;
+
+  bool init()
+  {
+    uint64_t base_reward;
+    if (!cryptonote::get_block_reward(median_weight, 0, 0, base_reward, version))
+      return false;
+
+    // fees per byte around what makes a full block in the penalty zone break even
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<uint64_t> weight(1500, 60000);
+    std::uniform_real_distribution<double> density(0.05, 1.5);
+    m_items.resize(n_txes);
+    for (cryptonote::tx_selection_item &item: m_items)
+    {
+      item.weight = weight(rng);
+      item.fee = item.weight * density(rng) * base_reward / median_weight;
+      item.selected = false;
+    }
+    std::sort(m_items.begin(), m_items.end(), [](const cryptonote::tx_selection_item &a, const cryptonote::tx_selection_item &b) {
+      return a.fee / (double)a.weight > b.fee / (double)b.weight;
+    });
+    return true;
+  }
+
+  bool test()
+  {
+    std::vector<cryptonote::tx_selection_item> items = m_items;
+    const uint64_t max_total_weight = 2 * median_weight - CRYPTONOTE_COINBASE_BLOB_RESERVED_SIZE;
+    uint64_t total_weight = 0, fee = 0, best_coinbase, reward;
+    cryptonote::get_block_reward(median_weight, 0, 0, best_coinbase, version);
+    for (cryptonote::tx_selection_item &item: items)
+    {
+      if (total_weight + item.weight > max_total_weight)
+        continue;
+      if (!cryptonote::get_block_reward(median_weight, total_weight + item.weight, 0, reward, version))
+        continue;
+      if (reward + fee + item.fee < best_coinbase)
+        continue;
+      item.selected = true;
+      total_weight += item.weight;
+      fee += item.fee;
+      best_coinbase = reward + fee;
+    }
+
+    if (improve)
+    {
+      cryptonote::improve_tx_selection(items, max_total_weight, [](uint64_t total_weight, uint64_t &reward) {
+        return cryptonote::get_block_reward(median_weight, total_weight, 0, reward, version);
+      }, 100000, 8);
+    }
+    return true;
+  }
+
+private:
+  std::vector<cryptonote::tx_selection_item> m_items;
+};
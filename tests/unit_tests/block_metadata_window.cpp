@@ -0,0 +1,114 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/block_metadata_window.h"
+
+namespace
+{
+  struct fake_chain
+  {
+    std::vector<uint64_t> values;
+    size_t loads = 0;
+
+    cryptonote::block_metadata_column<uint64_t>::loader_t loader()
+    {
+      return [this](uint64_t start_height, size_t count) {
+        ++loads;
+        return std::vector<uint64_t>(values.begin() + start_height, values.begin() + start_height + count);
+      };
+    }
+
+    void add(cryptonote::block_metadata_column<uint64_t> &column)
+    {
+      values.push_back(values.size() * 10);
+      column.push_back_or_clear(values.size() - 1, values.back());
+    }
+
+    void pop(cryptonote::block_metadata_column<uint64_t> &column)
+    {
+      values.pop_back();
+      column.pop_back_or_clear(values.size());
+    }
+  };
+}
+
+TEST(block_metadata_window, follows_chain_without_reloading)
+{
+  fake_chain chain;
+  cryptonote::block_metadata_column<uint64_t> column(10);
+  for (int i = 0; i < 100; ++i)
+    chain.add(column);
+
+  epee::span<const uint64_t> values = column.get(95, 5, 100, chain.loader());
+  ASSERT_EQ(chain.loads, 1u);
+  ASSERT_EQ(values.size(), 5u);
+  ASSERT_EQ(values[0], 950u);
+
+  for (int i = 0; i < 30; ++i)
+    chain.add(column);
+  values = column.get(120, 10, 130, chain.loader());
+  ASSERT_EQ(values[9], 1290u);
+
+  chain.pop(column);
+  chain.pop(column);
+  values = column.get(118, 10, 128, chain.loader());
+  ASSERT_EQ(values[9], 1270u);
+  ASSERT_EQ(chain.loads, 1u);
+}
+
+TEST(block_metadata_window, old_ranges_keep_window)
+{
+  fake_chain chain;
+  cryptonote::block_metadata_column<uint64_t> column(10);
+  for (int i = 0; i < 100; ++i)
+    chain.add(column);
+
+  column.get(90, 10, 100, chain.loader());
+  epee::span<const uint64_t> values = column.get(5, 3, 100, chain.loader());
+  ASSERT_EQ(values[0], 50u);
+  ASSERT_EQ(chain.loads, 2u);
+  column.get(90, 10, 100, chain.loader());
+  ASSERT_EQ(chain.loads, 2u);
+}
+
+TEST(block_metadata_window, reloads_when_out_of_step)
+{
+  fake_chain chain;
+  cryptonote::block_metadata_column<uint64_t> column(10);
+  for (int i = 0; i < 50; ++i)
+    chain.values.push_back(i * 10);
+
+  column.get(40, 10, 50, chain.loader());
+  chain.values.back() = 7;
+  column.push_back_or_clear(48, 7);
+  ASSERT_TRUE(column.empty());
+  ASSERT_EQ(column.get(49, 1, 50, chain.loader())[0], 7u);
+  ASSERT_EQ(chain.loads, 2u);
+}
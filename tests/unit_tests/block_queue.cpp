@@ -85,3 +85,48 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, span_size)
+{
+  cryptonote::block_queue bq;
+  std::vector<crypto::hash> hashes(1000);
+  for (size_t i = 0; i < hashes.size(); ++i)
+    hashes[i].data[0] = i, hashes[i].data[1] = i >> 8;
+
+  // unknown peer, the next span is kept short
+  std::pair<uint64_t, uint64_t> span = bq.reserve_span(1, 1000, 100, uuid1(), 0, 2000, hashes);
+  ASSERT_EQ(span.first, 1u);
+  ASSERT_EQ(span.second, 25u);
+
+  // unknown peer, later span
+  span = bq.reserve_span(1, 1000, 100, uuid1(), 0, 2000, hashes);
+  ASSERT_EQ(span.first, 26u);
+  ASSERT_EQ(span.second, 100u);
+
+  // a slow peer gets less
+  bq.add_blocks(500, std::vector<cryptonote::block_complete_entry>(10), uuid2(), 1000.0f, 10000);
+  span = bq.reserve_span(1, 1000, 100, uuid2(), 0, 2000, hashes);
+  ASSERT_EQ(span.first, 126u);
+  ASSERT_EQ(span.second, 8u);
+}
+
+TEST(block_queue, late_span)
+{
+  cryptonote::block_queue bq;
+  const boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+
+  // uuid1 is slow, uuid2 fast
+  bq.add_blocks(1000, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 1000.0f, 10000);
+  bq.add_blocks(2000, std::vector<cryptonote::block_complete_entry>(10), uuid2(), 100000.0f, 10000);
+  bq.flush_spans(uuid1(), true);
+  bq.flush_spans(uuid2(), true);
+
+  // 10 blocks from uuid1 should take about 10 seconds
+  bq.add_blocks(0, 10, uuid1(), t0);
+  ASSERT_FALSE(bq.is_next_span_late(0, uuid2(), t0 + boost::posix_time::seconds(1)));
+  ASSERT_FALSE(bq.is_next_span_late(0, uuid2(), t0 + boost::posix_time::seconds(20)));
+  ASSERT_TRUE(bq.is_next_span_late(0, uuid2(), t0 + boost::posix_time::seconds(31)));
+  // never late for the peer which has it, nor for a peer of unknown speed
+  ASSERT_FALSE(bq.is_next_span_late(0, uuid1(), t0 + boost::posix_time::seconds(31)));
+  ASSERT_FALSE(bq.is_next_span_late(0, crypto::rand<boost::uuids::uuid>(), t0 + boost::posix_time::seconds(31)));
+}
@@ -270,6 +270,7 @@ TYPED_TEST(BlockchainDBTest, AddBlock)
   ASSERT_NO_THROW(this->m_db->open(dirPath));
   this->get_filenames();
   this->init_hard_fork();
+  db_wtxn_guard guard(this->m_db);
 
   // adding a block with no parent in the blockchain should throw.
   // note: this shouldn't be possible, but is a good (and cheap) failsafe.
@@ -277,10 +278,10 @@ TYPED_TEST(BlockchainDBTest, AddBlock)
   // TODO: need at least one more block to make this reasonable, as the
   // BlockchainDB implementation should not check for parent if
   // no blocks have been added yet (because genesis has no parent).
-  //ASSERT_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]), BLOCK_PARENT_DNE);
+  //ASSERT_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]), BLOCK_PARENT_DNE);
 
-  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
-  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
 
   block b;
   ASSERT_TRUE(this->m_db->block_exists(get_block_hash(this->m_blocks[0])));
@@ -293,7 +294,7 @@ TYPED_TEST(BlockchainDBTest, AddBlock)
   ASSERT_TRUE(compare_blocks(this->m_blocks[0], b));
 
   // assert that we can't add the same block twice
-  ASSERT_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]), TX_EXISTS);
+  ASSERT_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]), TX_EXISTS);
 
   for (auto& h : this->m_blocks[0].tx_hashes)
   {
@@ -316,15 +317,16 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_NO_THROW(this->m_db->open(dirPath));
   this->get_filenames();
   this->init_hard_fork();
+  db_wtxn_guard guard(this->m_db);
 
-  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[0], t_sizes[0], t_sizes[0], t_diffs[0], t_coins[0], this->m_txs[0]));
 
-  ASSERT_EQ(t_sizes[0], this->m_db->get_block_size(0));
+  ASSERT_EQ(t_sizes[0], this->m_db->get_block_weight(0));
   ASSERT_EQ(t_diffs[0], this->m_db->get_block_cumulative_difficulty(0));
   ASSERT_EQ(t_diffs[0], this->m_db->get_block_difficulty(0));
   ASSERT_EQ(t_coins[0], this->m_db->get_block_already_generated_coins(0));
 
-  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
+  ASSERT_NO_THROW(this->m_db->add_block(this->m_blocks[1], t_sizes[1], t_sizes[1], t_diffs[1], t_coins[1], this->m_txs[1]));
   ASSERT_EQ(t_diffs[1] - t_diffs[0], this->m_db->get_block_difficulty(1));
 
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0]), this->m_db->get_block_hash_from_height(0));
@@ -344,4 +346,135 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
 }
 
+TYPED_TEST(BlockchainDBTest, PowHashIndex)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  const crypto::hash id0 = get_block_hash(this->m_blocks[0]);
+  const crypto::hash id1 = get_block_hash(this->m_blocks[1]);
+  crypto::hash pow0 = crypto::null_hash, pow1 = crypto::null_hash, pow;
+  pow0.data[0] = 1;
+  pow1.data[0] = 2;
+
+  ASSERT_FALSE(this->m_db->get_block_pow_hash(id0, pow));
+
+  this->m_db->block_wtxn_start();
+  ASSERT_NO_THROW(this->m_db->add_block_pow_hash(id0, pow0));
+  ASSERT_NO_THROW(this->m_db->add_block_pow_hash(id1, pow1));
+  // adding again is allowed, a block's PoW hash does not change
+  ASSERT_NO_THROW(this->m_db->add_block_pow_hash(id0, pow0));
+  this->m_db->block_wtxn_stop();
+
+  ASSERT_TRUE(this->m_db->get_block_pow_hash(id0, pow));
+  ASSERT_HASH_EQ(pow0, pow);
+  ASSERT_TRUE(this->m_db->get_block_pow_hash(id1, pow));
+  ASSERT_HASH_EQ(pow1, pow);
+}
+
+TYPED_TEST(BlockchainDBTest, BatchedOutputLookups)
+{
+  boost::filesystem::path tempPath = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  std::string dirPath = tempPath.string();
+
+  this->set_prefix(dirPath);
+
+  ASSERT_NO_THROW(this->m_db->open(dirPath));
+  this->get_filenames();
+  this->init_hard_fork();
+
+  // a genesis block whose miner tx has enough outputs of one amount to
+  // span many pages of duplicates
+  static const uint64_t amount = 1000;
+  static const size_t n_outputs = 2000;
+  block b;
+  b.major_version = 1;
+  b.minor_version = 0;
+  b.timestamp = 0;
+  b.prev_id = crypto::null_hash;
+  b.nonce = 0;
+  b.miner_tx.version = 1;
+  b.miner_tx.unlock_time = 60;
+  b.miner_tx.vin.push_back(txin_gen{0});
+  for (size_t i = 0; i < n_outputs; ++i)
+  {
+    txout_to_key otk;
+    memset(&otk.key, 0, sizeof(otk.key));
+    memcpy(&otk.key, &i, sizeof(i));
+    b.miner_tx.vout.push_back(tx_out{amount, otk});
+  }
+  const crypto::hash miner_tx_hash = get_transaction_hash(b.miner_tx);
+  {
+    db_wtxn_guard guard(this->m_db);
+    ASSERT_NO_THROW(this->m_db->add_block(b, t_sizes[0], t_sizes[0], t_diffs[0], amount * n_outputs, std::vector<transaction>()));
+  }
+  ASSERT_EQ(n_outputs, this->m_db->get_num_outputs(amount));
+
+  // out of order, with repeats, near neighbours and far jumps
+  std::vector<uint64_t> offsets = {1999, 0, 5, 4, 1000, 6, 5, 1, 64, 63, 65, 1998, 0, 1500, 127, 128};
+  for (uint64_t i = 700; i < 900; i += 3)
+    offsets.push_back(i);
+
+  const uint64_t amounts[] = {amount};
+  std::vector<output_data_t> outputs;
+  ASSERT_NO_THROW(this->m_db->get_output_key(epee::span<const uint64_t>(amounts, 1), offsets, outputs));
+  ASSERT_EQ(offsets.size(), outputs.size());
+  for (size_t i = 0; i < offsets.size(); ++i)
+  {
+    uint64_t key_index = 0;
+    memcpy(&key_index, &outputs[i].pubkey, sizeof(key_index));
+    ASSERT_EQ(offsets[i], key_index);
+    ASSERT_EQ(60u, outputs[i].unlock_time);
+    ASSERT_EQ(0u, outputs[i].height);
+  }
+
+  std::vector<tx_out_index> indices;
+  ASSERT_NO_THROW(this->m_db->get_output_tx_and_index(amount, offsets, indices));
+  ASSERT_EQ(offsets.size(), indices.size());
+  for (size_t i = 0; i < offsets.size(); ++i)
+  {
+    ASSERT_HASH_EQ(miner_tx_hash, indices[i].first);
+    ASSERT_EQ(offsets[i], indices[i].second);
+  }
+
+  // every output, in reverse
+  offsets.clear();
+  for (uint64_t i = n_outputs; i-- > 0; )
+    offsets.push_back(i);
+  ASSERT_NO_THROW(this->m_db->get_output_key(epee::span<const uint64_t>(amounts, 1), offsets, outputs));
+  ASSERT_EQ(n_outputs, outputs.size());
+  for (size_t i = 0; i < n_outputs; ++i)
+  {
+    uint64_t key_index = 0;
+    memcpy(&key_index, &outputs[i].pubkey, sizeof(key_index));
+    ASSERT_EQ(offsets[i], key_index);
+  }
+
+  // nothing to look up
+  offsets.clear();
+  ASSERT_NO_THROW(this->m_db->get_output_key(epee::span<const uint64_t>(amounts, 1), offsets, outputs));
+  ASSERT_TRUE(outputs.empty());
+
+  // an amount with no outputs at all
+  const uint64_t missing_amounts[] = {amount + 1};
+  offsets = {0, 1};
+  ASSERT_THROW(this->m_db->get_output_key(epee::span<const uint64_t>(missing_amounts, 1), offsets, outputs), OUTPUT_DNE);
+  ASSERT_NO_THROW(this->m_db->get_output_key(epee::span<const uint64_t>(missing_amounts, 1), offsets, outputs, true));
+  ASSERT_TRUE(outputs.empty());
+  ASSERT_THROW(this->m_db->get_output_tx_and_index(amount + 1, offsets, indices), OUTPUT_DNE);
+
+  // an index past the last output fails the whole lookup, or cuts a partial one short
+  offsets = {3, 2, n_outputs, 1};
+  ASSERT_THROW(this->m_db->get_output_key(epee::span<const uint64_t>(amounts, 1), offsets, outputs), OUTPUT_DNE);
+  ASSERT_NO_THROW(this->m_db->get_output_key(epee::span<const uint64_t>(amounts, 1), offsets, outputs, true));
+  ASSERT_EQ(2u, outputs.size());
+  ASSERT_THROW(this->m_db->get_output_tx_and_index(amount, offsets, indices), OUTPUT_DNE);
+}
+
 }  // anonymous namespace
@@ -0,0 +1,300 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+
+#include <algorithm>
+#include <map>
+#include <boost/uuid/nil_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/compact_block.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.inl"
+
+#define MAKE_IPV4_ADDRESS(a,b,c,d) epee::net_utils::ipv4_network_address{MAKE_IP(a,b,c,d),0}
+
+static crypto::hash make_hash(int n)
+{
+  return crypto::cn_fast_hash(&n, sizeof(n));
+}
+
+TEST(compact_block, short_tx_ids_blob)
+{
+  std::string blob;
+  std::vector<uint64_t> ids;
+  const crypto::hash key = cryptonote::get_compact_block_key(make_hash(0), 0);
+  for (int i = 1; i <= 100; ++i)
+  {
+    const uint64_t id = cryptonote::get_short_tx_id(key, make_hash(i));
+    ASSERT_LT(id, (uint64_t)1 << (8 * cryptonote::SHORT_TX_ID_SIZE));
+    ids.push_back(id);
+    cryptonote::add_short_tx_id(blob, id);
+  }
+  ASSERT_EQ(blob.size(), ids.size() * cryptonote::SHORT_TX_ID_SIZE);
+
+  std::vector<uint64_t> parsed;
+  ASSERT_TRUE(cryptonote::get_short_tx_ids(blob, parsed));
+  ASSERT_EQ(parsed, ids);
+
+  blob.pop_back();
+  ASSERT_FALSE(cryptonote::get_short_tx_ids(blob, parsed));
+  ASSERT_TRUE(cryptonote::get_short_tx_ids(std::string(), parsed));
+  ASSERT_TRUE(parsed.empty());
+}
+
+TEST(compact_block, salted)
+{
+  const crypto::hash txid = make_hash(1);
+  const crypto::hash key0 = cryptonote::get_compact_block_key(make_hash(0), 0);
+  const crypto::hash key1 = cryptonote::get_compact_block_key(make_hash(0), 1);
+  const crypto::hash key2 = cryptonote::get_compact_block_key(make_hash(2), 0);
+  ASSERT_EQ(cryptonote::get_short_tx_id(key0, txid), cryptonote::get_short_tx_id(key0, txid));
+  ASSERT_NE(cryptonote::get_short_tx_id(key0, txid), cryptonote::get_short_tx_id(key1, txid));
+  ASSERT_NE(cryptonote::get_short_tx_id(key0, txid), cryptonote::get_short_tx_id(key2, txid));
+  ASSERT_NE(cryptonote::get_short_tx_id(key0, txid), cryptonote::get_short_tx_id(key0, make_hash(2)));
+}
+
+namespace
+{
+  class test_core
+  {
+  public:
+    std::unordered_map<crypto::hash, cryptonote::blobdata> pool;
+    std::vector<cryptonote::blobdata> blocks;
+    std::vector<std::vector<cryptonote::blobdata>> block_txes;
+
+    void on_synchronized() {}
+    void safesyncmode(const bool) {}
+    uint64_t get_current_blockchain_height() const { return 1; }
+    void set_target_blockchain_height(uint64_t) {}
+    uint64_t get_target_blockchain_height() const { return 1; }
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool get_stat_info(cryptonote::core_stat_info& st_inf) const { return true; }
+    bool have_block(const crypto::hash& id) const { return false; }
+    void get_blockchain_top(uint64_t& height, crypto::hash& top_id) const { height = 0; top_id = crypto::null_hash; }
+    uint32_t get_blockchain_pruning_seed() const { return 0; }
+    bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_txs(const std::vector<cryptonote::blobdata>& tx_blobs, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { blocks.push_back(block_blob); return true; }
+    void pause_mine() {}
+    void resume_mine() {}
+    bool on_idle() { return true; }
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const { return true; }
+    bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::shared_request& rsp, cryptonote::cryptonote_connection_context& context) { return true; }
+    bool get_test_drop_download() const { return true; }
+    bool get_test_drop_download_height() const { return true; }
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry> &blocks) { block_txes.push_back(blocks.front().txs); return true; }
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    bool prehash_incoming_blocks(uint64_t height, const std::vector<cryptonote::blobdata> &block_blobs) { return true; }
+    size_t get_block_sync_size(uint64_t height) const { return config::sync::NORMAL_SYNC; }
+    void on_transaction_relayed(const cryptonote::blobdata& tx) {}
+    bool pad_transactions() const { return false; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const
+    {
+      const auto it = pool.find(id);
+      if (it == pool.end())
+        return false;
+      tx_blob = it->second;
+      return true;
+    }
+    bool get_relayable_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return get_pool_transaction(id, tx_blob); }
+    bool get_pool_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const
+    {
+      for (const auto &e: pool)
+        txs.push_back(e.first);
+      return true;
+    }
+    bool pool_has_tx(const crypto::hash &txid) const { return pool.count(txid) != 0; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::blobdata>& txs, std::vector<crypto::hash>& missed_txs) const { return false; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::transaction>& txs, std::vector<crypto::hash>& missed_txs) const { return false; }
+    bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk, bool *orphan = NULL) const { return false; }
+    uint8_t get_ideal_hard_fork_version() const { return 0; }
+    uint8_t get_ideal_hard_fork_version(uint64_t height) const { return 0; }
+    cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
+    bool fluffy_blocks_enabled() const { return true; }
+    uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes) { return 0; }
+    void stop() {}
+  };
+
+  // records the commands sent, per connection
+  class test_p2p: public nodetool::p2p_endpoint_stub<cryptonote::cryptonote_connection_context>
+  {
+  public:
+    std::map<boost::uuids::uuid, std::pair<cryptonote::cryptonote_connection_context, uint32_t>> connections;
+    std::map<boost::uuids::uuid, std::vector<std::pair<int, std::string>>> sent;
+
+    virtual bool relay_notify_to_list(int command, const epee::shared_buffer& data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections, epee::net_utils::send_priority priority)
+    {
+      for (const auto &c: connections)
+        sent[c.second].push_back({command, std::string(reinterpret_cast<const char*>(data_buff.data()), data_buff.size())});
+      return true;
+    }
+    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority)
+    {
+      sent[context.m_connection_id].push_back({command, std::string(reinterpret_cast<const char*>(req_buff.data()), req_buff.size())});
+      return true;
+    }
+    virtual void for_each_connection(std::function<bool(cryptonote::cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f)
+    {
+      for (auto &e: connections)
+        if (!f(e.second.first, 1, e.second.second))
+          break;
+    }
+  };
+
+  class compact_block_relay: public ::testing::Test
+  {
+  protected:
+    compact_block_relay(): protocol(core, &p2p, true) {}
+
+    cryptonote::cryptonote_connection_context &add_peer(uint8_t n, uint32_t support_flags)
+    {
+      boost::uuids::uuid id = boost::uuids::nil_uuid();
+      id.data[0] = n;
+      cryptonote::cryptonote_connection_context &context = p2p.connections[id].first;
+      p2p.connections[id].second = support_flags;
+      static_cast<epee::net_utils::connection_context_base&>(context) = epee::net_utils::connection_context_base(id, MAKE_IPV4_ADDRESS(1,2,3,n), false, false);
+      context.m_state = cryptonote::cryptonote_connection_context::state_normal;
+      return context;
+    }
+
+    static cryptonote::block make_block(const std::vector<crypto::hash> &tx_hashes)
+    {
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 1;
+      b.timestamp = 0;
+      b.prev_id = crypto::null_hash;
+      b.nonce = 0;
+      b.miner_tx.version = 1;
+      b.miner_tx.unlock_time = 0;
+      b.miner_tx.vin.push_back(cryptonote::txin_gen{1});
+      b.tx_hashes = tx_hashes;
+      return b;
+    }
+
+    // the compact block a peer would send us for b, with no prefilled tx
+    static cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request make_compact_block(cryptonote::block b)
+    {
+      cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request req = AUTO_VAL_INIT(req);
+      req.block_hash = cryptonote::get_block_hash(b);
+      req.nonce = 1;
+      req.current_blockchain_height = 2;
+      const crypto::hash key = cryptonote::get_compact_block_key(req.block_hash, req.nonce);
+      for (const crypto::hash &txid: b.tx_hashes)
+        cryptonote::add_short_tx_id(req.short_tx_ids, cryptonote::get_short_tx_id(key, txid));
+      b.tx_hashes.clear();
+      req.block = cryptonote::block_to_blob(b);
+      return req;
+    }
+
+    void receive(cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request &req, cryptonote::cryptonote_connection_context &context)
+    {
+      std::string blob, out;
+      ASSERT_TRUE(epee::serialization::store_t_to_binary(req, blob));
+      bool handled = false;
+      protocol.handle_invoke_map(true, cryptonote::NOTIFY_NEW_COMPACT_BLOCK::ID, epee::strspan<uint8_t>(blob), out, context, handled);
+      ASSERT_TRUE(handled);
+    }
+
+    std::vector<int> commands_sent_to(const cryptonote::cryptonote_connection_context &context)
+    {
+      std::vector<int> commands;
+      for (const auto &e: p2p.sent[context.m_connection_id])
+        commands.push_back(e.first);
+      return commands;
+    }
+
+    test_core core;
+    test_p2p p2p;
+    cryptonote::t_cryptonote_protocol_handler<test_core> protocol;
+  };
+}
+
+TEST_F(compact_block_relay, reconstructs_from_pool)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1, P2P_SUPPORT_FLAG_COMPACT_BLOCKS);
+  core.pool[make_hash(1)] = "tx1";
+  core.pool[make_hash(2)] = "tx2";
+  core.pool[make_hash(3)] = "tx3";
+  const cryptonote::block b = make_block({make_hash(2), make_hash(1)});
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request req = make_compact_block(b);
+  receive(req, a);
+
+  // the block is rebuilt with its tx hashes, and nothing is asked for
+  ASSERT_EQ(core.blocks, std::vector<cryptonote::blobdata>{cryptonote::block_to_blob(b)});
+  ASSERT_EQ(core.block_txes, std::vector<std::vector<cryptonote::blobdata>>{std::vector<cryptonote::blobdata>({"tx2", "tx1"})});
+  const std::vector<int> sent = commands_sent_to(a);
+  ASSERT_EQ(std::count(sent.begin(), sent.end(), (int)cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID), 0);
+}
+
+TEST_F(compact_block_relay, requests_missing_txes)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1, P2P_SUPPORT_FLAG_COMPACT_BLOCKS);
+  core.pool[make_hash(1)] = "tx1";
+  cryptonote::NOTIFY_NEW_COMPACT_BLOCK::request req = make_compact_block(make_block({make_hash(1), make_hash(2)}));
+  receive(req, a);
+
+  // tx 2 is not in the pool, so it is asked for by index
+  ASSERT_TRUE(core.blocks.empty());
+  ASSERT_EQ(commands_sent_to(a), std::vector<int>{cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID});
+  cryptonote::NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(missing, p2p.sent[a.m_connection_id].front().second));
+  ASSERT_EQ(missing.block_hash, req.block_hash);
+  ASSERT_EQ(missing.missing_tx_indices, std::vector<uint64_t>{1});
+}
+
+TEST_F(compact_block_relay, relays_by_support_flags)
+{
+  cryptonote::cryptonote_connection_context &compact = add_peer(1, P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_COMPACT_BLOCKS);
+  cryptonote::cryptonote_connection_context &fluffy = add_peer(2, P2P_SUPPORT_FLAG_FLUFFY_BLOCKS);
+  cryptonote::cryptonote_connection_context &full = add_peer(3, 0);
+  cryptonote::cryptonote_connection_context &origin = add_peer(4, P2P_SUPPORT_FLAG_COMPACT_BLOCKS);
+
+  cryptonote::NOTIFY_NEW_BLOCK::request arg = AUTO_VAL_INIT(arg);
+  arg.b.block = cryptonote::block_to_blob(make_block({make_hash(1)}));
+  arg.b.txs = {"tx1"};
+  arg.current_blockchain_height = 2;
+  cryptonote::i_cryptonote_protocol &relay = protocol;
+  ASSERT_TRUE(relay.relay_block(arg, origin));
+
+  ASSERT_EQ(commands_sent_to(compact), std::vector<int>{cryptonote::NOTIFY_NEW_COMPACT_BLOCK::ID});
+  ASSERT_EQ(commands_sent_to(fluffy), std::vector<int>{cryptonote::NOTIFY_NEW_FLUFFY_BLOCK::ID});
+  ASSERT_TRUE(commands_sent_to(origin).empty());
+
+  // a peer without either flag gets the full block, txes included
+  ASSERT_EQ(commands_sent_to(full), std::vector<int>{cryptonote::NOTIFY_NEW_BLOCK::ID});
+  cryptonote::NOTIFY_NEW_BLOCK::request received;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(received, p2p.sent[full.m_connection_id].front().second));
+  ASSERT_EQ(received.b.block, arg.b.block);
+  ASSERT_EQ(received.b.txs, arg.b.txs);
+}
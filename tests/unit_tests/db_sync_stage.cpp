@@ -0,0 +1,137 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <deque>
+#include <stdexcept>
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/db_sync_stage.h"
+
+namespace
+{
+  // runs the posted functions when asked, so the tests control the order
+  struct sync_harness
+  {
+    std::deque<std::function<void()>> posted;
+    std::deque<bool> results;
+    std::function<void()> during_sync;
+    size_t syncs = 0;
+    cryptonote::db_sync_stage stage;
+
+    sync_harness(): stage([this]() { return sync(); }, [this](const std::function<void()> &f) { posted.push_back(f); }) {}
+
+    bool sync()
+    {
+      ++syncs;
+      if (during_sync)
+        during_sync();
+      const bool r = results.empty() || results.front();
+      if (!results.empty())
+        results.pop_front();
+      return r;
+    }
+
+    void run_posted()
+    {
+      while (!posted.empty())
+      {
+        std::function<void()> f = posted.front();
+        posted.pop_front();
+        f();
+      }
+    }
+  };
+}
+
+TEST(db_sync_stage, merges_requests)
+{
+  sync_harness h;
+  const uint64_t t1 = h.stage.request();
+  const uint64_t t2 = h.stage.request();
+  ASSERT_EQ(h.posted.size(), 1u);
+  h.run_posted();
+  ASSERT_EQ(h.syncs, 1u);
+  ASSERT_TRUE(h.stage.wait(t1));
+  ASSERT_TRUE(h.stage.wait(t2));
+}
+
+TEST(db_sync_stage, retries_after_failure)
+{
+  sync_harness h;
+  h.results = {false};
+  const uint64_t t1 = h.stage.request();
+  h.run_posted();
+  ASSERT_EQ(h.syncs, 1u);
+  ASSERT_FALSE(h.stage.wait(t1));
+
+  // the failure does not stop later syncs
+  const uint64_t t2 = h.stage.request();
+  ASSERT_EQ(h.posted.size(), 1u);
+  h.run_posted();
+  ASSERT_EQ(h.syncs, 2u);
+  ASSERT_TRUE(h.stage.wait(t2));
+  // which synced what the failed request was for as well
+  ASSERT_TRUE(h.stage.wait(t1));
+}
+
+TEST(db_sync_stage, failure_fails_requests_made_meanwhile)
+{
+  sync_harness h;
+  h.results = {false};
+  uint64_t t2 = 0;
+  h.during_sync = [&]() { h.during_sync = nullptr; t2 = h.stage.request(); };
+  const uint64_t t1 = h.stage.request();
+  h.run_posted();
+  ASSERT_EQ(h.syncs, 1u);
+  ASSERT_GT(t2, t1);
+  // neither waits forever for a run which stopped
+  ASSERT_FALSE(h.stage.wait(t1));
+  ASSERT_FALSE(h.stage.wait(t2));
+
+  const uint64_t t3 = h.stage.request();
+  h.run_posted();
+  ASSERT_TRUE(h.stage.wait(t3));
+}
+
+TEST(db_sync_stage, throw_fails_the_run)
+{
+  sync_harness h;
+  h.during_sync = [&]() { h.during_sync = nullptr; throw std::runtime_error("sync failed"); };
+  const uint64_t t1 = h.stage.request();
+  h.run_posted();
+  ASSERT_EQ(h.syncs, 1u);
+  ASSERT_FALSE(h.stage.wait(t1));
+
+  // and does not leave the stage marked as running
+  const uint64_t t2 = h.stage.request();
+  ASSERT_EQ(h.posted.size(), 1u);
+  h.run_posted();
+  ASSERT_TRUE(h.stage.wait(t2));
+}
@@ -28,6 +28,10 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
@@ -49,6 +53,11 @@ namespace
 
   struct test_protocol_handler_config
   {
+    boost::mutex lock;
+    size_t connection_count = 0;
+    std::set<const boost::asio::io_service*> io_services;
+    std::vector<epee::net_utils::i_service_endpoint*> endpoints;
+    std::function<void(epee::net_utils::i_service_endpoint*)> on_recv; // called with the receiving connection
   };
 
   struct test_protocol_handler
@@ -56,12 +65,17 @@ namespace
     typedef test_connection_context connection_context;
     typedef test_protocol_handler_config config_type;
 
-    test_protocol_handler(epee::net_utils::i_service_endpoint* /*psnd_hndlr*/, config_type& /*config*/, connection_context& /*conn_context*/)
+    test_protocol_handler(epee::net_utils::i_service_endpoint* psnd_hndlr, config_type& config, connection_context& /*conn_context*/)
+      : m_psnd_hndlr(psnd_hndlr), m_config(config)
     {
     }
 
     void after_init_connection()
     {
+      boost::unique_lock<boost::mutex> lock(m_config.lock);
+      ++m_config.connection_count;
+      m_config.io_services.insert(&m_psnd_hndlr->get_io_service());
+      m_config.endpoints.push_back(m_psnd_hndlr);
     }
 
     void handle_qued_callback()
@@ -75,8 +89,14 @@ namespace
 
     bool handle_recv(const void* /*data*/, size_t /*size*/)
     {
-      return false;
+      if (!m_config.on_recv)
+        return false;
+      m_config.on_recv(m_psnd_hndlr);
+      return true;
     }
+
+    epee::net_utils::i_service_endpoint* m_psnd_hndlr;
+    config_type& m_config;
   };
 
   typedef epee::net_utils::boosted_tcp_server<test_protocol_handler> test_tcp_server;
@@ -132,3 +152,246 @@ TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
   ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
   ASSERT_TRUE(srv.deinit_server());
 }
+
+TEST(boosted_tcp_server, io_service_per_thread_spreads_connections)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC);
+  srv.set_io_service_per_thread(true);
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(3, false));
+
+  boost::asio::io_service io_service;
+  const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(test_server_host), test_server_port);
+  std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> sockets;
+  for (size_t i = 0; i < 6; ++i)
+  {
+    sockets.emplace_back(new boost::asio::ip::tcp::socket(io_service));
+    sockets.back()->connect(endpoint);
+  }
+
+  test_protocol_handler_config& config = srv.get_config_object();
+  for (size_t i = 0; i < 500; ++i)
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(config.lock);
+      if (config.connection_count == sockets.size())
+        break;
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+  }
+  {
+    boost::unique_lock<boost::mutex> lock(config.lock);
+    ASSERT_EQ(sockets.size(), config.connection_count);
+    ASSERT_EQ(3u, config.io_services.size());
+    ASSERT_EQ(1u, config.io_services.count(&srv.get_io_service()));
+  }
+
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
+
+TEST(boosted_tcp_server, io_service_per_thread_relay_into_a_full_queue_fails_fast)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_P2P);
+  srv.set_io_service_per_thread(true);
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  // one thread, so both connections are on the io_service it alone runs
+  ASSERT_TRUE(srv.run_server(1, false));
+
+  test_protocol_handler_config& config = srv.get_config_object();
+  boost::asio::io_service io_service;
+  const boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address::from_string(test_server_host), test_server_port);
+  boost::asio::ip::tcp::socket a(io_service), b(io_service);
+  for (boost::asio::ip::tcp::socket* socket: {&a, &b})
+  {
+    socket->connect(endpoint);
+    const size_t count = socket == &a ? 1 : 2;
+    for (size_t i = 0; i < 500; ++i)
+    {
+      {
+        boost::unique_lock<boost::mutex> lock(config.lock);
+        if (config.connection_count == count)
+          break;
+      }
+      boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+    }
+    boost::unique_lock<boost::mutex> lock(config.lock);
+    ASSERT_EQ(count, config.connection_count);
+  }
+
+  // what a receives is relayed to b, whose peer never reads, until b's queue is full
+  boost::condition_variable cond;
+  bool done = false, relayed = true;
+  boost::chrono::steady_clock::duration elapsed;
+  {
+    boost::unique_lock<boost::mutex> lock(config.lock);
+    ASSERT_EQ(1u, config.io_services.size());
+    epee::net_utils::i_service_endpoint* target = config.endpoints.at(1);
+    config.on_recv = [&, target](epee::net_utils::i_service_endpoint*)
+    {
+      const epee::shared_buffer body(std::string(ABSTRACT_SERVER_SEND_QUE_MAX_BYTES / 4, 'x'));
+      const auto start = boost::chrono::steady_clock::now();
+      bool r = true;
+      for (size_t i = 0; i < 8 && r; ++i)
+        r = target->do_send_shared(NULL, 0, body, epee::net_utils::send_priority_block);
+      boost::unique_lock<boost::mutex> lock(config.lock);
+      elapsed = boost::chrono::steady_clock::now() - start;
+      relayed = r;
+      done = true;
+      cond.notify_all();
+    };
+  }
+  boost::asio::write(a, boost::asio::buffer("x", 1));
+
+  {
+    boost::unique_lock<boost::mutex> lock(config.lock);
+    while (!done)
+      ASSERT_NE(boost::cv_status::timeout, cond.wait_for(lock, boost::chrono::seconds(3 * ABSTRACT_SERVER_SEND_QUE_WAIT_MS / 1000)));
+    // the thread which would have to write b's queue out did not wait for it
+    ASSERT_FALSE(relayed);
+    ASSERT_LT(elapsed, boost::chrono::milliseconds(ABSTRACT_SERVER_SEND_QUE_WAIT_MS / 2));
+  }
+
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
+
+TEST(boosted_tcp_server, rpc_send_queue_is_bounded)
+{
+  test_tcp_server srv(epee::net_utils::e_connection_type_RPC);
+  ASSERT_TRUE(srv.init_server(test_server_port, test_server_host));
+  ASSERT_TRUE(srv.run_server(2, false));
+
+  test_protocol_handler_config& config = srv.get_config_object();
+  boost::asio::io_service io_service;
+  boost::asio::ip::tcp::socket socket(io_service);
+  socket.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string(test_server_host), test_server_port));
+  epee::net_utils::i_service_endpoint* target = nullptr;
+  for (size_t i = 0; i < 500 && !target; ++i)
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(config.lock);
+      if (config.connection_count == 1)
+        target = config.endpoints.at(0);
+    }
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(target != nullptr);
+
+  // a response written off the strand to a client which never reads waits for room, then gives up
+  const epee::shared_buffer body(std::string(ABSTRACT_SERVER_SEND_QUE_MAX_BYTES / 4, 'x'));
+  const auto start = boost::chrono::steady_clock::now();
+  bool r = true;
+  for (size_t i = 0; i < 8 && r; ++i)
+    r = target->do_send_shared(NULL, 0, body);
+  ASSERT_FALSE(r);
+  ASSERT_GE(boost::chrono::steady_clock::now() - start, boost::chrono::milliseconds(ABSTRACT_SERVER_SEND_QUE_WAIT_MS / 2));
+
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  ASSERT_TRUE(srv.deinit_server());
+}
+
+namespace
+{
+  epee::net_utils::send_que_entry make_entry(const std::string& head, const std::string& body)
+  {
+    epee::net_utils::send_que_entry entry;
+    entry.head = head;
+    entry.body = epee::shared_buffer(std::string(body));
+    return entry;
+  }
+
+  std::string to_string(const epee::net_utils::send_queue::buffers_t& buffers)
+  {
+    std::string out;
+    for (const auto& buffer: buffers)
+      out.append(boost::asio::buffer_cast<const char*>(buffer), boost::asio::buffer_size(buffer));
+    return out;
+  }
+
+  std::string write_all(epee::net_utils::send_queue& queue, size_t max_size)
+  {
+    std::string out;
+    while (!queue.empty())
+    {
+      out += to_string(queue.start_write(max_size));
+      EXPECT_TRUE(queue.writing());
+      queue.finish_write();
+    }
+    return out;
+  }
+}
+
+TEST(send_queue, sends_most_urgent_class_first)
+{
+  epee::net_utils::send_queue queue;
+  ASSERT_TRUE(queue.empty());
+  queue.push(make_entry("s1", "sync"), epee::net_utils::send_priority_bulk);
+  queue.push(make_entry("t1", "tx"), epee::net_utils::send_priority_tx);
+  queue.push(make_entry("b1", "block"), epee::net_utils::send_priority_block);
+  queue.push(make_entry("t2", ""), epee::net_utils::send_priority_tx);
+  queue.push(make_entry("", "block2"), epee::net_utils::send_priority_block);
+  EXPECT_EQ(5u, queue.size());
+  EXPECT_FALSE(queue.writing());
+
+  EXPECT_EQ("b1blockblock2t1txt2s1sync", write_all(queue, 1000));
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(0u, queue.size());
+}
+
+TEST(send_queue, writes_a_message_whole_before_the_next)
+{
+  epee::net_utils::send_queue queue;
+  queue.push(make_entry("head", "sync body"), epee::net_utils::send_priority_bulk);
+
+  EXPECT_EQ("hea", to_string(queue.start_write(3)));
+  queue.finish_write();
+  EXPECT_EQ(1u, queue.size());
+  EXPECT_EQ(10u, queue.bytes(epee::net_utils::send_priority_bulk));
+
+  // a block queued now waits for the rest of the sync message, which is never cut by it
+  queue.push(make_entry("b", "lock"), epee::net_utils::send_priority_block);
+  EXPECT_EQ("dsy", to_string(queue.start_write(3)));
+  EXPECT_EQ("dsy", to_string(queue.write_buffers()));
+  queue.finish_write();
+  EXPECT_EQ("nc body", to_string(queue.start_write(100)));
+  queue.finish_write();
+  EXPECT_EQ(0u, queue.bytes(epee::net_utils::send_priority_bulk));
+  EXPECT_EQ(5u, queue.bytes(epee::net_utils::send_priority_block));
+  EXPECT_EQ("block", write_all(queue, 2));
+  EXPECT_EQ(0u, queue.bytes(epee::net_utils::send_priority_block));
+}
+
+TEST(send_queue, sends_a_block_between_bulk_frames)
+{
+  epee::net_utils::send_queue queue;
+  queue.push(make_entry("f1", "part1"), epee::net_utils::send_priority_bulk);
+  queue.push(make_entry("f2", "part2"), epee::net_utils::send_priority_bulk);
+
+  EXPECT_EQ("f1part1", to_string(queue.start_write(100)));
+  queue.push(make_entry("b", "lock"), epee::net_utils::send_priority_block);
+  queue.finish_write();
+  EXPECT_EQ("block", to_string(queue.start_write(100)));
+  queue.finish_write();
+  EXPECT_EQ("f2part2", write_all(queue, 100));
+}
+
+TEST(token_bucket, paces_takes_at_the_rate)
+{
+  epee::net_utils::token_bucket bucket(1.0);
+  EXPECT_EQ(0, bucket.take(1000000, 10.0)); // no rate, no limit
+
+  bucket.set_rate(1000);
+  EXPECT_EQ(0, bucket.take(1000, 10.0)); // a full second saved up
+  EXPECT_DOUBLE_EQ(0.5, bucket.take(500, 10.0));
+  EXPECT_DOUBLE_EQ(1.0, bucket.take(500, 10.0)); // waits for the previous debt too
+  EXPECT_DOUBLE_EQ(0.5, bucket.take(0, 10.5));
+  EXPECT_EQ(0, bucket.take(0, 11.0));
+
+  // no more than a second worth is saved while idle
+  EXPECT_EQ(0, bucket.take(1000, 100.0));
+  EXPECT_DOUBLE_EQ(0.1, bucket.take(100, 100.0));
+}
@@ -56,22 +56,22 @@ namespace
     {
     }
 
-    virtual int invoke(int command, const std::string& in_buff, std::string& buff_out, test_levin_connection_context& context)
+    virtual int invoke(int command, const epee::span<const uint8_t> in_buff, std::string& buff_out, test_levin_connection_context& context)
     {
       m_invoke_counter.inc();
       boost::unique_lock<boost::mutex> lock(m_mutex);
       m_last_command = command;
-      m_last_in_buf = in_buff;
+      m_last_in_buf.assign(reinterpret_cast<const char*>(in_buff.data()), in_buff.size());
       buff_out = m_invoke_out_buf;
       return m_return_code;
     }
 
-    virtual int notify(int command, const std::string& in_buff, test_levin_connection_context& context)
+    virtual int notify(int command, const epee::span<const uint8_t> in_buff, test_levin_connection_context& context)
     {
       m_notify_counter.inc();
       boost::unique_lock<boost::mutex> lock(m_mutex);
       m_last_command = command;
-      m_last_in_buf = in_buff;
+      m_last_in_buf.assign(reinterpret_cast<const char*>(in_buff.data()), in_buff.size());
       return m_return_code;
     }
 
@@ -534,3 +534,141 @@ TEST_F(test_levin_protocol_handler__hanle_recv_with_invalid_data, handles_unexpe
 
   ASSERT_FALSE(m_conn->m_protocol_handler.handle_recv(m_buf.data(), m_buf.size()));
 }
+
+namespace
+{
+  std::string make_packet(int command, uint32_t flags, const std::string& body)
+  {
+    epee::levin::bucket_head2 head = {0};
+    head.m_signature = LEVIN_SIGNATURE;
+    head.m_cb = body.size();
+    head.m_have_to_return_data = false;
+    head.m_command = command;
+    head.m_flags = flags;
+    head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+    return std::string(reinterpret_cast<const char*>(&head), sizeof(head)) + body;
+  }
+
+  // splits sent data back into packets
+  std::vector<std::pair<epee::levin::bucket_head2, std::string>> parse_packets(const std::string& data)
+  {
+    std::vector<std::pair<epee::levin::bucket_head2, std::string>> packets;
+    size_t offset = 0;
+    while (offset + sizeof(epee::levin::bucket_head2) <= data.size())
+    {
+      epee::levin::bucket_head2 head;
+      memcpy(&head, data.data() + offset, sizeof(head));
+      offset += sizeof(head);
+      packets.emplace_back(head, data.substr(offset, head.m_cb));
+      offset += head.m_cb;
+    }
+    return packets;
+  }
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_reassembles_fragmented_notify)
+{
+  test_connection_ptr conn = create_connection();
+  const std::string part1(300, 'a'), part2(200, 'b');
+
+  std::string buf = make_packet(11, LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENT, part1);
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_EQ(0, m_commands_handler.notify_counter());
+
+  // other messages may come between the parts
+  buf = make_packet(12, LEVIN_PACKET_REQUEST, "block");
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_EQ(1, m_commands_handler.notify_counter());
+  ASSERT_EQ(12, m_commands_handler.last_command());
+
+  buf = make_packet(11, LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENT | LEVIN_PACKET_END, part2);
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_EQ(2, m_commands_handler.notify_counter());
+  ASSERT_EQ(11, m_commands_handler.last_command());
+  ASSERT_EQ(part1 + part2, m_commands_handler.last_in_buf());
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_rejects_mixed_fragments)
+{
+  test_connection_ptr conn = create_connection();
+  std::string buf = make_packet(11, LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENT, "x");
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  buf = make_packet(12, LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENT | LEVIN_PACKET_END, "y");
+  ASSERT_FALSE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_EQ(0, m_commands_handler.notify_counter());
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_fragments_bulk_notify)
+{
+  test_connection_ptr conn = create_connection();
+  std::string body(2 * LEVIN_DEFAULT_FRAGMENT_SIZE + 100, 'z');
+  body[LEVIN_DEFAULT_FRAGMENT_SIZE] = 'w';
+
+  // not before the peer says it reassembles them
+  ASSERT_EQ(1, conn->m_protocol_handler.notify(7, epee::strspan<uint8_t>(body), epee::net_utils::send_priority_bulk));
+  auto packets = parse_packets(conn->last_send_data());
+  ASSERT_EQ(1u, packets.size());
+  ASSERT_EQ(0u, packets[0].first.m_flags & (LEVIN_PACKET_FRAGMENT | LEVIN_PACKET_END));
+  ASSERT_NE(0u, packets[0].first.m_flags & LEVIN_PACKET_FRAGMENTS_OK);
+
+  std::string buf = make_packet(12, LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENTS_OK, "hi");
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+
+  conn->reset_last_send_data();
+  ASSERT_EQ(1, conn->m_protocol_handler.notify(7, epee::strspan<uint8_t>(body), epee::net_utils::send_priority_bulk));
+  packets = parse_packets(conn->last_send_data());
+  ASSERT_EQ(3u, packets.size());
+  std::string joined;
+  for (size_t i = 0; i < packets.size(); ++i)
+  {
+    ASSERT_EQ(7u, packets[i].first.m_command);
+    ASSERT_FALSE(packets[i].first.m_have_to_return_data);
+    ASSERT_NE(0u, packets[i].first.m_flags & LEVIN_PACKET_FRAGMENT);
+    ASSERT_EQ(i + 1 == packets.size(), (packets[i].first.m_flags & LEVIN_PACKET_END) != 0);
+    ASSERT_LE(packets[i].second.size(), (size_t)LEVIN_DEFAULT_FRAGMENT_SIZE);
+    joined += packets[i].second;
+  }
+  ASSERT_EQ(body, joined);
+
+  // nor for other classes
+  conn->reset_last_send_data();
+  ASSERT_EQ(1, conn->m_protocol_handler.notify(7, epee::strspan<uint8_t>(body), epee::net_utils::send_priority_block));
+  ASSERT_EQ(1u, parse_packets(conn->last_send_data()).size());
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_fragments_pieces_without_joining_them)
+{
+  test_connection_ptr conn = create_connection();
+  const std::vector<epee::shared_buffer> pieces{
+    epee::shared_buffer(std::string(100, 'a')),
+    epee::shared_buffer(std::string(LEVIN_DEFAULT_FRAGMENT_SIZE + 10, 'b')),
+    epee::shared_buffer(std::string(20, 'c'))
+  };
+  std::string body;
+  for (const epee::shared_buffer& piece: pieces)
+    body.append(reinterpret_cast<const char*>(piece.data()), piece.size());
+
+  // joined for a peer which does not reassemble fragments
+  ASSERT_EQ(1, conn->m_protocol_handler.notify(7, pieces, epee::net_utils::send_priority_bulk));
+  auto packets = parse_packets(conn->last_send_data());
+  ASSERT_EQ(1u, packets.size());
+  ASSERT_EQ(body, packets[0].second);
+
+  std::string buf = make_packet(12, LEVIN_PACKET_REQUEST | LEVIN_PACKET_FRAGMENTS_OK, "hi");
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+
+  // else each fragment is part of one piece
+  conn->reset_last_send_data();
+  ASSERT_EQ(1, conn->m_protocol_handler.notify(7, pieces, epee::net_utils::send_priority_bulk));
+  packets = parse_packets(conn->last_send_data());
+  ASSERT_EQ(4u, packets.size());
+  ASSERT_EQ(std::string(100, 'a'), packets[0].second);
+  ASSERT_EQ(std::string(LEVIN_DEFAULT_FRAGMENT_SIZE, 'b'), packets[1].second);
+  ASSERT_EQ(std::string(10, 'b'), packets[2].second);
+  ASSERT_EQ(std::string(20, 'c'), packets[3].second);
+  for (size_t i = 0; i < packets.size(); ++i)
+  {
+    ASSERT_NE(0u, packets[i].first.m_flags & LEVIN_PACKET_FRAGMENT);
+    ASSERT_EQ(i + 1 == packets.size(), (packets[i].first.m_flags & LEVIN_PACKET_END) != 0);
+  }
+}
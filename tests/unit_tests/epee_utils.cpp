@@ -46,6 +46,7 @@
 #include "hex.h"
 #include "net/net_utils_base.h"
 #include "p2p/net_peerlist_boost_serialization.h"
+#include "shared_buffer.h"
 #include "span.h"
 #include "string_tools.h"
 
@@ -317,6 +318,45 @@ TEST(Span, AsByteSpan)
   );
 }
 
+TEST(SharedBuffer, Construction)
+{
+  const epee::shared_buffer empty{};
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(0u, empty.size());
+  EXPECT_TRUE(empty.get_slice(0, 0).empty());
+
+  std::string source(100, 'x');
+  const char* const source_data = source.data();
+  const epee::shared_buffer moved{std::move(source)};
+  EXPECT_EQ(100u, moved.size());
+  EXPECT_EQ(reinterpret_cast<const std::uint8_t*>(source_data), moved.data());
+
+  const epee::shared_buffer copied{epee::strspan<std::uint8_t>(std::string(100, 'x'))};
+  EXPECT_NE(moved.data(), copied.data());
+  EXPECT_TRUE(boost::range::equal(moved.to_span(), copied.to_span()));
+}
+
+TEST(SharedBuffer, Slices)
+{
+  epee::shared_buffer slice;
+  {
+    epee::shared_buffer copy;
+    {
+      const epee::shared_buffer buffer{std::string{"0123456789"}};
+      copy = buffer;
+      EXPECT_EQ(buffer.data(), copy.data());
+      slice = buffer.get_slice(2, 5);
+      EXPECT_EQ(buffer.data() + 2, slice.data());
+      EXPECT_THROW(buffer.get_slice(6, 5), std::out_of_range);
+      EXPECT_THROW(buffer.get_slice(11, 0), std::out_of_range);
+    }
+    EXPECT_EQ(10u, copy.size());
+  }
+  // the slice keeps the storage alive
+  EXPECT_TRUE(boost::range::equal(epee::strspan<std::uint8_t>("23456"), slice.to_span()));
+  EXPECT_TRUE(boost::range::equal(epee::strspan<std::uint8_t>("4"), slice.get_slice(2, 1).to_span()));
+}
+
 TEST(ToHex, String)
 {
   EXPECT_TRUE(epee::to_hex::string(nullptr).empty());
@@ -0,0 +1,98 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/fee_histogram.h"
+
+TEST(fee_histogram, bins)
+{
+  ASSERT_EQ(cryptonote::fee_rate_histogram::bin_index(0.5), 0u);
+  ASSERT_EQ(cryptonote::fee_rate_histogram::bin_index(1.0), 1u);
+  ASSERT_EQ(cryptonote::fee_rate_histogram::bin_index(2.0), 1 + cryptonote::fee_rate_histogram::BINS_PER_DOUBLING);
+  ASSERT_EQ(cryptonote::fee_rate_histogram::bin_index(1e300), cryptonote::fee_rate_histogram::BINS - 1);
+  for (size_t i = 1; i < cryptonote::fee_rate_histogram::BINS; ++i)
+  {
+    const double lower_bound = cryptonote::fee_rate_histogram::bin_lower_bound(i);
+    ASSERT_EQ(cryptonote::fee_rate_histogram::bin_index(lower_bound * 1.0001), i);
+    ASSERT_EQ(cryptonote::fee_rate_histogram::bin_index(lower_bound * 0.9999), i - 1);
+  }
+}
+
+TEST(fee_histogram, add_remove)
+{
+  cryptonote::fee_rate_histogram histogram;
+  histogram.add(1000, 100);
+  histogram.add(5000, 100);
+  histogram.add(2000, 200);
+  ASSERT_EQ(histogram.txs(), 3u);
+  ASSERT_EQ(histogram.weight(), 400u);
+  ASSERT_EQ(histogram.bins()[cryptonote::fee_rate_histogram::bin_index(10.0)].txs, 2u);
+  ASSERT_EQ(histogram.bins()[cryptonote::fee_rate_histogram::bin_index(10.0)].weight, 300u);
+  ASSERT_EQ(histogram.bins()[cryptonote::fee_rate_histogram::bin_index(50.0)].fee, 5000u);
+
+  histogram.remove(1000, 100);
+  ASSERT_EQ(histogram.txs(), 2u);
+  ASSERT_EQ(histogram.weight(), 300u);
+  ASSERT_EQ(histogram.bins()[cryptonote::fee_rate_histogram::bin_index(10.0)].txs, 1u);
+
+  cryptonote::fee_rate_histogram other;
+  other.add(1000, 100);
+  histogram += other;
+  ASSERT_EQ(histogram.txs(), 3u);
+  ASSERT_EQ(histogram.weight(), 400u);
+
+  histogram.clear();
+  ASSERT_EQ(histogram.txs(), 0u);
+  ASSERT_EQ(histogram.weight(), 0u);
+  ASSERT_EQ(histogram.weight_paying_at_least(0), 0u);
+}
+
+TEST(fee_histogram, backlog)
+{
+  cryptonote::fee_rate_histogram histogram;
+  for (int i = 0; i < 10; ++i)
+  {
+    histogram.add(1000 * 10, 1000);
+    histogram.add(1000 * 100, 1000);
+  }
+  ASSERT_EQ(histogram.weight_paying_at_least(1), 20000u);
+  ASSERT_EQ(histogram.weight_paying_at_least(50), 10000u);
+  ASSERT_EQ(histogram.weight_paying_at_least(1000), 0u);
+
+  // everything fits
+  ASSERT_EQ(histogram.fee_per_byte_for_weight(20000), 0.0);
+  // only the high fee ones fit, paying more than the low fee ones is enough
+  const double fee = histogram.fee_per_byte_for_weight(15000);
+  ASSERT_GT(fee, 10.0);
+  ASSERT_LE(fee, 100.0);
+  ASSERT_EQ(histogram.weight_paying_at_least(fee), 10000u);
+  // not even those fit
+  ASSERT_GT(histogram.fee_per_byte_for_weight(5000), 100.0);
+}
@@ -28,6 +28,7 @@
 
 #include "gtest/gtest.h"
 #include "net/http_auth.h"
+#include "net/http_protocol_handler.h"
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/join.hpp>
@@ -51,6 +52,8 @@
 #include <boost/spirit/include/qi_plus.hpp>
 #include <boost/spirit/include/qi_sequence.hpp>
 #include <boost/spirit/include/qi_string.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
 #include <cstdint>
 #include <iterator>
 #include <string>
@@ -743,3 +746,126 @@ TEST(HTTP, Add_Field)
 
   EXPECT_STREQ("leading textfoo: bar\r\nbar: foo\r\nmoarbars: moarfoo\r\n", str.c_str());
 }
+
+namespace
+{
+  struct test_endpoint: public epee::net_utils::i_service_endpoint
+  {
+    std::string sent;
+    size_t callbacks = 0;
+    bool closed = false;
+
+    virtual bool do_send(const void* ptr, size_t cb) { boost::unique_lock<boost::mutex> lock(mutex); sent.append((const char*)ptr, cb); return true; }
+    virtual bool close() { closed = true; return true; }
+    virtual bool send_done() { return true; }
+    virtual bool call_run_once_service_io() { return true; }
+    virtual bool request_callback() { return true; }
+    virtual boost::asio::io_service& get_io_service() { return io_service; }
+    virtual bool add_ref() { return true; }
+    virtual bool release()
+    {
+      // the body writer is done with the connection, and asked for the callback before
+      boost::unique_lock<boost::mutex> lock(mutex);
+      ++callbacks;
+      cond.notify_all();
+      return true;
+    }
+
+    //! waits for a body written on its own thread
+    bool wait_for_callback()
+    {
+      boost::unique_lock<boost::mutex> lock(mutex);
+      while (!callbacks)
+      {
+        if (cond.wait_for(lock, boost::chrono::seconds(10)) == boost::cv_status::timeout)
+          return false;
+      }
+      --callbacks;
+      return true;
+    }
+
+    boost::asio::io_service io_service;
+    boost::mutex mutex;
+    boost::condition_variable cond;
+  };
+
+  struct pieces_handler: public http::i_http_server_handler<epee::net_utils::connection_context_base>
+  {
+    std::vector<std::string> pieces;
+    size_t handled = 0;
+
+    virtual bool handle_http_request(const http::http_request_info& query_info, http::http_response_info& response, epee::net_utils::connection_context_base& context)
+    {
+      ++handled;
+      std::vector<std::string> body = pieces;
+      if (!body.empty())
+        body.back() += query_info.m_URI.substr(1);
+      response.m_body_writer = [body](const http::body_chunk_sink& sink)
+      {
+        for (const std::string& piece: body)
+        {
+          if (!sink(epee::shared_buffer(std::string(piece))))
+            return false;
+        }
+        return true;
+      };
+      return true;
+    }
+  };
+
+  //! the requests are answered with the pieces, the last followed by the path
+  std::string get_written_response(const std::vector<std::string>& pieces, const std::string& request, size_t written_bodies = 1, size_t* handled_on_recv = nullptr)
+  {
+    test_endpoint endpoint;
+    pieces_handler handler;
+    handler.pieces = pieces;
+    http::custum_handler_config<epee::net_utils::connection_context_base> config;
+    config.m_phandler = &handler;
+    epee::net_utils::connection_context_base context;
+    http::http_custom_handler<epee::net_utils::connection_context_base> protocol(&endpoint, config, context);
+    EXPECT_TRUE(protocol.handle_recv(request.data(), request.size()));
+    if (handled_on_recv)
+      *handled_on_recv = handler.handled;
+    for (size_t i = 0; i < written_bodies; ++i)
+    {
+      if (!endpoint.wait_for_callback())
+        return std::string();
+      protocol.handle_qued_callback();
+    }
+    EXPECT_FALSE(endpoint.closed);
+    return endpoint.sent;
+  }
+}
+
+TEST(HTTP, Response_Body_Writer)
+{
+  // a body written in one piece goes out with a Content-Length
+  std::string sent = get_written_response({"hello"}, "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_NE(std::string::npos, sent.find("\r\nContent-Length: 5\r\n"));
+  EXPECT_TRUE(boost::ends_with(sent, "\r\n\r\nhello"));
+
+  // more pieces are sent as chunks
+  sent = get_written_response({"hello", "", "big world"}, "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  EXPECT_EQ(std::string::npos, sent.find("Content-Length"));
+  EXPECT_NE(std::string::npos, sent.find("\r\nTransfer-Encoding: chunked\r\n"));
+  EXPECT_TRUE(boost::ends_with(sent, "\r\n\r\n5\r\nhello\r\n9\r\nbig world\r\n0\r\n\r\n"));
+
+  // but not to HTTP/1.0 clients, whose body is collected before it is sent
+  sent = get_written_response({"hello", " world"}, "GET / HTTP/1.0\r\nHost: localhost\r\n\r\n", 0);
+  EXPECT_NE(std::string::npos, sent.find("\r\nContent-Length: 11\r\n"));
+  EXPECT_TRUE(boost::ends_with(sent, "\r\n\r\nhello world"));
+}
+
+TEST(HTTP, Response_Body_Writer_Keeps_Requests_In_Order)
+{
+  // the second request is read while the first body is written, and answered after it
+  size_t handled = 0;
+  const std::string sent = get_written_response({"hello", " "},
+    "GET /first HTTP/1.1\r\nHost: localhost\r\n\r\nGET /second HTTP/1.1\r\nHost: localhost\r\n\r\n", 2, &handled);
+  EXPECT_EQ(1u, handled);
+  const size_t first = sent.find("5\r\nhello\r\n6\r\n first\r\n0\r\n\r\n");
+  ASSERT_NE(std::string::npos, first);
+  const size_t second = sent.find("7\r\n second\r\n0\r\n\r\n");
+  ASSERT_NE(std::string::npos, second);
+  EXPECT_LT(first, second);
+}
@@ -0,0 +1,136 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_core/prehashed_blocks.h"
+
+namespace
+{
+  crypto::hash make_hash(uint8_t n)
+  {
+    crypto::hash h = crypto::null_hash;
+    h.data[0] = n;
+    return h;
+  }
+
+  std::vector<cryptonote::prehashed_blocks::entry> make_entries(uint64_t height, size_t n)
+  {
+    std::vector<cryptonote::prehashed_blocks::entry> entries;
+    for (size_t i = 0; i < n; ++i)
+      entries.push_back({make_hash(i + 1), height + i, make_hash(i + 101)});
+    return entries;
+  }
+}
+
+TEST(prehashed_blocks, hit)
+{
+  cryptonote::prehashed_blocks blocks(16);
+  uint64_t generation;
+  ASSERT_TRUE(blocks.start(generation));
+  ASSERT_TRUE(blocks.running());
+  blocks.finish(generation, make_entries(100, 3), false);
+  ASSERT_FALSE(blocks.running());
+
+  crypto::hash pow_hash;
+  ASSERT_TRUE(blocks.take(make_hash(2), 101, pow_hash));
+  ASSERT_EQ(pow_hash, make_hash(102));
+  // taken once only
+  ASSERT_FALSE(blocks.take(make_hash(2), 101, pow_hash));
+}
+
+TEST(prehashed_blocks, miss)
+{
+  cryptonote::prehashed_blocks blocks(16);
+  uint64_t generation;
+  ASSERT_TRUE(blocks.start(generation));
+  blocks.finish(generation, make_entries(100, 3), false);
+
+  crypto::hash pow_hash = crypto::null_hash;
+  ASSERT_FALSE(blocks.take(make_hash(9), 100, pow_hash));
+  // hashed for another height, the seed may differ
+  ASSERT_FALSE(blocks.take(make_hash(1), 200, pow_hash));
+  ASSERT_FALSE(blocks.take(make_hash(1), 100, pow_hash));
+  ASSERT_EQ(pow_hash, crypto::null_hash);
+  ASSERT_TRUE(blocks.take(make_hash(3), 102, pow_hash));
+}
+
+TEST(prehashed_blocks, one_job_at_a_time)
+{
+  cryptonote::prehashed_blocks blocks(16);
+  uint64_t generation, generation2;
+  ASSERT_TRUE(blocks.start(generation));
+  ASSERT_FALSE(blocks.start(generation2));
+  blocks.finish(generation, {}, false);
+  ASSERT_TRUE(blocks.start(generation2));
+}
+
+TEST(prehashed_blocks, clear_discards_running_job)
+{
+  cryptonote::prehashed_blocks blocks(16);
+  uint64_t generation;
+  ASSERT_TRUE(blocks.start(generation));
+  blocks.clear();
+  blocks.finish(generation, make_entries(100, 3), false);
+  ASSERT_FALSE(blocks.running());
+
+  crypto::hash pow_hash;
+  ASSERT_FALSE(blocks.take(make_hash(1), 100, pow_hash));
+
+  // the next job is kept
+  ASSERT_TRUE(blocks.start(generation));
+  blocks.finish(generation, make_entries(100, 3), false);
+  ASSERT_TRUE(blocks.take(make_hash(1), 100, pow_hash));
+}
+
+TEST(prehashed_blocks, cancelled_job_is_dropped)
+{
+  cryptonote::prehashed_blocks blocks(16);
+  uint64_t generation;
+  ASSERT_TRUE(blocks.start(generation));
+  blocks.finish(generation, make_entries(100, 3), true);
+  ASSERT_FALSE(blocks.running());
+
+  crypto::hash pow_hash;
+  ASSERT_FALSE(blocks.take(make_hash(1), 100, pow_hash));
+}
+
+TEST(prehashed_blocks, unused_hashes_are_dropped)
+{
+  cryptonote::prehashed_blocks blocks(4);
+  uint64_t generation;
+  ASSERT_TRUE(blocks.start(generation));
+  blocks.finish(generation, make_entries(100, 5), false);
+  ASSERT_TRUE(blocks.start(generation));
+  blocks.finish(generation, {{make_hash(50), 200, make_hash(150)}}, false);
+
+  crypto::hash pow_hash;
+  ASSERT_FALSE(blocks.take(make_hash(1), 100, pow_hash));
+  ASSERT_TRUE(blocks.take(make_hash(50), 200, pow_hash));
+}
@@ -37,6 +37,7 @@
 #include "ringct/rctTypes.h"
 #include "ringct/rctSigs.h"
 #include "ringct/rctOps.h"
+#include "ringct/bulletproofs.h"
 #include "device/device.hpp"
 
 using namespace std;
@@ -1061,3 +1062,40 @@ TEST(ringct, key_ostream)
     out.str()
   );
 }
+
+static rct::rctSig make_sample_bulletproof_semantics(const rct::key &amount)
+{
+  rct::rctSig rv;
+  rv.type = rct::RCTTypeBulletproof;
+  rv.txnFee = 0;
+  rv.p.bulletproofs.push_back(rct::bulletproof_PROVE(amount, rct::skGen()));
+  rv.outPk.resize(1);
+  rv.outPk[0].mask = rct::scalarmult8(rv.p.bulletproofs[0].V[0]);
+  rv.ecdhInfo.resize(1);
+  rv.p.pseudoOuts.push_back(rv.outPk[0].mask);
+  return rv;
+}
+
+TEST(ringct, batch_semantics_finds_bad_proofs)
+{
+  rct::key invalid_amount = rct::zero();
+  invalid_amount[8] = 1;
+
+  std::vector<rct::rctSig> sigs;
+  for (size_t n = 0; n < 10; ++n)
+    sigs.push_back(make_sample_bulletproof_semantics(n == 3 || n == 7 ? invalid_amount : rct::d2h(n * 1000)));
+  std::vector<const rct::rctSig*> rvv;
+  for (const auto &s: sigs)
+    rvv.push_back(&s);
+
+  std::vector<bool> valid;
+  ASSERT_FALSE(rct::verRctSemanticsSimpleBatch(rvv, valid, 2));
+  ASSERT_EQ(valid.size(), sigs.size());
+  for (size_t n = 0; n < valid.size(); ++n)
+    ASSERT_EQ(valid[n], n != 3 && n != 7);
+
+  rvv.erase(rvv.begin() + 7);
+  rvv.erase(rvv.begin() + 3);
+  ASSERT_TRUE(rct::verRctSemanticsSimpleBatch(rvv, valid, 2));
+  ASSERT_EQ((size_t)std::count(valid.begin(), valid.end(), true), rvv.size());
+}
@@ -28,9 +28,12 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <algorithm>
+
 #include "gtest/gtest.h"
 
 #include "include_base_utils.h"
+#include "string_tools.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "storages/portable_storage_template_helper.h"
 
@@ -53,3 +56,440 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+namespace
+{
+  struct pack_test_inner
+  {
+    uint32_t a;
+    std::vector<std::string> strings;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(a)
+      KV_SERIALIZE(strings)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct pack_test_small
+  {
+    uint32_t value;
+    std::string s;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(value)
+      KV_SERIALIZE(s)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct pack_test_wide
+  {
+    uint64_t value;
+    uint64_t missing;
+    pack_test_inner inner;
+    std::list<pack_test_inner> inners;
+    std::vector<uint16_t> values;
+    crypto::hash h;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(value)
+      KV_SERIALIZE_OPT(missing, (uint64_t)7)
+      KV_SERIALIZE(inner)
+      KV_SERIALIZE(inners)
+      KV_SERIALIZE(values)
+      KV_SERIALIZE_VAL_POD_AS_BLOB_OPT(h, crypto::null_hash)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct pack_test_narrow
+  {
+    uint32_t value;
+    pack_test_inner inner;
+    std::vector<pack_test_inner> inners;
+    std::vector<uint64_t> values;
+    crypto::hash h;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(value)
+      KV_SERIALIZE(inner)
+      KV_SERIALIZE(inners)
+      KV_SERIALIZE(values)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(h)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  template<class t_struct>
+  bool load_with_section_tree(t_struct& out, const std::string& buff)
+  {
+    epee::serialization::portable_storage ps;
+    return ps.load_from_binary(buff) && out.load(ps);
+  }
+}
+
+TEST(protocol_pack, bin_reader_matches_section_tree)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+  r.current_blockchain_height = 1234567;
+  r.txs.push_back(std::string(300, 'x'));
+  for (size_t i = 0; i < 20; ++i)
+  {
+    cryptonote::block_complete_entry b;
+    b.block = std::string(100 + i, 'a' + i);
+    b.txs.resize(i % 4, std::string(50 + i, 'z' - i));
+    r.blocks.push_back(b);
+  }
+  r.missed_ids.resize(3);
+  for (size_t i = 0; i < r.missed_ids.size(); ++i)
+    r.missed_ids[i].data[i] = i + 1;
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, buff));
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request tree, stream;
+  ASSERT_TRUE(load_with_section_tree(tree, buff));
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(stream, buff));
+  for (const auto* loaded: {&tree, &stream})
+  {
+    ASSERT_EQ(r.current_blockchain_height, loaded->current_blockchain_height);
+    ASSERT_EQ(r.txs, loaded->txs);
+    ASSERT_EQ(r.missed_ids, loaded->missed_ids);
+    ASSERT_EQ(r.blocks.size(), loaded->blocks.size());
+    for (size_t i = 0; i < r.blocks.size(); ++i)
+    {
+      ASSERT_EQ(r.blocks[i].block, loaded->blocks[i].block);
+      ASSERT_EQ(r.blocks[i].txs, loaded->blocks[i].txs);
+    }
+  }
+}
+
+TEST(protocol_pack, bin_reader_converts_like_section_tree)
+{
+  pack_test_narrow n;
+  n.value = 42;
+  n.inner.a = 3;
+  n.inner.strings = {"one", "two"};
+  n.inners.resize(2);
+  n.inners[1].a = 9;
+  n.inners[1].strings = {"three"};
+  n.values = {1, 2, 65535};
+  n.h = crypto::null_hash;
+  n.h.data[31] = 1;
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(n, buff));
+
+  pack_test_wide tree, stream;
+  ASSERT_TRUE(load_with_section_tree(tree, buff));
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(stream, buff));
+  for (const auto* loaded: {&tree, &stream})
+  {
+    ASSERT_EQ(42u, loaded->value);
+    ASSERT_EQ(7u, loaded->missing);
+    ASSERT_EQ(3u, loaded->inner.a);
+    ASSERT_EQ(n.inner.strings, loaded->inner.strings);
+    ASSERT_EQ(2u, loaded->inners.size());
+    ASSERT_EQ(9u, loaded->inners.back().a);
+    ASSERT_EQ(n.inners[1].strings, loaded->inners.back().strings);
+    ASSERT_EQ(std::vector<uint16_t>({1, 2, 65535}), loaded->values);
+    ASSERT_EQ(n.h, loaded->h);
+  }
+
+  // values out of range for the target fail both
+  n.values.push_back(65536);
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(n, buff));
+  ASSERT_FALSE(load_with_section_tree(tree, buff));
+  ASSERT_FALSE(epee::serialization::load_t_from_binary(stream, buff));
+}
+
+TEST(protocol_pack, bin_reader_rejects_what_section_tree_rejects)
+{
+  pack_test_small s;
+  s.value = 5;
+  s.s = "some string";
+  std::string buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(s, buff));
+
+  for (size_t size = 0; size <= buff.size(); ++size)
+  {
+    const std::string truncated = buff.substr(0, size);
+    pack_test_small tree, stream;
+    const bool tree_ok = load_with_section_tree(tree, truncated);
+    ASSERT_EQ(tree_ok, epee::serialization::load_t_from_binary(stream, truncated)) << "size " << size;
+    ASSERT_EQ(size == buff.size(), tree_ok);
+  }
+}
+
+namespace
+{
+  std::string raw_varint(size_t v)
+  {
+    return std::string(1, char(v << 2));
+  }
+
+  std::string raw_entry(uint8_t type, const std::string& value)
+  {
+    return std::string(1, char(1)) + "a" + std::string(1, char(type)) + value;
+  }
+
+  std::string raw_section(const std::string& entry)
+  {
+    return raw_varint(entry.empty() ? 0 : 1) + entry;
+  }
+
+  // nests a section holding leaf depth times, alternating how each level is nested
+  std::string raw_nested(size_t depth, size_t nesting, const std::string& leaf)
+  {
+    std::string section = raw_section(leaf);
+    for (size_t i = 0; i < depth; ++i)
+    {
+      switch ((nesting + i) % 3)
+      {
+        case 0: section = raw_section(raw_entry(SERIALIZE_TYPE_OBJECT, section)); break;
+        case 1: section = raw_section(raw_entry(SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY, raw_varint(1) + section)); break;
+        default: section = raw_section(raw_entry(SERIALIZE_TYPE_ARRAY, std::string(1, char(SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY)) + raw_varint(1) + section)); break;
+      }
+    }
+    std::string blob(9, 0);
+    const uint32_t signature_a = SWAP32LE(PORTABLE_STORAGE_SIGNATUREA), signature_b = SWAP32LE(PORTABLE_STORAGE_SIGNATUREB);
+    memcpy(&blob[0], &signature_a, 4);
+    memcpy(&blob[4], &signature_b, 4);
+    blob[8] = PORTABLE_STORAGE_FORMAT_VER;
+    return blob + section;
+  }
+}
+
+TEST(protocol_pack, bin_reader_enforces_the_section_tree_nesting_limit)
+{
+  const std::string string_array = raw_varint(1) + raw_varint(1) + "x";
+  const std::string leaves[] = {
+    "",
+    raw_entry(SERIALIZE_TYPE_UINT8, std::string(1, char(1))),
+    raw_entry(SERIALIZE_TYPE_STRING, raw_varint(1) + "x"),
+    raw_entry(SERIALIZE_TYPE_UINT8 | SERIALIZE_FLAG_ARRAY, raw_varint(1) + "x"),
+    raw_entry(SERIALIZE_TYPE_STRING | SERIALIZE_FLAG_ARRAY, string_array),
+    raw_entry(SERIALIZE_TYPE_STRING | SERIALIZE_FLAG_ARRAY, raw_varint(0)),
+    raw_entry(SERIALIZE_TYPE_ARRAY, std::string(1, char(SERIALIZE_TYPE_STRING | SERIALIZE_FLAG_ARRAY)) + string_array),
+    raw_entry(SERIALIZE_TYPE_ARRAY, std::string(1, char(SERIALIZE_TYPE_UINT8 | SERIALIZE_FLAG_ARRAY)) + raw_varint(1) + "x")
+  };
+
+  size_t rejected = 0;
+  for (const std::string& leaf: leaves)
+  {
+    for (size_t nesting = 0; nesting < 3; ++nesting)
+    {
+      for (size_t depth = 0; depth < 40; ++depth)
+      {
+        const std::string blob = raw_nested(depth, nesting, leaf);
+        epee::serialization::portable_storage tree;
+        epee::serialization::portable_storage_bin_reader stream;
+        const bool tree_ok = tree.load_from_binary(blob);
+        ASSERT_EQ(tree_ok, stream.load_from_binary(blob)) << "depth " << depth << ", nesting " << nesting << ", leaf " << epee::string_tools::buff_to_hex_nodelimer(leaf);
+        rejected += !tree_ok;
+      }
+    }
+  }
+  ASSERT_NE(0u, rejected);
+}
+
+namespace
+{
+  struct pack_test_empty
+  {
+    BEGIN_KV_SERIALIZE_MAP()
+    END_KV_SERIALIZE_MAP()
+  };
+
+  // fields in name order, so the section tree dumps them in the same order
+  struct pack_test_sorted
+  {
+    std::string a_text;
+    double b_double;
+    bool c_flag;
+    int8_t d_small;
+    pack_test_empty e_empty;
+    pack_test_inner f_inner;
+    std::vector<pack_test_inner> g_inners;
+    epee::serialization::storage_entry h_id;
+    std::vector<uint64_t> i_values;
+    crypto::hash j_hash;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(a_text)
+      KV_SERIALIZE(b_double)
+      KV_SERIALIZE(c_flag)
+      KV_SERIALIZE(d_small)
+      KV_SERIALIZE(e_empty)
+      KV_SERIALIZE(f_inner)
+      KV_SERIALIZE(g_inners)
+      KV_SERIALIZE(h_id)
+      KV_SERIALIZE(i_values)
+      KV_SERIALIZE_VAL_POD_AS_BLOB(j_hash)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  pack_test_sorted make_sorted()
+  {
+    pack_test_sorted s;
+    s.a_text = "quote \" backslash \\ newline \n tab \t";
+    s.b_double = 0.1234567;
+    s.c_flag = true;
+    s.d_small = -5;
+    s.f_inner.a = 7;
+    s.f_inner.strings = {"x", "y"};
+    s.g_inners.resize(3);
+    for (size_t i = 0; i < s.g_inners.size(); ++i)
+    {
+      s.g_inners[i].a = i;
+      s.g_inners[i].strings.resize(i, std::string(i, 'a' + i));
+    }
+    s.h_id = epee::serialization::storage_entry(uint64_t(42));
+    s.i_values = {1, 2, 3, std::numeric_limits<uint64_t>::max()};
+    for (size_t i = 0; i < sizeof(s.j_hash.data); ++i)
+      s.j_hash.data[i] = i;
+    return s;
+  }
+
+  void append(std::string& out, const epee::shared_buffer& chunk)
+  {
+    out.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+  }
+
+  template<class t_struct>
+  std::string store_streamed(t_struct& s, bool json, size_t min_chunk_size, size_t* chunks = nullptr, size_t indent = 0, bool insert_newlines = true)
+  {
+    std::string out;
+    size_t n = 0;
+    epee::serialization::chunked_output output([&](epee::shared_buffer&& chunk) { append(out, chunk); ++n; return true; }, min_chunk_size);
+    const bool r = json ? epee::serialization::store_t_to_json(s, output, indent, insert_newlines) : epee::serialization::store_t_to_binary(s, output);
+    if (chunks)
+      *chunks = n;
+    return r ? out : std::string();
+  }
+}
+
+TEST(protocol_pack, bin_writer_loads_like_section_tree)
+{
+  pack_test_sorted s = make_sorted();
+  std::string tree_buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(s, tree_buff));
+  for (size_t min_chunk_size: {1, 3, 7, 64 * 1024})
+  {
+    size_t chunks = 0;
+    const std::string buff = store_streamed(s, false, min_chunk_size, &chunks);
+    ASSERT_GE(chunks, 1u);
+    // counts are packed like the section tree packs them, so the fields in name order give the same bytes
+    ASSERT_EQ(tree_buff, buff);
+  }
+
+  pack_test_wide w{};
+  w.value = 5;
+  w.inners.resize(2);
+  w.values = {9, 8};
+  pack_test_narrow n;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(n, store_streamed(w, false, 16)));
+  ASSERT_EQ(5u, n.value);
+  ASSERT_EQ(2u, n.inners.size());
+  ASSERT_EQ((std::vector<uint64_t>{9, 8}), n.values);
+}
+
+TEST(protocol_pack, bin_writer_hands_on_output_as_it_is_written)
+{
+  pack_test_sorted s = make_sorted();
+  std::string out;
+  epee::serialization::chunked_output output([&](epee::shared_buffer&& chunk) { append(out, chunk); return true; }, 16);
+  epee::serialization::portable_storage_bin_writer writer(output, epee::serialization::count_entries(s));
+  ASSERT_TRUE(s.store(writer));
+  const size_t before_finish = out.size();
+  ASSERT_TRUE(writer.finish());
+  ASSERT_LT(out.size() - before_finish, 16u);
+  std::string tree_buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(s, tree_buff));
+  ASSERT_EQ(tree_buff, out);
+
+  // the entry count is checked against what is stored
+  out.clear();
+  epee::serialization::chunked_output short_output([&](epee::shared_buffer&& chunk) { append(out, chunk); return true; }, 16);
+  epee::serialization::portable_storage_bin_writer short_writer(short_output, epee::serialization::count_entries(s) - 1);
+  ASSERT_THROW(s.store(short_writer), std::exception);
+}
+
+TEST(protocol_pack, json_writer_dumps_like_section_tree)
+{
+  pack_test_sorted s = make_sorted();
+  for (size_t indent: {0, 2})
+  {
+    for (bool insert_newlines: {true, false})
+    {
+      std::string tree_json;
+      ASSERT_TRUE(epee::serialization::store_t_to_json(s, tree_json, indent, insert_newlines));
+      size_t chunks = 0;
+      ASSERT_EQ(tree_json, store_streamed(s, true, 5, &chunks, indent, insert_newlines));
+      ASSERT_GT(chunks, 1u);
+    }
+  }
+
+  // other field orders load back the same
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request r;
+  r.current_blockchain_height = 10;
+  r.blocks.resize(2);
+  r.blocks[1].block = "block";
+  r.blocks[1].txs = {"tx1", "tx2"};
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request loaded;
+  ASSERT_TRUE(epee::serialization::load_t_from_json(loaded, store_streamed(r, true, 64)));
+  ASSERT_EQ(epee::serialization::store_t_to_json(r), epee::serialization::store_t_to_json(loaded));
+}
+
+TEST(protocol_pack, writers_stop_when_the_sink_refuses)
+{
+  pack_test_sorted s = make_sorted();
+  for (bool json: {true, false})
+  {
+    size_t calls = 0;
+    epee::serialization::chunked_output output([&](epee::shared_buffer&& chunk) { ++calls; return false; }, 4);
+    const bool r = json ? epee::serialization::store_t_to_json(s, output) : epee::serialization::store_t_to_binary(s, output);
+    ASSERT_FALSE(r);
+    ASSERT_EQ(1u, calls);
+  }
+}
+
+TEST(protocol_pack, bin_writer_hands_on_shared_blobs)
+{
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::shared_request r;
+  r.current_blockchain_height = 77;
+  r.txs.emplace_back(std::string(CHUNKED_OUTPUT_MIN_SHARED_SIZE, 't'));
+  r.blocks.resize(2);
+  r.blocks[0].block = epee::shared_buffer(std::string(2 * CHUNKED_OUTPUT_MIN_SHARED_SIZE, 'b'));
+  r.blocks[0].txs.emplace_back(std::string(10, 's'));
+  r.blocks[0].txs.emplace_back(std::string(3 * CHUNKED_OUTPUT_MIN_SHARED_SIZE, 'l'));
+  r.blocks[1].block = epee::shared_buffer(std::string(20, 'c'));
+
+  std::string out;
+  std::vector<const uint8_t*> pieces;
+  epee::serialization::chunked_output output([&](epee::shared_buffer&& chunk) { append(out, chunk); pieces.push_back(chunk.data()); return true; });
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, output));
+
+  // the big blobs are handed on as they are, the small ones are copied
+  for (const epee::shared_buffer* blob: {&r.txs[0], &r.blocks[0].block, &r.blocks[0].txs[1]})
+    ASSERT_NE(pieces.end(), std::find(pieces.begin(), pieces.end(), blob->data()));
+  for (const epee::shared_buffer* blob: {&r.blocks[0].txs[0], &r.blocks[1].block})
+    ASSERT_EQ(pieces.end(), std::find(pieces.begin(), pieces.end(), blob->data()));
+
+  // and it reads back as the usual request, as it does through the section tree
+  std::string tree_buff;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary(r, tree_buff));
+  for (const std::string* buff: {&out, &tree_buff})
+  {
+    cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request loaded;
+    ASSERT_TRUE(epee::serialization::load_t_from_binary(loaded, *buff));
+    ASSERT_EQ(77u, loaded.current_blockchain_height);
+    ASSERT_EQ(std::vector<cryptonote::blobdata>{std::string(CHUNKED_OUTPUT_MIN_SHARED_SIZE, 't')}, loaded.txs);
+    ASSERT_EQ(2u, loaded.blocks.size());
+    ASSERT_EQ(std::string(2 * CHUNKED_OUTPUT_MIN_SHARED_SIZE, 'b'), loaded.blocks[0].block);
+    ASSERT_EQ((std::vector<cryptonote::blobdata>{std::string(10, 's'), std::string(3 * CHUNKED_OUTPUT_MIN_SHARED_SIZE, 'l')}), loaded.blocks[0].txs);
+    ASSERT_EQ(std::string(20, 'c'), loaded.blocks[1].block);
+    ASSERT_TRUE(loaded.blocks[1].txs.empty());
+  }
+
+  cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::shared_request shared;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(shared, out));
+  ASSERT_EQ(2u, shared.blocks.size());
+  ASSERT_EQ(2u, shared.blocks[0].txs.size());
+  ASSERT_EQ(std::string(3 * CHUNKED_OUTPUT_MIN_SHARED_SIZE, 'l'), std::string(reinterpret_cast<const char*>(shared.blocks[0].txs[1].data()), shared.blocks[0].txs[1].size()));
+}
@@ -0,0 +1,325 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <map>
+#include <unordered_set>
+#include <boost/uuid/nil_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>
+
+#include "gtest/gtest.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.inl"
+
+#define MAKE_IPV4_ADDRESS(a,b,c,d) epee::net_utils::ipv4_network_address{MAKE_IP(a,b,c,d),0}
+
+namespace
+{
+  class test_core
+  {
+  public:
+    std::unordered_set<crypto::hash> pool;
+
+    void on_synchronized() {}
+    void safesyncmode(const bool) {}
+    uint64_t get_current_blockchain_height() const { return 1; }
+    void set_target_blockchain_height(uint64_t) {}
+    uint64_t get_target_blockchain_height() const { return 1; }
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool get_stat_info(cryptonote::core_stat_info& st_inf) const { return true; }
+    bool have_block(const crypto::hash& id) const { return true; }
+    void get_blockchain_top(uint64_t& height, crypto::hash& top_id) const { height = 0; top_id = crypto::null_hash; }
+    uint32_t get_blockchain_pruning_seed() const { return 0; }
+    bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_txs(const std::vector<cryptonote::blobdata>& tx_blobs, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { return true; }
+    void pause_mine() {}
+    void resume_mine() {}
+    bool on_idle() { return true; }
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp) const { return true; }
+    bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::shared_request& rsp, cryptonote::cryptonote_connection_context& context) { return true; }
+    bool get_test_drop_download() const { return true; }
+    bool get_test_drop_download_height() const { return true; }
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry> &blocks) { return true; }
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    bool prehash_incoming_blocks(uint64_t height, const std::vector<cryptonote::blobdata> &block_blobs) { return true; }
+    size_t get_block_sync_size(uint64_t height) const { return config::sync::NORMAL_SYNC; }
+    void on_transaction_relayed(const cryptonote::blobdata& tx) {}
+    bool pad_transactions() const { return false; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return false; }
+    bool get_relayable_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return false; }
+    bool get_pool_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const { return true; }
+    bool pool_has_tx(const crypto::hash &txid) const { return pool.count(txid) != 0; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::blobdata>& txs, std::vector<crypto::hash>& missed_txs) const { return false; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::transaction>& txs, std::vector<crypto::hash>& missed_txs) const { return false; }
+    bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk, bool *orphan = NULL) const { return false; }
+    uint8_t get_ideal_hard_fork_version() const { return 0; }
+    uint8_t get_ideal_hard_fork_version(uint64_t height) const { return 0; }
+    cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
+    bool fluffy_blocks_enabled() const { return false; }
+    uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes) { return 0; }
+    void stop() {}
+  };
+
+  // records the tx requests sent and the txes relayed, per connection
+  class test_p2p: public nodetool::p2p_endpoint_stub<cryptonote::cryptonote_connection_context>
+  {
+  public:
+    std::map<boost::uuids::uuid, cryptonote::cryptonote_connection_context> connections;
+    std::map<boost::uuids::uuid, std::vector<crypto::hash>> requested;
+    std::map<boost::uuids::uuid, std::vector<crypto::hash>> announced;
+    std::map<boost::uuids::uuid, std::vector<cryptonote::blobdata>> pushed;
+
+    virtual bool relay_notify_to_list(int command, const epee::shared_buffer& data_buff, std::vector<std::pair<epee::net_utils::zone, boost::uuids::uuid>> connections, epee::net_utils::send_priority priority)
+    {
+      const epee::span<const uint8_t> buff{data_buff.data(), data_buff.size()};
+      cryptonote::NOTIFY_NEW_TRANSACTION_HASHES::request announce;
+      cryptonote::NOTIFY_NEW_TRANSACTIONS::request push;
+      if (command == cryptonote::NOTIFY_NEW_TRANSACTION_HASHES::ID && !epee::serialization::load_t_from_binary(announce, buff))
+        return false;
+      if (command == cryptonote::NOTIFY_NEW_TRANSACTIONS::ID && !epee::serialization::load_t_from_binary(push, buff))
+        return false;
+      for (const auto &c: connections)
+      {
+        announced[c.second].insert(announced[c.second].end(), announce.tx_hashes.begin(), announce.tx_hashes.end());
+        pushed[c.second].insert(pushed[c.second].end(), push.txs.begin(), push.txs.end());
+      }
+      return true;
+    }
+    virtual void for_each_connection(std::function<bool(cryptonote::cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f)
+    {
+      for (auto &e: connections)
+        if (!f(e.second, 1, P2P_SUPPORT_FLAG_TX_ANNOUNCEMENTS))
+          break;
+    }
+
+    virtual bool invoke_notify_to_peer(int command, const epee::span<const uint8_t> req_buff, const epee::net_utils::connection_context_base& context, epee::net_utils::send_priority priority)
+    {
+      if (command != cryptonote::NOTIFY_REQUEST_TRANSACTIONS::ID)
+        return true;
+      cryptonote::NOTIFY_REQUEST_TRANSACTIONS::request req;
+      if (!epee::serialization::load_t_from_binary(req, req_buff))
+        return false;
+      std::vector<crypto::hash> &hashes = requested[context.m_connection_id];
+      hashes.insert(hashes.end(), req.tx_hashes.begin(), req.tx_hashes.end());
+      return true;
+    }
+    virtual bool for_connection(const boost::uuids::uuid &id, std::function<bool(cryptonote::cryptonote_connection_context&, nodetool::peerid_type, uint32_t)> f)
+    {
+      const auto it = connections.find(id);
+      if (it == connections.end())
+        return false;
+      return f(it->second, 0, 0);
+    }
+  };
+
+  class tx_announcements: public ::testing::Test
+  {
+  protected:
+    tx_announcements(): protocol(core, &p2p, true) {}
+
+    cryptonote::cryptonote_connection_context &add_peer(uint8_t n, bool incoming = false)
+    {
+      boost::uuids::uuid id = boost::uuids::nil_uuid();
+      id.data[0] = n;
+      cryptonote::cryptonote_connection_context &context = p2p.connections[id];
+      static_cast<epee::net_utils::connection_context_base&>(context) = epee::net_utils::connection_context_base(id, MAKE_IPV4_ADDRESS(1,2,3,n), incoming, false);
+      context.m_state = cryptonote::cryptonote_connection_context::state_normal;
+      return context;
+    }
+
+    void announce(cryptonote::cryptonote_connection_context &context, const std::vector<crypto::hash> &tx_hashes)
+    {
+      cryptonote::NOTIFY_NEW_TRANSACTION_HASHES::request req;
+      req.tx_hashes = tx_hashes;
+      std::string blob, out;
+      ASSERT_TRUE(epee::serialization::store_t_to_binary(req, blob));
+      bool handled = false;
+      protocol.handle_invoke_map(true, cryptonote::NOTIFY_NEW_TRANSACTION_HASHES::ID, epee::strspan<uint8_t>(blob), out, context, handled);
+      ASSERT_TRUE(handled);
+    }
+
+    std::vector<crypto::hash> requested_from(const cryptonote::cryptonote_connection_context &context)
+    {
+      return p2p.requested[context.m_connection_id];
+    }
+
+    static crypto::hash tx(uint8_t n)
+    {
+      crypto::hash h = crypto::null_hash;
+      h.data[0] = n;
+      return h;
+    }
+
+    test_core core;
+    test_p2p p2p;
+    cryptonote::t_cryptonote_protocol_handler<test_core> protocol;
+  };
+}
+
+TEST_F(tx_announcements, requests_once)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1);
+  core.pool.insert(tx(2));
+  announce(a, {tx(1), tx(2)});
+  // the tx in the pool is not asked for
+  ASSERT_EQ(requested_from(a), std::vector<crypto::hash>{tx(1)});
+
+  // nor asked for again from the same peer before the timeout
+  announce(a, {tx(1)});
+  ASSERT_EQ(requested_from(a), std::vector<crypto::hash>{tx(1)});
+}
+
+TEST_F(tx_announcements, ignores_duplicates)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1);
+  cryptonote::cryptonote_connection_context &b = add_peer(2);
+  announce(a, {tx(1)});
+  announce(b, {tx(1)});
+  announce(b, {tx(1)});
+  ASSERT_EQ(requested_from(a), std::vector<crypto::hash>{tx(1)});
+  ASSERT_TRUE(requested_from(b).empty());
+
+  // the first peer sent it in time
+  core.pool.insert(tx(1));
+  protocol.retry_requested_txes(time(NULL) + TX_REQUEST_TIMEOUT);
+  ASSERT_TRUE(requested_from(b).empty());
+}
+
+TEST_F(tx_announcements, falls_back_on_timeout)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1);
+  cryptonote::cryptonote_connection_context &b = add_peer(2);
+  cryptonote::cryptonote_connection_context &c = add_peer(3);
+  announce(a, {tx(1)});
+  announce(b, {tx(1)});
+  announce(c, {tx(1)});
+  const time_t now = time(NULL);
+
+  // not yet
+  protocol.retry_requested_txes(now + TX_REQUEST_TIMEOUT - 2);
+  ASSERT_TRUE(requested_from(b).empty());
+
+  // a did not send it, the next announcer is asked, then the one after
+  protocol.retry_requested_txes(now + TX_REQUEST_TIMEOUT);
+  ASSERT_EQ(requested_from(b), std::vector<crypto::hash>{tx(1)});
+  ASSERT_TRUE(requested_from(c).empty());
+  protocol.retry_requested_txes(now + 2 * TX_REQUEST_TIMEOUT);
+  ASSERT_EQ(requested_from(c), std::vector<crypto::hash>{tx(1)});
+
+  // with nobody left, it is forgotten, and the next announcement asks for it again
+  protocol.retry_requested_txes(now + 3 * TX_REQUEST_TIMEOUT);
+  ASSERT_EQ(requested_from(a), std::vector<crypto::hash>{tx(1)});
+  announce(b, {tx(1)});
+  ASSERT_EQ(requested_from(b), std::vector<crypto::hash>({tx(1), tx(1)}));
+}
+
+TEST_F(tx_announcements, caps_announcers)
+{
+  std::vector<cryptonote::cryptonote_connection_context*> peers;
+  for (uint8_t n = 1; n <= MAX_TX_ANNOUNCERS + 3; ++n)
+  {
+    peers.push_back(&add_peer(n));
+    announce(*peers.back(), {tx(1)});
+  }
+  time_t now = time(NULL);
+  for (size_t i = 1; i <= MAX_TX_ANNOUNCERS + 2; ++i)
+    protocol.retry_requested_txes(now + i * TX_REQUEST_TIMEOUT);
+  size_t asked = 0;
+  for (const auto *peer: peers)
+    asked += requested_from(*peer).size();
+  ASSERT_EQ(asked, 1u + MAX_TX_ANNOUNCERS);
+}
+
+TEST_F(tx_announcements, prefers_outbound_announcers)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1, true);
+  cryptonote::cryptonote_connection_context &b = add_peer(2, true);
+  cryptonote::cryptonote_connection_context &c = add_peer(3);
+  announce(a, {tx(1)});
+  announce(b, {tx(1)});
+  announce(c, {tx(1)});
+  const time_t now = time(NULL);
+
+  // c announced it last, but we connected to it, so it is asked first
+  protocol.retry_requested_txes(now + TX_REQUEST_TIMEOUT);
+  ASSERT_EQ(requested_from(c), std::vector<crypto::hash>{tx(1)});
+  ASSERT_TRUE(requested_from(b).empty());
+  protocol.retry_requested_txes(now + 2 * TX_REQUEST_TIMEOUT);
+  ASSERT_EQ(requested_from(b), std::vector<crypto::hash>{tx(1)});
+}
+
+TEST_F(tx_announcements, outbound_announcer_replaces_inbound)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1, true);
+  announce(a, {tx(1)});
+  std::vector<cryptonote::cryptonote_connection_context*> inbound;
+  for (uint8_t n = 2; n < 2 + MAX_TX_ANNOUNCERS; ++n)
+  {
+    inbound.push_back(&add_peer(n, true));
+    announce(*inbound.back(), {tx(1)});
+  }
+  // the list is full of inbound peers, the outbound one still gets in
+  cryptonote::cryptonote_connection_context &b = add_peer(2 + MAX_TX_ANNOUNCERS);
+  announce(b, {tx(1)});
+
+  const time_t now = time(NULL);
+  protocol.retry_requested_txes(now + TX_REQUEST_TIMEOUT);
+  ASSERT_EQ(requested_from(b), std::vector<crypto::hash>{tx(1)});
+  for (size_t i = 2; i <= MAX_TX_ANNOUNCERS + 1; ++i)
+    protocol.retry_requested_txes(now + i * TX_REQUEST_TIMEOUT);
+  size_t asked = 0;
+  for (const auto *peer: inbound)
+    asked += requested_from(*peer).size();
+  ASSERT_EQ(asked, MAX_TX_ANNOUNCERS - 1);
+  ASSERT_TRUE(requested_from(*inbound.back()).empty());
+}
+
+TEST_F(tx_announcements, pushes_missed_txes_in_full)
+{
+  cryptonote::cryptonote_connection_context &a = add_peer(1);
+  cryptonote::cryptonote_connection_context &b = add_peer(2);
+  announce(a, {tx(1)});
+  protocol.retry_requested_txes(time(NULL) + TX_REQUEST_TIMEOUT);
+
+  // a did not send tx(1), so b gets it in full rather than only its hash
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request txes;
+  txes.txs = {"tx1", "tx2"};
+  cryptonote::i_cryptonote_protocol &relay = protocol;
+  ASSERT_TRUE(relay.relay_transactions(txes, {tx(1), tx(2)}, a));
+  ASSERT_EQ(p2p.pushed[b.m_connection_id], std::vector<cryptonote::blobdata>{"tx1"});
+  ASSERT_EQ(p2p.announced[b.m_connection_id], std::vector<crypto::hash>{tx(2)});
+  ASSERT_TRUE(p2p.pushed[a.m_connection_id].empty());
+  ASSERT_TRUE(p2p.announced[a.m_connection_id].empty());
+
+  // only once
+  ASSERT_TRUE(relay.relay_transactions(txes, {tx(1), tx(2)}, a));
+  ASSERT_EQ(p2p.pushed[b.m_connection_id], std::vector<cryptonote::blobdata>{"tx1"});
+  ASSERT_EQ(p2p.announced[b.m_connection_id], std::vector<crypto::hash>({tx(2), tx(1), tx(2)}));
+}
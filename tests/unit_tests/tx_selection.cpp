@@ -0,0 +1,155 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include <random>
+
+#include "gtest/gtest.h"
+
+#include "cryptonote_basic/cryptonote_basic_impl.h"
+#include "cryptonote_core/tx_pool.h"
+#include "cryptonote_core/tx_selection.h"
+
+namespace
+{
+  // a flat reward up to 50, then losing 20 per unit of weight
+  bool penalized_reward(uint64_t total_weight, uint64_t &reward)
+  {
+    if (total_weight > 100)
+      return false;
+    reward = total_weight <= 50 ? 1000 : 1000 - (total_weight - 50) * 20;
+    return true;
+  }
+
+  bool flat_reward(uint64_t total_weight, uint64_t &reward)
+  {
+    reward = 1000;
+    return true;
+  }
+
+  uint64_t value(const std::vector<cryptonote::tx_selection_item> &items, uint64_t &total_weight)
+  {
+    uint64_t fee = 0, reward;
+    total_weight = 0;
+    for (const auto &item: items)
+    {
+      if (item.selected)
+      {
+        total_weight += item.weight;
+        fee += item.fee;
+      }
+    }
+    if (!penalized_reward(total_weight, reward))
+      return 0;
+    return reward + fee;
+  }
+}
+
+TEST(tx_selection, swaps_for_better_packing)
+{
+  // greedy took the densest one, the other two together pay more
+  std::vector<cryptonote::tx_selection_item> items{{52, 520, true}, {50, 490, false}, {49, 465, false}};
+  ASSERT_GT(cryptonote::improve_tx_selection(items, 100, flat_reward, 1000, 8), 0u);
+  ASSERT_FALSE(items[0].selected);
+  ASSERT_TRUE(items[1].selected);
+  ASSERT_TRUE(items[2].selected);
+}
+
+TEST(tx_selection, drops_transactions_not_paying_the_penalty)
+{
+  std::vector<cryptonote::tx_selection_item> items{{50, 500, true}, {10, 90, true}};
+  ASSERT_EQ(cryptonote::improve_tx_selection(items, 100, penalized_reward, 1000, 8), 1u);
+  ASSERT_TRUE(items[0].selected);
+  ASSERT_FALSE(items[1].selected);
+
+  // already optimal
+  ASSERT_EQ(cryptonote::improve_tx_selection(items, 100, penalized_reward, 1000, 8), 0u);
+}
+
+TEST(tx_selection, bounded)
+{
+  std::vector<cryptonote::tx_selection_item> items{{52, 520, true}, {50, 490, false}, {49, 465, false}};
+  ASSERT_EQ(cryptonote::improve_tx_selection(items, 100, flat_reward, 0, 8), 0u);
+  ASSERT_TRUE(items[0].selected);
+  ASSERT_FALSE(items[1].selected);
+  ASSERT_FALSE(items[2].selected);
+}
+
+TEST(tx_selection, never_worse)
+{
+  std::mt19937 rng(42);
+  for (int n = 0; n < 200; ++n)
+  {
+    std::vector<cryptonote::tx_selection_item> items;
+    const size_t count = 1 + rng() % 20;
+    for (size_t i = 0; i < count; ++i)
+      items.push_back({1 + rng() % 30, rng() % 300, rng() % 3 == 0});
+    uint64_t weight;
+    const uint64_t before = value(items, weight);
+    if (weight > 100)
+      continue;
+    cryptonote::improve_tx_selection(items, 100, penalized_reward, 10000, 4);
+    const uint64_t after = value(items, weight);
+    ASSERT_LE(weight, 100u);
+    ASSERT_GE(after, before);
+  }
+}
+
+TEST(tx_selection, block_template_swap_keeps_count)
+{
+  // the block's transaction and a denser one which only fits in its place
+  cryptonote::block bl;
+  crypto::hash in_block = crypto::null_hash, left_out = crypto::null_hash;
+  in_block.data[0] = 1;
+  left_out.data[0] = 2;
+  bl.tx_hashes.push_back(in_block);
+
+  cryptonote::tx_memory_pool::block_template_candidates candidates;
+  candidates.median_weight = 0;
+  candidates.already_generated_coins = 0;
+  candidates.version = 5;
+  candidates.max_total_weight = 150;
+  candidates.items = {{100, 1000, true}, {100, 2000, false}};
+  candidates.txids = {in_block, left_out};
+
+  uint64_t reward;
+  ASSERT_TRUE(cryptonote::get_block_reward(0, 100, 0, reward, 5));
+  size_t total_weight = 100;
+  uint64_t fee = 1000, expected_reward = reward + 1000;
+  ASSERT_TRUE(cryptonote::tx_memory_pool::improve_block_template(bl, candidates, total_weight, fee, expected_reward));
+
+  // same count, so the miner tx must be rebuilt on the fee, not on the count
+  ASSERT_EQ(bl.tx_hashes.size(), 1u);
+  ASSERT_EQ(bl.tx_hashes[0], left_out);
+  ASSERT_EQ(total_weight, 100u);
+  ASSERT_EQ(fee, 2000u);
+  ASSERT_EQ(expected_reward, reward + 2000);
+
+  // nothing left to improve
+  ASSERT_FALSE(cryptonote::tx_memory_pool::improve_block_template(bl, candidates, total_weight, fee, expected_reward));
+}
@@ -0,0 +1,92 @@
+// Copyright (c) 2020, The Evolution Network
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+#include "ringct/rctOps.h"
+#include "cryptonote_core/verified_tx_cache.h"
+
+static crypto::hash random_hash()
+{
+  return crypto::rand<crypto::hash>();
+}
+
+TEST(verified_tx_cache, add_and_find)
+{
+  cryptonote::verified_tx_cache cache;
+  const crypto::hash key = cryptonote::verified_tx_cache::make_key(random_hash(), random_hash(), random_hash());
+  ASSERT_FALSE(cache.has(key));
+  cache.add(key);
+  ASSERT_TRUE(cache.has(key));
+  cache.add(key);
+  ASSERT_EQ(cache.size(), 1u);
+  cache.clear();
+  ASSERT_FALSE(cache.has(key));
+}
+
+TEST(verified_tx_cache, key_depends_on_all_parts)
+{
+  const crypto::hash txid = random_hash(), prunable = random_hash(), ring = random_hash();
+  const crypto::hash key = cryptonote::verified_tx_cache::make_key(txid, prunable, ring);
+  ASSERT_NE(key, cryptonote::verified_tx_cache::make_key(random_hash(), prunable, ring));
+  ASSERT_NE(key, cryptonote::verified_tx_cache::make_key(txid, random_hash(), ring));
+  ASSERT_NE(key, cryptonote::verified_tx_cache::make_key(txid, prunable, random_hash()));
+}
+
+TEST(verified_tx_cache, ring_hash)
+{
+  std::vector<std::vector<rct::ctkey>> pubkeys(2);
+  for (auto &ring: pubkeys)
+    for (size_t n = 0; n < 3; ++n)
+      ring.push_back({rct::pkGen(), rct::pkGen()});
+  const crypto::hash h = cryptonote::verified_tx_cache::get_ring_hash(pubkeys);
+  ASSERT_EQ(h, cryptonote::verified_tx_cache::get_ring_hash(pubkeys));
+
+  // moving a member from one ring to the next must change the hash
+  std::vector<std::vector<rct::ctkey>> shifted = pubkeys;
+  shifted[1].insert(shifted[1].begin(), shifted[0].back());
+  shifted[0].pop_back();
+  ASSERT_NE(h, cryptonote::verified_tx_cache::get_ring_hash(shifted));
+
+  pubkeys[1][2].mask = rct::pkGen();
+  ASSERT_NE(h, cryptonote::verified_tx_cache::get_ring_hash(pubkeys));
+}
+
+TEST(verified_tx_cache, bounded)
+{
+  cryptonote::verified_tx_cache cache(cryptonote::verified_tx_cache::NUM_SHARDS * 4);
+  std::vector<crypto::hash> keys;
+  for (size_t n = 0; n < 1000; ++n)
+  {
+    keys.push_back(random_hash());
+    cache.add(keys.back());
+  }
+  ASSERT_LE(cache.size(), cryptonote::verified_tx_cache::NUM_SHARDS * 4);
+  ASSERT_TRUE(cache.has(keys.back()));
+}